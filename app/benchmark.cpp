@@ -0,0 +1,177 @@
+#include <simulation/fluid_system.h>
+#include <simulation/work_group_tuner.h>
+#include <glutils/gpu_memory.h>
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/// @brief Parameters of the benchmark
+namespace benchmark_params
+{
+    constexpr int contextVersionMajor{ 4 };
+    constexpr int contextVersionMinor{ 6 };
+
+    constexpr int warmupFrames{ 120 };
+    constexpr int defaultFrames{ 600 };
+    constexpr int densitySampleInterval{ 10 };
+    const char* workGroupCache{ "work_groups.txt" };
+}
+
+/// @brief Results of simulating with one set of options
+struct BenchmarkResult
+{
+    double gpuMillisecondsPerFrame{};
+    double meanDensityError{};
+    double maxDensityError{};
+    double meanSubsteps{};
+    double meanSolverIterations{};
+    double meanAwakeParticles{};
+    std::size_t particleMemory{};
+};
+
+/// @brief Simulate a dam break and measure time per frame and density error
+/// @param options the options of the fluid system
+/// @param frames the number of measured frames after warming up
+BenchmarkResult runBenchmark(const FluidSystem::Options& options, int frames)
+{
+    FluidSystem fluid{ options };
+    // every configuration compiles its own variants of the kernels, which are tuned once per GPU
+    WorkGroupTuner{ benchmark_params::workGroupCache }.apply(fluid);
+    BenchmarkResult result{};
+    result.particleMemory = fluid.particleMemory();
+
+    for (int i{ 0 }; i < benchmark_params::warmupFrames; ++i)
+    {
+        fluid.update();
+    }
+
+    GLuint query{};
+    glGenQueries(1, &query);
+    GLuint64 totalNanoseconds{ 0 };
+    int samples{ 0 };
+    for (int i{ 0 }; i < frames; ++i)
+    {
+        glBeginQuery(GL_TIME_ELAPSED, query);
+        fluid.update();
+        glEndQuery(GL_TIME_ELAPSED);
+        GLuint64 nanoseconds{};
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+        totalNanoseconds += nanoseconds;
+        result.meanSubsteps += fluid.substeps();
+        result.meanSolverIterations += fluid.solverIterations();
+        result.meanAwakeParticles += options.sleeping ? fluid.awakeParticles() : fluid.numParticles();
+
+        if (i % benchmark_params::densitySampleInterval == 0)
+        {
+            // only compression counts as error; free surfaces are under-dense by nature
+            std::vector<float> densities{ fluid.densities() };
+            double sum{ 0.0 };
+            for (float density : densities)
+            {
+                double error{ std::max(0.0, density / FluidSystem::restDensity() - 1.0) };
+                sum += error;
+                result.maxDensityError = std::max(result.maxDensityError, error);
+            }
+            result.meanDensityError += sum / densities.size();
+            ++samples;
+        }
+    }
+    glDeleteQueries(1, &query);
+
+    result.gpuMillisecondsPerFrame = totalNanoseconds / 1e6 / frames;
+    result.meanDensityError /= samples;
+    result.meanSubsteps /= frames;
+    result.meanSolverIterations /= frames;
+    result.meanAwakeParticles /= frames;
+    return result;
+}
+
+int main(int argc, char* argv[])
+{
+    int frames{ argc > 1 ? std::atoi(argv[1]) : benchmark_params::defaultFrames };
+    if (frames <= 0)
+    {
+        std::cerr << "Usage: benchmark [frames]\n";
+        return EXIT_FAILURE;
+    }
+
+    if (!glfwInit())
+    {
+        std::cerr << "Failed to initialize GLFW!";
+        return EXIT_FAILURE;
+    }
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, benchmark_params::contextVersionMajor);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, benchmark_params::contextVersionMinor);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    GLFWwindow* window{ glfwCreateWindow(64, 64, "benchmark", nullptr, nullptr) };
+    if (!window)
+    {
+        std::cerr << "Failed to create a window!";
+        glfwTerminate();
+        return EXIT_FAILURE;
+    }
+    glfwMakeContextCurrent(window);
+    if (!gladLoadGL())
+    {
+        std::cerr << "Failed to load OpenGL!\n";
+        glfwTerminate();
+        return EXIT_FAILURE;
+    }
+
+    // storage, solver and ensemble configurations; the accelerated solver trades iterations for error
+    struct Configuration
+    {
+        const char* name{};
+        FluidSystem::Options options{};
+    };
+    std::vector<Configuration> configurations{
+        { "full", {} },
+        { "compact", { .compactStorage = true } },
+        { "accel 2", { .acceleratedSolver = true, .maxSolverIterations = 2 } },
+        { "accel 3", { .acceleratedSolver = true, .maxSolverIterations = 3 } },
+        { "accel 4", { .acceleratedSolver = true, .maxSolverIterations = 4 } },
+        { "sleeping", { .sleeping = true } },
+        // a small scene alone underfills the GPU; an ensemble of them should cost far less per scene
+        { "small", { .numParticles = 16'384 } },
+        { "16 small", { .numParticles = 16'384, .numScenes = 16 } },
+        // large enough that the solver's error sum would overflow 32 bits
+        { "4M", { .numParticles = 4'194'304 } },
+    };
+
+    auto print{ [](const char* name, const BenchmarkResult& result)
+        {
+            std::cout << std::left << std::setw(10) << name
+                << std::right << std::fixed
+                << std::setw(12) << std::setprecision(3) << result.gpuMillisecondsPerFrame
+                << std::setw(14) << std::setprecision(3) << 100.0 * result.meanDensityError
+                << std::setw(14) << std::setprecision(3) << 100.0 * result.maxDensityError
+                << std::setw(10) << std::setprecision(2) << result.meanSubsteps
+                << std::setw(10) << std::setprecision(2) << result.meanSolverIterations
+                << std::setw(10) << std::setprecision(0) << result.meanAwakeParticles
+                << std::setw(12) << std::setprecision(1) << result.particleMemory / double(1 << 20) << '\n';
+        } };
+    std::cout << '\n' << frames << " frames after " << benchmark_params::warmupFrames << " frames of warm-up\n";
+    std::cout << std::left << std::setw(10) << "solver" << std::right
+        << std::setw(12) << "ms/frame" << std::setw(14) << "mean err %" << std::setw(14) << "max err %" << std::setw(10) << "steps" << std::setw(10) << "iters"
+        << std::setw(10) << "solved"
+        << std::setw(12) << "MiB" << '\n';
+    for (const Configuration& configuration : configurations)
+    {
+        print(configuration.name, runBenchmark(configuration.options, frames));
+    }
+    // the peaks are those of the largest configuration
+    std::cout << '\n';
+    GpuMemory::report(std::cout);
+
+    glfwDestroyWindow(window);
+    glfwTerminate();
+    return 0;
+}
@@ -0,0 +1,332 @@
+#include <simulation/fluid_system.h>
+#include <simulation/shared_memory_transport.h>
+#include <misc/shared_memory.h>
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+extern char** environ;
+#endif
+
+/// @brief Parameters of the scaling benchmark
+namespace scaling_params
+{
+    constexpr int contextVersionMajor{ 4 };
+    constexpr int contextVersionMinor{ 6 };
+
+    constexpr int warmupFrames{ 60 };
+    constexpr int defaultFrames{ 300 };
+
+    const int rankCounts[]{ 1, 2, 4, 8 };
+    constexpr int strongParticles{ 65'536 }; // in total, whatever the number of ranks
+    constexpr int weakParticlesPerRank{ 16'384 };
+}
+
+/// @brief What one rank measured, written to shared memory for the launching process
+struct RankResult
+{
+    double millisecondsPerFrame{};
+    double waitMillisecondsPerFrame{};
+    double haloParticlesPerSubstep{};
+    std::int32_t ownedParticles{};
+    std::int32_t done{};
+};
+
+/// @brief What a run with one number of ranks measured
+struct ScalingResult
+{
+    int particles{};
+    double millisecondsPerFrame{};     // of the slowest rank, which the others wait for
+    double waitMillisecondsPerFrame{}; // mean over ranks
+    double haloParticlesPerSubstep{};  // mean over ranks
+    int ownedParticles{};              // summed over ranks; every particle is owned once
+};
+
+/// @brief Create a hidden window whose context the simulation runs in
+GLFWwindow* createContext()
+{
+    if (!glfwInit())
+    {
+        std::cerr << "Failed to initialize GLFW!";
+        return nullptr;
+    }
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, scaling_params::contextVersionMajor);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, scaling_params::contextVersionMinor);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    GLFWwindow* window{ glfwCreateWindow(64, 64, "scaling", nullptr, nullptr) };
+    if (!window)
+    {
+        std::cerr << "Failed to create a window!";
+        glfwTerminate();
+        return nullptr;
+    }
+    glfwMakeContextCurrent(window);
+    if (!gladLoadGL())
+    {
+        std::cerr << "Failed to load OpenGL!\n";
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        return nullptr;
+    }
+    return window;
+}
+
+/// @brief Simulate one slab of a dam break and write the measurements to shared memory
+/// @param name the name of the transport's shared memory; the results are in name_results
+/// @param rank the slab of this process
+/// @param particles the number of particles of the whole grid
+/// @param frames the number of measured frames
+/// @return the exit code
+int runRank(const std::string& name, int rank, int particles, int frames)
+{
+    SharedMemoryTransport transport{ name, rank };
+    SharedMemory results{ name + "_results" };
+    if (!transport.available() || !results.available()
+        || results.size() < transport.numRanks() * sizeof(RankResult))
+    {
+        return EXIT_FAILURE;
+    }
+    GLFWwindow* window{ createContext() };
+    if (!window)
+    {
+        return EXIT_FAILURE;
+    }
+
+    RankResult result{};
+    {
+        // every slab starts from all particles and drops the ones farther than a layer away
+        FluidSystem fluid{ { .numParticles = particles, .rank = rank, .numRanks = transport.numRanks() } };
+        if (transport.numRanks() > 1)
+        {
+            fluid.setHaloExchange(transport.haloExchange());
+        }
+        for (int i{ 0 }; i < scaling_params::warmupFrames; ++i)
+        {
+            fluid.update();
+        }
+        glFinish();
+        transport.barrier();
+
+        // wall-clock time, as the ranks wait on each other and share the GPU
+        double waitTime{ transport.waitTime() };
+        std::uint64_t received{ transport.particlesReceived() };
+        int substeps{ 0 };
+        auto start{ std::chrono::steady_clock::now() };
+        for (int i{ 0 }; i < frames; ++i)
+        {
+            fluid.update();
+            substeps += fluid.substeps();
+        }
+        glFinish();
+        double seconds{ std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() };
+
+        result.millisecondsPerFrame = 1e3 * seconds / frames;
+        result.waitMillisecondsPerFrame = 1e3 * (transport.waitTime() - waitTime) / frames;
+        result.haloParticlesPerSubstep = static_cast<double>(transport.particlesReceived() - received) / substeps;
+        result.ownedParticles = fluid.ownedParticles();
+        result.done = 1;
+    }
+    std::memcpy(results.data() + rank * sizeof(RankResult), &result, sizeof(result));
+
+    glfwDestroyWindow(window);
+    glfwTerminate();
+    return EXIT_SUCCESS;
+}
+
+/// @brief Run the ranks as processes of this executable and wait for them
+/// @param executable the path of this executable
+/// @param arguments the arguments of each rank
+/// @return false if a rank could not be started or failed
+bool runProcesses(const std::string& executable, const std::vector<std::vector<std::string>>& arguments)
+{
+    bool succeeded{ true };
+#ifdef _WIN32
+    // the ranks' output is discarded, as they print the same setup
+    SECURITY_ATTRIBUTES security{ sizeof(security), nullptr, TRUE };
+    HANDLE null{ CreateFileA("NUL", GENERIC_WRITE, FILE_SHARE_WRITE, &security, OPEN_EXISTING, 0, nullptr) };
+    std::vector<PROCESS_INFORMATION> processes{};
+    for (const std::vector<std::string>& args : arguments)
+    {
+        std::string commandLine{ '"' + executable + '"' };
+        for (const std::string& arg : args)
+        {
+            commandLine += ' ' + arg;
+        }
+        STARTUPINFOA startup{};
+        startup.cb = sizeof(startup);
+        startup.dwFlags = STARTF_USESTDHANDLES;
+        startup.hStdOutput = null;
+        startup.hStdError = GetStdHandle(STD_ERROR_HANDLE);
+        PROCESS_INFORMATION process{};
+        if (!CreateProcessA(executable.c_str(), commandLine.data(), nullptr, nullptr, TRUE, 0, nullptr, nullptr, &startup, &process))
+        {
+            std::cerr << "Failed to start a rank\n";
+            succeeded = false;
+            continue;
+        }
+        processes.push_back(process);
+    }
+    for (PROCESS_INFORMATION& process : processes)
+    {
+        WaitForSingleObject(process.hProcess, INFINITE);
+        DWORD code{};
+        GetExitCodeProcess(process.hProcess, &code);
+        succeeded = succeeded && code == EXIT_SUCCESS;
+        CloseHandle(process.hThread);
+        CloseHandle(process.hProcess);
+    }
+    CloseHandle(null);
+#else
+    // the ranks' output is discarded, as they print the same setup
+    posix_spawn_file_actions_t actions{};
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+    std::vector<pid_t> processes{};
+    for (const std::vector<std::string>& args : arguments)
+    {
+        std::vector<char*> argv{ const_cast<char*>(executable.c_str()) };
+        for (const std::string& arg : args)
+        {
+            argv.push_back(const_cast<char*>(arg.c_str()));
+        }
+        argv.push_back(nullptr);
+        pid_t process{};
+        if (posix_spawnp(&process, executable.c_str(), &actions, nullptr, argv.data(), environ) != 0)
+        {
+            std::cerr << "Failed to start a rank\n";
+            succeeded = false;
+            continue;
+        }
+        processes.push_back(process);
+    }
+    posix_spawn_file_actions_destroy(&actions);
+    for (pid_t process : processes)
+    {
+        int status{};
+        waitpid(process, &status, 0);
+        succeeded = succeeded && WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+    }
+#endif
+    return succeeded;
+}
+
+/// @brief Simulate the grid split into slabs, one process per slab
+/// @param executable the path of this executable
+/// @param numRanks the number of ranks
+/// @param particles the number of particles of the whole grid
+/// @param frames the number of measured frames
+/// @return the measurements; no particles if a rank failed
+ScalingResult runScaling(const std::string& executable, int numRanks, int particles, int frames)
+{
+#ifdef _WIN32
+    std::string name{ "pbf_scaling_" + std::to_string(GetCurrentProcessId()) + '_' + std::to_string(numRanks) };
+#else
+    std::string name{ "pbf_scaling_" + std::to_string(getpid()) + '_' + std::to_string(numRanks) };
+#endif
+    // a message never holds more than all particles
+    SharedMemoryTransport transport{ name, numRanks, particles };
+    SharedMemory results{ name + "_results", numRanks * sizeof(RankResult) };
+    if (!transport.available() || !results.available())
+    {
+        return {};
+    }
+
+    std::vector<std::vector<std::string>> arguments{};
+    for (int rank{ 0 }; rank < numRanks; ++rank)
+    {
+        arguments.push_back({ "--rank", name, std::to_string(rank), std::to_string(particles), std::to_string(frames) });
+    }
+    if (!runProcesses(executable, arguments))
+    {
+        return {};
+    }
+
+    ScalingResult scaling{};
+    for (int rank{ 0 }; rank < numRanks; ++rank)
+    {
+        RankResult result{};
+        std::memcpy(&result, results.data() + rank * sizeof(RankResult), sizeof(result));
+        if (!result.done)
+        {
+            return {};
+        }
+        scaling.millisecondsPerFrame = std::max(scaling.millisecondsPerFrame, result.millisecondsPerFrame);
+        scaling.waitMillisecondsPerFrame += result.waitMillisecondsPerFrame / numRanks;
+        scaling.haloParticlesPerSubstep += result.haloParticlesPerSubstep / numRanks;
+        scaling.ownedParticles += result.ownedParticles;
+    }
+    scaling.particles = particles;
+    return scaling;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc == 6 && std::strcmp(argv[1], "--rank") == 0)
+    {
+        return runRank(argv[2], std::atoi(argv[3]), std::atoi(argv[4]), std::atoi(argv[5]));
+    }
+
+    int frames{ argc > 1 ? std::atoi(argv[1]) : scaling_params::defaultFrames };
+    if (frames <= 0)
+    {
+        std::cerr << "Usage: scaling [frames]\n";
+        return EXIT_FAILURE;
+    }
+
+    // strong scaling splits a fixed number of particles; weak scaling keeps the particles
+    // per rank, so the grid gets finer with more ranks
+    std::cout << '\n' << frames << " frames after " << scaling_params::warmupFrames << " frames of warm-up\n";
+    for (bool strong : { true, false })
+    {
+        std::cout << '\n' << (strong ? "strong scaling" : "weak scaling") << '\n';
+        std::cout << std::setw(6) << "ranks" << std::setw(10) << "particles" << std::setw(12) << "ms/frame"
+            << std::setw(12) << (strong ? "speedup" : "efficiency") << std::setw(12) << "wait ms"
+            << std::setw(12) << "halo/step" << std::setw(10) << "owned" << '\n';
+        double baseline{};
+        for (int numRanks : scaling_params::rankCounts)
+        {
+            int particles{ strong ? scaling_params::strongParticles : scaling_params::weakParticlesPerRank * numRanks };
+            ScalingResult result{ runScaling(argv[0], numRanks, particles, frames) };
+            if (result.particles == 0)
+            {
+                std::cerr << "Scaling with " << numRanks << " ranks failed\n";
+                continue;
+            }
+            if (numRanks == 1)
+            {
+                baseline = result.millisecondsPerFrame;
+            }
+            // ideally, strong scaling speeds up by the number of ranks and weak scaling keeps the time
+            double ratio{ baseline / result.millisecondsPerFrame };
+            std::cout << std::fixed
+                << std::setw(6) << numRanks
+                << std::setw(10) << result.particles
+                << std::setw(12) << std::setprecision(3) << result.millisecondsPerFrame
+                << std::setw(12) << std::setprecision(2) << ratio
+                << std::setw(12) << std::setprecision(3) << result.waitMillisecondsPerFrame
+                << std::setw(12) << std::setprecision(0) << result.haloParticlesPerSubstep
+                << std::setw(10) << result.ownedParticles << '\n';
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,35 @@
+// Static colliders are signed distance fields stored in 3D textures, negative inside the
+// solid. A particle closer to a collider than the margin is moved out along the gradient
+// of the field, so a collider of any shape costs a few texture lookups per particle. The
+// fields are clamped a few voxels from the surface, so particles deep inside stay put.
+
+const int maxColliders = 4; // must match FluidSystem::maxColliders
+uniform sampler3D u_colliders[maxColliders];
+uniform vec3 u_colliderLow[maxColliders];  // the box covered by each field
+uniform vec3 u_colliderHigh[maxColliders];
+uniform int u_numColliders;
+uniform float u_colliderMargin; // the distance particles keep from colliders
+
+vec3 collideColliders(vec3 position)
+{
+    for (int i = 0; i < u_numColliders; i++)
+    {
+        vec3 coordinates = (position - u_colliderLow[i]) / (u_colliderHigh[i] - u_colliderLow[i]);
+        if (any(lessThan(coordinates, vec3(0.0))) || any(greaterThan(coordinates, vec3(1.0)))) continue;
+        float signedDistance = texture(u_colliders[i], coordinates).r;
+        if (signedDistance >= u_colliderMargin) continue;
+
+        // central differences a voxel apart
+        vec3 texel = 1.0 / vec3(textureSize(u_colliders[i], 0));
+        vec3 gradient = vec3(
+            texture(u_colliders[i], coordinates + vec3(texel.x, 0.0, 0.0)).r - texture(u_colliders[i], coordinates - vec3(texel.x, 0.0, 0.0)).r,
+            texture(u_colliders[i], coordinates + vec3(0.0, texel.y, 0.0)).r - texture(u_colliders[i], coordinates - vec3(0.0, texel.y, 0.0)).r,
+            texture(u_colliders[i], coordinates + vec3(0.0, 0.0, texel.z)).r - texture(u_colliders[i], coordinates - vec3(0.0, 0.0, texel.z)).r);
+        float norm = length(gradient);
+        if (norm > 0.0)
+        {
+            position += (u_colliderMargin - signedDistance) * gradient / norm;
+        }
+    }
+    return position;
+}
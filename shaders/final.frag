@@ -30,22 +30,97 @@ uniform mat4 u_projInv;
 uniform mat3 u_viewInv;
 uniform Fluid u_fluid;
 uniform Light u_light;
+uniform float u_upsampleRange;
+
+float viewDepth(float depth)
+{
+    vec4 posView = u_projInv * vec4(0.0, 0.0, 2.0 * depth - 1.0, 1.0);
+    return posView.z / posView.w;
+}
+
+// thickness may be smaller than depth; the four texels around the pixel are weighted
+// bilinearly and by how close the depth at their centers is to the pixel's, so edges of
+// fluid do not take thickness from background or from fluid far behind
+float upsampleThickness(float pixelViewDepth)
+{
+    ivec2 size = textureSize(u_thicknessMap, 0);
+    ivec2 depthSize = textureSize(u_depthMap, 0);
+    vec2 texelPos = v_texCoord * size - 0.5;
+    ivec2 base = ivec2(floor(texelPos));
+    vec2 f = texelPos - base;
+
+    float range = -0.5 / (u_upsampleRange * u_upsampleRange);
+    float sum = 0.0;
+    float weights = 0.0;
+    for (int i = 0; i < 4; ++i)
+    {
+        ivec2 offset = ivec2(i & 1, i >> 1);
+        ivec2 texel = clamp(base + offset, ivec2(0), size - 1);
+        float depth = texelFetch(u_depthMap, ivec2((vec2(texel) + 0.5) / size * depthSize), 0).x;
+        if (depth == 1.0)
+        {
+            continue;
+        }
+        vec2 bilinear = mix(1.0 - f, f, vec2(offset));
+        float difference = viewDepth(depth) - pixelViewDepth;
+        float weight = bilinear.x * bilinear.y * exp(range * difference * difference);
+        sum += weight * texelFetch(u_thicknessMap, texel, 0).x;
+        weights += weight;
+    }
+    return weights > 0.0 ? sum / weights : texture(u_thicknessMap, v_texCoord).x;
+}
 
 void main()
 {
-    float depth = texture(u_depthMap, v_texCoord).x;
-    if (depth == 1.0)
+    // the depth and normal maps may be smaller than the screen; the four texels around the
+    // pixel are weighted as in bilinear filtering, but background and fluid far behind the
+    // front most texel are left out, so the silhouette is not smeared into the background
+    ivec2 size = textureSize(u_depthMap, 0);
+    vec2 texelPos = v_texCoord * size - 0.5;
+    ivec2 base = ivec2(floor(texelPos));
+    vec2 f = texelPos - base;
+    vec4 bilinear = vec4((1.0 - f.x) * (1.0 - f.y), f.x * (1.0 - f.y), (1.0 - f.x) * f.y, f.x * f.y);
+    ivec2 texels[4] = ivec2[](base, base + ivec2(1, 0), base + ivec2(0, 1), base + ivec2(1, 1));
+
+    vec4 depths;
+    float front = 1.0;
+    for (int i = 0; i < 4; ++i)
     {
-        out_FragColor = texture(u_background, v_texCoord);
+        texels[i] = clamp(texels[i], ivec2(0), size - 1);
+        depths[i] = texelFetch(u_depthMap, texels[i], 0).x;
+        front = min(front, depths[i]);
+    }
+    vec4 background = texture(u_background, v_texCoord);
+    if (front == 1.0)
+    {
+        out_FragColor = background;
         return;
     }
 
+    float frontView = viewDepth(front);
+    vec4 weights = vec4(0.0);
+    float coverage = 0.0;
+    for (int i = 0; i < 4; ++i)
+    {
+        if (depths[i] < 1.0)
+        {
+            coverage += bilinear[i];
+            weights[i] = abs(viewDepth(depths[i]) - frontView) < u_upsampleRange ? bilinear[i] : 0.0;
+        }
+    }
+    weights /= weights.x + weights.y + weights.z + weights.w;
+    float depth = dot(weights, depths);
+    vec3 normal = vec3(0.0);
+    for (int i = 0; i < 4; ++i)
+    {
+        normal += weights[i] * texelFetch(u_normalMap, texels[i], 0).xyz;
+    }
+
     // preparation
     vec3 posClip = 2.0 * vec3(v_texCoord, depth) - 1.0;
     vec4 _posView = u_projInv * vec4(posClip, 1.0);
     vec3 posView = _posView.xyz / _posView.w;
     vec3 eyeDir = normalize(-posView);
-    vec3 normal = texture(u_normalMap, v_texCoord).xyz;
     normal = normalize(normal);
 
     // specular
@@ -64,7 +139,7 @@ void main()
                   * pow(max(0.0, dot(normal, eyeDir)), 5.0);
 
     // refraction
-    float thickness = texture(u_thicknessMap, v_texCoord).x;
+    float thickness = upsampleThickness(posView.z);
     float beta = thickness * u_fluid.refractance;
     vec3 refraction = texture(u_background, v_texCoord + beta * normal.xy).xyz;
     float t = exp(-thickness * u_fluid.attenuation);
@@ -72,5 +147,5 @@ void main()
 
     // modified from curvature flow paper
     vec3 color = mix(attenuateRefraction, reflection, 0.5 * fresnel) + specular;
-    out_FragColor = vec4(color, 1.0);
+    out_FragColor = vec4(mix(background.xyz, color, coverage), 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,7 @@
+// The work group size of a per-particle kernel. FluidSystem compiles the kernel with
+// GROUP_SIZE defined when it is tuned to another size; every size divides the largest
+#ifndef GROUP_SIZE
+#define GROUP_SIZE 1024
+#endif
+
+layout(local_size_x = GROUP_SIZE) in;
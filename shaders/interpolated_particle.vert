@@ -0,0 +1,44 @@
+#version 460 core
+
+// particles of the two latest simulation frames, in ID order
+in layout(location = 0) vec4 a_position;
+in layout(location = 1) float a_density;
+in layout(location = 2) vec4 a_previousPosition;
+in layout(location = 3) float a_previousDensity;
+
+uniform mat4 u_mvp;
+uniform mat4 u_mv;
+uniform float u_pointSize;
+uniform float u_maxPointSize;
+uniform float u_near;
+uniform float u_far;
+uniform float u_alpha;   // 0 at the previous frame, 1 at the latest one
+uniform float u_maxJump; // particles moving farther between frames are not interpolated
+
+out vec3 v_positionView;
+
+const float restDensity = 997.0f;
+
+void main()
+{
+    // w = 0 marks unused IDs, which are moved out of the clip volume
+    if (a_position.w == 0.0)
+    {
+        v_positionView = vec3(0.0);
+        gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+        gl_PointSize = 1.0;
+        return;
+    }
+
+    // new particles and IDs given to another particle appear at their latest position
+    bool interpolate = a_previousPosition.w != 0.0 && distance(a_previousPosition.xyz, a_position.xyz) < u_maxJump;
+    vec3 position = interpolate ? mix(a_previousPosition.xyz, a_position.xyz, u_alpha) : a_position.xyz;
+    float density = interpolate ? mix(a_previousDensity, a_density, u_alpha) : a_density;
+
+    v_positionView = (u_mv * vec4(position, 1.0)).xyz;
+    float linearDepth = (-v_positionView.z - u_near) / (u_far - u_near);
+    float constraint = density / restDensity - 1.0;
+    gl_Position = u_mvp * vec4(position, 1.0);
+    // small size when density is small or depth is far
+    gl_PointSize = min(min(1.0, 1.0 + 30.0 * constraint) * u_pointSize / linearDepth, u_maxPointSize);
+}
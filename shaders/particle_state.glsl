@@ -0,0 +1,51 @@
+// DispatchIndirectCommand of a pass over particles
+struct DispatchCommand
+{
+    uint numGroupsX;
+    uint numGroupsY;
+    uint numGroupsZ;
+    uint reserved;
+};
+
+// passes are dispatched at one of these work group sizes, the largest first and each
+// half the one before; must match FluidSystem::numGroupSizes
+const uint numGroupSizes = 5;
+
+// set the command of every work group size for a pass over a number of items
+void setDispatchCommands(out DispatchCommand commands[numGroupSizes], uint numItems, uint largestGroupSize)
+{
+    for (uint i = 0; i < numGroupSizes; ++i)
+    {
+        uint groupSize = largestGroupSize >> i;
+        commands[i] = DispatchCommand((numItems + groupSize - 1) / groupSize, 1, 1, 0);
+    }
+}
+
+// State of the particle system kept on GPU, so the number of particles can change
+// without being read back. Must match FluidSystem::ParticleState
+struct ParticleState
+{
+    // DrawArraysIndirectCommand for drawing live particles
+    uint drawCount;
+    uint drawInstanceCount;
+    uint drawFirst;
+    uint drawBaseInstance;
+
+    uint numParticles; // live particles, always the first ones in the buffers
+    uint numRemoved;   // particles that entered a sink in this substep
+    uint numFreeIds;   // IDs on the free list
+    uint idLimit;      // one more than the largest ID given out
+
+    // commands for per-particle passes, one per work group size
+    DispatchCommand groups[numGroupSizes];
+};
+
+layout(std430, binding = 8) coherent buffer block8
+{
+    ParticleState io_state;
+};
+
+bool isLive(uint id)
+{
+    return id < io_state.numParticles;
+}
@@ -0,0 +1,86 @@
+// Storage of particle data in the solver buffers. With COMPACT_STORAGE defined,
+// positions are 21-bit fixed point packed into a uvec2, velocities are half floats
+// packed into a uvec2 and lambdas are half floats packed in pairs into a uint.
+// Otherwise they are stored as floats. Data is unpacked into registers on load.
+
+#ifdef COMPACT_STORAGE
+
+#define PackedPosition uvec2
+#define PackedVelocity uvec2
+#define PackedLambdas uint
+
+uniform vec3 u_storageLow;   // origin of fixed-point positions
+uniform float u_storageStep; // size of one fixed-point unit
+
+const float maxFixedPoint = 2097151.0; // 2^21 - 1
+
+PackedPosition packPosition(vec3 position)
+{
+    uvec3 q = uvec3(clamp(round((position - u_storageLow) / u_storageStep), 0.0, maxFixedPoint));
+    return uvec2(q.x | (q.y << 21), (q.y >> 11) | (q.z << 10));
+}
+
+vec3 unpackPosition(PackedPosition value)
+{
+    uvec3 q = uvec3(value.x & 0x1FFFFFu, (value.x >> 21) | ((value.y & 0x3FFu) << 11), value.y >> 10);
+    return u_storageLow + vec3(q) * u_storageStep;
+}
+
+PackedVelocity packVelocity(vec3 velocity)
+{
+    return uvec2(packHalf2x16(velocity.xy), packHalf2x16(vec2(velocity.z, 0.0)));
+}
+
+vec3 unpackVelocity(PackedVelocity value)
+{
+    return vec3(unpackHalf2x16(value.x), unpackHalf2x16(value.y).x);
+}
+
+// index of the word holding the lambda of a particle
+uint lambdaWord(uint particle)
+{
+    return particle >> 1;
+}
+
+float unpackLambda(PackedLambdas value, uint particle)
+{
+    return unpackHalf2x16(value)[particle & 1u];
+}
+
+#else
+
+#define PackedPosition vec4
+#define PackedVelocity vec4
+#define PackedLambdas float
+
+PackedPosition packPosition(vec3 position)
+{
+    return vec4(position, 1.0);
+}
+
+vec3 unpackPosition(PackedPosition value)
+{
+    return value.xyz;
+}
+
+PackedVelocity packVelocity(vec3 velocity)
+{
+    return vec4(velocity, 0.0);
+}
+
+vec3 unpackVelocity(PackedVelocity value)
+{
+    return value.xyz;
+}
+
+uint lambdaWord(uint particle)
+{
+    return particle;
+}
+
+float unpackLambda(PackedLambdas value, uint particle)
+{
+    return value;
+}
+
+#endif
@@ -0,0 +1,21 @@
+uniform uint u_seed;
+
+// counter-based random number generator
+// reference: Hash Functions for GPU Rendering, Jarzynski and Olano, 2020
+uint pcgHash(uint v)
+{
+    uint state = v * 747796405u + 2891336453u;
+    uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+// uniform random number in [0, 1) for the given particle and stream
+float random(uint id, uint stream)
+{
+    return float(pcgHash(id ^ pcgHash(u_seed + stream))) / 4294967296.0;
+}
+
+vec3 random3(uint id)
+{
+    return vec3(random(id, 0u), random(id, 1u), random(id, 2u));
+}
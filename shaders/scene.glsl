@@ -0,0 +1,30 @@
+// An ensemble packs independent scenes into the buffers and grid of one system, so every
+// pass runs on all of them in one dispatch. Each scene has a slot of its own; the slots
+// tile the grid in x and z, and each holds the boundary of a single system followed by a
+// gap wider than the kernel radius, so fluid of different scenes never interacts and the
+// scene of a particle is known from its position. Needs u_boundary to be declared before
+// it is included.
+
+// must match FluidSystem::SceneData
+struct Scene
+{
+    vec4 low;     // the walls of the scene in the coordinates of the grid
+    vec4 high;
+    vec4 gravity; // w is the collision damping
+};
+
+layout(std430, binding = 16) readonly buffer block16
+{
+    Scene in_scenes[];
+};
+
+uniform vec2 u_slotSize; // in x and z
+uniform uint u_sceneColumns;
+
+// the scene whose slot holds a position
+Scene sceneOf(vec3 position)
+{
+    uvec2 slot = uvec2(max((position.xz - u_boundary.low.xz) / u_slotSize, 0.0));
+    uint scene = min(slot.x, u_sceneColumns - 1u) + u_sceneColumns * slot.y;
+    return in_scenes[min(scene, uint(in_scenes.length()) - 1u)];
+}
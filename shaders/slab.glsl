@@ -0,0 +1,20 @@
+// The grid may be split along z into slabs of whole cell layers, each simulated by its
+// own fluid system. A system holds the particles of its slab and ghost copies of the
+// particles near its faces, which belong to the neighbors. Cells are numbered with z
+// last, so after sorting the particles of a run of layers are contiguous. Needs
+// in_prefixSums and u_gridResolution to be declared before it is included.
+
+uniform uvec2 u_ownedLayers; // first and end z layer of the slab; all of them unless the grid is split
+
+// index of the first sorted particle in a layer
+uint layerStart(uint layer)
+{
+    uint cell = layer * u_gridResolution.x * u_gridResolution.y;
+    return cell == 0 ? 0 : in_prefixSums[cell - 1];
+}
+
+// whether a sorted particle is a ghost, which is only read by the solver and not moved
+bool isGhost(uint id)
+{
+    return id < layerStart(u_ownedLayers.x) || id >= layerStart(u_ownedLayers.y);
+}
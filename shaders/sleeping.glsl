@@ -0,0 +1,57 @@
+// Cells where the fluid has been at rest fall asleep, and the solver only runs on the
+// particles of the cells that are awake. A cell is quiet while no particle in it moves
+// faster or is compressed more than a threshold; it sleeps once it and all of its
+// neighbors have been quiet for a window of substeps. Sleeping cells next to awake ones
+// are border cells, whose lambdas are computed for their awake neighbors but whose
+// particles do not move. Needs u_boundary and u_gridResolution to be declared before it
+// is included.
+
+const uint solveCell = 0u;  // awake; particles are solved
+const uint borderCell = 1u; // asleep next to an awake cell; only lambdas are computed
+const uint asleepCell = 2u; // asleep; particles are skipped by the solver
+
+// must match FluidSystem::CellSleep
+struct CellSleep
+{
+    uint moving; // set when a particle in the cell moved or was compressed in this substep
+    uint quiet;  // substeps the cell has been quiet in a row, up to the window
+    uint asleep; // whether the cell and its neighbors have been quiet for the window
+    uint state;  // one of the states above
+};
+
+// the awake list holds the particles the solver runs on, in pairs of neighboring
+// indices, as compact storage packs lambdas in pairs; particles only listed for their
+// lambdas are marked by the top bit
+const uint lambdaOnlyBit = 0x80000000u;
+
+layout(std430, binding = 14) coherent buffer block14
+{
+    uint io_numAwake;
+    uint io_numSorted; // live particles at the last sort; the ones after them are new
+    uint io_awake[];
+};
+
+layout(std430, binding = 15) coherent buffer block15
+{
+    CellSleep io_cells[];
+};
+
+// the cell of a position, clamped to the grid
+uint sleepCell(vec3 position)
+{
+    vec3 cellSize = (u_boundary.high - u_boundary.low) / u_gridResolution;
+    uvec3 cell = min(uvec3(max((position - u_boundary.low) / cellSize, 0.0)), u_gridResolution - 1u);
+    return cell.x + u_gridResolution.x * cell.y + u_gridResolution.x * u_gridResolution.y * cell.z;
+}
+
+// the particle an invocation of a solver pass runs on; past the list it is no particle
+uint awakeParticle(uint invocation)
+{
+    return invocation < io_numAwake ? io_awake[invocation] & ~lambdaOnlyBit : 0xFFFFFFFFu;
+}
+
+// whether the particle of an invocation is moved by the solver
+bool awakeSolved(uint invocation)
+{
+    return invocation < io_numAwake && (io_awake[invocation] & lambdaOnlyBit) == 0u;
+}
@@ -0,0 +1,41 @@
+// State of the position solver kept on GPU, so iterations can stop early without
+// reading the error back. Must match FluidSystem::SolverState; needs particle_state.glsl
+struct SolverState
+{
+    uint errorSum;        // fixed-point sum of positive density errors of the last lambda pass
+    uint errorSumHigh;    // the high word of the sum, carried into when the low one wraps
+    uint iterations;      // position passes run in this substep
+    uint frameIterations; // position passes run in this frame
+    float error;          // mean positive density error of the last lambda pass
+
+    // commands for the lambda and position passes, one per work group size; zero once converged
+    DispatchCommand groups[numGroupSizes];
+
+    // commands for moving the solution into the output buffer
+    DispatchCommand copyGroups[numGroupSizes];
+};
+
+layout(std430, binding = 11) coherent buffer block11
+{
+    SolverState io_solver;
+};
+
+// errors are clamped to 1 and summed per work group first, so a group adds at most 2^22;
+// the sum is 64 bits wide, as millions of particles with large errors overflow 32 bits
+const float errorScale = 4096.0;
+
+// add the error of a work group to the sum
+void addError(float groupError)
+{
+    uint added = uint(groupError * errorScale);
+    if (atomicAdd(io_solver.errorSum, added) > 0xffffffffu - added)
+    {
+        atomicAdd(io_solver.errorSumHigh, 1u);
+    }
+}
+
+// the sum as a float, which is precise enough for a mean
+float totalError()
+{
+    return (float(io_solver.errorSumHigh) * 4294967296.0 + float(io_solver.errorSum)) / errorScale;
+}
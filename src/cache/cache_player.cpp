@@ -0,0 +1,160 @@
+#include "cache_player.h"
+
+#include <iostream>
+
+CachePlayer::CachePlayer(const std::string& path, const Options& options)
+    : m_options{ options }
+    , m_reader{ path }
+{
+    if (!m_reader.available())
+    {
+        std::cerr << "Failed to open cache file " << path << '\n';
+        return;
+    }
+
+    m_thread = std::thread{ &CachePlayer::run, this };
+}
+
+CachePlayer::~CachePlayer()
+{
+    if (!m_thread.joinable())
+    {
+        return;
+    }
+
+    {
+        std::lock_guard lock{ m_mutex };
+        m_stop = true;
+    }
+    m_changed.notify_all();
+    m_thread.join();
+}
+
+int CachePlayer::clampIndex(int index) const
+{
+    int count{ m_reader.numFrames() };
+    if (m_options.loop)
+    {
+        return (index % count + count) % count;
+    }
+    return index < 0 ? 0 : (index >= count ? count - 1 : index);
+}
+
+int CachePlayer::wantedFrame(int distance) const
+{
+    int index{ m_position + m_direction * distance };
+    if (!m_options.loop && (index < 0 || index >= m_reader.numFrames()))
+    {
+        return -1;
+    }
+    return clampIndex(index);
+}
+
+void CachePlayer::run()
+{
+    std::vector<glm::vec4> positions{};
+    while (true)
+    {
+        std::unique_lock lock{ m_mutex };
+        int next{ -1 };
+        m_changed.wait(lock, [&]()
+            {
+                if (m_stop) return true;
+                for (int distance{ 0 }; distance <= m_options.readAhead; ++distance)
+                {
+                    int index{ wantedFrame(distance) };
+                    if (index >= 0 && m_decoded.find(index) == m_decoded.end())
+                    {
+                        next = index;
+                        return true;
+                    }
+                }
+                return false;
+            });
+        if (m_stop)
+        {
+            return;
+        }
+
+        // frames outside the window around the position are dropped
+        for (auto it{ m_decoded.begin() }; it != m_decoded.end();)
+        {
+            int distance{ (it->first - m_position) * m_direction };
+            if (m_options.loop)
+            {
+                int count{ m_reader.numFrames() };
+                distance = (distance % count + count) % count;
+                if (distance > count - 1 - m_options.keepBehind) distance -= count;
+            }
+            bool keep{ distance >= -m_options.keepBehind && distance <= m_options.readAhead };
+            it = keep ? std::next(it) : m_decoded.erase(it);
+        }
+        int prefetch{ wantedFrame(m_options.readAhead + 1) };
+        lock.unlock();
+
+        // let the OS read the frame after the window while this one is decoded
+        if (prefetch >= 0)
+        {
+            m_reader.prefetch(prefetch);
+        }
+        if (!m_reader.readFrame(next, positions))
+        {
+            std::cerr << "Failed to decode frame " << next << " of the cache\n";
+            positions.clear();
+        }
+
+        lock.lock();
+        m_decoded[next] = positions;
+        lock.unlock();
+        m_changed.notify_all();
+    }
+}
+
+int CachePlayer::position()
+{
+    std::lock_guard lock{ m_mutex };
+    return m_position;
+}
+
+void CachePlayer::seek(int index)
+{
+    if (!available())
+    {
+        return;
+    }
+
+    {
+        std::lock_guard lock{ m_mutex };
+        m_position = clampIndex(index);
+    }
+    m_changed.notify_all();
+}
+
+void CachePlayer::step(int frames)
+{
+    if (!available() || frames == 0)
+    {
+        return;
+    }
+
+    {
+        std::lock_guard lock{ m_mutex };
+        m_direction = frames > 0 ? 1 : -1;
+        m_position = clampIndex(m_position + frames);
+    }
+    m_changed.notify_all();
+}
+
+bool CachePlayer::current(std::vector<glm::vec4>& positions)
+{
+    if (!available())
+    {
+        return false;
+    }
+
+    std::unique_lock lock{ m_mutex };
+    m_changed.wait(lock, [this]() { return m_decoded.find(m_position) != m_decoded.end(); });
+    const std::vector<glm::vec4>& frame{ m_decoded[m_position] };
+    positions.assign(frame.begin(), frame.end());
+    return !frame.empty();
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "particle_cache_reader.h"
+
+#include <glm/glm.hpp>
+
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/// @brief Plays back a particle cache file. Frames around the playback position are
+///        decoded ahead on a background thread in the direction of playback, so
+///        playing and scrubbing rarely wait for decoding
+class CachePlayer
+{
+public:
+    /// @brief Options for playback
+    struct Options
+    {
+        /// @brief Number of frames decoded ahead of the current one
+        int readAhead{ 8 };
+
+        /// @brief Number of frames kept behind the current one for scrubbing back
+        int keepBehind{ 2 };
+
+        /// @brief Whether playback wraps around at the ends
+        bool loop{ true };
+    };
+
+private:
+    /// @brief The options
+    Options m_options{};
+
+    /// @brief The cache file
+    ParticleCacheReader m_reader;
+
+    /// @brief Decoded frames by index; an empty frame failed to decode
+    std::map<int, std::vector<glm::vec4>> m_decoded{};
+
+    /// @brief The current frame
+    int m_position{};
+
+    /// @brief Direction of playback, 1 or -1
+    int m_direction{ 1 };
+
+    /// @brief Guards the decoded frames, the position and the stop flag
+    std::mutex m_mutex{};
+
+    /// @brief Signaled when the position changes or a frame is decoded
+    std::condition_variable m_changed{};
+
+    /// @brief Set when the player is being closed
+    bool m_stop{};
+
+    /// @brief The thread decoding frames
+    std::thread m_thread{};
+
+    /// @brief Background thread loop
+    void run();
+
+    /// @brief Wrap or clamp a frame index into the file
+    int clampIndex(int index) const;
+
+    /// @brief The frame wanted at the given distance ahead of the current one; -1 if none
+    int wantedFrame(int distance) const;
+
+public:
+    /// @brief Open the cache file and start decoding from the first frame
+    /// @param path the path of the cache file
+    /// @param options the options
+    CachePlayer(const std::string& path, const Options& options);
+
+    /// @brief Stop the background thread
+    ~CachePlayer();
+
+    /// @brief No copying
+    CachePlayer(const CachePlayer& other) = delete;
+
+    /// @brief No copying
+    CachePlayer& operator=(const CachePlayer& other) = delete;
+
+    /// @brief Whether the file is a valid cache
+    inline bool available() const { return m_reader.available(); }
+
+    /// @brief The number of frames in the file
+    inline int numFrames() const { return m_reader.numFrames(); }
+
+    /// @brief The index of the current frame
+    int position();
+
+    /// @brief Go to a frame
+    /// @param index the index of the frame; wrapped or clamped into the file
+    void seek(int index);
+
+    /// @brief Move by a number of frames; the sign also sets the direction of read-ahead
+    /// @param frames the number of frames, negative for going back
+    void step(int frames);
+
+    /// @brief Get the positions of the current frame, waiting for it to be decoded
+    /// @param positions output positions
+    /// @return false if the frame cannot be decoded
+    bool current(std::vector<glm::vec4>& positions);
+};
@@ -0,0 +1,154 @@
+#include "entropy_coder.h"
+
+#include <array>
+#include <cstring>
+
+namespace
+{
+    constexpr std::uint32_t probBits{ 12 };
+    constexpr std::uint32_t probScale{ 1u << probBits };
+    constexpr std::uint32_t stateLow{ 1u << 23 }; // lower bound of the normalized state
+    constexpr std::size_t tableBytes{ 256 * sizeof(std::uint16_t) };
+
+    using FrequencyTable = std::array<std::uint32_t, 256>;
+
+    /// @brief Scale the symbol counts so that they sum up to probScale
+    FrequencyTable normalize(const FrequencyTable& counts, std::size_t total)
+    {
+        FrequencyTable freqs{};
+        std::uint32_t sum{ 0 };
+        for (int s{ 0 }; s < 256; ++s)
+        {
+            if (counts[s] == 0) continue;
+            std::uint64_t scaled{ static_cast<std::uint64_t>(counts[s]) * probScale / total };
+            freqs[s] = scaled == 0 ? 1 : static_cast<std::uint32_t>(scaled);
+            sum += freqs[s];
+        }
+
+        // the rounding error is given to or taken from the most frequent symbols
+        while (sum != probScale)
+        {
+            int largest{ -1 };
+            for (int s{ 0 }; s < 256; ++s)
+            {
+                bool adjustable{ sum < probScale ? freqs[s] > 0 : freqs[s] > 1 };
+                if (adjustable && (largest < 0 || freqs[s] > freqs[largest])) largest = s;
+            }
+            if (sum < probScale)
+            {
+                ++freqs[largest];
+                ++sum;
+            }
+            else
+            {
+                --freqs[largest];
+                --sum;
+            }
+        }
+        return freqs;
+    }
+
+    FrequencyTable cumulative(const FrequencyTable& freqs)
+    {
+        FrequencyTable cumFreqs{};
+        std::uint32_t sum{ 0 };
+        for (int s{ 0 }; s < 256; ++s)
+        {
+            cumFreqs[s] = sum;
+            sum += freqs[s];
+        }
+        return cumFreqs;
+    }
+}
+
+std::vector<std::uint8_t> entropy_coder::compress(const std::uint8_t* data, std::size_t size)
+{
+    FrequencyTable counts{};
+    for (std::size_t i{ 0 }; i < size; ++i)
+    {
+        ++counts[data[i]];
+    }
+    FrequencyTable freqs{ size ? normalize(counts, size) : FrequencyTable{} };
+    FrequencyTable cumFreqs{ cumulative(freqs) };
+
+    // rANS encodes backwards, so the stream is written from the end of the buffer
+    std::vector<std::uint8_t> stream(size + size / 2 + 16);
+    std::uint8_t* end{ stream.data() + stream.size() };
+    std::uint8_t* ptr{ end };
+    std::uint32_t state{ stateLow };
+    for (std::size_t i{ size }; i-- > 0;)
+    {
+        std::uint32_t freq{ freqs[data[i]] };
+        std::uint32_t maxState{ ((stateLow >> probBits) << 8) * freq };
+        while (state >= maxState)
+        {
+            *--ptr = static_cast<std::uint8_t>(state & 0xff);
+            state >>= 8;
+        }
+        state = ((state / freq) << probBits) + (state % freq) + cumFreqs[data[i]];
+    }
+    ptr -= sizeof(state);
+    std::memcpy(ptr, &state, sizeof(state));
+
+    std::vector<std::uint8_t> output(tableBytes + (end - ptr));
+    for (int s{ 0 }; s < 256; ++s)
+    {
+        std::uint16_t freq{ static_cast<std::uint16_t>(freqs[s]) };
+        std::memcpy(output.data() + s * sizeof(freq), &freq, sizeof(freq));
+    }
+    std::memcpy(output.data() + tableBytes, ptr, end - ptr);
+    return output;
+}
+
+bool entropy_coder::decompress(const std::uint8_t* data, std::size_t size, std::uint8_t* output, std::size_t outputSize)
+{
+    if (size < tableBytes + sizeof(std::uint32_t))
+    {
+        return false;
+    }
+
+    FrequencyTable freqs{};
+    std::uint32_t sum{ 0 };
+    for (int s{ 0 }; s < 256; ++s)
+    {
+        std::uint16_t freq{};
+        std::memcpy(&freq, data + s * sizeof(freq), sizeof(freq));
+        freqs[s] = freq;
+        sum += freq;
+    }
+    // the symbol table below is filled from the frequencies, so they are checked even if
+    // nothing is decoded
+    if (sum != probScale)
+    {
+        return false;
+    }
+    FrequencyTable cumFreqs{ cumulative(freqs) };
+
+    std::array<std::uint8_t, probScale> symbols{};
+    for (int s{ 0 }; s < 256; ++s)
+    {
+        for (std::uint32_t slot{ cumFreqs[s] }; slot < cumFreqs[s] + freqs[s]; ++slot)
+        {
+            symbols[slot] = static_cast<std::uint8_t>(s);
+        }
+    }
+
+    const std::uint8_t* ptr{ data + tableBytes };
+    const std::uint8_t* end{ data + size };
+    std::uint32_t state{};
+    std::memcpy(&state, ptr, sizeof(state));
+    ptr += sizeof(state);
+    for (std::size_t i{ 0 }; i < outputSize; ++i)
+    {
+        std::uint32_t slot{ state & (probScale - 1) };
+        std::uint8_t symbol{ symbols[slot] };
+        output[i] = symbol;
+        state = freqs[symbol] * (state >> probBits) + slot - cumFreqs[symbol];
+        while (state < stateLow)
+        {
+            if (ptr == end) return false;
+            state = (state << 8) | *ptr++;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/// @brief Lightweight order-0 entropy coder for bytes based on rANS
+/// reference: https://github.com/rygorous/ryg_rans
+namespace entropy_coder
+{
+    /// @brief Compress the bytes; the frequency table is stored with the stream
+    /// @param data the input bytes
+    /// @param size the number of input bytes
+    /// @return the compressed bytes
+    std::vector<std::uint8_t> compress(const std::uint8_t* data, std::size_t size);
+
+    /// @brief Decompress the bytes compressed by compress()
+    /// @param data the compressed bytes
+    /// @param size the number of compressed bytes
+    /// @param output the output buffer
+    /// @param outputSize the number of bytes before compression
+    /// @return false if the compressed bytes are corrupted
+    bool decompress(const std::uint8_t* data, std::size_t size, std::uint8_t* output, std::size_t outputSize);
+}
@@ -0,0 +1,507 @@
+#include "particle_cache_codec.h"
+#include "entropy_coder.h"
+
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+    void writeVarint(std::vector<std::uint8_t>& output, std::uint32_t value)
+    {
+        while (value >= 0x80)
+        {
+            output.push_back(static_cast<std::uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+        output.push_back(static_cast<std::uint8_t>(value));
+    }
+
+    bool readVarint(const std::uint8_t*& ptr, const std::uint8_t* end, std::uint32_t& value)
+    {
+        value = 0;
+        for (int shift{ 0 }; shift < 35; shift += 7)
+        {
+            if (ptr == end) return false;
+            std::uint8_t byte{ *ptr++ };
+            value |= static_cast<std::uint32_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) return true;
+        }
+        return false;
+    }
+
+    inline std::uint32_t zigzag(std::int32_t value)
+    {
+        return (static_cast<std::uint32_t>(value) << 1) ^ static_cast<std::uint32_t>(value >> 31);
+    }
+
+    inline std::int32_t unzigzag(std::uint32_t value)
+    {
+        return static_cast<std::int32_t>(value >> 1) ^ -static_cast<std::int32_t>(value & 1);
+    }
+
+    /// @brief Append 16-bit values of three components as six byte planes (low bytes of
+    ///        x, high bytes of x, ...), which the entropy coder compresses much better
+    void writePlanes(std::vector<std::uint8_t>& output, const std::vector<glm::u16vec3>& values)
+    {
+        std::size_t n{ values.size() };
+        std::size_t base{ output.size() };
+        output.resize(base + 6 * n);
+        for (int c{ 0 }; c < 3; ++c)
+        {
+            std::uint8_t* low{ output.data() + base + (2 * c) * n };
+            std::uint8_t* high{ low + n };
+            for (std::size_t i{ 0 }; i < n; ++i)
+            {
+                low[i] = static_cast<std::uint8_t>(values[i][c] & 0xff);
+                high[i] = static_cast<std::uint8_t>(values[i][c] >> 8);
+            }
+        }
+    }
+
+    inline std::uint16_t readPlane(const std::uint8_t* planes, std::size_t n, int component, std::size_t i)
+    {
+        const std::uint8_t* low{ planes + (2 * component) * n };
+        return static_cast<std::uint16_t>(low[i] | (low[n + i] << 8));
+    }
+
+    void writeHalfVelocities(std::vector<std::uint8_t>& output, const glm::vec4* velocities, int numParticles)
+    {
+        std::vector<glm::u16vec3> halves(numParticles);
+        for (int i{ 0 }; i < numParticles; ++i)
+        {
+            halves[i] = glm::u16vec3(
+                glm::packHalf1x16(velocities[i].x),
+                glm::packHalf1x16(velocities[i].y),
+                glm::packHalf1x16(velocities[i].z));
+        }
+        writePlanes(output, halves);
+    }
+
+    void readHalfVelocities(const std::uint8_t* planes, std::size_t n, bool present, glm::vec4* velocities)
+    {
+        for (std::size_t i{ 0 }; i < n; ++i)
+        {
+            velocities[i] = present
+                ? glm::vec4(
+                    glm::unpackHalf1x16(readPlane(planes, n, 0, i)),
+                    glm::unpackHalf1x16(readPlane(planes, n, 1, i)),
+                    glm::unpackHalf1x16(readPlane(planes, n, 2, i)),
+                    0.0f)
+                : glm::vec4(0.0f);
+        }
+    }
+
+    /// @brief Flag the dead particles of a chunk, those with w = 0
+    /// @return the number of dead particles
+    int findDead(const glm::vec4* positions, int numParticles, std::vector<std::uint8_t>& dead)
+    {
+        dead.assign(numParticles, 0);
+        int numDead{ 0 };
+        for (int i{ 0 }; i < numParticles; ++i)
+        {
+            if (positions[i].w == 0.0f)
+            {
+                dead[i] = 1;
+                ++numDead;
+            }
+        }
+        return numDead;
+    }
+
+    /// @brief Append the runs of dead particles as their count followed by (gap since the
+    ///        last run, length) pairs
+    void writeDeadRuns(std::vector<std::uint8_t>& output, const std::vector<std::uint8_t>& dead)
+    {
+        std::vector<std::uint8_t> runs{};
+        std::uint32_t numRuns{ 0 };
+        std::size_t lastEnd{ 0 };
+        for (std::size_t i{ 0 }; i < dead.size();)
+        {
+            if (!dead[i])
+            {
+                ++i;
+                continue;
+            }
+            std::size_t first{ i };
+            while (i < dead.size() && dead[i]) ++i;
+            writeVarint(runs, static_cast<std::uint32_t>(first - lastEnd));
+            writeVarint(runs, static_cast<std::uint32_t>(i - first));
+            lastEnd = i;
+            ++numRuns;
+        }
+        writeVarint(output, numRuns);
+        output.insert(output.end(), runs.begin(), runs.end());
+    }
+
+    /// @brief Read the runs of dead particles into flags sized for the whole chunk
+    /// @param numLive output number of live particles
+    /// @return false if the runs are corrupted
+    bool readDeadRuns(const std::uint8_t*& ptr, const std::uint8_t* end, std::vector<std::uint8_t>& dead, std::size_t& numLive)
+    {
+        std::uint32_t numRuns{};
+        if (!readVarint(ptr, end, numRuns)) return false;
+        numLive = dead.size();
+        std::size_t lastEnd{ 0 };
+        for (std::uint32_t run{ 0 }; run < numRuns; ++run)
+        {
+            std::uint32_t gap{};
+            std::uint32_t length{};
+            if (!readVarint(ptr, end, gap) || !readVarint(ptr, end, length)) return false;
+            std::size_t first{ lastEnd + gap };
+            if (length == 0 || first > dead.size() || length > dead.size() - first) return false;
+            std::fill(dead.begin() + first, dead.begin() + first + length, std::uint8_t{ 1 });
+            lastEnd = first + length;
+            numLive -= length;
+        }
+        return true;
+    }
+
+    /// @brief Copy the values of the live particles of a chunk
+    std::vector<glm::vec4> gatherLive(const glm::vec4* values, const std::vector<std::uint8_t>& dead)
+    {
+        std::vector<glm::vec4> live{};
+        for (std::size_t i{ 0 }; i < dead.size(); ++i)
+        {
+            if (!dead[i]) live.push_back(values[i]);
+        }
+        return live;
+    }
+
+    /// @brief Move the values of the live particles, decoded to the front of the array, to
+    ///        their slots and zero those of the dead; backwards, so nothing is overwritten
+    ///        before it is moved
+    void scatterLive(glm::vec4* values, const std::vector<std::uint8_t>& dead, std::size_t numLive)
+    {
+        std::size_t live{ numLive };
+        for (std::size_t i{ dead.size() }; i-- > 0;)
+        {
+            values[i] = dead[i] ? glm::vec4(0.0f) : values[--live];
+        }
+    }
+
+    /// @brief Entropy code the payload if that makes it smaller and fill in its sizes
+    void finishPayload(std::vector<std::uint8_t>& payload, bool compress, particle_cache::ChunkHeader& header)
+    {
+        header.rawSize = static_cast<std::uint32_t>(payload.size());
+        if (compress)
+        {
+            std::vector<std::uint8_t> compressed{ entropy_coder::compress(payload.data(), payload.size()) };
+            if (compressed.size() < payload.size())
+            {
+                payload = std::move(compressed);
+                header.flags |= particle_cache::ChunkFlags::compressed;
+            }
+        }
+        header.storedSize = static_cast<std::uint32_t>(payload.size());
+    }
+
+    /// @brief Get the raw payload, decompressing it into the buffer if needed; null if corrupted
+    const std::uint8_t* rawPayload(const particle_cache::ChunkHeader& header, const std::uint8_t* payload,
+        std::vector<std::uint8_t>& buffer)
+    {
+        if (!(header.flags & particle_cache::ChunkFlags::compressed))
+        {
+            // only the stored size is checked against the file, and decoding reads up to the raw one
+            return header.rawSize == header.storedSize ? payload : nullptr;
+        }
+        // the writer never compresses an empty payload
+        if (header.rawSize == 0)
+        {
+            return nullptr;
+        }
+        buffer.resize(header.rawSize);
+        if (!entropy_coder::decompress(payload, header.storedSize, buffer.data(), header.rawSize))
+        {
+            return nullptr;
+        }
+        return buffer.data();
+    }
+}
+
+std::vector<std::uint8_t> particle_cache::encodeChunk(
+    const BoundingBox& boundary, const Grid& grid,
+    const glm::vec4* positions, const glm::vec4* velocities, int numParticles,
+    bool compress, ChunkHeader& header)
+{
+    glm::vec3 cellSize{ (boundary.high - boundary.low) / glm::vec3(grid.resolution) };
+    glm::ivec3 maxCell{ glm::ivec3(grid.resolution) - 1 };
+
+    // dead particles are only listed, and the rest is encoded as if they were not there
+    int numEntries{ numParticles };
+    std::vector<std::uint8_t> dead{};
+    std::vector<std::uint8_t> deadRuns{};
+    std::vector<glm::vec4> livePositions{};
+    std::vector<glm::vec4> liveVelocities{};
+    int numDead{ findDead(positions, numParticles, dead) };
+    if (numDead > 0)
+    {
+        writeDeadRuns(deadRuns, dead);
+        livePositions = gatherLive(positions, dead);
+        positions = livePositions.data();
+        if (velocities)
+        {
+            liveVelocities = gatherLive(velocities, dead);
+            velocities = liveVelocities.data();
+        }
+        numParticles -= numDead;
+    }
+
+    std::vector<std::uint8_t> runs{};
+    std::vector<glm::u16vec3> offsets(numParticles);
+    std::uint32_t numRuns{ 0 };
+    std::int64_t runCell{ -1 };
+    std::uint32_t runCount{ 0 };
+    std::int64_t lastRunCell{ 0 };
+    auto flushRun{ [&]()
+        {
+            if (runCount == 0) return;
+            writeVarint(runs, zigzag(static_cast<std::int32_t>(runCell - lastRunCell)));
+            writeVarint(runs, runCount);
+            lastRunCell = runCell;
+            ++numRuns;
+        } };
+
+    for (int i{ 0 }; i < numParticles; ++i)
+    {
+        glm::vec3 relative{ (glm::vec3(positions[i]) - boundary.low) / cellSize };
+        glm::ivec3 cell{ glm::clamp(glm::ivec3(glm::floor(relative)), glm::ivec3(0), maxCell) };
+        glm::vec3 fraction{ glm::clamp(relative - glm::vec3(cell), 0.0f, 1.0f) };
+        offsets[i] = glm::u16vec3(glm::round(fraction * quantizationScale));
+
+        std::int64_t cellIndex{ cell.x + static_cast<std::int64_t>(grid.resolution.x) * cell.y
+            + static_cast<std::int64_t>(grid.resolution.x) * grid.resolution.y * cell.z };
+        if (cellIndex != runCell)
+        {
+            flushRun();
+            runCell = cellIndex;
+            runCount = 0;
+        }
+        ++runCount;
+    }
+    flushRun();
+
+    std::vector<std::uint8_t> payload{ std::move(deadRuns) };
+    payload.insert(payload.end(), runs.begin(), runs.end());
+    writePlanes(payload, offsets);
+    if (velocities)
+    {
+        writeHalfVelocities(payload, velocities, numParticles);
+    }
+
+    header.encoding = static_cast<std::uint32_t>(Encoding::cellQuantized);
+    header.flags = (velocities ? hasVelocities : ChunkFlags{}) | (numDead > 0 ? hasDead : ChunkFlags{});
+    header.numParticles = static_cast<std::uint32_t>(numEntries);
+    header.numRuns = numRuns;
+    header.quantizationStep = 0.0f;
+    for (int c{ 0 }; c < 3; ++c)
+    {
+        header.boundaryLow[c] = boundary.low[c];
+        header.boundaryHigh[c] = boundary.high[c];
+        header.resolution[c] = grid.resolution[c];
+    }
+
+    finishPayload(payload, compress, header);
+    return payload;
+}
+
+bool particle_cache::decodeChunk(const ChunkHeader& header, const std::uint8_t* payload,
+    glm::vec4* positions, glm::vec4* velocities)
+{
+    if (header.encoding != static_cast<std::uint32_t>(Encoding::cellQuantized))
+    {
+        return false;
+    }
+
+    std::vector<std::uint8_t> decompressed{};
+    payload = rawPayload(header, payload, decompressed);
+    if (!payload)
+    {
+        return false;
+    }
+
+    bool hasVelocities{ (header.flags & ChunkFlags::hasVelocities) != 0 };
+    const std::uint8_t* ptr{ payload };
+    const std::uint8_t* end{ payload + header.rawSize };
+
+    // live particles are decoded to the front and moved to their slots at the end
+    std::size_t n{ header.numParticles };
+    std::vector<std::uint8_t> dead{};
+    if (header.flags & ChunkFlags::hasDead)
+    {
+        dead.resize(n);
+        if (!readDeadRuns(ptr, end, dead, n)) return false;
+    }
+
+    glm::vec3 low{ header.boundaryLow[0], header.boundaryLow[1], header.boundaryLow[2] };
+    glm::vec3 high{ header.boundaryHigh[0], header.boundaryHigh[1], header.boundaryHigh[2] };
+    glm::uvec3 resolution{ header.resolution[0], header.resolution[1], header.resolution[2] };
+    glm::vec3 cellSize{ (high - low) / glm::vec3(resolution) };
+
+    // the runs come first, so the planes start where they end
+    std::vector<std::uint32_t> cells(n);
+    std::size_t particle{ 0 };
+    std::int64_t cellIndex{ 0 };
+    for (std::uint32_t run{ 0 }; run < header.numRuns; ++run)
+    {
+        std::uint32_t delta{};
+        std::uint32_t count{};
+        if (!readVarint(ptr, end, delta) || !readVarint(ptr, end, count)) return false;
+        cellIndex += unzigzag(delta);
+        if (particle + count > n) return false;
+        for (std::uint32_t i{ 0 }; i < count; ++i)
+        {
+            cells[particle++] = static_cast<std::uint32_t>(cellIndex);
+        }
+    }
+    std::size_t planeBytes{ (hasVelocities ? 12 : 6) * n };
+    if (particle != n || static_cast<std::size_t>(end - ptr) != planeBytes) return false;
+
+    for (std::size_t i{ 0 }; i < n; ++i)
+    {
+        glm::uvec3 cell{
+            cells[i] % resolution.x,
+            (cells[i] / resolution.x) % resolution.y,
+            cells[i] / (resolution.x * resolution.y) };
+        glm::vec3 fraction{
+            readPlane(ptr, n, 0, i),
+            readPlane(ptr, n, 1, i),
+            readPlane(ptr, n, 2, i) };
+        fraction /= quantizationScale;
+        positions[i] = glm::vec4(low + (glm::vec3(cell) + fraction) * cellSize, 1.0f);
+    }
+
+    if (velocities)
+    {
+        readHalfVelocities(ptr + 6 * n, n, hasVelocities, velocities);
+    }
+    if (!dead.empty())
+    {
+        scatterLive(positions, dead, n);
+        if (velocities)
+        {
+            scatterLive(velocities, dead, n);
+        }
+    }
+    return true;
+}
+
+std::vector<std::uint8_t> particle_cache::encodeDeltaChunk(
+    const glm::vec3& origin, float step,
+    const glm::vec4* positions, const glm::vec4* velocities, int numParticles,
+    const glm::ivec3* previous, const glm::ivec3* beforePrevious,
+    bool compress, ChunkHeader& header, glm::ivec3* quantized)
+{
+    bool secondOrder{ previous && beforePrevious };
+    std::vector<std::uint8_t> dead{};
+    int numDead{ findDead(positions, numParticles, dead) };
+    for (int i{ 0 }; i < numParticles; ++i)
+    {
+        // a dead ID keeps its last position as the reference for when it is reused
+        quantized[i] = dead[i]
+            ? (previous ? previous[i] : glm::ivec3(0))
+            : glm::ivec3(glm::round((glm::vec3(positions[i]) - origin) / step));
+    }
+
+    // components are written one after another, as their residuals are distributed alike
+    std::vector<std::uint8_t> payload{};
+    payload.reserve(3 * numParticles);
+    if (numDead > 0)
+    {
+        writeDeadRuns(payload, dead);
+    }
+    for (int c{ 0 }; c < 3; ++c)
+    {
+        for (int i{ 0 }; i < numParticles; ++i)
+        {
+            if (dead[i]) continue;
+            std::int32_t prediction{ secondOrder ? 2 * previous[i][c] - beforePrevious[i][c] : (previous ? previous[i][c] : 0) };
+            writeVarint(payload, zigzag(quantized[i][c] - prediction));
+        }
+    }
+    if (velocities && numDead > 0)
+    {
+        std::vector<glm::vec4> live{ gatherLive(velocities, dead) };
+        writeHalfVelocities(payload, live.data(), numParticles - numDead);
+    }
+    else if (velocities)
+    {
+        writeHalfVelocities(payload, velocities, numParticles);
+    }
+
+    header.encoding = static_cast<std::uint32_t>(Encoding::idDelta);
+    header.flags = (velocities ? hasVelocities : ChunkFlags{}) | (previous ? ChunkFlags{} : keyframe)
+        | (secondOrder ? ChunkFlags::secondOrder : ChunkFlags{}) | (numDead > 0 ? hasDead : ChunkFlags{});
+    header.numParticles = static_cast<std::uint32_t>(numParticles);
+    header.numRuns = 0;
+    header.quantizationStep = step;
+    for (int c{ 0 }; c < 3; ++c)
+    {
+        header.boundaryLow[c] = origin[c];
+        header.boundaryHigh[c] = origin[c];
+        header.resolution[c] = 0;
+    }
+
+    finishPayload(payload, compress, header);
+    return payload;
+}
+
+bool particle_cache::decodeDeltaChunk(const ChunkHeader& header, const std::uint8_t* payload,
+    const glm::ivec3* previous, const glm::ivec3* beforePrevious,
+    glm::ivec3* quantized, glm::vec4* positions, glm::vec4* velocities)
+{
+    bool isKeyframe{ (header.flags & keyframe) != 0 };
+    bool secondOrder{ (header.flags & ChunkFlags::secondOrder) != 0 };
+    if (header.encoding != static_cast<std::uint32_t>(Encoding::idDelta)
+        || (!isKeyframe && !previous) || (secondOrder && !beforePrevious))
+    {
+        return false;
+    }
+
+    std::vector<std::uint8_t> decompressed{};
+    payload = rawPayload(header, payload, decompressed);
+    if (!payload)
+    {
+        return false;
+    }
+
+    std::size_t n{ header.numParticles };
+    const std::uint8_t* ptr{ payload };
+    const std::uint8_t* end{ payload + header.rawSize };
+    std::vector<std::uint8_t> dead(n);
+    std::size_t numLive{ n };
+    if ((header.flags & ChunkFlags::hasDead) && !readDeadRuns(ptr, end, dead, numLive)) return false;
+    for (int c{ 0 }; c < 3; ++c)
+    {
+        for (std::size_t i{ 0 }; i < n; ++i)
+        {
+            if (dead[i])
+            {
+                quantized[i][c] = isKeyframe ? 0 : previous[i][c];
+                continue;
+            }
+            std::uint32_t residual{};
+            if (!readVarint(ptr, end, residual)) return false;
+            std::int32_t prediction{ isKeyframe ? 0 : (secondOrder ? 2 * previous[i][c] - beforePrevious[i][c] : previous[i][c]) };
+            quantized[i][c] = prediction + unzigzag(residual);
+        }
+    }
+    bool hasVelocities{ (header.flags & ChunkFlags::hasVelocities) != 0 };
+    if (static_cast<std::size_t>(end - ptr) != (hasVelocities ? 6 * numLive : 0)) return false;
+
+    glm::vec3 origin{ header.boundaryLow[0], header.boundaryLow[1], header.boundaryLow[2] };
+    for (std::size_t i{ 0 }; i < n; ++i)
+    {
+        positions[i] = dead[i] ? glm::vec4(0.0f) : glm::vec4(origin + glm::vec3(quantized[i]) * header.quantizationStep, 1.0f);
+    }
+    if (velocities)
+    {
+        readHalfVelocities(ptr, numLive, hasVelocities, velocities);
+        if (numLive < n)
+        {
+            scatterLive(velocities, dead, numLive);
+        }
+    }
+    return true;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "particle_cache_format.h"
+#include <misc/bounding_box.h>
+#include <misc/grid.h>
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/// @brief Encoding and decoding of the chunks of particle cache files
+namespace particle_cache
+{
+    /// @brief Encode a range of particles into a chunk payload and fill in its header
+    /// @param boundary the boundary of the grid
+    /// @param grid the grid particles are quantized against
+    /// @param positions positions of the particles in the chunk; those with w = 0 are
+    ///        stored as dead
+    /// @param velocities velocities of the particles in the chunk; null if not written
+    /// @param numParticles the number of particles in the chunk
+    /// @param compress whether to entropy code the payload if it gets smaller
+    /// @param header the chunk header; encoding, flags, numParticles, numRuns, sizes and
+    ///        grid are filled in
+    /// @return the payload
+    std::vector<std::uint8_t> encodeChunk(
+        const BoundingBox& boundary, const Grid& grid,
+        const glm::vec4* positions, const glm::vec4* velocities, int numParticles,
+        bool compress, ChunkHeader& header);
+
+    /// @brief Decode a chunk payload
+    /// @param header the chunk header
+    /// @param payload the payload following the header
+    /// @param positions output positions of header.numParticles particles; zero for dead ones
+    /// @param velocities output velocities; may be null. Zero if the chunk has none
+    /// @return false if the chunk is corrupted or its encoding unknown
+    bool decodeChunk(const ChunkHeader& header, const std::uint8_t* payload,
+        glm::vec4* positions, glm::vec4* velocities);
+
+    /// @brief Encode a range of ID-ordered particles into an idDelta chunk payload
+    /// @param origin the origin of the fixed-point positions; the same for the whole chain of frames
+    /// @param step the size of one fixed-point unit in m
+    /// @param positions positions of the particles in the chunk; those with w = 0 are
+    ///        stored as dead, without residuals
+    /// @param velocities velocities of the particles in the chunk; null if not written
+    /// @param numParticles the number of particles in the chunk
+    /// @param previous fixed-point positions of the same particles in the previous frame;
+    ///        null for a keyframe
+    /// @param beforePrevious fixed-point positions in the frame before the previous one;
+    ///        null if unknown
+    /// @param compress whether to entropy code the payload if it gets smaller
+    /// @param header the chunk header; encoding, flags, numParticles, sizes and origin are filled in
+    /// @param quantized output fixed-point positions, the reference of the next frame; dead
+    ///        particles keep those of the previous frame
+    /// @return the payload
+    std::vector<std::uint8_t> encodeDeltaChunk(
+        const glm::vec3& origin, float step,
+        const glm::vec4* positions, const glm::vec4* velocities, int numParticles,
+        const glm::ivec3* previous, const glm::ivec3* beforePrevious,
+        bool compress, ChunkHeader& header, glm::ivec3* quantized);
+
+    /// @brief Decode an idDelta chunk payload
+    /// @param header the chunk header
+    /// @param payload the payload following the header
+    /// @param previous fixed-point positions of the previous frame; may be null for a keyframe
+    /// @param beforePrevious fixed-point positions of the frame before; may be null unless
+    ///        the chunk is second order
+    /// @param quantized output fixed-point positions of header.numParticles particles
+    /// @param positions output positions; zero for dead particles
+    /// @param velocities output velocities; may be null. Zero if the chunk has none
+    /// @return false if the chunk is corrupted or its references are missing
+    bool decodeDeltaChunk(const ChunkHeader& header, const std::uint8_t* payload,
+        const glm::ivec3* previous, const glm::ivec3* beforePrevious,
+        glm::ivec3* quantized, glm::vec4* positions, glm::vec4* velocities);
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstdint>
+
+/// @brief On-disk layout of particle cache files. A file is a header followed by
+///        chunks and ends with an index of the chunks and a trailer, so a reader can
+///        map the file and seek to any frame. Every chunk holds a contiguous range of
+///        particles of one frame and can be decoded on its own. All values are
+///        little endian.
+namespace particle_cache
+{
+    constexpr std::uint32_t fileMagic{ 0x43464250 }; // "PBFC"
+    constexpr std::uint32_t indexMagic{ 0x49464250 }; // "PBFI"
+    constexpr std::uint32_t version{ 2 }; // 2 added dead particles
+
+    /// @brief Maximum value of the quantized offset inside a cell
+    constexpr float quantizationScale{ 65535.0f };
+
+    /// @brief How the particles of a chunk are encoded
+    enum class Encoding : std::uint32_t
+    {
+        // runs of (cell index, count) followed by 16-bit offsets of particles inside their cells
+        cellQuantized = 0,
+
+        // particles in ID order; fixed-point positions as varint residuals against a
+        // prediction from the same particles in the previous frames
+        idDelta = 1,
+    };
+
+    /// @brief Flags of a chunk
+    enum ChunkFlags : std::uint32_t
+    {
+        hasVelocities = 1 << 0, // half-precision velocities follow the positions
+        compressed = 1 << 1,    // the payload is compressed by entropy_coder
+        keyframe = 1 << 2,      // idDelta only: residuals are against zero, not the previous frame
+        secondOrder = 1 << 3,   // idDelta only: predicted by 2 * previous - the frame before
+        hasDead = 1 << 4,       // the payload starts with runs of dead particles, i.e. IDs freed
+                                // by sinks, which decode to w = 0 and store nothing else
+    };
+
+    /// @brief The header at the start of the file
+    struct FileHeader
+    {
+        std::uint32_t magic;
+        std::uint32_t version;
+        std::uint32_t reserved[2];
+    };
+
+    /// @brief The header in front of every chunk's payload
+    struct ChunkHeader
+    {
+        std::uint64_t frame;
+        std::uint32_t encoding;
+        std::uint32_t flags;
+
+        /// @brief Particles of the whole frame and the range in this chunk
+        std::uint32_t frameParticles;
+        std::uint32_t firstParticle;
+        std::uint32_t numParticles;
+
+        /// @brief Number of (cell index, count) runs
+        std::uint32_t numRuns;
+
+        /// @brief Payload size before and after compression
+        std::uint32_t rawSize;
+        std::uint32_t storedSize;
+
+        /// @brief The grid particles are quantized against; for idDelta, boundaryLow is
+        ///        the origin of the fixed-point positions and the rest is informative
+        float boundaryLow[3];
+        float boundaryHigh[3];
+        std::uint32_t resolution[3];
+
+        /// @brief idDelta only: the size of one fixed-point unit in m; zero otherwise
+        float quantizationStep;
+    };
+
+    /// @brief An entry of the index at the end of the file
+    struct IndexEntry
+    {
+        std::uint64_t offset; // of the chunk header
+        std::uint64_t frame;
+        std::uint32_t firstParticle;
+        std::uint32_t numParticles;
+        std::uint32_t frameParticles;
+        std::uint32_t size; // of the chunk including its header
+    };
+
+    /// @brief The trailer at the very end of the file
+    struct Trailer
+    {
+        std::uint64_t indexOffset;
+        std::uint32_t numEntries;
+        std::uint32_t magic;
+    };
+
+    static_assert(sizeof(ChunkHeader) == 80);
+    static_assert(sizeof(IndexEntry) == 32);
+    static_assert(sizeof(Trailer) == 16);
+}
@@ -0,0 +1,183 @@
+#include "particle_cache_reader.h"
+#include "particle_cache_codec.h"
+
+#include <cstring>
+#include <iostream>
+
+ParticleCacheReader::ParticleCacheReader(const std::string& path)
+    : m_file{ path.c_str() }
+{
+    if (m_file.available() && !readIndex())
+    {
+        std::cerr << "Invalid cache file " << path << '\n';
+        m_frames.clear();
+    }
+}
+
+bool ParticleCacheReader::readIndex()
+{
+    const std::byte* data{ m_file.data() };
+    std::size_t size{ m_file.size() };
+    if (size < sizeof(particle_cache::FileHeader) + sizeof(particle_cache::Trailer))
+    {
+        return false;
+    }
+
+    particle_cache::FileHeader header{};
+    std::memcpy(&header, data, sizeof(header));
+    if (header.magic != particle_cache::fileMagic || header.version > particle_cache::version)
+    {
+        return false;
+    }
+
+    particle_cache::Trailer trailer{};
+    std::memcpy(&trailer, data + size - sizeof(trailer), sizeof(trailer));
+    // the checks subtract rather than add, as offsets and sizes of a corrupt file may wrap
+    std::size_t indexBytes{ trailer.numEntries * sizeof(particle_cache::IndexEntry) };
+    std::size_t indexEnd{ size - sizeof(trailer) };
+    if (trailer.magic != particle_cache::indexMagic || trailer.indexOffset > indexEnd
+        || indexBytes != indexEnd - trailer.indexOffset)
+    {
+        return false; // e.g. the writer did not finish
+    }
+    m_index.resize(trailer.numEntries);
+    std::memcpy(m_index.data(), data + trailer.indexOffset, indexBytes);
+
+    // chunks of a frame are consecutive in the index
+    for (std::size_t i{ 0 }; i < m_index.size(); ++i)
+    {
+        const particle_cache::IndexEntry& entry{ m_index[i] };
+        if (entry.size < sizeof(particle_cache::ChunkHeader) || entry.offset > trailer.indexOffset
+            || entry.size > trailer.indexOffset - entry.offset)
+        {
+            return false;
+        }
+        if (m_frames.empty() || m_frames.back().frame != entry.frame || entry.firstParticle == 0)
+        {
+            m_frames.push_back(FrameEntry{ entry.frame, entry.frameParticles, i, 0 });
+        }
+        ++m_frames.back().numChunks;
+    }
+    return true;
+}
+
+particle_cache::ChunkHeader ParticleCacheReader::firstChunkHeader(int index) const
+{
+    particle_cache::ChunkHeader header{};
+    std::memcpy(&header, m_file.data() + m_index[m_frames[index].firstChunk].offset, sizeof(header));
+    return header;
+}
+
+bool ParticleCacheReader::readFrame(int index, std::vector<glm::vec4>& positions, std::vector<glm::vec4>* velocities)
+{
+    if (index < 0 || index >= numFrames())
+    {
+        return false;
+    }
+
+    particle_cache::ChunkHeader header{ firstChunkHeader(index) };
+    if (header.encoding != static_cast<std::uint32_t>(particle_cache::Encoding::idDelta)
+        || (header.flags & particle_cache::ChunkFlags::keyframe)
+        || m_deltaFrame == index - 1)
+    {
+        return decodeFrame(index, positions, velocities);
+    }
+
+    // continue from the last keyframe
+    int keyframe{ index - 1 };
+    while (keyframe >= 0)
+    {
+        header = firstChunkHeader(keyframe);
+        if (header.encoding != static_cast<std::uint32_t>(particle_cache::Encoding::idDelta))
+        {
+            return false;
+        }
+        if (header.flags & particle_cache::ChunkFlags::keyframe)
+        {
+            break;
+        }
+        --keyframe;
+    }
+    for (int i{ keyframe }; i < index; ++i)
+    {
+        if (i < 0 || !decodeFrame(i, positions, nullptr))
+        {
+            return false;
+        }
+    }
+    return decodeFrame(index, positions, velocities);
+}
+
+bool ParticleCacheReader::decodeFrame(int index, std::vector<glm::vec4>& positions, std::vector<glm::vec4>* velocities)
+{
+    const FrameEntry& frame{ m_frames[index] };
+    positions.resize(frame.numParticles);
+    if (velocities) velocities->resize(frame.numParticles);
+
+    std::vector<glm::ivec3> quantized{};
+    bool delta{ false };
+    for (std::size_t i{ frame.firstChunk }; i < frame.firstChunk + frame.numChunks; ++i)
+    {
+        const particle_cache::IndexEntry& entry{ m_index[i] };
+        const std::uint8_t* chunk{ reinterpret_cast<const std::uint8_t*>(m_file.data() + entry.offset) };
+        particle_cache::ChunkHeader header{};
+        std::memcpy(&header, chunk, sizeof(header));
+        if (std::uint64_t{ header.firstParticle } + header.numParticles > frame.numParticles
+            || header.storedSize != entry.size - sizeof(header))
+        {
+            m_deltaFrame = -1;
+            return false;
+        }
+
+        bool decoded{};
+        if (header.encoding == static_cast<std::uint32_t>(particle_cache::Encoding::idDelta))
+        {
+            bool hasReference{ m_deltaFrame == index - 1 && m_previous.size() == frame.numParticles };
+            bool hasSecondReference{ hasReference && m_beforePrevious.size() == frame.numParticles };
+            quantized.resize(frame.numParticles);
+            delta = true;
+            decoded = particle_cache::decodeDeltaChunk(header, chunk + sizeof(header),
+                hasReference ? m_previous.data() + header.firstParticle : nullptr,
+                hasSecondReference ? m_beforePrevious.data() + header.firstParticle : nullptr,
+                quantized.data() + header.firstParticle,
+                positions.data() + header.firstParticle,
+                velocities ? velocities->data() + header.firstParticle : nullptr);
+        }
+        else
+        {
+            decoded = particle_cache::decodeChunk(header, chunk + sizeof(header),
+                positions.data() + header.firstParticle,
+                velocities ? velocities->data() + header.firstParticle : nullptr);
+        }
+        if (!decoded)
+        {
+            m_deltaFrame = -1;
+            return false;
+        }
+    }
+
+    if (delta)
+    {
+        m_beforePrevious = std::move(m_previous);
+        m_previous = std::move(quantized);
+        m_deltaFrame = index;
+    }
+    else
+    {
+        m_deltaFrame = -1;
+    }
+    return true;
+}
+
+void ParticleCacheReader::prefetch(int index) const
+{
+    if (index < 0 || index >= numFrames())
+    {
+        return;
+    }
+
+    const FrameEntry& frame{ m_frames[index] };
+    const particle_cache::IndexEntry& first{ m_index[frame.firstChunk] };
+    const particle_cache::IndexEntry& last{ m_index[frame.firstChunk + frame.numChunks - 1] };
+    m_file.prefetch(first.offset, last.offset + last.size - first.offset);
+}
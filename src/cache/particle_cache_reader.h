@@ -0,0 +1,78 @@
+#pragma once
+
+#include "particle_cache_format.h"
+#include <misc/mapped_file.h>
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/// @brief Reads particle frames from a memory-mapped cache file. Delta-encoded frames
+///        are decoded from their last keyframe, so reading frames in order is fastest.
+///        Not thread safe, as the state of the delta chain is kept between reads
+class ParticleCacheReader
+{
+private:
+    /// @brief Where the chunks of one frame are in the index
+    struct FrameEntry
+    {
+        std::uint64_t frame{};
+        std::uint32_t numParticles{};
+        std::size_t firstChunk{};
+        std::size_t numChunks{};
+    };
+
+    /// @brief The mapped file
+    MappedFile m_file{};
+
+    /// @brief The index stored at the end of the file; copied since it may be unaligned
+    std::vector<particle_cache::IndexEntry> m_index{};
+
+    /// @brief The frames in file order
+    std::vector<FrameEntry> m_frames{};
+
+    /// @brief The frame the delta state belongs to; -1 if none
+    int m_deltaFrame{ -1 };
+
+    /// @brief Fixed-point positions of the last two delta-encoded frames read
+    std::vector<glm::ivec3> m_previous{};
+    std::vector<glm::ivec3> m_beforePrevious{};
+
+    /// @brief Read the trailer and the index; false if the file is not a valid cache
+    bool readIndex();
+
+    /// @brief Copy the header of the first chunk of a frame
+    particle_cache::ChunkHeader firstChunkHeader(int index) const;
+
+    /// @brief Decode the chunks of one frame; delta-encoded chunks use and advance the delta state
+    bool decodeFrame(int index, std::vector<glm::vec4>& positions, std::vector<glm::vec4>* velocities);
+
+public:
+    /// @brief Map the cache file and read its index
+    /// @param path the path of the cache file
+    ParticleCacheReader(const std::string& path);
+
+    /// @brief Whether the file is a valid cache
+    inline bool available() const { return !m_frames.empty(); }
+
+    /// @brief The number of frames in the file
+    inline int numFrames() const { return static_cast<int>(m_frames.size()); }
+
+    /// @brief The frame index the simulation had when the frame was captured
+    inline std::uint64_t frameNumber(int index) const { return m_frames[index].frame; }
+
+    /// @brief The number of particles in the frame
+    inline int numParticles(int index) const { return static_cast<int>(m_frames[index].numParticles); }
+
+    /// @brief Decode a frame
+    /// @param index the index of the frame in the file, from 0 to numFrames() - 1
+    /// @param positions output positions; resized to the number of particles
+    /// @param velocities output velocities; may be null
+    /// @return false if the frame cannot be decoded
+    bool readFrame(int index, std::vector<glm::vec4>& positions, std::vector<glm::vec4>* velocities = nullptr);
+
+    /// @brief Hint the OS to load a frame ahead of reading it
+    void prefetch(int index) const;
+};
@@ -0,0 +1,183 @@
+#include "particle_cache_writer.h"
+#include "particle_cache_codec.h"
+
+#include <algorithm>
+#include <iostream>
+
+ParticleCacheWriter::ParticleCacheWriter(const std::string& path, const Options& options)
+    : m_options{ options }
+    , m_file{ path, std::ios::binary | std::ios::trunc }
+{
+    if (!m_file)
+    {
+        std::cerr << "Failed to create cache file " << path << '\n';
+        return;
+    }
+
+    particle_cache::FileHeader header{ particle_cache::fileMagic, particle_cache::version, { 0, 0 } };
+    writeBytes(&header, sizeof(header));
+
+    m_thread = std::thread{ &ParticleCacheWriter::run, this };
+}
+
+ParticleCacheWriter::~ParticleCacheWriter()
+{
+    if (!m_thread.joinable())
+    {
+        return;
+    }
+
+    {
+        std::lock_guard lock{ m_mutex };
+        m_stop = true;
+    }
+    m_queueChanged.notify_all();
+    m_thread.join();
+
+    particle_cache::Trailer trailer{ m_offset, static_cast<std::uint32_t>(m_index.size()), particle_cache::indexMagic };
+    writeBytes(m_index.data(), m_index.size() * sizeof(particle_cache::IndexEntry));
+    writeBytes(&trailer, sizeof(trailer));
+    m_file.close();
+}
+
+void ParticleCacheWriter::write(std::uint64_t frame, const BoundingBox& boundary, const Grid& grid,
+    const glm::vec4* positions, const glm::vec4* velocities, int numParticles, bool idOrdered)
+{
+    if (!available())
+    {
+        return;
+    }
+
+    // waiting for room would stall the caller, which is the simulation thread; delta
+    // encoding is against the frames written, so a gap costs only a larger residual
+    {
+        std::lock_guard lock{ m_mutex };
+        if (static_cast<int>(m_queue.size()) >= m_options.maxQueuedFrames)
+        {
+            ++m_droppedFrames;
+            return;
+        }
+    }
+
+    Frame job{ frame, boundary, grid, std::vector<glm::vec4>(positions, positions + numParticles) };
+    job.idOrdered = idOrdered;
+    if (m_options.velocities && velocities)
+    {
+        job.velocities.assign(velocities, velocities + numParticles);
+    }
+
+    {
+        std::lock_guard lock{ m_mutex };
+        m_queue.push_back(std::move(job));
+    }
+    m_queueChanged.notify_all();
+}
+
+int ParticleCacheWriter::droppedFrames()
+{
+    std::lock_guard lock{ m_mutex };
+    return m_droppedFrames;
+}
+
+void ParticleCacheWriter::run()
+{
+    while (true)
+    {
+        std::unique_lock lock{ m_mutex };
+        m_queueChanged.wait(lock, [this]() { return m_stop || !m_queue.empty(); });
+        if (m_queue.empty())
+        {
+            return; // stopped and drained
+        }
+        Frame frame{ std::move(m_queue.front()) };
+        m_queue.pop_front();
+        lock.unlock();
+
+        writeFrame(frame);
+    }
+}
+
+void ParticleCacheWriter::writeFrame(const Frame& frame)
+{
+    if (frame.idOrdered && m_options.deltaEncoding)
+    {
+        writeDeltaFrame(frame);
+        return;
+    }
+    m_previous.clear();
+    m_beforePrevious.clear();
+
+    int numParticles{ static_cast<int>(frame.positions.size()) };
+    bool hasVelocities{ !frame.velocities.empty() };
+    for (int first{ 0 }; first < numParticles; first += m_options.particlesPerChunk)
+    {
+        int count{ std::min(m_options.particlesPerChunk, numParticles - first) };
+
+        particle_cache::ChunkHeader header{};
+        header.frame = frame.frame;
+        header.frameParticles = static_cast<std::uint32_t>(numParticles);
+        header.firstParticle = static_cast<std::uint32_t>(first);
+        std::vector<std::uint8_t> payload{ particle_cache::encodeChunk(
+            frame.boundary, frame.grid,
+            frame.positions.data() + first,
+            hasVelocities ? frame.velocities.data() + first : nullptr,
+            count, m_options.compress, header) };
+        writeChunk(header, payload);
+    }
+}
+
+void ParticleCacheWriter::writeDeltaFrame(const Frame& frame)
+{
+    int numParticles{ static_cast<int>(frame.positions.size()) };
+    bool hasVelocities{ !frame.velocities.empty() };
+    bool keyframe{ static_cast<int>(m_previous.size()) != numParticles || m_framesSinceKeyframe >= m_options.keyframeInterval };
+    if (keyframe)
+    {
+        m_origin = frame.boundary.low;
+        m_previous.clear();
+        m_beforePrevious.clear();
+        m_framesSinceKeyframe = 0;
+    }
+
+    std::vector<glm::ivec3> quantized(numParticles);
+    for (int first{ 0 }; first < numParticles; first += m_options.particlesPerChunk)
+    {
+        int count{ std::min(m_options.particlesPerChunk, numParticles - first) };
+
+        particle_cache::ChunkHeader header{};
+        header.frame = frame.frame;
+        header.frameParticles = static_cast<std::uint32_t>(numParticles);
+        header.firstParticle = static_cast<std::uint32_t>(first);
+        std::vector<std::uint8_t> payload{ particle_cache::encodeDeltaChunk(
+            m_origin, m_options.quantizationStep,
+            frame.positions.data() + first,
+            hasVelocities ? frame.velocities.data() + first : nullptr,
+            count,
+            m_previous.empty() ? nullptr : m_previous.data() + first,
+            m_beforePrevious.empty() ? nullptr : m_beforePrevious.data() + first,
+            m_options.compress, header, quantized.data() + first) };
+        writeChunk(header, payload);
+    }
+
+    m_beforePrevious = std::move(m_previous);
+    m_previous = std::move(quantized);
+    ++m_framesSinceKeyframe;
+}
+
+void ParticleCacheWriter::writeChunk(const particle_cache::ChunkHeader& header, const std::vector<std::uint8_t>& payload)
+{
+    particle_cache::IndexEntry entry{
+        m_offset, header.frame,
+        header.firstParticle, header.numParticles, header.frameParticles,
+        static_cast<std::uint32_t>(sizeof(header) + payload.size()) };
+    m_index.push_back(entry);
+
+    writeBytes(&header, sizeof(header));
+    writeBytes(payload.data(), payload.size());
+}
+
+void ParticleCacheWriter::writeBytes(const void* data, std::size_t size)
+{
+    m_file.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+    m_offset += size;
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include "particle_cache_format.h"
+#include <misc/bounding_box.h>
+#include <misc/grid.h>
+
+#include <glm/glm.hpp>
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/// @brief Writes particle frames to a cache file on a background thread. Positions
+///        are quantized to 16 bits relative to their grid cells; frames in particle ID
+///        order are instead stored as fixed-point residuals against the previous frames
+class ParticleCacheWriter
+{
+public:
+    /// @brief Options for writing
+    struct Options
+    {
+        /// @brief Maximum number of particles in a chunk
+        int particlesPerChunk{ 1 << 16 };
+
+        /// @brief Whether half-precision velocities are written
+        bool velocities{ false };
+
+        /// @brief Whether chunks are entropy coded when that makes them smaller
+        bool compress{ true };
+
+        /// @brief Maximum number of frames waiting to be written; write() drops frames beyond
+        int maxQueuedFrames{ 4 };
+
+        /// @brief Whether frames in ID order are delta encoded
+        bool deltaEncoding{ true };
+
+        /// @brief Maximum number of frames between delta-encoding keyframes; bounds the
+        ///        frames decoded when seeking
+        int keyframeInterval{ 30 };
+
+        /// @brief The size of one fixed-point unit of delta-encoded positions in m
+        float quantizationStep{ 1e-5f };
+    };
+
+private:
+    /// @brief A frame waiting to be written
+    struct Frame
+    {
+        std::uint64_t frame{};
+        BoundingBox boundary{};
+        Grid grid{};
+        std::vector<glm::vec4> positions{};
+        std::vector<glm::vec4> velocities{};
+        bool idOrdered{};
+    };
+
+    /// @brief The options
+    Options m_options{};
+
+    /// @brief The output file
+    std::ofstream m_file{};
+
+    /// @brief Current offset in the file
+    std::uint64_t m_offset{};
+
+    /// @brief Index of the chunks written so far
+    std::vector<particle_cache::IndexEntry> m_index{};
+
+    /// @brief Fixed-point positions of the last two delta-encoded frames; empty when the
+    ///        next ID-ordered frame must be a keyframe
+    std::vector<glm::ivec3> m_previous{};
+    std::vector<glm::ivec3> m_beforePrevious{};
+
+    /// @brief Origin of the fixed-point positions since the last keyframe
+    glm::vec3 m_origin{};
+
+    /// @brief Number of frames written since the last keyframe
+    int m_framesSinceKeyframe{};
+
+    /// @brief Frames waiting to be written
+    std::deque<Frame> m_queue{};
+
+    /// @brief Guards the queue and the stop flag
+    std::mutex m_mutex{};
+
+    /// @brief Signaled when the queue changes
+    std::condition_variable m_queueChanged{};
+
+    /// @brief Set when the writer is being closed
+    bool m_stop{};
+
+    /// @brief Frames dropped as the queue was full; guarded by the mutex
+    int m_droppedFrames{};
+
+    /// @brief The thread encoding and writing frames
+    std::thread m_thread{};
+
+    /// @brief Background thread loop
+    void run();
+
+    /// @brief Encode and write all chunks of a frame
+    void writeFrame(const Frame& frame);
+
+    /// @brief Encode and write all chunks of a frame in ID order against the previous frames
+    void writeDeltaFrame(const Frame& frame);
+
+    /// @brief Write a chunk and add it to the index
+    void writeChunk(const particle_cache::ChunkHeader& header, const std::vector<std::uint8_t>& payload);
+
+    /// @brief Write raw bytes and advance the offset
+    void writeBytes(const void* data, std::size_t size);
+
+public:
+    /// @brief Create the file and start the background thread
+    /// @param path the path of the cache file
+    /// @param options the options
+    ParticleCacheWriter(const std::string& path, const Options& options);
+
+    /// @brief Write the pending frames and the index, then close the file
+    ~ParticleCacheWriter();
+
+    /// @brief No copying
+    ParticleCacheWriter(const ParticleCacheWriter& other) = delete;
+
+    /// @brief No copying
+    ParticleCacheWriter& operator=(const ParticleCacheWriter& other) = delete;
+
+    /// @brief Queue a frame for writing; the arrays are copied. Drops the frame if the
+    ///        queue is full, which keeps memory bounded when the disk is slow without
+    ///        stalling the simulation thread that takes the snapshots
+    /// @param frame the frame index
+    /// @param boundary the boundary of the grid
+    /// @param grid the grid the particles are sorted by
+    /// @param positions positions of particles; those with w = 0 are written as dead
+    /// @param velocities velocities of particles; may be null if velocities are not written
+    /// @param numParticles the number of particles
+    /// @param idOrdered whether particles are in ID order, which allows delta encoding
+    void write(std::uint64_t frame, const BoundingBox& boundary, const Grid& grid,
+        const glm::vec4* positions, const glm::vec4* velocities, int numParticles, bool idOrdered = false);
+
+    /// @brief Whether the file is open
+    inline bool available() const { return m_file.is_open(); }
+
+    /// @brief Return the number of frames dropped so far as the disk fell behind
+    int droppedFrames();
+};
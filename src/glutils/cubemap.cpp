@@ -12,6 +12,7 @@ Cubemap::~Cubemap()
 
 Cubemap::Cubemap(Cubemap&& other) noexcept
     : m_id{ other.m_id }
+    , m_memory{ std::move(other.m_memory) }
 {
     other.m_id = 0;
 }
@@ -19,6 +20,7 @@ Cubemap::Cubemap(Cubemap&& other) noexcept
 Cubemap& Cubemap::operator=(Cubemap&& other) noexcept
 {
     std::swap(m_id, other.m_id);
+    std::swap(m_memory, other.m_memory);
     return *this;
 }
 
@@ -26,7 +28,7 @@ Cubemap::Cubemap(
     const char* positiveX, const char* negativeX,
     const char* positiveY, const char* negativeY,
     const char* positiveZ, const char* negativeZ,
-    bool flipVertical)
+    bool flipVertical, const GpuMemory::Tag& tag)
 {
     glGenTextures(1, &m_id);
     glBindTexture(GL_TEXTURE_CUBE_MAP, m_id);
@@ -34,6 +36,7 @@ Cubemap::Cubemap(
     const char* images[]{
         positiveX, negativeX, positiveY, negativeY, positiveZ, negativeZ
     };
+    std::size_t bytes{ 0 };
     for (int i{ 0 }; i < 6; ++i)
     {
         std::cout << "Loading image " << images[i] << " ...\n";
@@ -67,25 +70,25 @@ Cubemap::Cubemap(
             GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, format,
             img.width(), img.height(), 0, format, GL_UNSIGNED_BYTE, img.data()
         );
+        bytes += static_cast<std::size_t>(img.width()) * img.height() * GpuMemory::texelBytes(format);
     }
 
     glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
     generateMipmap();
+    m_memory = GpuMemory::Allocation{ tag, bytes + bytes / 3 }; // with its mipmaps
 }
 
 void Cubemap::bind(GLuint textureUnit) const
 {
-    glActiveTexture(GL_TEXTURE0 + textureUnit);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, m_id);
+    glBindTextureUnit(textureUnit, m_id);
 }
 
 void Cubemap::generateMipmap() const
 {
-    bind();
-    glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameterf(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_ANISOTROPY, 8.0f);
+    glGenerateTextureMipmap(m_id);
+    glTextureParameteri(m_id, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTextureParameteri(m_id, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTextureParameterf(m_id, GL_TEXTURE_MAX_ANISOTROPY, 8.0f);
 }
 
 
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "gpu_memory.h"
+
 #include <glad/glad.h>
 
 /// @brief Wrapper class for OpenGL's cubemap texture
@@ -9,6 +11,9 @@ private:
     /// @brief ID of this cubemap texture; nonzero if initialized
     GLuint m_id{};
 
+    /// @brief The record of its memory
+    GpuMemory::Allocation m_memory{};
+
 public:
     /// @brief Default constructor; cubemap not usable
     Cubemap() = default;
@@ -30,11 +35,12 @@ public:
 
     /// @brief Create a cubemap from six images
     /// @param flipVertical true if images need to be flipped vertically
+    /// @param tag the owner and purpose its memory is accounted to
     Cubemap(
         const char* positiveX, const char* negativeX,
         const char* positiveY, const char* negativeY,
         const char* positiveZ, const char* negativeZ,
-        bool flipVertical = false
+        bool flipVertical = false, const GpuMemory::Tag& tag = {}
     );
 
     /// @brief Bind to a texture unit
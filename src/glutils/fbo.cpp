@@ -6,17 +6,24 @@ void FBO::bindDepthRenderBuffer()
 {
     if (!m_depthRenderBuffer)
     {
-        glGenRenderbuffers(1, &m_depthRenderBuffer);
-        glBindRenderbuffer(GL_RENDERBUFFER, m_depthRenderBuffer);
-        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, m_width, m_height);
+        glCreateRenderbuffers(1, &m_depthRenderBuffer);
     }
-    glBindFramebuffer(GL_FRAMEBUFFER, m_id);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_depthRenderBuffer);
+    if (m_depthWidth != m_width || m_depthHeight != m_height)
+    {
+        glNamedRenderbufferStorage(m_depthRenderBuffer, GL_DEPTH_COMPONENT, m_width, m_height);
+        m_depthMemory.resize(static_cast<std::size_t>(m_width) * m_height * GpuMemory::texelBytes(GL_DEPTH_COMPONENT));
+        m_depthWidth = m_width;
+        m_depthHeight = m_height;
+    }
+    glNamedFramebufferRenderbuffer(m_id, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_depthRenderBuffer);
+    m_complete = false;
 }
 
-FBO::FBO()
+FBO::FBO(const GpuMemory::Tag& tag)
+    : m_tag{ tag }
+    , m_depthMemory{ tag, 0 }
 {
-    glGenFramebuffers(1, &m_id);
+    glCreateFramebuffers(1, &m_id);
 }
 
 FBO::~FBO()
@@ -32,7 +39,6 @@ void FBO::bind(const Texture& texture)
         std::cerr << "Texture is not initialized!\n";
         return;
     }
-    glBindFramebuffer(GL_FRAMEBUFFER, m_id);
 
     GLenum attachment{};
     switch (texture.format())
@@ -40,16 +46,15 @@ void FBO::bind(const Texture& texture)
     case GL_RGB:
     case GL_RGBA:
         attachment = GL_COLOR_ATTACHMENT0;
-        //glDrawBuffer(attachment);
-        //glReadBuffer(attachment);
         break;
     case GL_DEPTH_COMPONENT:
         attachment = GL_DEPTH_ATTACHMENT;
         break;
     }
-    glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, texture, 0);
+    glNamedFramebufferTexture(m_id, attachment, texture, 0);
     m_width = texture.width();
     m_height = texture.height();
+    m_complete = false;
 }
 
 void FBO::disableDepthOutput()
@@ -59,17 +64,22 @@ void FBO::disableDepthOutput()
 
 void FBO::disableColorOutput()
 {
-    glDrawBuffer(GL_NONE);
-    glReadBuffer(GL_NONE);
+    glNamedFramebufferDrawBuffer(m_id, GL_NONE);
+    glNamedFramebufferReadBuffer(m_id, GL_NONE);
+    m_complete = false;
 }
 
 void FBO::activate()
 {
     glBindFramebuffer(GL_FRAMEBUFFER, m_id);
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    if (!m_complete)
     {
-        std::cerr << "Framebuffer is not complete!\n";
-        return;
+        m_complete = glCheckNamedFramebufferStatus(m_id, GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        if (!m_complete)
+        {
+            std::cerr << "Framebuffer is not complete!\n";
+            return;
+        }
     }
     glViewport(0, 0, m_width, m_height);
 }
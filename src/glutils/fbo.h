@@ -1,6 +1,7 @@
 #pragma once
 
 #include "texture.h"
+#include "gpu_memory.h"
 
 /// @brief Wrapper for OpenGL's frame buffer object
 class FBO
@@ -12,18 +13,32 @@ private:
     /// @brief ID of depth render buffer; created if no depth attachment
     GLuint m_depthRenderBuffer{};
 
+    /// @brief Size of the depth render buffer
+    int m_depthWidth{};
+    int m_depthHeight{};
+
+    /// @brief The owner and purpose the memory of the render buffer is accounted to
+    GpuMemory::Tag m_tag{};
+
+    /// @brief The record of the memory of the render buffer
+    GpuMemory::Allocation m_depthMemory{};
+
     /// @brief Width of last bind texture
     int m_width{};
 
     /// @brief Height of last bind texture
     int m_height{};
 
-    /// @brief Bind the render buffer as depth attachment
+    /// @brief Whether the attachments were found complete since they last changed
+    bool m_complete{};
+
+    /// @brief Bind the render buffer as depth attachment, resizing it to the last bind texture
     void bindDepthRenderBuffer();
 
 public:
     /// @brief Create a framebuffer
-    FBO();
+    /// @param tag the owner and purpose the memory of its depth render buffer is accounted to
+    explicit FBO(const GpuMemory::Tag& tag = {});
 
     /// @brief Delete the object on GPU
     ~FBO();
@@ -43,7 +58,7 @@ public:
     /// @brief Disable color output
     void disableColorOutput();
 
-    /// @brief Activate framebuffer; will check availability
+    /// @brief Activate framebuffer; checks availability once after the attachments change
     void activate();
 
     /// @brief Change to default framebuffer
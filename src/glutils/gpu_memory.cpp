@@ -0,0 +1,216 @@
+#include "gpu_memory.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <utility>
+
+namespace
+{
+    /// @brief Queries of GL_NVX_gpu_memory_info and GL_ATI_meminfo, which glad does not load
+    constexpr GLenum currentAvailableVidmemNvx{ 0x9049 };
+    constexpr GLenum textureFreeMemoryAti{ 0x87FC };
+
+    /// @brief Live and peak bytes of some allocations
+    struct Counter
+    {
+        std::size_t liveBytes{};
+        std::size_t peakBytes{};
+        int allocations{};
+
+        void add(std::size_t added, std::size_t removed, int count)
+        {
+            liveBytes = liveBytes + added - removed;
+            peakBytes = std::max(peakBytes, liveBytes);
+            allocations += count;
+        }
+    };
+
+    /// @brief The counters of every owner and purpose, shared by the simulation and render
+    ///        threads
+    struct Registry
+    {
+        std::mutex mutex{};
+        std::map<std::string, Counter> owners{};
+        std::map<std::pair<std::string, std::string>, Counter> purposes{};
+        Counter total{};
+    };
+
+    // never destroyed, so resources released during exit can still be recorded
+    Registry& registry()
+    {
+        static Registry* registry{ new Registry{} };
+        return *registry;
+    }
+
+    /// @brief Record an allocation changing size from removed to added bytes
+    void record(const GpuMemory::Tag& tag, std::size_t added, std::size_t removed)
+    {
+        if (added == removed)
+        {
+            return;
+        }
+        int count{ (added > 0 ? 1 : 0) - (removed > 0 ? 1 : 0) };
+        Registry& r{ registry() };
+        std::lock_guard lock{ r.mutex };
+        r.owners[tag.owner].add(added, removed, count);
+        r.purposes[{ tag.owner, tag.purpose }].add(added, removed, count);
+        r.total.add(added, removed, count);
+    }
+
+    bool hasExtension(const char* name)
+    {
+        GLint numExtensions{};
+        glGetIntegerv(GL_NUM_EXTENSIONS, &numExtensions);
+        for (GLint i{ 0 }; i < numExtensions; ++i)
+        {
+            const char* extension{ reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i)) };
+            if (extension && std::strcmp(extension, name) == 0)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+}
+
+GpuMemory::Allocation::Allocation(const Tag& tag, std::size_t bytes)
+    : m_tag{ tag }
+    , m_bytes{ bytes }
+{
+    record(m_tag, m_bytes, 0);
+}
+
+GpuMemory::Allocation::~Allocation()
+{
+    record(m_tag, 0, m_bytes);
+}
+
+GpuMemory::Allocation::Allocation(Allocation&& other) noexcept
+    : m_tag{ other.m_tag }
+    , m_bytes{ other.m_bytes }
+{
+    other.m_bytes = 0;
+}
+
+GpuMemory::Allocation& GpuMemory::Allocation::operator=(Allocation&& other) noexcept
+{
+    std::swap(m_tag, other.m_tag);
+    std::swap(m_bytes, other.m_bytes);
+    return *this;
+}
+
+void GpuMemory::Allocation::resize(std::size_t bytes)
+{
+    record(m_tag, bytes, m_bytes);
+    m_bytes = bytes;
+}
+
+std::vector<GpuMemory::Usage> GpuMemory::usage()
+{
+    Registry& r{ registry() };
+    std::lock_guard lock{ r.mutex };
+    std::vector<Usage> usage{};
+    for (const auto& [owner, counter] : r.owners)
+    {
+        usage.push_back(Usage{ owner, "", counter.liveBytes, counter.peakBytes, counter.allocations });
+        for (auto it{ r.purposes.lower_bound({ owner, "" }) }; it != r.purposes.end() && it->first.first == owner; ++it)
+        {
+            usage.push_back(Usage{ owner, it->first.second, it->second.liveBytes, it->second.peakBytes, it->second.allocations });
+        }
+    }
+    return usage;
+}
+
+std::size_t GpuMemory::liveBytes(const char* owner)
+{
+    Registry& r{ registry() };
+    std::lock_guard lock{ r.mutex };
+    if (!owner)
+    {
+        return r.total.liveBytes;
+    }
+    auto it{ r.owners.find(owner) };
+    return it != r.owners.end() ? it->second.liveBytes : 0;
+}
+
+std::size_t GpuMemory::peakBytes(const char* owner)
+{
+    Registry& r{ registry() };
+    std::lock_guard lock{ r.mutex };
+    if (!owner)
+    {
+        return r.total.peakBytes;
+    }
+    auto it{ r.owners.find(owner) };
+    return it != r.owners.end() ? it->second.peakBytes : 0;
+}
+
+std::size_t GpuMemory::availableBytes()
+{
+    // both report kilobytes
+    if (hasExtension("GL_NVX_gpu_memory_info"))
+    {
+        GLint kilobytes{};
+        glGetIntegerv(currentAvailableVidmemNvx, &kilobytes);
+        return static_cast<std::size_t>(kilobytes) * 1024;
+    }
+    if (hasExtension("GL_ATI_meminfo"))
+    {
+        GLint info[4]{}; // the total free, the largest free block and the same of auxiliary memory
+        glGetIntegerv(textureFreeMemoryAti, info);
+        return static_cast<std::size_t>(info[0]) * 1024;
+    }
+    return 0;
+}
+
+void GpuMemory::report(std::ostream& out)
+{
+    // the format of the stream is restored afterwards
+    std::ios_base::fmtflags flags{ out.flags() };
+    std::streamsize precision{ out.precision() };
+    auto megabytes{ [](std::size_t bytes) { return bytes / double(1 << 20); } };
+    auto row{ [&](const std::string& name, std::size_t live, std::size_t peak)
+        {
+            out << std::left << std::setw(24) << name << std::right << std::fixed << std::setprecision(1)
+                << std::setw(12) << megabytes(live) << std::setw(12) << megabytes(peak) << '\n';
+        } };
+
+    out << std::left << std::setw(24) << "GPU memory" << std::right << std::setw(12) << "live MiB" << std::setw(12) << "peak MiB" << '\n';
+    for (const Usage& usage : GpuMemory::usage())
+    {
+        row(usage.purpose.empty() ? usage.owner : "  " + usage.purpose, usage.liveBytes, usage.peakBytes);
+    }
+    row("total", liveBytes(), peakBytes());
+    std::size_t available{ availableBytes() };
+    if (available > 0)
+    {
+        out << std::left << std::setw(24) << "free on GPU" << std::right << std::setw(12) << megabytes(available) << '\n';
+    }
+    out.flags(flags);
+    out.precision(precision);
+}
+
+std::size_t GpuMemory::texelBytes(GLenum internalFormat)
+{
+    switch (internalFormat)
+    {
+    case GL_RED:
+    case GL_R8:
+        return 1;
+    case GL_RG:
+    case GL_RG8:
+    case GL_R16F:
+        return 2;
+    case GL_RGBA16F:
+    case GL_RG32F:
+        return 8;
+    case GL_RGBA32F:
+        return 16;
+    default:
+        // RGB, RGBA, R32F, RG16F and depth, which drivers store in 24 or 32 bits
+        return 4;
+    }
+}
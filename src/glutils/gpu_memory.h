@@ -0,0 +1,97 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/// @brief Accounts for the memory of GPU resources. Every buffer, texture and render buffer
+///        is tagged with the subsystem that owns it and what it is for, and live and peak
+///        bytes are kept per tag, per owner and in total, from any thread. Sizes are those
+///        requested; drivers may pad or compress them.
+class GpuMemory
+{
+public:
+    /// @brief The owner and purpose of an allocation; both must outlive it, e.g. literals
+    struct Tag
+    {
+        const char* owner{ "untagged" };
+        const char* purpose{ "untagged" };
+    };
+
+    /// @brief Memory of an owner, or of one purpose of it
+    struct Usage
+    {
+        std::string owner{};
+
+        /// @brief Empty for the total of the owner
+        std::string purpose{};
+
+        std::size_t liveBytes{};
+        std::size_t peakBytes{};
+        int allocations{};
+    };
+
+    /// @brief The record of one allocation, held by the resource that made it and dropped
+    ///        with it
+    class Allocation
+    {
+    private:
+        Tag m_tag{};
+        std::size_t m_bytes{};
+
+    public:
+        /// @brief Default constructor; records nothing
+        Allocation() = default;
+
+        /// @brief Record an allocation
+        Allocation(const Tag& tag, std::size_t bytes);
+
+        /// @brief Drop the record
+        ~Allocation();
+
+        /// @brief No copying
+        Allocation(const Allocation& other) = delete;
+
+        /// @brief No copying
+        Allocation& operator=(const Allocation& other) = delete;
+
+        /// @brief Move constructor
+        Allocation(Allocation&& other) noexcept;
+
+        /// @brief Move assignment
+        Allocation& operator=(Allocation&& other) noexcept;
+
+        /// @brief Record a new size, e.g. after mipmaps are added
+        void resize(std::size_t bytes);
+
+        /// @brief Return the size in bytes
+        inline std::size_t bytes() const { return m_bytes; }
+
+        /// @brief Return the tag
+        inline const Tag& tag() const { return m_tag; }
+    };
+
+    /// @brief Return the usage of every owner followed by that of its purposes, by owner
+    static std::vector<Usage> usage();
+
+    /// @brief Return the bytes allocated now, of all owners or of one
+    static std::size_t liveBytes(const char* owner = nullptr);
+
+    /// @brief Return the most bytes allocated at once, of all owners or of one
+    static std::size_t peakBytes(const char* owner = nullptr);
+
+    /// @brief Return the memory the driver reports free on the GPU of the current context,
+    ///        through GL_NVX_gpu_memory_info or GL_ATI_meminfo; 0 if neither is supported
+    static std::size_t availableBytes();
+
+    /// @brief Print live and peak megabytes per owner and purpose, the total and the free
+    ///        memory if known; needs a current context for the latter
+    static void report(std::ostream& out);
+
+    /// @brief Return the bytes of a texel of an internal format; unsized formats are taken
+    ///        as 8 bits per channel, and RGB as padded to four channels like most drivers do
+    static std::size_t texelBytes(GLenum internalFormat);
+};
\ No newline at end of file
@@ -0,0 +1,112 @@
+#include "gpu_timer.h"
+
+#include <utility>
+
+void GpuTimer::release()
+{
+    for (Slot& slot : m_slots)
+    {
+        glDeleteQueries(1, &slot.query);
+    }
+    m_slots.clear();
+}
+
+GpuTimer::GpuTimer(int numSlots)
+    : m_slots(numSlots)
+{
+    for (Slot& slot : m_slots)
+    {
+        glGenQueries(1, &slot.query);
+    }
+}
+
+GpuTimer::~GpuTimer()
+{
+    if (m_measuring)
+    {
+        glEndQuery(GL_TIME_ELAPSED);
+    }
+    release();
+}
+
+GpuTimer::GpuTimer(GpuTimer&& other) noexcept
+    : m_slots{ std::move(other.m_slots) }
+    , m_next{ other.m_next }
+    , m_oldest{ other.m_oldest }
+    , m_measuring{ other.m_measuring }
+{
+    other.m_slots.clear();
+    other.m_measuring = false;
+}
+
+GpuTimer& GpuTimer::operator=(GpuTimer&& other) noexcept
+{
+    std::swap(m_slots, other.m_slots);
+    std::swap(m_next, other.m_next);
+    std::swap(m_oldest, other.m_oldest);
+    std::swap(m_measuring, other.m_measuring);
+    return *this;
+}
+
+bool GpuTimer::begin()
+{
+    if (m_slots.empty() || m_measuring || m_slots[m_next].inFlight)
+    {
+        return false; // all queries in flight; drop this measurement rather than wait
+    }
+
+    glBeginQuery(GL_TIME_ELAPSED, m_slots[m_next].query);
+    m_measuring = true;
+    return true;
+}
+
+void GpuTimer::end()
+{
+    if (!m_measuring)
+    {
+        return;
+    }
+
+    glEndQuery(GL_TIME_ELAPSED);
+    m_slots[m_next].inFlight = true;
+    m_next = (m_next + 1) % static_cast<int>(m_slots.size());
+    m_measuring = false;
+}
+
+bool GpuTimer::poll(double& seconds)
+{
+    bool finished{ false };
+    while (!m_slots.empty() && m_slots[m_oldest].inFlight)
+    {
+        Slot& slot{ m_slots[m_oldest] };
+        GLint available{};
+        glGetQueryObjectiv(slot.query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+        {
+            break;
+        }
+
+        GLuint64 nanoseconds{};
+        glGetQueryObjectui64v(slot.query, GL_QUERY_RESULT, &nanoseconds);
+        seconds = nanoseconds * 1e-9;
+        finished = true;
+        slot.inFlight = false;
+        m_oldest = (m_oldest + 1) % static_cast<int>(m_slots.size());
+    }
+    return finished;
+}
+
+double GpuTimer::finish()
+{
+    double seconds{ 0.0 };
+    while (!m_slots.empty() && m_slots[m_oldest].inFlight)
+    {
+        Slot& slot{ m_slots[m_oldest] };
+        GLuint64 nanoseconds{};
+        glGetQueryObjectui64v(slot.query, GL_QUERY_RESULT, &nanoseconds);
+        seconds += nanoseconds * 1e-9;
+        slot.inFlight = false;
+        m_oldest = (m_oldest + 1) % static_cast<int>(m_slots.size());
+    }
+    return seconds;
+}
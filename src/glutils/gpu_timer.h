@@ -0,0 +1,78 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <vector>
+
+/// @brief A ring of timer queries measuring GPU time between two points of a frame
+///        without stalling. A measurement is read once the GPU finished it, usually a
+///        frame or two later
+class GpuTimer
+{
+private:
+    /// @brief One query of the ring
+    struct Slot
+    {
+        /// @brief ID of the query
+        GLuint query{};
+
+        /// @brief Whether the query was issued and not read yet
+        bool inFlight{};
+    };
+
+    /// @brief The slots
+    std::vector<Slot> m_slots{};
+
+    /// @brief The slot for the next measurement
+    int m_next{};
+
+    /// @brief The slot of the oldest measurement in flight
+    int m_oldest{};
+
+    /// @brief Whether a measurement was begun and not ended
+    bool m_measuring{};
+
+    /// @brief Delete the queries
+    void release();
+
+public:
+    /// @brief Default constructor; not usable
+    GpuTimer() = default;
+
+    /// @brief Create a ring of queries
+    GpuTimer(int numSlots);
+
+    /// @brief Delete the queries on GPU
+    ~GpuTimer();
+
+    /// @brief No copying
+    GpuTimer(const GpuTimer& other) = delete;
+
+    /// @brief No copying
+    GpuTimer& operator=(const GpuTimer& other) = delete;
+
+    /// @brief Move constructor
+    GpuTimer(GpuTimer&& other) noexcept;
+
+    /// @brief Move assignment
+    GpuTimer& operator=(GpuTimer&& other) noexcept;
+
+    /// @brief Start measuring; no other time elapsed query may be active
+    /// @return false if every query is still in flight and this measurement is dropped
+    bool begin();
+
+    /// @brief Stop measuring
+    void end();
+
+    /// @brief Read finished measurements in order; never waits for GPU
+    /// @param seconds set to the GPU time of the latest finished measurement
+    /// @return whether any measurement finished
+    bool poll(double& seconds);
+
+    /// @brief Wait for every measurement in flight, e.g. to sum many short ones
+    /// @return the sum of their GPU times in s
+    double finish();
+
+    /// @brief Whether this timer is available
+    inline bool available() const { return !m_slots.empty(); }
+};
@@ -0,0 +1,160 @@
+#include "pass_descriptor.h"
+
+#include <algorithm>
+#include <array>
+
+void PassDescriptor::addBuffer(const BufferBinding& binding)
+{
+    auto position{ std::lower_bound(m_buffers.begin(), m_buffers.end(), binding,
+        [](const BufferBinding& a, const BufferBinding& b) { return a.target != b.target ? a.target < b.target : a.index < b.index; }) };
+    if (position != m_buffers.end() && position->target == binding.target && position->index == binding.index)
+    {
+        *position = binding;
+        return;
+    }
+    m_buffers.insert(position, binding);
+}
+
+void PassDescriptor::addTexture(const TextureBinding& binding)
+{
+    auto position{ std::lower_bound(m_textures.begin(), m_textures.end(), binding,
+        [](const TextureBinding& a, const TextureBinding& b) { return a.unit < b.unit; }) };
+    if (position != m_textures.end() && position->unit == binding.unit)
+    {
+        *position = binding;
+        return;
+    }
+    m_textures.insert(position, binding);
+}
+
+void PassDescriptor::bindBuffers() const
+{
+    // the binding points of a stage are limited, so runs are short
+    constexpr std::size_t maxRun{ 16 };
+    std::array<GLuint, maxRun> ids{};
+    for (std::size_t i{ 0 }; i < m_buffers.size();)
+    {
+        const BufferBinding& first{ m_buffers[i] };
+        if (first.size != 0)
+        {
+            glBindBufferRange(first.target, first.index, first.buffer.id(first.buffer.object), first.offset, first.size);
+            ++i;
+            continue;
+        }
+        std::size_t count{ 0 };
+        while (i + count < m_buffers.size() && count < maxRun)
+        {
+            const BufferBinding& next{ m_buffers[i + count] };
+            if (next.size != 0 || next.target != first.target || next.index != first.index + count)
+            {
+                break;
+            }
+            ids[count++] = next.buffer.id(next.buffer.object);
+        }
+        glBindBuffersBase(first.target, first.index, static_cast<GLsizei>(count), ids.data());
+        i += count;
+    }
+}
+
+void PassDescriptor::bindTextures() const
+{
+    constexpr std::size_t maxRun{ 16 };
+    std::array<GLuint, maxRun> ids{};
+    for (std::size_t i{ 0 }; i < m_textures.size();)
+    {
+        GLuint firstUnit{ m_textures[i].unit };
+        std::size_t count{ 0 };
+        while (i + count < m_textures.size() && count < maxRun && m_textures[i + count].unit == firstUnit + count)
+        {
+            const Object& texture{ m_textures[i + count].texture };
+            ids[count++] = texture.id(texture.object);
+        }
+        glBindTextures(firstUnit, static_cast<GLsizei>(count), ids.data());
+        i += count;
+    }
+}
+
+PassDescriptor::PassDescriptor(const ShaderProgram& program)
+    : m_program{ &program }
+{
+}
+
+PassDescriptor& PassDescriptor::storage(GLuint index, const SSBO& buffer, GLintptr offset, GLsizeiptr size)
+{
+    addBuffer(BufferBinding{ GL_SHADER_STORAGE_BUFFER, index, objectOf(buffer), offset, size });
+    return *this;
+}
+
+PassDescriptor& PassDescriptor::uniformBlock(GLuint index, const SSBO& buffer, GLintptr offset, GLsizeiptr size)
+{
+    addBuffer(BufferBinding{ GL_UNIFORM_BUFFER, index, objectOf(buffer), offset, size });
+    return *this;
+}
+
+PassDescriptor& PassDescriptor::texture(GLuint unit, const Texture& texture)
+{
+    addTexture(TextureBinding{ unit, objectOf(texture) });
+    return *this;
+}
+
+PassDescriptor& PassDescriptor::texture(GLuint unit, const Cubemap& cubemap)
+{
+    addTexture(TextureBinding{ unit, objectOf(cubemap) });
+    return *this;
+}
+
+PassDescriptor& PassDescriptor::texture(GLuint unit, const Texture3D& texture)
+{
+    addTexture(TextureBinding{ unit, objectOf(texture) });
+    return *this;
+}
+
+PassDescriptor& PassDescriptor::image(GLuint unit, const Texture& texture, GLenum access)
+{
+    m_images.push_back(ImageBinding{ unit, &texture, access });
+    return *this;
+}
+
+PassDescriptor& PassDescriptor::buffer(GLenum target, const SSBO& buffer)
+{
+    m_targetBuffers.push_back(TargetBinding{ target, objectOf(buffer) });
+    return *this;
+}
+
+PassDescriptor& PassDescriptor::vertexArray(const VAO& vertexArray)
+{
+    m_vertexArray = &vertexArray;
+    return *this;
+}
+
+PassDescriptor& PassDescriptor::target(FBO& framebuffer)
+{
+    m_target = &framebuffer;
+    return *this;
+}
+
+void PassDescriptor::bind() const
+{
+    if (m_program)
+    {
+        m_program->activate();
+    }
+    bindBuffers();
+    bindTextures();
+    for (const ImageBinding& image : m_images)
+    {
+        image.texture->bindImage(image.unit, image.access);
+    }
+    for (const TargetBinding& binding : m_targetBuffers)
+    {
+        glBindBuffer(binding.target, binding.buffer.id(binding.buffer.object));
+    }
+    if (m_vertexArray)
+    {
+        m_vertexArray->activate();
+    }
+    if (m_target)
+    {
+        m_target->activate();
+    }
+}
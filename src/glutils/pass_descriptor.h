@@ -0,0 +1,149 @@
+#pragma once
+
+#include "shader_program.h"
+#include "ssbo.h"
+#include "texture.h"
+#include "texture3d.h"
+#include "cubemap.h"
+#include "fbo.h"
+#include "vao.h"
+
+#include <glad/glad.h>
+
+#include <vector>
+
+/// @brief The state a pass binds before it draws or dispatches: a program, buffer ranges,
+///        uniform blocks, textures, images, indirect buffers, a vertex array and a target.
+///        It is recorded once and bound with as few calls as possible every time the pass
+///        runs. The objects are recorded rather than their IDs, so buffers swapped or
+///        reallocated and textures resized by move assignment are bound as they are when
+///        the pass runs; the objects must outlive the descriptor.
+class PassDescriptor
+{
+private:
+    /// @brief An object whose ID is read when the pass is bound
+    struct Object
+    {
+        const void* object{};
+        GLuint(*id)(const void* object) {};
+    };
+
+    /// @brief A buffer bound to an indexed target
+    struct BufferBinding
+    {
+        GLenum target{};
+        GLuint index{};
+        Object buffer{};
+        GLintptr offset{};
+        GLsizeiptr size{}; // the whole buffer if zero
+    };
+
+    /// @brief A texture bound to a texture unit
+    struct TextureBinding
+    {
+        GLuint unit{};
+        Object texture{};
+    };
+
+    /// @brief Level 0 of a texture bound to an image unit
+    struct ImageBinding
+    {
+        GLuint unit{};
+        const Texture* texture{};
+        GLenum access{};
+    };
+
+    /// @brief A buffer bound to a non-indexed target, such as the indirect dispatch buffer
+    struct TargetBinding
+    {
+        GLenum target{};
+        Object buffer{};
+    };
+
+    /// @brief The program; none if null
+    const ShaderProgram* m_program{};
+
+    /// @brief The vertex array; none if null
+    const VAO* m_vertexArray{};
+
+    /// @brief The framebuffer drawn into; the current one if null
+    FBO* m_target{};
+
+    /// @brief Buffers in the order of their target and index, so adjacent ones are bound together
+    std::vector<BufferBinding> m_buffers{};
+
+    /// @brief Textures in the order of their unit
+    std::vector<TextureBinding> m_textures{};
+
+    /// @brief Images
+    std::vector<ImageBinding> m_images{};
+
+    /// @brief Buffers of non-indexed targets
+    std::vector<TargetBinding> m_targetBuffers{};
+
+    /// @brief Refer to an object that converts to its ID
+    template <typename T>
+    static Object objectOf(const T& object)
+    {
+        return Object{ &object, [](const void* pointer) { return static_cast<GLuint>(*static_cast<const T*>(pointer)); } };
+    }
+
+    /// @brief Record a buffer of an indexed target, replacing the one recorded at the index
+    void addBuffer(const BufferBinding& binding);
+
+    /// @brief Record a texture, replacing the one recorded at the unit
+    void addTexture(const TextureBinding& binding);
+
+    /// @brief Bind the recorded buffers, those of adjacent indices in one call
+    void bindBuffers() const;
+
+    /// @brief Bind the recorded textures, those of adjacent units in one call
+    void bindTextures() const;
+
+public:
+    /// @brief Create an empty descriptor, which binds nothing
+    PassDescriptor() = default;
+
+    /// @brief Create a descriptor of a pass running the program
+    explicit PassDescriptor(const ShaderProgram& program);
+
+    /// @brief Record a shader storage buffer
+    /// @param index the binding index
+    /// @param buffer the buffer
+    /// @param offset the offset in bytes of the range bound
+    /// @param size the size in bytes of the range bound; the whole buffer if zero
+    PassDescriptor& storage(GLuint index, const SSBO& buffer, GLintptr offset = 0, GLsizeiptr size = 0);
+
+    /// @brief Record a uniform buffer
+    /// @param index the binding index
+    /// @param buffer the buffer
+    /// @param offset the offset in bytes of the range bound
+    /// @param size the size in bytes of the range bound; the whole buffer if zero
+    PassDescriptor& uniformBlock(GLuint index, const SSBO& buffer, GLintptr offset = 0, GLsizeiptr size = 0);
+
+    /// @brief Record a texture
+    PassDescriptor& texture(GLuint unit, const Texture& texture);
+
+    /// @brief Record a cubemap
+    PassDescriptor& texture(GLuint unit, const Cubemap& cubemap);
+
+    /// @brief Record a 3D texture
+    PassDescriptor& texture(GLuint unit, const Texture3D& texture);
+
+    /// @brief Record level 0 of a texture as an image; needs a sized internal format
+    /// @param access GL_READ_ONLY, GL_WRITE_ONLY or GL_READ_WRITE
+    PassDescriptor& image(GLuint unit, const Texture& texture, GLenum access);
+
+    /// @brief Record the buffer of a non-indexed target
+    /// @param target such as GL_DISPATCH_INDIRECT_BUFFER or GL_DRAW_INDIRECT_BUFFER
+    PassDescriptor& buffer(GLenum target, const SSBO& buffer);
+
+    /// @brief Record the vertex array
+    PassDescriptor& vertexArray(const VAO& vertexArray);
+
+    /// @brief Record the framebuffer drawn into, which also sets the viewport
+    PassDescriptor& target(FBO& framebuffer);
+
+    /// @brief Bind everything recorded
+    void bind() const;
+};
\ No newline at end of file
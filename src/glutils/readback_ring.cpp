@@ -0,0 +1,137 @@
+#include "readback_ring.h"
+
+#include <iostream>
+#include <utility>
+
+void ReadbackRing::release()
+{
+    for (Slot& slot : m_slots)
+    {
+        if (slot.fence)
+        {
+            glDeleteSync(slot.fence);
+        }
+        if (slot.buffer)
+        {
+            glUnmapNamedBuffer(slot.buffer);
+            glDeleteBuffers(1, &slot.buffer);
+        }
+    }
+    m_slots.clear();
+    m_memory.resize(0);
+}
+
+ReadbackRing::ReadbackRing(GLsizeiptr size, int numSlots, const GpuMemory::Tag& tag)
+    : m_slots(numSlots)
+    , m_size{ size }
+    , m_memory{ tag, static_cast<std::size_t>(size) * numSlots }
+{
+    constexpr GLbitfield flags{ GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT };
+    for (Slot& slot : m_slots)
+    {
+        glCreateBuffers(1, &slot.buffer);
+        glNamedBufferStorage(slot.buffer, size, nullptr, flags | GL_CLIENT_STORAGE_BIT);
+        slot.data = glMapNamedBufferRange(slot.buffer, 0, size, flags);
+        if (!slot.data)
+        {
+            std::cerr << "Failed to map readback buffer!\n";
+            release();
+            return;
+        }
+    }
+}
+
+ReadbackRing::~ReadbackRing()
+{
+    release();
+}
+
+ReadbackRing::ReadbackRing(ReadbackRing&& other) noexcept
+    : m_slots{ std::move(other.m_slots) }
+    , m_size{ other.m_size }
+    , m_next{ other.m_next }
+    , m_oldest{ other.m_oldest }
+    , m_memory{ std::move(other.m_memory) }
+{
+    other.m_slots.clear();
+}
+
+ReadbackRing& ReadbackRing::operator=(ReadbackRing&& other) noexcept
+{
+    std::swap(m_slots, other.m_slots);
+    std::swap(m_size, other.m_size);
+    std::swap(m_next, other.m_next);
+    std::swap(m_oldest, other.m_oldest);
+    std::swap(m_memory, other.m_memory);
+    return *this;
+}
+
+bool ReadbackRing::capture(std::initializer_list<Copy> copies, std::uint64_t tag)
+{
+    if (m_slots.empty())
+    {
+        return false;
+    }
+
+    Slot& slot{ m_slots[m_next] };
+    if (slot.fence)
+    {
+        return false; // all slots in flight; drop this capture rather than wait
+    }
+
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    for (const Copy& copy : copies)
+    {
+        glCopyNamedBufferSubData(copy.buffer, slot.buffer, copy.srcOffset, copy.dstOffset, copy.size);
+    }
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.tag = tag;
+    m_next = (m_next + 1) % static_cast<int>(m_slots.size());
+    return true;
+}
+
+int ReadbackRing::poll(const Callback& callback)
+{
+    int delivered{ 0 };
+    while (!m_slots.empty() && m_slots[m_oldest].fence)
+    {
+        Slot& slot{ m_slots[m_oldest] };
+        GLenum status{ glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0) };
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+        {
+            break;
+        }
+
+        glDeleteSync(slot.fence);
+        slot.fence = 0;
+        callback(slot.data, slot.tag);
+        m_oldest = (m_oldest + 1) % static_cast<int>(m_slots.size());
+        ++delivered;
+    }
+    return delivered;
+}
+
+int ReadbackRing::finish(const Callback& callback)
+{
+    int delivered{ 0 };
+    while (!m_slots.empty() && m_slots[m_oldest].fence)
+    {
+        Slot& slot{ m_slots[m_oldest] };
+        GLenum status{ GL_TIMEOUT_EXPIRED };
+        while (status == GL_TIMEOUT_EXPIRED)
+        {
+            status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1'000'000);
+        }
+        if (status == GL_WAIT_FAILED)
+        {
+            break;
+        }
+
+        glDeleteSync(slot.fence);
+        slot.fence = 0;
+        callback(slot.data, slot.tag);
+        m_oldest = (m_oldest + 1) % static_cast<int>(m_slots.size());
+        ++delivered;
+    }
+    return delivered;
+}
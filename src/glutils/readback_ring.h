@@ -0,0 +1,117 @@
+#pragma once
+
+#include "gpu_memory.h"
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <vector>
+
+/// @brief A ring of persistently mapped buffers for reading data back from GPU
+///        without stalling. Each capture copies buffer ranges into a free slot and
+///        places a fence; a capture is delivered once its fence is signaled.
+class ReadbackRing
+{
+public:
+    /// @brief A range of a buffer to be copied in a capture
+    struct Copy
+    {
+        /// @brief The source buffer ID
+        GLuint buffer;
+
+        /// @brief The offset in the source buffer
+        GLintptr srcOffset;
+
+        /// @brief The offset in the slot
+        GLintptr dstOffset;
+
+        /// @brief The number of bytes
+        GLsizeiptr size;
+    };
+
+    /// @brief Callback for a finished capture; data is only valid during the call
+    using Callback = std::function<void(const void* data, std::uint64_t tag)>;
+
+private:
+    /// @brief One buffer of the ring
+    struct Slot
+    {
+        /// @brief ID of the buffer
+        GLuint buffer{};
+
+        /// @brief The persistently mapped pointer
+        const void* data{};
+
+        /// @brief The fence placed after copying; nonzero while in flight
+        GLsync fence{};
+
+        /// @brief User tag of the capture
+        std::uint64_t tag{};
+    };
+
+    /// @brief The slots
+    std::vector<Slot> m_slots{};
+
+    /// @brief The size of each slot in bytes
+    GLsizeiptr m_size{};
+
+    /// @brief The slot for the next capture
+    int m_next{};
+
+    /// @brief The slot of the oldest capture in flight
+    int m_oldest{};
+
+    /// @brief The record of the memory of the slots
+    GpuMemory::Allocation m_memory{};
+
+    /// @brief Delete the buffers and fences
+    void release();
+
+public:
+    /// @brief Default constructor; not usable
+    ReadbackRing() = default;
+
+    /// @brief Create a ring of slots with the given size in bytes
+    /// @param tag the owner and purpose the memory of the slots is accounted to
+    ReadbackRing(GLsizeiptr size, int numSlots = 3, const GpuMemory::Tag& tag = {});
+
+    /// @brief Delete the buffers and fences on GPU
+    ~ReadbackRing();
+
+    /// @brief No copying
+    ReadbackRing(const ReadbackRing& other) = delete;
+
+    /// @brief No copying
+    ReadbackRing& operator=(const ReadbackRing& other) = delete;
+
+    /// @brief Move constructor
+    ReadbackRing(ReadbackRing&& other) noexcept;
+
+    /// @brief Move assignment
+    ReadbackRing& operator=(ReadbackRing&& other) noexcept;
+
+    /// @brief Copy the ranges into the next slot
+    /// @param copies the ranges to be copied
+    /// @param tag user tag passed back to the callback
+    /// @return false if every slot is still in flight and the capture is dropped
+    bool capture(std::initializer_list<Copy> copies, std::uint64_t tag);
+
+    /// @brief Deliver finished captures in order; never waits for GPU
+    /// @param callback called once for each finished capture
+    /// @return the number of captures delivered
+    int poll(const Callback& callback);
+
+    /// @brief Deliver every capture in flight in order, waiting for GPU where needed; for
+    ///        data needed right away that was captured well ahead of it
+    /// @param callback called once for each capture
+    /// @return the number of captures delivered
+    int finish(const Callback& callback);
+
+    /// @brief The size of each slot in bytes
+    inline GLsizeiptr size() const { return m_size; }
+
+    /// @brief Whether this ring is available
+    inline bool available() const { return !m_slots.empty(); }
+};
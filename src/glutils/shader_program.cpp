@@ -3,8 +3,10 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include <iostream>
+#include <filesystem>
 #include <fstream>
 #include <sstream>
+#include <string_view>
 
 std::string ShaderProgram::readFile(const char* filepath)
 {
@@ -19,11 +21,52 @@ std::string ShaderProgram::readFile(const char* filepath)
     return content.str();
 }
 
-GLuint ShaderProgram::compileShader(GLenum shaderType, const char* shaderPath)
+std::string ShaderProgram::readSource(const char* filepath, const std::vector<std::string>& defines)
+{
+    constexpr int maxIncludeDepth{ 8 };
+    std::filesystem::path path{ filepath };
+    std::string source{ readFile(filepath) };
+
+    for (int depth{ 0 }; depth < maxIncludeDepth && source.find("#include") != std::string::npos; ++depth)
+    {
+        std::istringstream input{ source };
+        std::ostringstream output{};
+        for (std::string line{}; std::getline(input, line);)
+        {
+            std::size_t open{ line.find('"') };
+            std::size_t close{ line.rfind('"') };
+            if (line.rfind("#include", 0) == 0 && open != std::string::npos && close > open)
+            {
+                std::filesystem::path included{ path.parent_path() / line.substr(open + 1, close - open - 1) };
+                output << readFile(included.string().c_str()) << '\n';
+            }
+            else
+            {
+                output << line << '\n';
+            }
+        }
+        source = output.str();
+    }
+
+    if (!defines.empty())
+    {
+        std::size_t version{ source.find("#version") };
+        std::size_t lineEnd{ version == std::string::npos ? 0 : source.find('\n', version) + 1 };
+        std::string preamble{};
+        for (const std::string& define : defines)
+        {
+            preamble += "#define " + define + '\n';
+        }
+        source.insert(lineEnd, preamble);
+    }
+    return source;
+}
+
+GLuint ShaderProgram::compileShader(GLenum shaderType, const char* shaderPath, const std::vector<std::string>& defines)
 {
     std::cout << "Compiling shader " << shaderPath << "...\n";
     GLuint shader{ glCreateShader(shaderType) };
-    std::string shaderString{ readFile(shaderPath) };
+    std::string shaderString{ readSource(shaderPath, defines) };
     const char* shaderSource{ shaderString.c_str() };
     glShaderSource(shader, 1, &shaderSource, nullptr);
     glCompileShader(shader);
@@ -39,12 +82,12 @@ GLuint ShaderProgram::compileShader(GLenum shaderType, const char* shaderPath)
     return shader;
 }
 
-GLuint ShaderProgram::linkProgram(const char* computePath)
+GLuint ShaderProgram::linkProgram(const char* computePath, const std::vector<std::string>& defines)
 {
     std::cout << '\n';
     std::cout << "Linking " << computePath << "...\n";
     GLuint program{ glCreateProgram() };
-    GLuint computeShader{ compileShader(GL_COMPUTE_SHADER, computePath) };
+    GLuint computeShader{ compileShader(GL_COMPUTE_SHADER, computePath, defines) };
 
     glAttachShader(program, computeShader);
     glLinkProgram(program);
@@ -118,11 +161,12 @@ GLint ShaderProgram::linkSuccess(GLuint program)
 
 ShaderProgram::~ShaderProgram()
 {
-    glDeleteShader(m_id);
+    glDeleteProgram(m_id);
 }
 
 ShaderProgram::ShaderProgram(ShaderProgram&& other) noexcept
     : m_id{ other.m_id }
+    , m_locations{ std::move(other.m_locations) }
 {
     other.m_id = 0;
 }
@@ -130,11 +174,17 @@ ShaderProgram::ShaderProgram(ShaderProgram&& other) noexcept
 ShaderProgram& ShaderProgram::operator=(ShaderProgram&& other) noexcept
 {
     std::swap(m_id, other.m_id);
+    std::swap(m_locations, other.m_locations);
     return *this;
 }
 
 ShaderProgram::ShaderProgram(const char* computePath)
-    : m_id{ linkProgram(computePath) }
+    : m_id{ linkProgram(computePath, std::vector<std::string>{}) }
+{
+}
+
+ShaderProgram::ShaderProgram(const char* computePath, const std::vector<std::string>& defines)
+    : m_id{ linkProgram(computePath, defines) }
 {
 }
 
@@ -143,38 +193,68 @@ ShaderProgram::ShaderProgram(const char* vertexPath, const char* fragmentPath)
 {
 }
 
+GLint ShaderProgram::location(const char* name)
+{
+    auto found{ m_locations.find(std::string_view{ name }) };
+    if (found == m_locations.end())
+    {
+        found = m_locations.emplace(name, glGetUniformLocation(m_id, name)).first;
+    }
+    return found->second;
+}
+
 void ShaderProgram::setUniform(const char *name, int value)
 {
-    glUseProgram(m_id);
-    glUniform1i(
-        glGetUniformLocation(m_id, name),
+    glProgramUniform1i(
+        m_id,
+        location(name),
         value
     );
 }
 
 void ShaderProgram::setUniform(const char* name, unsigned int value)
 {
-    glUseProgram(m_id);
-    glUniform1ui(
-        glGetUniformLocation(m_id, name),
+    glProgramUniform1ui(
+        m_id,
+        location(name),
         value
     );
 }
 
 void ShaderProgram::setUniform(const char *name, float value)
 {
-    glUseProgram(m_id);
-    glUniform1f(
-        glGetUniformLocation(m_id, name),
+    glProgramUniform1f(
+        m_id,
+        location(name),
         value
     );
 }
 
 void ShaderProgram::setUniform(const char* name, const glm::vec2& value)
 {
-    glUseProgram(m_id);
-    glUniform2fv(
-        glGetUniformLocation(m_id, name),
+    glProgramUniform2fv(
+        m_id,
+        location(name),
+        1,
+        glm::value_ptr(value)
+    );
+}
+
+void ShaderProgram::setUniform(const char* name, const glm::ivec2& value)
+{
+    glProgramUniform2iv(
+        m_id,
+        location(name),
+        1,
+        glm::value_ptr(value)
+    );
+}
+
+void ShaderProgram::setUniform(const char* name, const glm::uvec2& value)
+{
+    glProgramUniform2uiv(
+        m_id,
+        location(name),
         1,
         glm::value_ptr(value)
     );
@@ -182,9 +262,9 @@ void ShaderProgram::setUniform(const char* name, const glm::vec2& value)
 
 void ShaderProgram::setUniform(const char *name, const glm::vec3 &value)
 {
-    glUseProgram(m_id);
-    glUniform3fv(
-        glGetUniformLocation(m_id, name),
+    glProgramUniform3fv(
+        m_id,
+        location(name),
         1,
         glm::value_ptr(value)
     );
@@ -192,9 +272,9 @@ void ShaderProgram::setUniform(const char *name, const glm::vec3 &value)
 
 void ShaderProgram::setUniform(const char* name, const glm::uvec3& value)
 {
-    glUseProgram(m_id);
-    glUniform3uiv(
-        glGetUniformLocation(m_id, name),
+    glProgramUniform3uiv(
+        m_id,
+        location(name),
         1,
         glm::value_ptr(value)
     );
@@ -202,9 +282,9 @@ void ShaderProgram::setUniform(const char* name, const glm::uvec3& value)
 
 void ShaderProgram::setUniform(const char* name, const glm::vec4& value)
 {
-    glUseProgram(m_id);
-    glUniform4fv(
-        glGetUniformLocation(m_id, name),
+    glProgramUniform4fv(
+        m_id,
+        location(name),
         1,
         glm::value_ptr(value)
     );
@@ -212,9 +292,9 @@ void ShaderProgram::setUniform(const char* name, const glm::vec4& value)
 
 void ShaderProgram::setUniform(const char *name, const glm::mat3 &value)
 {
-    glUseProgram(m_id);
-    glUniformMatrix3fv(
-        glGetUniformLocation(m_id, name),
+    glProgramUniformMatrix3fv(
+        m_id,
+        location(name),
         1,
         GL_FALSE,
         glm::value_ptr(value)
@@ -223,9 +303,9 @@ void ShaderProgram::setUniform(const char *name, const glm::mat3 &value)
 
 void ShaderProgram::setUniform(const char *name, const glm::mat4 &value)
 {
-    glUseProgram(m_id);
-    glUniformMatrix4fv(
-        glGetUniformLocation(m_id, name),
+    glProgramUniformMatrix4fv(
+        m_id,
+        location(name),
         1,
         GL_FALSE,
         glm::value_ptr(value)
@@ -3,7 +3,10 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include <functional>
+#include <map>
 #include <string>
+#include <vector>
 
 /// @brief A wrapper class for OpenGL's shader program. In this project, we will 
 ///        only need vertex shader, fragment shader, and compute shader.
@@ -13,22 +16,38 @@ private:
     /// @brief The ID of a linked shader program, nonzero if initialized correctly
     GLuint m_id{};
 
+    /// @brief Locations of the uniforms set so far by name
+    std::map<std::string, GLint, std::less<>> m_locations{};
+
+    /// @brief Get the location of a uniform, looking it up on the first use only
+    GLint location(const char* name);
+
     /// @brief Read the content of a file into a string. This function is used to read
     ///        shader source code files
     /// @param filepath the path of a file
     /// @return the content of the file as a string
     static std::string readFile(const char* filepath);
 
+    /// @brief Read a shader source file, replacing lines of `#include "file"` with the
+    ///        content of the file relative to the including one, and adding a `#define`
+    ///        line for every define after the `#version` line
+    /// @param filepath the path of the shader source file
+    /// @param defines names of macros to define, optionally followed by a space and a value
+    /// @return the source code
+    static std::string readSource(const char* filepath, const std::vector<std::string>& defines);
+
     /// @brief Compile the shader written in the given file
     /// @param shaderType The type of shader, GL_VERTEX_SHADER, etc.
     /// @param shaderPath The path of shader source file
+    /// @param defines macros defined in the shader
     /// @return the shader ID
-    static GLuint compileShader(GLenum shaderType, const char* shaderPath);
+    static GLuint compileShader(GLenum shaderType, const char* shaderPath, const std::vector<std::string>& defines = {});
 
     /// @brief Link the compute shader into a program
     /// @param computePath 
+    /// @param defines macros defined in the shader
     /// @return the program ID
-    static GLuint linkProgram(const char* computePath);
+    static GLuint linkProgram(const char* computePath, const std::vector<std::string>& defines);
 
     /// @brief Link the vertex shader and fragment shader into a program
     /// @param vertexPath the path of vertex shader source file
@@ -67,6 +86,11 @@ public:
     /// @param computePath 
     ShaderProgram(const char* computePath);
 
+    /// @brief Constructor a program with the given compute shader and macros
+    /// @param computePath 
+    /// @param defines names of macros to define, optionally followed by a space and a value
+    ShaderProgram(const char* computePath, const std::vector<std::string>& defines);
+
     /// @brief Constructor a program with the given vertex and fragment shader
     /// @param vertexPath 
     /// @param fragmentPath 
@@ -93,6 +117,12 @@ public:
     /// @brief Set a vec2 uniform
     void setUniform(const char* name, const glm::vec2& value);
 
+    /// @brief Set an ivec2 uniform
+    void setUniform(const char* name, const glm::ivec2& value);
+
+    /// @brief Set a uvec2 uniform
+    void setUniform(const char* name, const glm::uvec2& value);
+
     /// @brief Set a vec3 uniform
     void setUniform(const char* name, const glm::vec3& value);
 
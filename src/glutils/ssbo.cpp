@@ -9,6 +9,7 @@ SSBO::~SSBO()
 
 SSBO::SSBO(SSBO&& other) noexcept
     : m_id{ other.m_id }
+    , m_memory{ std::move(other.m_memory) }
 {
     other.m_id = 0;
 }
@@ -16,23 +17,24 @@ SSBO::SSBO(SSBO&& other) noexcept
 SSBO& SSBO::operator=(SSBO&& other) noexcept
 {
     std::swap(m_id, other.m_id);
+    std::swap(m_memory, other.m_memory);
     return *this;
 }
 
-SSBO::SSBO(GLenum usage, GLsizeiptr size, const void* data)
+SSBO::SSBO(GLenum usage, GLsizeiptr size, const void* data, const GpuMemory::Tag& tag)
+    : m_memory{ tag, static_cast<std::size_t>(size) }
 {
-    glGenBuffers(1, &m_id);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_id);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, size, data, usage);
+    glCreateBuffers(1, &m_id);
+    glNamedBufferData(m_id, size, data, usage);
 }
 
 void SSBO::bind(GLuint index) const
 {
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_id);
     glBindBufferBase(GL_SHADER_STORAGE_BUFFER, index, m_id);
 }
 
 void SSBO::swap(SSBO& ssbo1, SSBO& ssbo2)
 {
     std::swap(ssbo1.m_id, ssbo2.m_id);
+    std::swap(ssbo1.m_memory, ssbo2.m_memory);
 }
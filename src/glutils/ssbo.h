@@ -1,5 +1,7 @@
 #pragma once
 
+#include "gpu_memory.h"
+
 #include <glad/glad.h>
 
 /// @brief Wrapper class for OpenGL's Shader Storage Buffer Object (SSBO)
@@ -9,6 +11,9 @@ private:
     /// @brief ID of SSBO, nonzero if initialized correctly
     GLuint m_id{};
 
+    /// @brief The record of its memory
+    GpuMemory::Allocation m_memory{};
+
 public:
     /// @brief Default constructor
     SSBO() = default;
@@ -29,7 +34,8 @@ public:
     SSBO& operator=(SSBO&& other) noexcept;
 
     /// @brief Create a SSBO specifying the parameters
-    SSBO(GLenum usage, GLsizeiptr size, const void* data = nullptr);
+    /// @param tag the owner and purpose its memory is accounted to
+    SSBO(GLenum usage, GLsizeiptr size, const void* data = nullptr, const GpuMemory::Tag& tag = {});
 
     /// @brief Let this buffer bind to the given index
     void bind(GLuint index) const;
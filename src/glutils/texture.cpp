@@ -13,7 +13,9 @@ Texture::Texture(Texture&& other) noexcept
     : m_width{ other.m_width }
     , m_height{ other.m_height }
     , m_format{ other.m_format }
+    , m_internalFormat{ other.m_internalFormat }
     , m_id{ other.m_id }
+    , m_memory{ std::move(other.m_memory) }
 {
     other.m_id = 0;
 }
@@ -24,31 +26,37 @@ Texture& Texture::operator=(Texture&& other) noexcept
     std::swap(m_height, other.m_height);
     std::swap(m_id, other.m_id);
     std::swap(m_format, other.m_format);
+    std::swap(m_internalFormat, other.m_internalFormat);
+    std::swap(m_memory, other.m_memory);
 
     return *this;
 }
 
-Texture::Texture(int width, int height, int format)
+Texture::Texture(int width, int height, int format, int internalFormat, const GpuMemory::Tag& tag)
     : m_width{ width }
     , m_height{ height }
     , m_format{ format }
+    , m_internalFormat{ internalFormat ? internalFormat : format }
+    , m_memory{ tag, static_cast<std::size_t>(width) * height * GpuMemory::texelBytes(m_internalFormat) }
 {
-    glGenTextures(1, &m_id);
+    // mutable storage, as unsized formats have no immutable equivalent
+    glCreateTextures(GL_TEXTURE_2D, 1, &m_id);
     glBindTexture(GL_TEXTURE_2D, m_id);
-    glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, nullptr);
+    glTexImage2D(GL_TEXTURE_2D, 0, m_internalFormat, width, height, 0, format, GL_UNSIGNED_BYTE, nullptr);
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTextureParameteri(m_id, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTextureParameteri(m_id, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 
     switch (format)
     {
+    case GL_RED:
     case GL_RGB:
     case GL_RGBA:
         clampToEdge();
         break;
     case GL_DEPTH_COMPONENT:
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LESS);
+        glTextureParameteri(m_id, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTextureParameteri(m_id, GL_TEXTURE_COMPARE_FUNC, GL_LESS);
         clampToBorder();
         break;
     }
@@ -56,30 +64,34 @@ Texture::Texture(int width, int height, int format)
 
 void Texture::bind(GLuint textureUnit) const
 {
-    glActiveTexture(GL_TEXTURE0 + textureUnit);
-    glBindTexture(GL_TEXTURE_2D, m_id);
+    glBindTextureUnit(textureUnit, m_id);
+}
+
+void Texture::bindImage(GLuint imageUnit, GLenum access) const
+{
+    glBindImageTexture(imageUnit, m_id, 0, GL_FALSE, 0, access, m_internalFormat);
 }
 
 void Texture::clampToEdge() const
 {
-    bind();
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTextureParameteri(m_id, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTextureParameteri(m_id, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 }
 
 void Texture::clampToBorder(const glm::vec4& borderColor) const
 {
-    bind();
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-    glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, glm::value_ptr(borderColor));
+    glTextureParameteri(m_id, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+    glTextureParameteri(m_id, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+    glTextureParameterfv(m_id, GL_TEXTURE_BORDER_COLOR, glm::value_ptr(borderColor));
 }
 
-void Texture::generateMipmap() const
+void Texture::generateMipmap()
 {
-    bind();
-    glGenerateMipmap(GL_TEXTURE_2D);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY, 8.0f);
+    // the levels below the first add a third of it
+    std::size_t levelBytes{ static_cast<std::size_t>(m_width) * m_height * GpuMemory::texelBytes(m_internalFormat) };
+    m_memory.resize(levelBytes + levelBytes / 3);
+    glGenerateTextureMipmap(m_id);
+    glTextureParameteri(m_id, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTextureParameteri(m_id, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTextureParameterf(m_id, GL_TEXTURE_MAX_ANISOTROPY, 8.0f);
 }
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "gpu_memory.h"
+
 #include <glm/glm.hpp>
 #include <glad/glad.h>
 
@@ -16,9 +18,15 @@ private:
     /// @brief texture format
     GLint m_format{};
 
+    /// @brief internal format on the GPU; the format if not sized
+    GLint m_internalFormat{};
+
     /// @brief ID of texture buffer, nonzero if initialized
     GLuint m_id{};
 
+    /// @brief The record of its memory
+    GpuMemory::Allocation m_memory{};
+
 public:
     /// @brief Default constructor
     Texture() = default;
@@ -39,11 +47,19 @@ public:
     Texture& operator=(Texture&& other) noexcept;
 
     /// @brief Create a texture with given size
-    Texture(int width, int height, int format = GL_RGB);
+    /// @param format the format of pixels, such as GL_RGB
+    /// @param internalFormat a sized format such as GL_RGBA8, needed for image load and
+    ///        store; the format if zero
+    /// @param tag the owner and purpose its memory is accounted to
+    Texture(int width, int height, int format = GL_RGB, int internalFormat = 0, const GpuMemory::Tag& tag = {});
 
     /// @brief Bind the given texture unit
     void bind(GLuint textureUnit = 0) const;
 
+    /// @brief Bind level 0 to the given image unit; needs a sized internal format
+    /// @param access GL_READ_ONLY, GL_WRITE_ONLY or GL_READ_WRITE
+    void bindImage(GLuint imageUnit, GLenum access) const;
+
     /// @brief Set the wrapping method to clamping to edge
     void clampToEdge() const;
 
@@ -52,7 +68,7 @@ public:
     void clampToBorder(const glm::vec4& borderColor = glm::vec4(1.0f)) const;
 
     /// @brief Generate mipmap for this texture
-    void generateMipmap() const;
+    void generateMipmap();
 
     /// @brief Return its ID when converted to unsigned int
     inline operator GLuint() const { return m_id; }
@@ -65,4 +81,7 @@ public:
 
     /// @brief Return the format
     inline int format() const { return m_format; }
+
+    /// @brief Return the internal format
+    inline int internalFormat() const { return m_internalFormat; }
 };
\ No newline at end of file
@@ -0,0 +1,45 @@
+#include "texture3d.h"
+
+#include <utility>
+
+Texture3D::~Texture3D()
+{
+    glDeleteTextures(1, &m_id);
+}
+
+Texture3D::Texture3D(Texture3D&& other) noexcept
+    : m_size{ other.m_size }
+    , m_id{ other.m_id }
+    , m_memory{ std::move(other.m_memory) }
+{
+    other.m_id = 0;
+}
+
+Texture3D& Texture3D::operator=(Texture3D&& other) noexcept
+{
+    std::swap(m_size, other.m_size);
+    std::swap(m_id, other.m_id);
+    std::swap(m_memory, other.m_memory);
+
+    return *this;
+}
+
+Texture3D::Texture3D(const glm::ivec3& size, const float* texels, GLenum internalFormat, const GpuMemory::Tag& tag)
+    : m_size{ size }
+    , m_memory{ tag, static_cast<std::size_t>(size.x) * size.y * size.z * GpuMemory::texelBytes(internalFormat) }
+{
+    glCreateTextures(GL_TEXTURE_3D, 1, &m_id);
+    glTextureStorage3D(m_id, 1, internalFormat, size.x, size.y, size.z);
+    glTextureSubImage3D(m_id, 0, 0, 0, 0, size.x, size.y, size.z, GL_RED, GL_FLOAT, texels);
+
+    glTextureParameteri(m_id, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTextureParameteri(m_id, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTextureParameteri(m_id, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTextureParameteri(m_id, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTextureParameteri(m_id, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+}
+
+void Texture3D::bind(GLuint textureUnit) const
+{
+    glBindTextureUnit(textureUnit, m_id);
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "gpu_memory.h"
+
+#include <glm/glm.hpp>
+#include <glad/glad.h>
+
+/// @brief Wrapper for OpenGL's texture 3D with a single channel of floats, sampled
+///        linearly and clamped to its edge
+class Texture3D
+{
+private:
+    /// @brief the number of texels along each axis
+    glm::ivec3 m_size{};
+
+    /// @brief ID of texture, nonzero if initialized
+    GLuint m_id{};
+
+    /// @brief The record of its memory
+    GpuMemory::Allocation m_memory{};
+
+public:
+    /// @brief Default constructor
+    Texture3D() = default;
+
+    /// @brief Delete texture on GPU
+    ~Texture3D();
+
+    /// @brief No copying
+    Texture3D(const Texture3D& other) = delete;
+
+    /// @brief No copying
+    Texture3D& operator=(const Texture3D& other) = delete;
+
+    /// @brief Move constructor
+    Texture3D(Texture3D&& other) noexcept;
+
+    /// @brief Move assignment
+    Texture3D& operator=(Texture3D&& other) noexcept;
+
+    /// @brief Create an immutable texture and upload its texels
+    /// @param size the number of texels along each axis
+    /// @param texels the texels with x varying fastest and z slowest
+    /// @param internalFormat a sized single channel format such as GL_R32F or GL_R16F
+    /// @param tag the owner and purpose its memory is accounted to
+    Texture3D(const glm::ivec3& size, const float* texels, GLenum internalFormat = GL_R32F, const GpuMemory::Tag& tag = {});
+
+    /// @brief Bind the given texture unit
+    void bind(GLuint textureUnit = 0) const;
+
+    /// @brief Return its ID when converted to unsigned int
+    inline operator GLuint() const { return m_id; }
+
+    /// @brief Return the number of texels along each axis
+    inline const glm::ivec3& size() const { return m_size; }
+};
\ No newline at end of file
@@ -4,7 +4,7 @@
 
 VAO::VAO()
 {
-    glGenVertexArrays(1, &m_id);
+    glCreateVertexArrays(1, &m_id);
 }
 
 VAO::~VAO()
@@ -26,8 +26,23 @@ VAO& VAO::operator=(VAO&& other) noexcept
 
 void VAO::setAttrib(GLuint buffer, GLuint index, GLint size, GLenum type, GLsizei stride, size_t offset, GLboolean normalized) const
 {
-    activate();
-    glBindBuffer(GL_ARRAY_BUFFER, buffer);
-    glVertexAttribPointer(index, size, type, normalized, stride, reinterpret_cast<void*>(offset));
-    glEnableVertexAttribArray(index);
+    setFormat(index, size, type, normalized);
+    setBuffer(index, buffer, stride, static_cast<GLintptr>(offset));
+}
+
+void VAO::setFormat(GLuint index, GLint size, GLenum type, GLboolean normalized) const
+{
+    glVertexArrayAttribFormat(m_id, index, size, type, normalized, 0);
+    glVertexArrayAttribBinding(m_id, index, index);
+    glEnableVertexArrayAttrib(m_id, index);
+}
+
+void VAO::setBuffer(GLuint index, GLuint buffer, GLsizei stride, GLintptr offset) const
+{
+    glVertexArrayVertexBuffer(m_id, index, buffer, offset, stride);
+}
+
+void VAO::setElements(GLuint buffer) const
+{
+    glVertexArrayElementBuffer(m_id, buffer);
 }
@@ -43,6 +43,25 @@ public:
     /// @param normalized if the data is normalized
     void setAttrib(GLuint buffer, GLuint index, GLint size, GLenum type, GLsizei stride, size_t offset, GLboolean normalized = GL_FALSE) const;
 
+    /// @brief Set the format of an attribute and enable it, reading from the buffer of the
+    ///        same index; for buffers that change between draws while the format does not
+    /// @param index the index of attribute
+    /// @param size the size of attribute
+    /// @param type the type of data
+    /// @param normalized if the data is normalized
+    void setFormat(GLuint index, GLint size, GLenum type, GLboolean normalized = GL_FALSE) const;
+
+    /// @brief Set the buffer an attribute with a format reads from
+    /// @param index the index of attribute
+    /// @param buffer the buffer ID
+    /// @param stride the stride
+    /// @param offset the offset
+    void setBuffer(GLuint index, GLuint buffer, GLsizei stride, GLintptr offset = 0) const;
+
+    /// @brief Set the buffer of indices for indexed draws
+    /// @param buffer the buffer ID
+    void setElements(GLuint buffer) const;
+
     /// @brief Implicit conversion to unsigned int
     inline operator GLuint() const { return m_id; }
 };
\ No newline at end of file
@@ -0,0 +1,372 @@
+#include "distance_field.h"
+
+#include <misc/mapped_file.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+/// @brief On-disk layout of cached distance fields: a header followed by the distances.
+///        All values are little endian
+namespace distance_field_file
+{
+    constexpr std::uint32_t magic{ 0x46445350 }; // "PSDF"
+    constexpr std::uint32_t version{ 1 };
+
+    /// @brief The header at the start of the file
+    struct Header
+    {
+        std::uint32_t magic;
+        std::uint32_t version;
+        std::uint64_t meshHash; // FNV-1a of the mesh file
+        float voxelSize;
+        std::int32_t band;
+        std::int32_t resolution[3];
+        float low[3];
+    };
+    static_assert(sizeof(Header) == 48);
+}
+
+namespace
+{
+    /// @brief The closest point of a triangle to a point
+    /// reference: Real-Time Collision Detection, Ericson, 2004, section 5.1.5
+    glm::vec3 closestPoint(const glm::vec3& p, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+    {
+        glm::vec3 ab{ b - a };
+        glm::vec3 ac{ c - a };
+        glm::vec3 ap{ p - a };
+        float d1{ glm::dot(ab, ap) };
+        float d2{ glm::dot(ac, ap) };
+        if (d1 <= 0.0f && d2 <= 0.0f) return a;
+
+        glm::vec3 bp{ p - b };
+        float d3{ glm::dot(ab, bp) };
+        float d4{ glm::dot(ac, bp) };
+        if (d3 >= 0.0f && d4 <= d3) return b;
+
+        float vc{ d1 * d4 - d3 * d2 };
+        if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) return a + d1 / (d1 - d3) * ab;
+
+        glm::vec3 cp{ p - c };
+        float d5{ glm::dot(ab, cp) };
+        float d6{ glm::dot(ac, cp) };
+        if (d6 >= 0.0f && d5 <= d6) return c;
+
+        float vb{ d5 * d2 - d1 * d6 };
+        if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) return a + d2 / (d2 - d6) * ac;
+
+        float va{ d3 * d6 - d5 * d4 };
+        if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f) return b + (d4 - d3) / ((d4 - d3) + (d5 - d6)) * (c - b);
+
+        float denominator{ 1.0f / (va + vb + vc) };
+        return a + ab * (vb * denominator) + ac * (vc * denominator);
+    }
+
+    /// @brief The 2D cross product
+    float cross(const glm::vec2& u, const glm::vec2& v)
+    {
+        return u.x * v.y - u.y * v.x;
+    }
+
+    /// @brief Hash the bytes of a file
+    std::uint64_t fnv1a(const std::byte* data, std::size_t size)
+    {
+        std::uint64_t hash{ 0xcbf29ce484222325ull };
+        for (std::size_t i{ 0 }; i < size; ++i)
+        {
+            hash = (hash ^ static_cast<std::uint64_t>(data[i])) * 0x100000001b3ull;
+        }
+        return hash;
+    }
+}
+
+DistanceField::DistanceField(ThreadPool& pool, const TriangleMesh& mesh, const Options& options)
+    : m_options{ options }
+{
+    if (mesh.positions.empty())
+    {
+        return;
+    }
+
+    float voxelSize{ options.voxelSize };
+    BoundingBox bounds{ mesh.positions[0], mesh.positions[0] };
+    for (const glm::vec3& position : mesh.positions)
+    {
+        bounds.low = glm::min(bounds.low, position);
+        bounds.high = glm::max(bounds.high, position);
+    }
+    // a voxel more than the band, so the field is clamped on all of its faces
+    glm::vec3 margin{ (options.band + 1) * voxelSize };
+    m_box.low = bounds.low - margin;
+    m_resolution = glm::ivec3{ glm::ceil((bounds.high + margin - m_box.low) / voxelSize) };
+    m_box.high = m_box.low + glm::vec3{ m_resolution } * voxelSize;
+    m_distances.assign(static_cast<std::size_t>(m_resolution.x) * m_resolution.y * m_resolution.z, bandWidth());
+
+    // every slice lists the triangles within the band of it and those crossing its center plane
+    std::vector<std::vector<int>> nearTriangles(m_resolution.z);
+    std::vector<std::vector<int>> crossingTriangles(m_resolution.z);
+    for (int t{ 0 }; t < static_cast<int>(mesh.triangles.size()); ++t)
+    {
+        const glm::uvec3& triangle{ mesh.triangles[t] };
+        float low{ std::min({ mesh.positions[triangle.x].z, mesh.positions[triangle.y].z, mesh.positions[triangle.z].z }) };
+        float high{ std::max({ mesh.positions[triangle.x].z, mesh.positions[triangle.y].z, mesh.positions[triangle.z].z }) };
+        // slices whose centers are in a range of z
+        auto first{ [&](float z) { return std::max(static_cast<int>(std::ceil((z - m_box.low.z) / voxelSize - 0.5f)), 0); } };
+        auto last{ [&](float z) { return std::min(static_cast<int>(std::floor((z - m_box.low.z) / voxelSize - 0.5f)), m_resolution.z - 1); } };
+        for (int z{ first(low - bandWidth()) }; z <= last(high + bandWidth()); ++z)
+        {
+            nearTriangles[z].push_back(t);
+        }
+        // with some slack, as the rays are nudged off the slice centers and rounding may
+        // drop a triangle whose edge lies on one
+        float slack{ 0.01f * voxelSize };
+        for (int z{ first(low - slack) }; z <= last(high + slack); ++z)
+        {
+            crossingTriangles[z].push_back(t);
+        }
+    }
+
+    pool.parallelFor(m_resolution.z, [&](int z) { bakeSlice(z, mesh, nearTriangles[z], crossingTriangles[z]); });
+}
+
+void DistanceField::bakeSlice(int z, const TriangleMesh& mesh, const std::vector<int>& nearTriangles,
+    const std::vector<int>& crossingTriangles)
+{
+    float voxelSize{ m_options.voxelSize };
+    float* slice{ m_distances.data() + static_cast<std::size_t>(z) * m_resolution.x * m_resolution.y };
+    auto center{ [&](int x, int y) { return m_box.low + (glm::vec3{ x, y, z } + 0.5f) * voxelSize; } };
+
+    // unsigned distances in the band around each triangle
+    for (int t : nearTriangles)
+    {
+        const glm::uvec3& triangle{ mesh.triangles[t] };
+        const glm::vec3& a{ mesh.positions[triangle.x] };
+        const glm::vec3& b{ mesh.positions[triangle.y] };
+        const glm::vec3& c{ mesh.positions[triangle.z] };
+        glm::vec2 low{ glm::vec2{ glm::min(a, glm::min(b, c)) } - bandWidth() };
+        glm::vec2 high{ glm::vec2{ glm::max(a, glm::max(b, c)) } + bandWidth() };
+        glm::ivec2 first{ glm::max(glm::ivec2{ glm::ceil((low - glm::vec2{ m_box.low }) / voxelSize - 0.5f) }, 0) };
+        glm::ivec2 last{ glm::min(glm::ivec2{ glm::floor((high - glm::vec2{ m_box.low }) / voxelSize - 0.5f) },
+            glm::ivec2{ m_resolution } - 1) };
+        for (int y{ first.y }; y <= last.y; ++y)
+        {
+            for (int x{ first.x }; x <= last.x; ++x)
+            {
+                glm::vec3 position{ center(x, y) };
+                float& distance{ slice[x + y * m_resolution.x] };
+                distance = std::min(distance, glm::distance(position, closestPoint(position, a, b, c)));
+            }
+        }
+    }
+
+    // a voxel is inside if a ray from it along -x crosses the surface an odd number of
+    // times; the rays are nudged off the lattice, where vertices and edges of modeled
+    // meshes tend to lie
+    float rayZ{ m_box.low.z + (z + 0.5f) * voxelSize + 1.7e-4f * voxelSize };
+    std::vector<float> crossings{};
+    for (int y{ 0 }; y < m_resolution.y; ++y)
+    {
+        glm::vec2 ray{ m_box.low.y + (y + 0.5f) * voxelSize + 1.3e-4f * voxelSize, rayZ };
+        crossings.clear();
+        for (int t : crossingTriangles)
+        {
+            const glm::uvec3& triangle{ mesh.triangles[t] };
+            const glm::vec3& a{ mesh.positions[triangle.x] };
+            const glm::vec3& b{ mesh.positions[triangle.y] };
+            const glm::vec3& c{ mesh.positions[triangle.z] };
+            // barycentric coordinates of the ray in the triangle projected onto the yz plane
+            glm::vec2 pa{ glm::vec2{ a.y, a.z } - ray };
+            glm::vec2 pb{ glm::vec2{ b.y, b.z } - ray };
+            glm::vec2 pc{ glm::vec2{ c.y, c.z } - ray };
+            float area{ cross(pb - pa, pc - pa) };
+            if (area == 0.0f)
+            {
+                continue; // parallel to the ray
+            }
+            float u{ cross(pb, pc) / area };
+            float v{ cross(pc, pa) / area };
+            float w{ 1.0f - u - v };
+            if (u >= 0.0f && v >= 0.0f && w >= 0.0f)
+            {
+                crossings.push_back(u * a.x + v * b.x + w * c.x);
+            }
+        }
+        std::sort(crossings.begin(), crossings.end());
+
+        std::size_t passed{ 0 };
+        for (int x{ 0 }; x < m_resolution.x; ++x)
+        {
+            float positionX{ m_box.low.x + (x + 0.5f) * voxelSize };
+            while (passed < crossings.size() && crossings[passed] < positionX)
+            {
+                ++passed;
+            }
+            if (passed % 2 == 1)
+            {
+                slice[x + y * m_resolution.x] = -slice[x + y * m_resolution.x];
+            }
+        }
+    }
+}
+
+bool DistanceField::readObj(const std::string& path, TriangleMesh& mesh)
+{
+    std::ifstream file{ path };
+    if (!file)
+    {
+        std::cerr << "Failed to open mesh file " << path << '\n';
+        return false;
+    }
+
+    mesh = TriangleMesh{};
+    std::vector<int> polygon{};
+    for (std::string line{}; std::getline(file, line);)
+    {
+        std::istringstream input{ line };
+        std::string keyword{};
+        input >> keyword;
+        if (keyword == "v")
+        {
+            glm::vec3 position{};
+            input >> position.x >> position.y >> position.z;
+            mesh.positions.push_back(position);
+        }
+        else if (keyword == "f")
+        {
+            // vertices are given as v, v/vt, v//vn or v/vt/vn, counted from 1 or from the end if negative
+            polygon.clear();
+            for (std::string vertex{}; input >> vertex;)
+            {
+                int index{ std::atoi(vertex.c_str()) };
+                polygon.push_back(index < 0 ? static_cast<int>(mesh.positions.size()) + index : index - 1);
+            }
+            for (std::size_t i{ 2 }; i < polygon.size(); ++i)
+            {
+                mesh.triangles.push_back(glm::uvec3{ polygon[0], polygon[i - 1], polygon[i] });
+            }
+        }
+    }
+
+    for (const glm::uvec3& triangle : mesh.triangles)
+    {
+        if (glm::any(glm::greaterThanEqual(triangle, glm::uvec3{ static_cast<unsigned int>(mesh.positions.size()) })))
+        {
+            std::cerr << "Mesh file " << path << " has faces with invalid vertices\n";
+            return false;
+        }
+    }
+    if (mesh.triangles.empty())
+    {
+        std::cerr << "Mesh file " << path << " has no faces\n";
+        return false;
+    }
+    return true;
+}
+
+bool DistanceField::save(const std::string& path, std::uint64_t meshHash) const
+{
+    std::ofstream file{ path, std::ios::binary | std::ios::trunc };
+    if (!file)
+    {
+        std::cerr << "Failed to create distance field file " << path << '\n';
+        return false;
+    }
+
+    distance_field_file::Header header{};
+    header.magic = distance_field_file::magic;
+    header.version = distance_field_file::version;
+    header.meshHash = meshHash;
+    header.voxelSize = m_options.voxelSize;
+    header.band = m_options.band;
+    for (int c{ 0 }; c < 3; ++c)
+    {
+        header.resolution[c] = m_resolution[c];
+        header.low[c] = m_box.low[c];
+    }
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(m_distances.data()), static_cast<std::streamsize>(m_distances.size() * sizeof(float)));
+
+    if (!file)
+    {
+        std::cerr << "Failed to write distance field file " << path << '\n';
+        return false;
+    }
+    return true;
+}
+
+bool DistanceField::load(const std::string& path, std::uint64_t meshHash, const Options& options)
+{
+    MappedFile file{ path.c_str() };
+    distance_field_file::Header header{};
+    if (!file.available() || file.size() < sizeof(header))
+    {
+        return false;
+    }
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (header.magic != distance_field_file::magic || header.version != distance_field_file::version
+        || header.meshHash != meshHash || header.voxelSize != options.voxelSize || header.band != options.band)
+    {
+        return false;
+    }
+    glm::ivec3 resolution{ header.resolution[0], header.resolution[1], header.resolution[2] };
+    if (glm::any(glm::lessThanEqual(resolution, glm::ivec3{ 0 })))
+    {
+        return false;
+    }
+    std::size_t count{ static_cast<std::size_t>(resolution.x) * resolution.y * resolution.z };
+    if (file.size() - sizeof(header) != count * sizeof(float))
+    {
+        return false;
+    }
+
+    m_options = options;
+    m_resolution = resolution;
+    m_box.low = glm::vec3{ header.low[0], header.low[1], header.low[2] };
+    m_box.high = m_box.low + glm::vec3{ resolution } * options.voxelSize;
+    m_distances.resize(count);
+    std::memcpy(m_distances.data(), file.data() + sizeof(header), count * sizeof(float));
+    return true;
+}
+
+bool DistanceField::bakeCached(ThreadPool& pool, const std::string& meshPath, const Options& options, DistanceField& field)
+{
+    std::uint64_t meshHash{};
+    {
+        MappedFile mesh{ meshPath.c_str() };
+        if (!mesh.available())
+        {
+            std::cerr << "Failed to open mesh file " << meshPath << '\n';
+            return false;
+        }
+        meshHash = fnv1a(mesh.data(), mesh.size());
+    }
+
+    std::string cachePath{ meshPath + ".sdf" };
+    if (field.load(cachePath, meshHash, options))
+    {
+        std::cout << "Loaded distance field " << cachePath << '\n';
+        return true;
+    }
+
+    TriangleMesh mesh{};
+    if (!readObj(meshPath, mesh))
+    {
+        return false;
+    }
+    field = DistanceField{ pool, mesh, options };
+    std::cout << "Baked distance field of " << meshPath << ": " << field.m_resolution.x << ' '
+        << field.m_resolution.y << ' ' << field.m_resolution.z << " voxels\n";
+    // a field that cannot be cached is baked again next time
+    field.save(cachePath, meshHash);
+    return true;
+}
+
+void DistanceField::translate(const glm::vec3& offset)
+{
+    m_box.low += offset;
+    m_box.high += offset;
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "surface_mesher.h"
+#include <misc/bounding_box.h>
+#include <misc/thread_pool.h>
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/// @brief The signed distance to a closed triangle mesh sampled at the centers of the
+///        voxels of a lattice, negative inside. Distances are exact in a narrow band
+///        around the surface and clamped to its width beyond it, which is all that
+///        collisions need. Fields are baked in parallel, a z slice of the lattice per
+///        task, and cached on disk next to the mesh they were baked from
+class DistanceField
+{
+public:
+    /// @brief Options for baking
+    struct Options
+    {
+        /// @brief The edge length of a voxel in m
+        float voxelSize{ 0.02f };
+
+        /// @brief The width in voxels of the band of exact distances, which is also the
+        ///        margin of the lattice around the mesh
+        int band{ 4 };
+    };
+
+private:
+    /// @brief The options the field was baked with
+    Options m_options{};
+
+    /// @brief The box covered by the lattice
+    BoundingBox m_box{};
+
+    /// @brief The number of voxels along each axis
+    glm::ivec3 m_resolution{};
+
+    /// @brief The distances with x varying fastest and z slowest
+    std::vector<float> m_distances{};
+
+    /// @brief Compute the distances of a z slice from the triangles within the band of
+    ///        it, and their signs from the triangles crossing its center plane
+    void bakeSlice(int z, const TriangleMesh& mesh, const std::vector<int>& nearTriangles,
+        const std::vector<int>& crossingTriangles);
+
+    /// @brief Read the positions and faces of a mesh from an OBJ file; polygons are split
+    ///        into fans of triangles
+    static bool readObj(const std::string& path, TriangleMesh& mesh);
+
+public:
+    /// @brief Default constructor; an empty field
+    DistanceField() = default;
+
+    /// @brief Bake the field of a mesh
+    /// @param pool the threads baking slices
+    /// @param mesh the mesh, which must be closed for the signs to be right
+    /// @param options the options
+    DistanceField(ThreadPool& pool, const TriangleMesh& mesh, const Options& options);
+
+    /// @brief Save the field to a cache file
+    /// @param meshHash the hash of the mesh file the field was baked from
+    /// @return false if the file cannot be written
+    bool save(const std::string& path, std::uint64_t meshHash) const;
+
+    /// @brief Load the field from a cache file; the field is unchanged if the file is
+    ///        missing or was baked from another mesh or with other options
+    /// @return false if the file cannot be used
+    bool load(const std::string& path, std::uint64_t meshHash, const Options& options);
+
+    /// @brief Load the field of an OBJ mesh file from its cache file, the mesh path with
+    ///        ".sdf" appended, or bake it and write the cache file if that is out of date
+    /// @return false if the mesh cannot be read
+    static bool bakeCached(ThreadPool& pool, const std::string& meshPath, const Options& options, DistanceField& field);
+
+    /// @brief Move the field, e.g. to place a mesh modeled around the origin
+    void translate(const glm::vec3& offset);
+
+    /// @brief The box covered by the lattice
+    inline const BoundingBox& box() const { return m_box; }
+
+    /// @brief The number of voxels along each axis
+    inline const glm::ivec3& resolution() const { return m_resolution; }
+
+    /// @brief The distances with x varying fastest and z slowest
+    inline const std::vector<float>& distances() const { return m_distances; }
+
+    /// @brief The largest distance stored; farther points are clamped to it
+    inline float bandWidth() const { return m_options.band * m_options.voxelSize; }
+
+    /// @brief Whether the field holds any voxels
+    inline bool empty() const { return m_distances.empty(); }
+};
\ No newline at end of file
@@ -0,0 +1,142 @@
+#include "mesh_writer.h"
+
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+MeshWriter::MeshWriter(const std::string& prefix, const Options& options)
+    : m_options{ options }
+    , m_prefix{ prefix }
+    , m_mesher{ options.mesher }
+    , m_pool{ options.numThreads }
+{
+    m_thread = std::thread{ &MeshWriter::run, this };
+}
+
+MeshWriter::~MeshWriter()
+{
+    {
+        std::lock_guard lock{ m_mutex };
+        m_stop = true;
+    }
+    m_queueChanged.notify_all();
+    m_thread.join();
+}
+
+void MeshWriter::write(std::uint64_t frame, const BoundingBox& boundary, const Grid& grid,
+    const glm::vec4* positions, int numParticles)
+{
+    // waiting for room would stall the caller, which is the simulation thread
+    {
+        std::lock_guard lock{ m_mutex };
+        if (static_cast<int>(m_queue.size()) >= m_options.maxQueuedFrames)
+        {
+            ++m_droppedFrames;
+            return;
+        }
+    }
+
+    Frame job{ frame, boundary, grid, std::vector<glm::vec4>(positions, positions + numParticles) };
+    {
+        std::lock_guard lock{ m_mutex };
+        m_queue.push_back(std::move(job));
+    }
+    m_queueChanged.notify_all();
+}
+
+int MeshWriter::droppedFrames()
+{
+    std::lock_guard lock{ m_mutex };
+    return m_droppedFrames;
+}
+
+void MeshWriter::run()
+{
+    while (true)
+    {
+        std::unique_lock lock{ m_mutex };
+        m_queueChanged.wait(lock, [this]() { return m_stop || !m_queue.empty(); });
+        if (m_queue.empty())
+        {
+            return; // stopped and drained
+        }
+        Frame frame{ std::move(m_queue.front()) };
+        m_queue.pop_front();
+        lock.unlock();
+
+        m_mesher.extract(m_pool, frame.positions.data(), static_cast<int>(frame.positions.size()),
+            frame.boundary, frame.grid, m_mesh);
+
+        std::ostringstream path{};
+        path << m_prefix << std::setw(6) << std::setfill('0') << frame.frame
+             << (m_options.format == Format::ply ? ".ply" : ".obj");
+        bool written{ m_options.format == Format::ply ? writePly(path.str(), m_mesh) : writeObj(path.str(), m_mesh) };
+        if (!written)
+        {
+            std::cerr << "Failed to write mesh " << path.str() << '\n';
+        }
+    }
+}
+
+bool MeshWriter::writePly(const std::string& path, const TriangleMesh& mesh)
+{
+    std::ofstream file{ path, std::ios::binary | std::ios::trunc };
+    if (!file)
+    {
+        return false;
+    }
+    file << "ply\n"
+         << "format binary_little_endian 1.0\n"
+         << "element vertex " << mesh.positions.size() << '\n'
+         << "property float x\nproperty float y\nproperty float z\n"
+         << "property float nx\nproperty float ny\nproperty float nz\n"
+         << "element face " << mesh.triangles.size() << '\n'
+         << "property list uchar int vertex_indices\n"
+         << "end_header\n";
+
+    // the host is little endian like the particle cache assumes; faces are not aligned
+    constexpr std::size_t vertexSize{ 6 * sizeof(float) };
+    constexpr std::size_t faceSize{ 1 + 3 * sizeof(std::int32_t) };
+    std::vector<char> data(mesh.positions.size() * vertexSize + mesh.triangles.size() * faceSize);
+    char* out{ data.data() };
+    for (std::size_t i{ 0 }; i < mesh.positions.size(); ++i)
+    {
+        std::memcpy(out, &mesh.positions[i], sizeof(glm::vec3));
+        std::memcpy(out + sizeof(glm::vec3), &mesh.normals[i], sizeof(glm::vec3));
+        out += vertexSize;
+    }
+    for (const glm::uvec3& triangle : mesh.triangles)
+    {
+        *out = 3;
+        std::memcpy(out + 1, &triangle, sizeof(glm::uvec3));
+        out += faceSize;
+    }
+    file.write(data.data(), static_cast<std::streamsize>(data.size()));
+    return static_cast<bool>(file);
+}
+
+bool MeshWriter::writeObj(const std::string& path, const TriangleMesh& mesh)
+{
+    std::ofstream file{ path, std::ios::trunc };
+    if (!file)
+    {
+        return false;
+    }
+    for (const glm::vec3& position : mesh.positions)
+    {
+        file << "v " << position.x << ' ' << position.y << ' ' << position.z << '\n';
+    }
+    for (const glm::vec3& normal : mesh.normals)
+    {
+        file << "vn " << normal.x << ' ' << normal.y << ' ' << normal.z << '\n';
+    }
+    // indices start at 1
+    for (const glm::uvec3& triangle : mesh.triangles)
+    {
+        glm::uvec3 index{ triangle + 1u };
+        file << "f " << index.x << "//" << index.x << ' ' << index.y << "//" << index.y << ' ' << index.z << "//" << index.z << '\n';
+    }
+    return static_cast<bool>(file);
+}
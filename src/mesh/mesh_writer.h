@@ -0,0 +1,127 @@
+#pragma once
+
+#include "surface_mesher.h"
+#include <misc/bounding_box.h>
+#include <misc/grid.h>
+#include <misc/thread_pool.h>
+
+#include <glm/glm.hpp>
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/// @brief Meshes particle frames on a background thread and writes each frame to its
+///        own file, named by the prefix and the frame index. Blocks of a frame are meshed
+///        in parallel on a thread pool
+class MeshWriter
+{
+public:
+    /// @brief File formats
+    enum class Format
+    {
+        ply, // binary little endian, with normals
+        obj, // text, with normals; much larger and slower to write
+    };
+
+    /// @brief Options for meshing and writing
+    struct Options
+    {
+        /// @brief The file format
+        Format format{ Format::ply };
+
+        /// @brief Options of the mesher
+        SurfaceMesher::Options mesher{};
+
+        /// @brief Threads meshing a frame, including the writer thread; all hardware threads if 0
+        int numThreads{ 0 };
+
+        /// @brief Maximum number of frames waiting to be meshed; write() drops frames beyond
+        int maxQueuedFrames{ 2 };
+    };
+
+private:
+    /// @brief A frame waiting to be meshed
+    struct Frame
+    {
+        std::uint64_t frame{};
+        BoundingBox boundary{};
+        Grid grid{};
+        std::vector<glm::vec4> positions{};
+    };
+
+    /// @brief The options
+    Options m_options{};
+
+    /// @brief The path of the files up to the frame index
+    std::string m_prefix{};
+
+    /// @brief The mesher, only used by the background thread
+    SurfaceMesher m_mesher;
+
+    /// @brief Threads meshing blocks together with the background thread
+    ThreadPool m_pool;
+
+    /// @brief The mesh of the frame being written
+    TriangleMesh m_mesh{};
+
+    /// @brief Frames waiting to be meshed
+    std::deque<Frame> m_queue{};
+
+    /// @brief Guards the queue and the stop flag
+    std::mutex m_mutex{};
+
+    /// @brief Signaled when the queue changes
+    std::condition_variable m_queueChanged{};
+
+    /// @brief Set when the writer is being closed
+    bool m_stop{};
+
+    /// @brief Frames dropped as the queue was full; guarded by the mutex
+    int m_droppedFrames{};
+
+    /// @brief The thread meshing and writing frames
+    std::thread m_thread{};
+
+    /// @brief Background thread loop
+    void run();
+
+    /// @brief Write a mesh as binary PLY
+    static bool writePly(const std::string& path, const TriangleMesh& mesh);
+
+    /// @brief Write a mesh as OBJ
+    static bool writeObj(const std::string& path, const TriangleMesh& mesh);
+
+public:
+    /// @brief Start the background thread
+    /// @param prefix the path of the files up to the frame index, e.g. "meshes/fluid_"
+    /// @param options the options
+    MeshWriter(const std::string& prefix, const Options& options);
+
+    /// @brief Mesh and write the pending frames
+    ~MeshWriter();
+
+    /// @brief No copying
+    MeshWriter(const MeshWriter& other) = delete;
+
+    /// @brief No copying
+    MeshWriter& operator=(const MeshWriter& other) = delete;
+
+    /// @brief Queue a frame for meshing; the positions are copied. Drops the frame if the
+    ///        queue is full, which keeps memory bounded when meshing falls behind without
+    ///        stalling the simulation thread that calls this
+    /// @param frame the frame index, which names the file
+    /// @param boundary the boundary of the grid
+    /// @param grid the grid of the simulation
+    /// @param positions positions of particles; those with w = 0 are dead and skipped
+    /// @param numParticles the number of particles
+    void write(std::uint64_t frame, const BoundingBox& boundary, const Grid& grid,
+        const glm::vec4* positions, int numParticles);
+
+    /// @brief Return the number of frames dropped so far as meshing fell behind
+    int droppedFrames();
+};
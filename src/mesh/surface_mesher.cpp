@@ -0,0 +1,378 @@
+#include "surface_mesher.h"
+
+#include <glm/gtc/constants.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+namespace
+{
+    /// @brief The triangles of marching cubes for every case of inside corners. Corner c
+    ///        is at (c & 1, c >> 1 & 1, c >> 2 & 1), and a corner is inside when its bit
+    ///        is set in the case
+    struct MarchingCubesTable
+    {
+        /// @brief The corners of every edge, the lower one first
+        std::array<glm::ivec2, 12> edges{};
+
+        /// @brief The edges each triangle has its vertices on
+        std::array<std::vector<glm::ivec3>, 256> triangles{};
+    };
+
+    /// @brief The position of a corner of the unit cube
+    glm::ivec3 corner(int c)
+    {
+        return glm::ivec3{ c & 1, (c >> 1) & 1, (c >> 2) & 1 };
+    }
+
+    /// @brief Build the table from the faces of the cube rather than by listing it. On
+    ///        every face the crossed edges are joined so that each run of inside corners is
+    ///        cut off on its own, which only depends on the face and so always agrees with
+    ///        the cube on the other side. The pieces join into loops around the surface,
+    ///        which are split into fans of triangles
+    MarchingCubesTable buildTable()
+    {
+        MarchingCubesTable table{};
+        std::array<std::array<int, 8>, 8> edgeIndex{};
+        int numEdges{ 0 };
+        for (int axis{ 0 }; axis < 3; ++axis)
+        {
+            for (int c{ 0 }; c < 8; ++c)
+            {
+                if ((c >> axis & 1) == 0)
+                {
+                    int other{ c | 1 << axis };
+                    table.edges[numEdges] = glm::ivec2{ c, other };
+                    edgeIndex[c][other] = numEdges;
+                    edgeIndex[other][c] = numEdges;
+                    ++numEdges;
+                }
+            }
+        }
+
+        // corners of every face, counterclockwise seen from outside
+        std::array<std::array<int, 4>, 6> faces{};
+        for (int axis{ 0 }; axis < 3; ++axis)
+        {
+            int u{ 1 << (axis + 1) % 3 };
+            int w{ 1 << (axis + 2) % 3 };
+            for (int side{ 0 }; side < 2; ++side)
+            {
+                int base{ side << axis };
+                std::array<int, 4>& face{ faces[2 * axis + side] };
+                face = { base, base | u, base | u | w, base | w };
+                if (side == 0)
+                {
+                    std::swap(face[1], face[3]);
+                }
+            }
+        }
+
+        for (int cube{ 0 }; cube < 256; ++cube)
+        {
+            auto inside{ [cube](int c) { return (cube >> c & 1) != 0; } };
+
+            // an edge is entered on one of its faces and left on the other, as the faces run
+            // along it in opposite directions, so every crossed edge has one next edge
+            std::array<int, 12> next{};
+            next.fill(-1);
+            for (const std::array<int, 4>& face : faces)
+            {
+                for (int k{ 0 }; k < 4; ++k)
+                {
+                    int from{ face[k] };
+                    int to{ face[(k + 1) % 4] };
+                    if (inside(from) || !inside(to))
+                    {
+                        continue;
+                    }
+                    for (int j{ 1 }; j < 4; ++j)
+                    {
+                        int last{ face[(k + j) % 4] };
+                        int after{ face[(k + j + 1) % 4] };
+                        if (inside(last) && !inside(after))
+                        {
+                            next[edgeIndex[from][to]] = edgeIndex[last][after];
+                            break;
+                        }
+                    }
+                }
+            }
+
+            std::array<bool, 12> visited{};
+            for (int start{ 0 }; start < 12; ++start)
+            {
+                if (next[start] < 0 || visited[start])
+                {
+                    continue;
+                }
+                std::vector<int> loop{};
+                for (int edge{ start }; !visited[edge]; edge = next[edge])
+                {
+                    visited[edge] = true;
+                    loop.push_back(edge);
+                }
+                for (std::size_t i{ 2 }; i < loop.size(); ++i)
+                {
+                    table.triangles[cube].push_back(glm::ivec3{ loop[0], loop[i - 1], loop[i] });
+                }
+            }
+        }
+
+        // the loops turn the same way around every surface; flip them if that is clockwise
+        // seen from outside, tested on the corner at the origin being the only one inside
+        auto midpoint{ [&](int edge) { return glm::vec3{ corner(table.edges[edge].x) + corner(table.edges[edge].y) } * 0.5f; } };
+        const glm::ivec3& first{ table.triangles[1].front() };
+        glm::vec3 a{ midpoint(first.x) };
+        glm::vec3 normal{ glm::cross(midpoint(first.y) - a, midpoint(first.z) - a) };
+        if (glm::dot(normal, glm::vec3{ 1.0f }) < 0.0f)
+        {
+            for (std::vector<glm::ivec3>& triangles : table.triangles)
+            {
+                for (glm::ivec3& triangle : triangles)
+                {
+                    std::swap(triangle.y, triangle.z);
+                }
+            }
+        }
+        return table;
+    }
+
+    /// @brief The marching cubes table, built on first use
+    const MarchingCubesTable& marchingCubesTable()
+    {
+        static const MarchingCubesTable table{ buildTable() };
+        return table;
+    }
+}
+
+SurfaceMesher::SurfaceMesher(const Options& options)
+    : m_options{ options }
+{
+    m_options.voxelsPerCell = std::max(m_options.voxelsPerCell, 1);
+    m_options.cellsPerBlock = std::max(m_options.cellsPerBlock, 1);
+    // particles only reach the blocks next to their own
+    m_options.radius = std::clamp(m_options.radius, 0.0f, static_cast<float>(m_options.cellsPerBlock));
+}
+
+void SurfaceMesher::extract(ThreadPool& pool, const glm::vec4* positions, int numParticles,
+    const BoundingBox& boundary, const Grid& grid, TriangleMesh& mesh)
+{
+    m_voxelSize = grid.cellSize / m_options.voxelsPerCell;
+    m_blockSize = grid.cellSize * m_options.cellsPerBlock;
+    // a block of padding on every side closes the surface where fluid touches the boundary
+    m_blocks = glm::ivec3{ (glm::ivec3{ grid.resolution } + m_options.cellsPerBlock - 1) / m_options.cellsPerBlock } + 2;
+    m_origin = boundary.low - m_blockSize;
+
+    binParticles(pool, positions, numParticles);
+
+    m_blockMeshes.resize(m_activeBlocks.size());
+    pool.parallelFor(static_cast<int>(m_activeBlocks.size()), [this](int i) { meshBlock(m_activeBlocks[i], m_blockMeshes[i]); });
+
+    std::vector<std::size_t> firstVertices(m_blockMeshes.size() + 1);
+    std::vector<std::size_t> firstTriangles(m_blockMeshes.size() + 1);
+    for (std::size_t i{ 0 }; i < m_blockMeshes.size(); ++i)
+    {
+        firstVertices[i + 1] = firstVertices[i] + m_blockMeshes[i].positions.size();
+        firstTriangles[i + 1] = firstTriangles[i] + m_blockMeshes[i].triangles.size();
+    }
+    mesh.positions.resize(firstVertices.back());
+    mesh.normals.resize(firstVertices.back());
+    mesh.triangles.resize(firstTriangles.back());
+    pool.parallelFor(static_cast<int>(m_blockMeshes.size()), [&](int i)
+        {
+            const TriangleMesh& block{ m_blockMeshes[i] };
+            std::copy(block.positions.begin(), block.positions.end(), mesh.positions.begin() + firstVertices[i]);
+            std::copy(block.normals.begin(), block.normals.end(), mesh.normals.begin() + firstVertices[i]);
+            glm::uvec3 offset{ static_cast<unsigned int>(firstVertices[i]) };
+            std::transform(block.triangles.begin(), block.triangles.end(), mesh.triangles.begin() + firstTriangles[i],
+                [offset](const glm::uvec3& triangle) { return triangle + offset; });
+        });
+}
+
+void SurfaceMesher::binParticles(ThreadPool& pool, const glm::vec4* positions, int numParticles)
+{
+    constexpr int particlesPerTask{ 1 << 14 };
+    int numBlocks{ m_blocks.x * m_blocks.y * m_blocks.z };
+    m_particleBlocks.resize(numParticles);
+    pool.parallelFor((numParticles + particlesPerTask - 1) / particlesPerTask, [&](int task)
+        {
+            int end{ std::min(numParticles, (task + 1) * particlesPerTask) };
+            for (int i{ task * particlesPerTask }; i < end; ++i)
+            {
+                // dead IDs of ID-ordered frames are at w = 0
+                glm::vec3 position{ positions[i] };
+                if (positions[i].w == 0.0f
+                    || !std::isfinite(position.x) || !std::isfinite(position.y) || !std::isfinite(position.z))
+                {
+                    m_particleBlocks[i] = -1;
+                    continue;
+                }
+                glm::ivec3 block{ glm::clamp(glm::ivec3{ glm::floor((position - m_origin) / m_blockSize) }, glm::ivec3{ 0 }, m_blocks - 1) };
+                m_particleBlocks[i] = block.x + m_blocks.x * (block.y + m_blocks.y * block.z);
+            }
+        });
+
+    // counting sort, so the particles of a block are together
+    m_blockStarts.assign(numBlocks + 1, 0);
+    for (int block : m_particleBlocks)
+    {
+        m_blockStarts[block + 1] += block >= 0;
+    }
+    for (int i{ 0 }; i < numBlocks; ++i)
+    {
+        m_blockStarts[i + 1] += m_blockStarts[i];
+    }
+    std::vector<int> cursors(m_blockStarts.begin(), m_blockStarts.end() - 1);
+    m_sorted.resize(m_blockStarts.back());
+    for (int i{ 0 }; i < numParticles; ++i)
+    {
+        if (m_particleBlocks[i] >= 0)
+        {
+            m_sorted[cursors[m_particleBlocks[i]]++] = glm::vec3{ positions[i] };
+        }
+    }
+
+    // blocks with particles and their neighbors, as particles splat across block faces
+    std::vector<bool> active(numBlocks);
+    for (int z{ 0 }; z < m_blocks.z; ++z)
+    {
+        for (int y{ 0 }; y < m_blocks.y; ++y)
+        {
+            for (int x{ 0 }; x < m_blocks.x; ++x)
+            {
+                int block{ x + m_blocks.x * (y + m_blocks.y * z) };
+                if (m_blockStarts[block] == m_blockStarts[block + 1])
+                {
+                    continue;
+                }
+                for (int dz{ std::max(z - 1, 0) }; dz <= std::min(z + 1, m_blocks.z - 1); ++dz)
+                {
+                    for (int dy{ std::max(y - 1, 0) }; dy <= std::min(y + 1, m_blocks.y - 1); ++dy)
+                    {
+                        for (int dx{ std::max(x - 1, 0) }; dx <= std::min(x + 1, m_blocks.x - 1); ++dx)
+                        {
+                            active[dx + m_blocks.x * (dy + m_blocks.y * dz)] = true;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    m_activeBlocks.clear();
+    for (int block{ 0 }; block < numBlocks; ++block)
+    {
+        if (active[block])
+        {
+            m_activeBlocks.push_back(block);
+        }
+    }
+}
+
+void SurfaceMesher::meshBlock(int block, TriangleMesh& mesh) const
+{
+    mesh.positions.clear();
+    mesh.normals.clear();
+    mesh.triangles.clear();
+
+    // samples reach one voxel past the block on every side for the gradients at its faces
+    int voxels{ m_options.voxelsPerCell * m_options.cellsPerBlock };
+    int size{ voxels + 3 };
+    glm::ivec3 blockIndex{ block % m_blocks.x, block / m_blocks.x % m_blocks.y, block / (m_blocks.x * m_blocks.y) };
+    glm::vec3 sampleOrigin{ m_origin + glm::vec3{ blockIndex } * m_blockSize - m_voxelSize };
+    auto sampleIndex{ [size](const glm::ivec3& sample) { return sample.x + size * (sample.y + size * sample.z); } };
+
+    // poly6 kernel weighted by the volume of a particle at rest, which sums to one inside fluid
+    float cellSize{ m_blockSize / m_options.cellsPerBlock };
+    float radius{ m_options.radius * cellSize };
+    float particleVolume{ cellSize * cellSize * cellSize / m_options.particlesPerCell };
+    float weight{ particleVolume * 315.0f / (64.0f * glm::pi<float>() * radius * radius * radius) };
+    float reach{ radius / m_voxelSize };
+    std::vector<float> density(size * size * size);
+    for (int z{ std::max(blockIndex.z - 1, 0) }; z <= std::min(blockIndex.z + 1, m_blocks.z - 1); ++z)
+    {
+        for (int y{ std::max(blockIndex.y - 1, 0) }; y <= std::min(blockIndex.y + 1, m_blocks.y - 1); ++y)
+        {
+            for (int x{ std::max(blockIndex.x - 1, 0) }; x <= std::min(blockIndex.x + 1, m_blocks.x - 1); ++x)
+            {
+                int neighbor{ x + m_blocks.x * (y + m_blocks.y * z) };
+                for (int i{ m_blockStarts[neighbor] }; i < m_blockStarts[neighbor + 1]; ++i)
+                {
+                    glm::vec3 local{ (m_sorted[i] - sampleOrigin) / m_voxelSize };
+                    glm::ivec3 low{ glm::max(glm::ivec3{ glm::ceil(local - reach) }, glm::ivec3{ 0 }) };
+                    glm::ivec3 high{ glm::min(glm::ivec3{ glm::floor(local + reach) }, glm::ivec3{ size - 1 }) };
+                    for (int sz{ low.z }; sz <= high.z; ++sz)
+                    {
+                        float dz{ sz - local.z };
+                        for (int sy{ low.y }; sy <= high.y; ++sy)
+                        {
+                            float dy{ sy - local.y };
+                            float* row{ &density[sampleIndex(glm::ivec3{ 0, sy, sz })] };
+                            for (int sx{ low.x }; sx <= high.x; ++sx)
+                            {
+                                float dx{ sx - local.x };
+                                float q{ 1.0f - (dx * dx + dy * dy + dz * dz) / (reach * reach) };
+                                if (q > 0.0f)
+                                {
+                                    row[sx] += weight * q * q * q;
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    auto gradientAt{ [&](const glm::ivec3& sample)
+        {
+            return glm::vec3{
+                density[sampleIndex(sample + glm::ivec3{ 1, 0, 0 })] - density[sampleIndex(sample - glm::ivec3{ 1, 0, 0 })],
+                density[sampleIndex(sample + glm::ivec3{ 0, 1, 0 })] - density[sampleIndex(sample - glm::ivec3{ 0, 1, 0 })],
+                density[sampleIndex(sample + glm::ivec3{ 0, 0, 1 })] - density[sampleIndex(sample - glm::ivec3{ 0, 0, 1 })] };
+        } };
+
+    const MarchingCubesTable& table{ marchingCubesTable() };
+    float isoLevel{ m_options.isoLevel };
+    std::vector<int> edgeVertices(3 * density.size(), -1);
+    auto vertex{ [&](const glm::ivec3& cube, int edge)
+        {
+            glm::ivec3 from{ cube + corner(table.edges[edge].x) };
+            glm::ivec3 to{ cube + corner(table.edges[edge].y) };
+            int axis{ to.x != from.x ? 0 : to.y != from.y ? 1 : 2 };
+            int& index{ edgeVertices[3 * sampleIndex(from) + axis] };
+            if (index < 0)
+            {
+                float fromDensity{ density[sampleIndex(from)] };
+                float t{ (isoLevel - fromDensity) / (density[sampleIndex(to)] - fromDensity) };
+                // density rises into the fluid, so the normal points down the gradient
+                glm::vec3 gradient{ glm::mix(gradientAt(from), gradientAt(to), t) };
+                float length{ glm::length(gradient) };
+                index = static_cast<int>(mesh.positions.size());
+                mesh.positions.push_back(sampleOrigin + glm::mix(glm::vec3{ from }, glm::vec3{ to }, t) * m_voxelSize);
+                mesh.normals.push_back(length > 0.0f ? -gradient / length : glm::vec3{ 0.0f });
+            }
+            return static_cast<unsigned int>(index);
+        } };
+
+    for (int z{ 1 }; z <= voxels; ++z)
+    {
+        for (int y{ 1 }; y <= voxels; ++y)
+        {
+            for (int x{ 1 }; x <= voxels; ++x)
+            {
+                glm::ivec3 cube{ x, y, z };
+                int insideCorners{ 0 };
+                for (int c{ 0 }; c < 8; ++c)
+                {
+                    insideCorners |= (density[sampleIndex(cube + corner(c))] > isoLevel) << c;
+                }
+                for (const glm::ivec3& triangle : table.triangles[insideCorners])
+                {
+                    mesh.triangles.push_back(glm::uvec3{ vertex(cube, triangle.x), vertex(cube, triangle.y), vertex(cube, triangle.z) });
+                }
+            }
+        }
+    }
+}
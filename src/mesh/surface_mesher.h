@@ -0,0 +1,99 @@
+#pragma once
+
+#include <misc/bounding_box.h>
+#include <misc/grid.h>
+#include <misc/thread_pool.h>
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <vector>
+
+/// @brief A triangle mesh with a normal per vertex
+struct TriangleMesh
+{
+    std::vector<glm::vec3> positions{};
+    std::vector<glm::vec3> normals{};
+
+    /// @brief Vertex indices, counterclockwise seen from outside
+    std::vector<glm::uvec3> triangles{};
+};
+
+/// @brief Extracts the surface of particles with marching cubes. The density of the
+///        particles is splatted onto a lattice split into blocks of whole grid cells,
+///        and only blocks with particles in or next to them are sampled and meshed, in
+///        parallel. Vertices on faces between blocks are not shared between them
+class SurfaceMesher
+{
+public:
+    /// @brief Options for meshing
+    struct Options
+    {
+        /// @brief Lattice samples along a grid cell
+        int voxelsPerCell{ 2 };
+
+        /// @brief Grid cells along a block
+        int cellsPerBlock{ 4 };
+
+        /// @brief The radius particles are splatted with in grid cells; at most cellsPerBlock
+        float radius{ 0.8f };
+
+        /// @brief Particles in a grid cell of fluid at rest; the simulation sizes its cells
+        ///        for about simulation_params::expectedParticlesPerCell
+        float particlesPerCell{ 15.0f };
+
+        /// @brief The fraction of the rest density the surface is at
+        float isoLevel{ 0.5f };
+    };
+
+private:
+    /// @brief The options
+    Options m_options{};
+
+    /// @brief The number of blocks along each axis, one more on every side than the grid needs
+    glm::ivec3 m_blocks{};
+
+    /// @brief The corner of the first block
+    glm::vec3 m_origin{};
+
+    /// @brief The size of a block and of a lattice voxel in m
+    float m_blockSize{};
+    float m_voxelSize{};
+
+    /// @brief The block of every particle
+    std::vector<int> m_particleBlocks{};
+
+    /// @brief Particles sorted by block, and where each block starts among them
+    std::vector<glm::vec3> m_sorted{};
+    std::vector<int> m_blockStarts{};
+
+    /// @brief Blocks to mesh
+    std::vector<int> m_activeBlocks{};
+
+    /// @brief The meshes of the active blocks
+    std::vector<TriangleMesh> m_blockMeshes{};
+
+    /// @brief Sort particles into blocks and find the blocks to mesh
+    void binParticles(ThreadPool& pool, const glm::vec4* positions, int numParticles);
+
+    /// @brief Sample the density around a block and run marching cubes in it
+    void meshBlock(int block, TriangleMesh& mesh) const;
+
+public:
+    /// @brief Constructor
+    /// @param options the options
+    SurfaceMesher(const Options& options);
+
+    /// @brief Extract the surface of particles
+    /// @param pool the threads meshing blocks
+    /// @param positions positions of particles; those with w = 0 are dead and skipped
+    /// @param numParticles the number of particles
+    /// @param boundary the boundary of the grid
+    /// @param grid the grid of the simulation, which the blocks are made of
+    /// @param mesh the output mesh; replaced
+    void extract(ThreadPool& pool, const glm::vec4* positions, int numParticles,
+        const BoundingBox& boundary, const Grid& grid, TriangleMesh& mesh);
+
+    /// @brief The number of blocks meshed in the last extraction
+    inline std::size_t activeBlocks() const { return m_activeBlocks.size(); }
+};
@@ -0,0 +1,144 @@
+#include "mapped_file.h"
+
+#include <algorithm>
+#include <iostream>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const char* path)
+{
+    m_file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (m_file == INVALID_HANDLE_VALUE)
+    {
+        std::cerr << "Failed to open file " << path << '\n';
+        m_file = nullptr;
+        return;
+    }
+
+    LARGE_INTEGER size{};
+    GetFileSizeEx(m_file, &size);
+    m_size = static_cast<std::size_t>(size.QuadPart);
+    if (m_size == 0)
+    {
+        std::cerr << "File " << path << " is empty\n";
+        release();
+        return;
+    }
+
+    m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (m_mapping)
+    {
+        m_data = static_cast<const std::byte*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+    }
+    if (!m_data)
+    {
+        std::cerr << "Failed to map file " << path << '\n';
+        release();
+    }
+}
+
+void MappedFile::release()
+{
+    if (m_data) UnmapViewOfFile(m_data);
+    if (m_mapping) CloseHandle(m_mapping);
+    if (m_file) CloseHandle(m_file);
+    m_data = nullptr;
+    m_mapping = nullptr;
+    m_file = nullptr;
+    m_size = 0;
+}
+
+void MappedFile::prefetch(std::size_t offset, std::size_t size) const
+{
+    if (!m_data || offset >= m_size) return;
+    WIN32_MEMORY_RANGE_ENTRY range{ const_cast<std::byte*>(m_data) + offset, std::min(size, m_size - offset) };
+    PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+}
+
+#else
+
+MappedFile::MappedFile(const char* path)
+{
+    m_fd = open(path, O_RDONLY);
+    if (m_fd < 0)
+    {
+        std::cerr << "Failed to open file " << path << '\n';
+        return;
+    }
+
+    struct stat status{};
+    fstat(m_fd, &status);
+    m_size = static_cast<std::size_t>(status.st_size);
+    if (m_size == 0)
+    {
+        std::cerr << "File " << path << " is empty\n";
+        release();
+        return;
+    }
+
+    void* data{ mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_fd, 0) };
+    if (data == MAP_FAILED)
+    {
+        std::cerr << "Failed to map file " << path << '\n';
+        release();
+        return;
+    }
+    m_data = static_cast<const std::byte*>(data);
+}
+
+void MappedFile::release()
+{
+    if (m_data) munmap(const_cast<std::byte*>(m_data), m_size);
+    if (m_fd >= 0) close(m_fd);
+    m_data = nullptr;
+    m_fd = -1;
+    m_size = 0;
+}
+
+void MappedFile::prefetch(std::size_t offset, std::size_t size) const
+{
+    if (!m_data || offset >= m_size) return;
+
+    // madvise needs a page-aligned start
+    long pageSize{ sysconf(_SC_PAGESIZE) };
+    std::size_t alignedOffset{ offset - offset % static_cast<std::size_t>(pageSize) };
+    std::size_t length{ std::min(size, m_size - offset) + (offset - alignedOffset) };
+    madvise(const_cast<std::byte*>(m_data) + alignedOffset, length, MADV_WILLNEED);
+}
+
+#endif
+
+MappedFile::~MappedFile()
+{
+    release();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+{
+    *this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+    std::swap(m_data, other.m_data);
+    std::swap(m_size, other.m_size);
+#ifdef _WIN32
+    std::swap(m_file, other.m_file);
+    std::swap(m_mapping, other.m_mapping);
+#else
+    std::swap(m_fd, other.m_fd);
+#endif
+    return *this;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+
+/// @brief A read-only memory mapping of a whole file
+class MappedFile
+{
+private:
+    /// @brief Start of the mapped file; null if not mapped
+    const std::byte* m_data{};
+
+    /// @brief Size of the file in bytes
+    std::size_t m_size{};
+
+#ifdef _WIN32
+    /// @brief Handle of the file
+    void* m_file{};
+
+    /// @brief Handle of the file mapping
+    void* m_mapping{};
+#else
+    /// @brief File descriptor
+    int m_fd{ -1 };
+#endif
+
+    /// @brief Unmap and close the file
+    void release();
+
+public:
+    /// @brief Default constructor; nothing mapped
+    MappedFile() = default;
+
+    /// @brief Map the file at the path for reading
+    /// @param path the file path
+    MappedFile(const char* path);
+
+    /// @brief Unmap the file
+    ~MappedFile();
+
+    /// @brief No copying
+    MappedFile(const MappedFile& other) = delete;
+
+    /// @brief No copying
+    MappedFile& operator=(const MappedFile& other) = delete;
+
+    /// @brief Move constructor
+    MappedFile(MappedFile&& other) noexcept;
+
+    /// @brief Move assignment
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    /// @brief Hint the OS to read the range ahead of use
+    /// @param offset the offset in bytes
+    /// @param size the number of bytes
+    void prefetch(std::size_t offset, std::size_t size) const;
+
+    /// @brief Whether the file is mapped
+    inline bool available() const { return m_data != nullptr; }
+
+    /// @brief Get the start of the mapped file
+    inline const std::byte* data() const { return m_data; }
+
+    /// @brief Get the size of the file
+    inline std::size_t size() const { return m_size; }
+};
@@ -0,0 +1,158 @@
+#include "shared_memory.h"
+
+#include <iostream>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+SharedMemory::SharedMemory(const std::string& name, std::size_t size)
+    : m_name{ "Local\\" + name }
+    , m_owner{ true }
+{
+    // backed by the paging file; the region lives while any process holds a handle
+    DWORD high{ static_cast<DWORD>(static_cast<unsigned long long>(size) >> 32) };
+    DWORD low{ static_cast<DWORD>(size & 0xffffffffull) };
+    m_mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, high, low, m_name.c_str());
+    if (m_mapping && GetLastError() == ERROR_ALREADY_EXISTS)
+    {
+        std::cerr << "Shared memory " << name << " exists already\n";
+        release();
+        return;
+    }
+    if (m_mapping)
+    {
+        m_data = static_cast<std::byte*>(MapViewOfFile(m_mapping, FILE_MAP_ALL_ACCESS, 0, 0, size));
+    }
+    if (!m_data)
+    {
+        std::cerr << "Failed to create shared memory " << name << '\n';
+        release();
+        return;
+    }
+    m_size = size;
+}
+
+SharedMemory::SharedMemory(const std::string& name)
+    : m_name{ "Local\\" + name }
+{
+    m_mapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, m_name.c_str());
+    if (m_mapping)
+    {
+        m_data = static_cast<std::byte*>(MapViewOfFile(m_mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0));
+    }
+    if (!m_data)
+    {
+        std::cerr << "Failed to open shared memory " << name << '\n';
+        release();
+        return;
+    }
+
+    // the view covers whole pages, so it may be larger than the size asked for on creation
+    MEMORY_BASIC_INFORMATION info{};
+    VirtualQuery(m_data, &info, sizeof(info));
+    m_size = info.RegionSize;
+}
+
+void SharedMemory::release()
+{
+    if (m_data) UnmapViewOfFile(m_data);
+    if (m_mapping) CloseHandle(m_mapping);
+    m_data = nullptr;
+    m_mapping = nullptr;
+    m_size = 0;
+}
+
+#else
+
+SharedMemory::SharedMemory(const std::string& name, std::size_t size)
+    : m_name{ "/" + name }
+{
+    int fd{ shm_open(m_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600) };
+    if (fd < 0)
+    {
+        std::cerr << "Failed to create shared memory " << name << '\n';
+        return;
+    }
+    m_owner = true;
+
+    // new pages of the object read as zeros
+    void* data{ ftruncate(fd, static_cast<off_t>(size)) == 0
+        ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED };
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        std::cerr << "Failed to map shared memory " << name << '\n';
+        release();
+        return;
+    }
+    m_data = static_cast<std::byte*>(data);
+    m_size = size;
+}
+
+SharedMemory::SharedMemory(const std::string& name)
+    : m_name{ "/" + name }
+{
+    int fd{ shm_open(m_name.c_str(), O_RDWR, 0600) };
+    if (fd < 0)
+    {
+        std::cerr << "Failed to open shared memory " << name << '\n';
+        return;
+    }
+
+    struct stat status{};
+    fstat(fd, &status);
+    std::size_t size{ static_cast<std::size_t>(status.st_size) };
+    void* data{ size > 0 ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED };
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        std::cerr << "Failed to map shared memory " << name << '\n';
+        return;
+    }
+    m_data = static_cast<std::byte*>(data);
+    m_size = size;
+}
+
+void SharedMemory::release()
+{
+    if (m_data) munmap(m_data, m_size);
+    if (m_owner) shm_unlink(m_name.c_str());
+    m_data = nullptr;
+    m_size = 0;
+    m_owner = false;
+}
+
+#endif
+
+SharedMemory::~SharedMemory()
+{
+    release();
+}
+
+SharedMemory::SharedMemory(SharedMemory&& other) noexcept
+{
+    *this = std::move(other);
+}
+
+SharedMemory& SharedMemory::operator=(SharedMemory&& other) noexcept
+{
+    std::swap(m_data, other.m_data);
+    std::swap(m_size, other.m_size);
+    std::swap(m_name, other.m_name);
+    std::swap(m_owner, other.m_owner);
+#ifdef _WIN32
+    std::swap(m_mapping, other.m_mapping);
+#endif
+    return *this;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+/// @brief A named region of memory shared between processes. The process creating it
+///        owns the name, which is removed when the owner unmaps the region
+class SharedMemory
+{
+private:
+    /// @brief Start of the region; null if not mapped
+    std::byte* m_data{};
+
+    /// @brief Size of the region in bytes
+    std::size_t m_size{};
+
+    /// @brief The name of the region, as given to the OS
+    std::string m_name{};
+
+    /// @brief Whether this process created the region
+    bool m_owner{};
+
+#ifdef _WIN32
+    /// @brief Handle of the file mapping
+    void* m_mapping{};
+#endif
+
+    /// @brief Unmap the region and remove the name if owned
+    void release();
+
+public:
+    /// @brief Default constructor; nothing mapped
+    SharedMemory() = default;
+
+    /// @brief Create a region of zeros; fails if the name is taken
+    /// @param name the name of the region, without slashes
+    /// @param size the size in bytes
+    SharedMemory(const std::string& name, std::size_t size);
+
+    /// @brief Open a region created by another process
+    /// @param name the name of the region, without slashes
+    SharedMemory(const std::string& name);
+
+    /// @brief Unmap the region
+    ~SharedMemory();
+
+    /// @brief No copying
+    SharedMemory(const SharedMemory& other) = delete;
+
+    /// @brief No copying
+    SharedMemory& operator=(const SharedMemory& other) = delete;
+
+    /// @brief Move constructor
+    SharedMemory(SharedMemory&& other) noexcept;
+
+    /// @brief Move assignment
+    SharedMemory& operator=(SharedMemory&& other) noexcept;
+
+    /// @brief Whether the region is mapped
+    inline bool available() const { return m_data != nullptr; }
+
+    /// @brief Get the start of the region
+    inline std::byte* data() const { return m_data; }
+
+    /// @brief Get the size of the region
+    inline std::size_t size() const { return m_size; }
+};
@@ -0,0 +1,93 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(int numThreads)
+{
+    if (numThreads <= 0)
+    {
+        numThreads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    }
+    for (int i{ 1 }; i < numThreads; ++i)
+    {
+        m_threads.emplace_back(&ThreadPool::run, this);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard lock{ m_mutex };
+        m_stop = true;
+    }
+    m_loopStarted.notify_all();
+    for (std::thread& thread : m_threads)
+    {
+        thread.join();
+    }
+}
+
+void ThreadPool::parallelFor(int count, const std::function<void(int)>& body)
+{
+    if (count <= 0)
+    {
+        return;
+    }
+    if (m_threads.empty() || count == 1)
+    {
+        for (int i{ 0 }; i < count; ++i)
+        {
+            body(i);
+        }
+        return;
+    }
+
+    {
+        std::lock_guard lock{ m_mutex };
+        m_body = &body;
+        m_count = count;
+        m_next.store(0, std::memory_order_relaxed);
+        m_busy = static_cast<int>(m_threads.size());
+        ++m_loops;
+    }
+    m_loopStarted.notify_all();
+    work();
+
+    // the body must outlive every worker still finishing an iteration
+    std::unique_lock lock{ m_mutex };
+    m_loopFinished.wait(lock, [this]() { return m_busy == 0; });
+    m_body = nullptr;
+}
+
+void ThreadPool::run()
+{
+    std::uint64_t loops{ 0 };
+    while (true)
+    {
+        {
+            std::unique_lock lock{ m_mutex };
+            m_loopStarted.wait(lock, [&]() { return m_stop || m_loops != loops; });
+            if (m_stop)
+            {
+                return;
+            }
+            loops = m_loops;
+        }
+
+        work();
+
+        std::lock_guard lock{ m_mutex };
+        if (--m_busy == 0)
+        {
+            m_loopFinished.notify_one();
+        }
+    }
+}
+
+void ThreadPool::work()
+{
+    for (int i{ m_next.fetch_add(1, std::memory_order_relaxed) }; i < m_count; i = m_next.fetch_add(1, std::memory_order_relaxed))
+    {
+        (*m_body)(i);
+    }
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// @brief A fixed set of worker threads running the iterations of parallel loops. The
+///        calling thread takes part in the loop, and iterations are handed out one at a
+///        time, so uneven iterations balance themselves
+class ThreadPool
+{
+private:
+    /// @brief The workers
+    std::vector<std::thread> m_threads{};
+
+    /// @brief Guards the loop and the stop flag
+    std::mutex m_mutex{};
+
+    /// @brief Signaled when a loop starts or the pool stops
+    std::condition_variable m_loopStarted{};
+
+    /// @brief Signaled when the last worker leaves a loop
+    std::condition_variable m_loopFinished{};
+
+    /// @brief The body of the running loop; null between loops
+    const std::function<void(int)>* m_body{};
+
+    /// @brief The number of iterations of the running loop
+    int m_count{};
+
+    /// @brief The next iteration to hand out
+    std::atomic<int> m_next{};
+
+    /// @brief The number of workers still in the running loop
+    int m_busy{};
+
+    /// @brief The number of loops started, so a worker runs each loop once
+    std::uint64_t m_loops{};
+
+    /// @brief Set when the pool is being destroyed
+    bool m_stop{};
+
+    /// @brief Worker thread loop
+    void run();
+
+    /// @brief Run iterations of the running loop until none are left
+    void work();
+
+public:
+    /// @brief Start the workers
+    /// @param numThreads the number of threads running loops including the caller; all
+    ///        hardware threads if 0
+    explicit ThreadPool(int numThreads = 0);
+
+    /// @brief Stop the workers
+    ~ThreadPool();
+
+    /// @brief No copying
+    ThreadPool(const ThreadPool& other) = delete;
+
+    /// @brief No copying
+    ThreadPool& operator=(const ThreadPool& other) = delete;
+
+    /// @brief The number of threads running loops including the caller
+    inline int numThreads() const { return static_cast<int>(m_threads.size()) + 1; }
+
+    /// @brief Run body(i) for i from 0 to count - 1 on the pool and return when all are
+    ///        done. Only one thread may run loops on a pool at a time
+    void parallelFor(int count, const std::function<void(int)>& body);
+};
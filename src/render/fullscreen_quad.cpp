@@ -11,9 +11,9 @@ FullscreenQuad::FullscreenQuad()
         -1.0f, 1.0f
     };
 
-    glGenBuffers(1, &m_VBO);
-    glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    glCreateBuffers(1, &m_VBO);
+    glNamedBufferData(m_VBO, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    m_memory = GpuMemory::Allocation{ GpuMemory::Tag{ "renderer", "fullscreen quad" }, sizeof(vertices) };
 
     m_VAO.setAttrib(m_VBO, 0, 2, GL_FLOAT, 2 * sizeof(float), 0);
 }
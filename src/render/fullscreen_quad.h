@@ -3,6 +3,7 @@
 #include <glad/glad.h>
 #include <glutils/shader_program.h>
 #include <glutils/vao.h>
+#include <glutils/gpu_memory.h>
 
 /// @brief A fullscreen quad for rendering with textures
 class FullscreenQuad
@@ -14,6 +15,9 @@ private:
     /// @brief The ID of associated VBO
     GLuint m_VBO{};
 
+    /// @brief The record of the memory of the VBO
+    GpuMemory::Allocation m_memory{};
+
 public:
     /// @brief Allocate a fullscreen quad on GPU
     FullscreenQuad();
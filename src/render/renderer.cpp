@@ -3,6 +3,9 @@
 #include <glm/ext/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
 #include <iostream>
 
 /// @brief Parameters for the renderer
@@ -16,6 +19,7 @@ namespace render_params
     const char* title{ "Fluid Simulation" };
 
     constexpr int fpsFrames{ 60 }; // compute fps every this frames
+    constexpr double idleWait{ 1.0 / 240 }; // in seconds; how long a frame with nothing to draw waits for events
 
     constexpr float cameraDistance{ 3.0f };
     constexpr float cameraAngleY{ 70.0f };
@@ -29,14 +33,32 @@ namespace render_params
     constexpr float near{ 0.1f };
     constexpr float far{ 100.0f };
 
-    constexpr float pointSize{ 0.3f };
-    constexpr float particleRadius{ 0.005f };
+    constexpr bool frustumCulling{ true };
+    constexpr float cullMargin{ 0.1f }; // in m; more than the radius of a splat at the lowest resolution
 
-    constexpr int renderTextureWidth{ 64 * 16 };
-    constexpr int renderTextureHeight{ 64 * 10 };
+    constexpr float pointSize{ 0.3f }; // in pixels of a texture pointSizeHeight high
+    constexpr float pointSizeHeight{ 640.0f };
+    constexpr float maxPointSize{ 128.0f }; // also in pixels of a texture pointSizeHeight high
+    constexpr float particleRadius{ 0.005f };
 
-    constexpr int backgroundWidth{ 1920 };
-    constexpr int backgroundHeight{ 1080 };
+    // the screen space textures are the window size times a scale, adjusted every frame
+    // to keep the GPU time of rendering near the target
+    constexpr bool dynamicResolution{ true };
+    constexpr double targetGpuTime{ 0.012 }; // in seconds
+    constexpr double gpuTimeTolerance{ 0.1 }; // no change while within this fraction of the target
+    constexpr float minResolutionScale{ 0.25f };
+    constexpr float maxResolutionScale{ 1.0f };
+    constexpr int resolutionCooldown{ 8 }; // measurements after a change before the next one
+    constexpr int resolutionAlignment{ 8 }; // texture sizes are multiples of this
+    constexpr int gpuTimerQueries{ 4 };
+    constexpr float upsampleRange{ 0.02f }; // in view space; texels farther behind are not blended
+    constexpr int thicknessDownsample{ 2 }; // thickness is rendered this many times smaller than depth
+
+    constexpr int blurGroupSize{ 128 }; // the same as in the blur shader
+    constexpr float normalSmoothSigma{ 10.0f }; // in texels
+    constexpr bool smoothDepth{ false }; // smooth depth before normals rather than normals
+    constexpr float depthSmoothSigma{ 6.0f }; // in texels
+    constexpr float depthSmoothRange{ 0.02f }; // in view space; about four particle radii
 
     const glm::vec3 fluidColor{ 0.137f, 0.537f, 1.0f };
     constexpr float fluidSpecular{ 0.5f };
@@ -44,21 +66,52 @@ namespace render_params
     constexpr float fluidReflectance{ 0.1f };
     constexpr float fluidRefractance{ 0.1f };
     constexpr float fluidAttenuation{ 1.0f };
+
+    const char* cachePath{ "fluid.pbfc" };
+    constexpr bool cacheVelocities{ false };
+    constexpr bool cacheCompression{ true };
+    constexpr int playbackReadAhead{ 8 };
+
+    const char* checkpointPath{ "fluid.pbfk" };
+
+    const char* meshPrefix{ "fluid_" }; // followed by the frame index
+    constexpr MeshWriter::Format meshFormat{ MeshWriter::Format::ply };
+
+    constexpr bool compactStorage{ false }; // see the benchmark for its density error
+
+    constexpr int particleCapacity{ 150'000 }; // room for particles from the inflow
+    const BoundingBox inflowRegion{ glm::vec3{ -0.9f, 1.4f, -0.9f }, glm::vec3{ -0.7f, 1.6f, -0.7f } };
+    const glm::vec3 inflowVelocity{ 1.0f, 0.0f, 1.0f };
+    constexpr float inflowRate{ 30'000.0f }; // particles per second
+    const BoundingBox outflowRegion{ glm::vec3{ 0.6f, -0.5f, 0.6f }, glm::vec3{ 1.0f, -0.3f, 1.0f } };
+
+    const char* colliderPath{ "collider.obj" }; // an obstacle in the tank, if the file exists
 }
 
 namespace shader_path
 {
-    const char* particleVert{ "shaders/particle.vert" };
+    const char* particleVert{ "shaders/interpolated_particle.vert" };
     const char* depthFrag{ "shaders/depth.frag" };
     const char* normalFrag{ "shaders/normal.frag" };
     const char* thicknessFrag{ "shaders/thickness.frag" };
     const char* quadVert{ "shaders/fullscreen_quad.vert" };
     const char* quadFrag{ "shaders/fullscreen_texture.frag" };
-    const char* gaussianFrag{ "shaders/gaussian.frag" };
+    const char* blurComp{ "shaders/blur.comp" };
     const char* backgroundFrag{ "shaders/background.frag" };
     const char* finalFrag{ "shaders/final.frag" };
 }
 
+/// @brief What the GPU memory of the renderer is accounted to
+namespace memory_tag
+{
+    constexpr GpuMemory::Tag depth{ "renderer", "depth" };
+    constexpr GpuMemory::Tag normals{ "renderer", "normals" };
+    constexpr GpuMemory::Tag thickness{ "renderer", "thickness" };
+    constexpr GpuMemory::Tag background{ "renderer", "background" };
+    constexpr GpuMemory::Tag depthBuffers{ "renderer", "depth buffers" };
+    constexpr GpuMemory::Tag skybox{ "renderer", "skybox" };
+}
+
 namespace texture_path
 {
     const char* skyboxPosX{ "assets/cubemap_posx.png" };
@@ -109,23 +162,77 @@ void Renderer::keyCallback(GLFWwindow* window, int key, int scancode, int action
     float moveAmount{ 0.03f * renderer->m_fps / 60.0f };
     if (key == GLFW_KEY_R && action == GLFW_PRESS)
     {
-        renderer->m_fluid.reset();
+        renderer->m_simulation.post([](FluidSystem& fluid) { fluid.reset(); }, true);
+    }
+    if (key == GLFW_KEY_C && action == GLFW_PRESS)
+    {
+        renderer->toggleRecording();
+    }
+    if (key == GLFW_KEY_M && action == GLFW_PRESS)
+    {
+        renderer->toggleMeshing();
+    }
+    if (key == GLFW_KEY_P && action == GLFW_PRESS)
+    {
+        renderer->togglePlayback();
+    }
+    if (key == GLFW_KEY_E && action == GLFW_PRESS)
+    {
+        renderer->toggleFlow();
+    }
+    if (key == GLFW_KEY_B && action == GLFW_PRESS)
+    {
+        renderer->m_smoothDepth = !renderer->m_smoothDepth;
+        renderer->recordPasses();
+        std::cout << (renderer->m_smoothDepth ? "Smoothing depth\n" : "Smoothing normals\n");
+    }
+    if (key == GLFW_KEY_G && action == GLFW_PRESS)
+    {
+        GpuMemory::report(std::cout);
+    }
+    if (key == GLFW_KEY_SPACE && action == GLFW_PRESS)
+    {
+        renderer->m_playbackPaused = !renderer->m_playbackPaused;
+    }
+    if (renderer->m_player && (key == GLFW_KEY_COMMA || key == GLFW_KEY_PERIOD) && action != GLFW_RELEASE)
+    {
+        renderer->m_playbackPaused = true;
+        renderer->m_player->step(key == GLFW_KEY_COMMA ? -1 : 1);
+    }
+    if (key == GLFW_KEY_F5 && action == GLFW_PRESS)
+    {
+        renderer->m_simulation.post([](FluidSystem& fluid)
+            {
+                if (fluid.save(render_params::checkpointPath))
+                {
+                    std::cout << "Checkpoint saved to " << render_params::checkpointPath << "\n";
+                }
+            });
+    }
+    if (key == GLFW_KEY_F9 && action == GLFW_PRESS)
+    {
+        renderer->m_simulation.post([](FluidSystem& fluid) { fluid.load(render_params::checkpointPath); }, true);
+    }
+    if (key >= GLFW_KEY_1 && key < GLFW_KEY_1 + static_cast<int>(FluidSystem::InitialShape::count) && action == GLFW_PRESS)
+    {
+        FluidSystem::InitialShape shape{ static_cast<FluidSystem::InitialShape>(key - GLFW_KEY_1) };
+        renderer->m_simulation.post([shape](FluidSystem& fluid) { fluid.reset(shape); }, true);
     }
     if (key == GLFW_KEY_LEFT)
     {
-        renderer->m_fluid.moveBoundaryX(-moveAmount);
+        renderer->m_simulation.post([moveAmount](FluidSystem& fluid) { fluid.moveBoundaryX(-moveAmount); });
     }
     if (key == GLFW_KEY_RIGHT)
     {
-        renderer->m_fluid.moveBoundaryX(moveAmount);
+        renderer->m_simulation.post([moveAmount](FluidSystem& fluid) { fluid.moveBoundaryX(moveAmount); });
     }
     if (key == GLFW_KEY_DOWN)
     {
-        renderer->m_fluid.moveBoundaryZ(moveAmount);
+        renderer->m_simulation.post([moveAmount](FluidSystem& fluid) { fluid.moveBoundaryZ(moveAmount); });
     }
     if (key == GLFW_KEY_UP)
     {
-        renderer->m_fluid.moveBoundaryZ(-moveAmount);
+        renderer->m_simulation.post([moveAmount](FluidSystem& fluid) { fluid.moveBoundaryZ(-moveAmount); });
     }
 }
 
@@ -164,6 +271,11 @@ void Renderer::mouseCallback(GLFWwindow* window, double xpos, double ypos)
     }
 }
 
+void Renderer::refreshCallback(GLFWwindow* window)
+{
+    static_cast<Renderer*>(glfwGetWindowUserPointer(window))->m_redraw = true;
+}
+
 void Renderer::renderFinal()
 {
     glViewport(0, 0, m_width, m_height);
@@ -171,18 +283,9 @@ void Renderer::renderFinal()
     glEnable(GL_DEPTH_TEST);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    m_depthTexture.bind(0);
-    m_finalShader.setUniform("u_depthMap", 0);
-    m_normalTexture.bind(1);
-    m_finalShader.setUniform("u_normalMap", 1);
-    m_thicknessTexture.bind(2);
-    m_finalShader.setUniform("u_thicknessMap", 2);
-    m_backgroundTexture.bind(3);
-    m_finalShader.setUniform("u_background", 3);
-    m_skybox.bind(4);
-    m_finalShader.setUniform("u_skybox", 4);
-
+    m_finalPass.bind();
     m_finalShader.setUniform("u_projInv", glm::inverse(m_projMatrix));
+    m_finalShader.setUniform("u_upsampleRange", render_params::upsampleRange);
     m_finalShader.setUniform("u_viewInv", glm::inverse(glm::mat3(m_camera.viewMatrix())));
 
     m_finalShader.setUniform("u_fluid.color", render_params::fluidColor);
@@ -200,11 +303,17 @@ void Renderer::renderFinal()
     m_screenQuad.draw(m_finalShader);
 }
 
+void Renderer::setPointSize(ShaderProgram& shader, const Texture& target)
+{
+    // splats cover the same part of the screen at any resolution
+    float scale{ target.height() / render_params::pointSizeHeight };
+    shader.setUniform("u_pointSize", scale * render_params::pointSize);
+    shader.setUniform("u_maxPointSize", scale * render_params::maxPointSize);
+}
+
 void Renderer::renderDepth()
 {
-    m_depthFBO.bind(m_depthTexture);
-    m_depthFBO.disableColorOutput();
-    m_depthFBO.activate();
+    m_depthPass.bind();
 
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 
@@ -218,12 +327,12 @@ void Renderer::renderDepth()
 
     m_depthShader.setUniform("u_mvp", m_projMatrix * m_camera.viewMatrix());
     m_depthShader.setUniform("u_mv", m_camera.viewMatrix());
-    m_depthShader.setUniform("u_pointSize", render_params::pointSize);
+    setPointSize(m_depthShader, m_depthTexture);
     m_depthShader.setUniform("u_proj", m_projMatrix);
     m_depthShader.setUniform("u_radius", render_params::particleRadius);
     m_depthShader.setUniform("u_near", render_params::near);
     m_depthShader.setUniform("u_far", render_params::far);
-    m_fluid.draw(m_depthShader);
+    m_simulation.draw(m_depthShader);
 
     m_depthFBO.deactivate();
 }
@@ -233,16 +342,10 @@ void Renderer::renderNormal()
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
     glEnable(GL_DEPTH_TEST);
 
-    // first pass smooth horizontal
-    m_normalFBO.bind(m_normalTexture);
-    m_normalFBO.disableDepthOutput();
-    m_normalFBO.activate();
-
+    m_normalPass.bind();
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    m_depthTexture.bind(0);
-    m_normalShader.setUniform("u_depthMap", 0);
-    m_normalShader.setUniform("u_diff", glm::vec2{ 4.0f / render_params::renderTextureWidth, 4.0f / render_params::renderTextureHeight });
+    m_normalShader.setUniform("u_diff", glm::vec2{ 4.0f / m_normalTexture.width(), 4.0f / m_normalTexture.height() });
     m_normalShader.setUniform("u_projInv", glm::inverse(m_projMatrix));
     m_screenQuad.draw(m_normalShader);
 
@@ -251,9 +354,7 @@ void Renderer::renderNormal()
 
 void Renderer::renderThickness()
 {
-    m_thicknessFBO.bind(m_thicknessTexture);
-    m_thicknessFBO.disableDepthOutput();
-    m_thicknessFBO.activate();
+    m_thicknessPass.bind();
 
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 
@@ -269,67 +370,344 @@ void Renderer::renderThickness()
 
     m_thicknessShader.setUniform("u_mvp", m_projMatrix * m_camera.viewMatrix());
     m_thicknessShader.setUniform("u_mv", m_camera.viewMatrix());
-    m_thicknessShader.setUniform("u_pointSize", render_params::pointSize);
+    setPointSize(m_thicknessShader, m_thicknessTexture);
     m_thicknessShader.setUniform("u_proj", m_projMatrix);
     m_thicknessShader.setUniform("u_radius", render_params::particleRadius);
     m_thicknessShader.setUniform("u_near", render_params::near);
     m_thicknessShader.setUniform("u_far", render_params::far);
 
-    m_fluid.draw(m_thicknessShader);
+    m_simulation.draw(m_thicknessShader);
 
     glDisable(GL_BLEND);
     m_thicknessFBO.deactivate();
 }
 
+void Renderer::blur(ShaderProgram& shader, const PassDescriptor& pass, const Texture& target, const glm::ivec2& direction)
+{
+    shader.setUniform("u_direction", direction);
+
+    // a group takes a segment of a row or a column
+    int length{ direction.x ? target.width() : target.height() };
+    int lines{ direction.x ? target.height() : target.width() };
+    pass.bind();
+    glDispatchCompute((length + render_params::blurGroupSize - 1) / render_params::blurGroupSize, lines, 1);
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+}
+
 void Renderer::smoothNormal()
 {
-    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-    glEnable(GL_DEPTH_TEST);
+    m_smoothShader.setUniform("u_sigma", render_params::normalSmoothSigma);
+    blur(m_smoothShader, m_smoothNormalRowsPass, m_smoothNormalTexture, glm::ivec2{ 1, 0 });
+    blur(m_smoothShader, m_smoothNormalColumnsPass, m_normalTexture, glm::ivec2{ 0, 1 });
+}
 
-    // first pass smooth horizontal
-    m_normalFBO.bind(m_smoothNormalTexture);
-    m_normalFBO.disableDepthOutput();
-    m_normalFBO.activate();
+void Renderer::smoothDepth()
+{
+    m_bilateralShader.setUniform("u_sigma", render_params::depthSmoothSigma);
+    m_bilateralShader.setUniform("u_rangeSigma", render_params::depthSmoothRange);
+    m_bilateralShader.setUniform("u_projInv", glm::inverse(m_projMatrix));
+    blur(m_bilateralShader, m_smoothDepthRowsPass, m_smoothDepthTextureRows, glm::ivec2{ 1, 0 });
+    blur(m_bilateralShader, m_smoothDepthColumnsPass, m_smoothDepthTexture, glm::ivec2{ 0, 1 });
+}
 
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+void Renderer::renderBackground()
+{
+    m_backgroundPass.bind();
 
-    m_normalTexture.bind(0);
-    m_smoothShader.setUniform("u_texture", 0);
-    m_smoothShader.setUniform("u_direction", glm::vec2{ 1.0f / render_params::renderTextureWidth, 0.0f });
-    m_screenQuad.draw(m_smoothShader);
+    glClearColor(1.0f, 0.0f, 0.0f, 1.0f);
+    glDisable(GL_DEPTH_TEST);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    // second path smooth vertical
-    m_normalFBO.bind(m_normalTexture);
-    m_normalFBO.disableDepthOutput();
-    m_normalFBO.activate();
+    glm::mat4 vpInv{ glm::inverse(m_projMatrix * m_camera.viewMatrix()) };
+    m_backgroundShader.setUniform("u_vpInv", vpInv);
+    m_screenQuad.draw(m_backgroundShader);
 
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    m_backgroundFBO.deactivate();
+}
 
-    m_smoothNormalTexture.bind(0);
-    m_smoothShader.setUniform("u_texture", 0);
-    m_smoothShader.setUniform("u_direction", glm::vec2{ 0.0f, 1.0f / render_params::renderTextureHeight });
-    m_screenQuad.draw(m_smoothShader);
+bool Renderer::resizeTextures()
+{
+    bool resized{ false };
+    auto scaled{ [this](int size)
+        {
+            int aligned{ static_cast<int>(size * m_resolutionScale) / render_params::resolutionAlignment * render_params::resolutionAlignment };
+            return std::max(aligned, render_params::resolutionAlignment);
+        } };
+    int width{ scaled(m_width) };
+    int height{ scaled(m_height) };
 
-    m_normalFBO.deactivate();
+    if (width != m_depthTexture.width() || height != m_depthTexture.height())
+    {
+        m_depthTexture = Texture{ width, height, GL_DEPTH_COMPONENT, 0, memory_tag::depth };
+        m_smoothDepthTexture = Texture{ width, height, GL_RED, GL_R32F, memory_tag::depth };
+        m_smoothDepthTextureRows = Texture{ width, height, GL_RED, GL_R32F, memory_tag::depth };
+        m_normalTexture = Texture{ width, height, GL_RGBA, GL_RGBA8, memory_tag::normals };
+        m_smoothNormalTexture = Texture{ width, height, GL_RGBA, GL_RGBA8, memory_tag::normals };
+        resized = true;
+    }
+    // absorption by thickness varies slowly over the screen, and blending is costly
+    int thicknessWidth{ std::max(width / render_params::thicknessDownsample, 1) };
+    int thicknessHeight{ std::max(height / render_params::thicknessDownsample, 1) };
+    if (thicknessWidth != m_thicknessTexture.width() || thicknessHeight != m_thicknessTexture.height())
+    {
+        m_thicknessTexture = Texture{ thicknessWidth, thicknessHeight, GL_RGB, 0, memory_tag::thickness };
+        resized = true;
+    }
+    if (m_width != m_backgroundTexture.width() || m_height != m_backgroundTexture.height())
+    {
+        m_backgroundTexture = Texture{ m_width, m_height, GL_RGB, 0, memory_tag::background };
+        resized = true;
+    }
+    if (resized)
+    {
+        attachTargets();
+    }
+    return resized;
 }
 
-void Renderer::renderBackground()
+void Renderer::attachTargets()
 {
+    m_depthFBO.bind(m_depthTexture);
+    m_depthFBO.disableColorOutput();
+    m_normalFBO.bind(m_normalTexture);
+    m_normalFBO.disableDepthOutput();
+    m_thicknessFBO.bind(m_thicknessTexture);
+    m_thicknessFBO.disableDepthOutput();
     m_backgroundFBO.bind(m_backgroundTexture);
     m_backgroundFBO.disableDepthOutput();
-    m_backgroundFBO.activate();
+}
 
-    glClearColor(1.0f, 0.0f, 0.0f, 1.0f);
-    glDisable(GL_DEPTH_TEST);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+void Renderer::recordPasses()
+{
+    // the passes refer to the textures, which stay the same objects when they are resized
+    const Texture& depth{ m_smoothDepth ? m_smoothDepthTexture : m_depthTexture };
+    m_depthPass = PassDescriptor{ m_depthShader }.target(m_depthFBO);
+    m_thicknessPass = PassDescriptor{ m_thicknessShader }.target(m_thicknessFBO);
+    m_normalPass = PassDescriptor{ m_normalShader }
+        .texture(0, depth)
+        .target(m_normalFBO);
+    m_backgroundPass = PassDescriptor{ m_backgroundShader }
+        .texture(0, m_skybox)
+        .target(m_backgroundFBO);
+    m_finalPass = PassDescriptor{ m_finalShader }
+        .texture(0, depth)
+        .texture(1, m_normalTexture)
+        .texture(2, m_thicknessTexture)
+        .texture(3, m_backgroundTexture)
+        .texture(4, m_skybox);
+    m_smoothNormalRowsPass = PassDescriptor{ m_smoothShader }
+        .texture(0, m_normalTexture)
+        .image(0, m_smoothNormalTexture, GL_WRITE_ONLY);
+    m_smoothNormalColumnsPass = PassDescriptor{ m_smoothShader }
+        .texture(0, m_smoothNormalTexture)
+        .image(0, m_normalTexture, GL_WRITE_ONLY);
+    m_smoothDepthRowsPass = PassDescriptor{ m_bilateralShader }
+        .texture(0, m_depthTexture)
+        .image(0, m_smoothDepthTextureRows, GL_WRITE_ONLY);
+    m_smoothDepthColumnsPass = PassDescriptor{ m_bilateralShader }
+        .texture(0, m_smoothDepthTextureRows)
+        .image(0, m_smoothDepthTexture, GL_WRITE_ONLY);
 
-    m_skybox.bind(0);
-    glm::mat4 vpInv{ glm::inverse(m_projMatrix * m_camera.viewMatrix()) };
+    m_finalShader.setUniform("u_depthMap", 0);
+    m_finalShader.setUniform("u_normalMap", 1);
+    m_finalShader.setUniform("u_thicknessMap", 2);
+    m_finalShader.setUniform("u_background", 3);
+    m_finalShader.setUniform("u_skybox", 4);
+    m_normalShader.setUniform("u_depthMap", 0);
     m_backgroundShader.setUniform("u_skybox", 0);
-    m_backgroundShader.setUniform("u_vpInv", vpInv);
-    m_screenQuad.draw(m_backgroundShader);
+    for (ShaderProgram* shader : { &m_smoothShader, &m_bilateralShader })
+    {
+        shader->setUniform("u_source", 0);
+        shader->setUniform("u_target", 0);
+    }
+}
 
-    m_backgroundFBO.deactivate();
+void Renderer::updateResolution()
+{
+    double gpuTime{};
+    if (!m_gpuTimer.poll(gpuTime))
+    {
+        return;
+    }
+    m_gpuTime = gpuTime;
+    if (!render_params::dynamicResolution || m_resolutionCooldown-- > 0)
+    {
+        return;
+    }
+
+    double ratio{ render_params::targetGpuTime / gpuTime };
+    if (std::abs(ratio - 1.0) < render_params::gpuTimeTolerance)
+    {
+        return;
+    }
+    // most passes cost in proportion to the pixels, the square of the scale
+    float scale{ std::clamp(m_resolutionScale * static_cast<float>(std::sqrt(ratio)),
+        render_params::minResolutionScale, render_params::maxResolutionScale) };
+    if (scale != m_resolutionScale)
+    {
+        m_resolutionScale = scale;
+        m_resolutionCooldown = render_params::resolutionCooldown;
+    }
+}
+
+void Renderer::updateSnapshotCallback()
+{
+    // snapshots are in particle ID order, as the simulation thread tracks IDs, so they hold
+    // dead IDs at w = 0; both writers keep them dead rather than writing them as particles
+    m_simulation.post([cacheWriter = m_cacheWriter.get(), meshWriter = m_meshWriter.get()](FluidSystem& fluid)
+        {
+            if (!cacheWriter && !meshWriter)
+            {
+                fluid.setSnapshotCallback({});
+                return;
+            }
+            fluid.setSnapshotCallback([cacheWriter, meshWriter](const ParticleSnapshot& snapshot)
+                {
+                    if (cacheWriter)
+                    {
+                        cacheWriter->write(snapshot.frame, snapshot.boundary, snapshot.grid,
+                            snapshot.positions, snapshot.velocities, snapshot.numParticles, snapshot.idOrdered);
+                    }
+                    if (meshWriter)
+                    {
+                        meshWriter->write(snapshot.frame, snapshot.boundary, snapshot.grid, snapshot.positions, snapshot.numParticles);
+                    }
+                });
+        });
+}
+
+void Renderer::toggleRecording()
+{
+    if (m_cacheWriter)
+    {
+        std::unique_ptr<ParticleCacheWriter> writer{ std::move(m_cacheWriter) };
+        updateSnapshotCallback();
+        m_simulation.flush(); // no snapshot may arrive once the writer is gone
+        int dropped{ writer->droppedFrames() };
+        writer.reset(); // finishes writing
+        std::cout << "Recording saved to " << render_params::cachePath << "\n";
+        if (dropped > 0)
+        {
+            std::cout << dropped << " frames were dropped as the disk fell behind\n";
+        }
+        return;
+    }
+
+    ParticleCacheWriter::Options options{};
+    options.velocities = render_params::cacheVelocities;
+    options.compress = render_params::cacheCompression;
+    m_cacheWriter = std::make_unique<ParticleCacheWriter>(render_params::cachePath, options);
+    if (!m_cacheWriter->available())
+    {
+        m_cacheWriter.reset();
+        return;
+    }
+    updateSnapshotCallback();
+    std::cout << "Recording to " << render_params::cachePath << "\n";
+}
+
+void Renderer::toggleMeshing()
+{
+    if (m_meshWriter)
+    {
+        std::unique_ptr<MeshWriter> writer{ std::move(m_meshWriter) };
+        updateSnapshotCallback();
+        m_simulation.flush();
+        int dropped{ writer->droppedFrames() };
+        writer.reset(); // meshes the frames still queued
+        std::cout << "Meshing stopped\n";
+        if (dropped > 0)
+        {
+            std::cout << dropped << " frames were dropped as meshing fell behind\n";
+        }
+        return;
+    }
+
+    MeshWriter::Options options{};
+    options.format = render_params::meshFormat;
+    m_meshWriter = std::make_unique<MeshWriter>(render_params::meshPrefix, options);
+    updateSnapshotCallback();
+    std::cout << "Meshing frames to " << render_params::meshPrefix << "*\n";
+}
+
+void Renderer::toggleFlow()
+{
+    m_flowing = !m_flowing;
+    if (m_flowing)
+    {
+        m_simulation.post([](FluidSystem& fluid)
+            {
+                fluid.addEmitter(FluidSystem::Emitter{ render_params::inflowRegion, render_params::inflowVelocity, render_params::inflowRate });
+                fluid.addSink(render_params::outflowRegion);
+            });
+        std::cout << "Inflow and outflow started\n";
+    }
+    else
+    {
+        m_simulation.post([](FluidSystem& fluid)
+            {
+                fluid.clearEmitters();
+                fluid.clearSinks();
+            });
+        std::cout << "Inflow and outflow stopped\n";
+    }
+}
+
+void Renderer::togglePlayback()
+{
+    if (m_player)
+    {
+        m_player.reset();
+        m_simulation.setPaused(false);
+        std::cout << "Playback stopped\n";
+        return;
+    }
+
+    if (m_cacheWriter)
+    {
+        toggleRecording(); // the file must be complete before it is read
+    }
+
+    CachePlayer::Options options{};
+    options.readAhead = render_params::playbackReadAhead;
+    m_player = std::make_unique<CachePlayer>(render_params::cachePath, options);
+    if (!m_player->available())
+    {
+        m_player.reset();
+        return;
+    }
+    m_playbackPaused = false;
+    m_playbackFrame = -1;
+    m_simulation.setPaused(true);
+    std::cout << "Playing " << m_player->numFrames() << " frames from " << render_params::cachePath << "\n";
+}
+
+void Renderer::updatePlayback()
+{
+    int frame{ m_player->position() };
+    if (frame != m_playbackFrame)
+    {
+        if (!m_player->current(m_playbackPositions))
+        {
+            m_player.reset();
+            m_simulation.setPaused(false);
+            return;
+        }
+        // the simulation is paused and takes no snapshots, so played frames are meshed here
+        m_simulation.post([positions = m_playbackPositions, frame, meshWriter = m_meshWriter.get()](FluidSystem& fluid)
+            {
+                fluid.uploadPositions(positions.data(), static_cast<int>(positions.size()));
+                if (meshWriter)
+                {
+                    meshWriter->write(frame, fluid.boundary(), fluid.grid(), positions.data(), static_cast<int>(positions.size()));
+                }
+            }, true);
+        m_playbackFrame = frame;
+    }
+    if (!m_playbackPaused)
+    {
+        m_player->step(1);
+    }
 }
 
 Renderer::Renderer()
@@ -339,26 +717,55 @@ Renderer::Renderer()
     , m_context{ setupContext(m_width, m_height, m_title.c_str()) }
     , m_camera{ render_params::cameraDistance, render_params::cameraAngleY, render_params::cameraAngleX }
     , m_light{ render_params::lightDistance, render_params::lightAngleY, render_params::lightAngleX }
-    , m_skybox{ texture_path::skyboxPosX, texture_path::skyboxNegX, texture_path::skyboxPosY, texture_path::skyboxNegY, texture_path::skyboxPosZ, texture_path::skyboxNegZ }
-    , m_depthTexture{ render_params::renderTextureWidth, render_params::renderTextureHeight, GL_DEPTH_COMPONENT }
-    , m_normalTexture{ render_params::renderTextureWidth, render_params::renderTextureHeight, GL_RGB }
-    , m_smoothNormalTexture{ render_params::renderTextureWidth, render_params::renderTextureHeight, GL_RGB }
-    , m_thicknessTexture{ render_params::renderTextureWidth, render_params::renderTextureHeight, GL_RGB }
-    , m_backgroundTexture{ render_params::backgroundWidth, render_params::backgroundHeight, GL_RGB }
+    , m_simulation{ m_context, FluidSystem::Options{ render_params::compactStorage, render_params::particleCapacity } }
+    , m_skybox{ texture_path::skyboxPosX, texture_path::skyboxNegX, texture_path::skyboxPosY, texture_path::skyboxNegY, texture_path::skyboxPosZ, texture_path::skyboxNegZ,
+        false, memory_tag::skybox }
+    , m_normalFBO{ memory_tag::depthBuffers }
+    , m_thicknessFBO{ memory_tag::depthBuffers }
+    , m_backgroundFBO{ memory_tag::depthBuffers }
     , m_finalShader{ shader_path::quadVert, shader_path::finalFrag }
     , m_depthShader{ shader_path::particleVert, shader_path::depthFrag }
     , m_normalShader{ shader_path::quadVert, shader_path::normalFrag }
     , m_thicknessShader{ shader_path::particleVert, shader_path::thicknessFrag }
-    , m_smoothShader{ shader_path::quadVert, shader_path::gaussianFrag }
+    , m_smoothShader{ shader_path::blurComp }
+    , m_bilateralShader{ shader_path::blurComp, std::vector<std::string>{ "BILATERAL" } }
     , m_backgroundShader{ shader_path::quadVert, shader_path::backgroundFrag }
+    , m_gpuTimer{ render_params::gpuTimerQueries }
+    , m_resolutionScale{ render_params::maxResolutionScale }
+    , m_smoothDepth{ render_params::smoothDepth }
 {
     glfwSetWindowUserPointer(m_context, this); // GLFW callbacks can only be static functions
     glfwSetKeyCallback(m_context, keyCallback);
     glfwSetCursorPosCallback(m_context, mouseCallback);
+    glfwSetWindowRefreshCallback(m_context, refreshCallback);
+    recordPasses();
+
+    if (std::filesystem::exists(render_params::colliderPath))
+    {
+        m_simulation.post([](FluidSystem& fluid)
+            {
+                ThreadPool pool{};
+                DistanceField field{};
+                if (DistanceField::bakeCached(pool, render_params::colliderPath, DistanceField::Options{}, field))
+                {
+                    fluid.addCollider(field);
+                }
+            });
+    }
 };
 
 Renderer::~Renderer()
 {
+    m_player.reset();
+    if (m_cacheWriter)
+    {
+        toggleRecording();
+    }
+    if (m_meshWriter)
+    {
+        toggleMeshing();
+    }
+    m_simulation.stop();
     glfwTerminate();
 }
 
@@ -369,18 +776,75 @@ void Renderer::run()
     while (!glfwWindowShouldClose(m_context))
     {
         glfwGetFramebufferSize(m_context, &m_width, &m_height);
+        if (m_width == 0 || m_height == 0)
+        {
+            glfwWaitEvents(); // minimized
+            continue;
+        }
+        bool resized{ resizeTextures() };
         m_projMatrix = glm::perspective(
             render_params::fov, static_cast<float>(m_width) / m_height,
             render_params::near, render_params::far);
 
-        renderDepth();
-        renderThickness();
-        renderNormal();
-        renderBackground();
-        smoothNormal();
-        renderFinal();
-        m_fluid.update();
+        // particles are drawn between the two latest frames the simulation thread handed over
+        m_simulation.beginFrame();
+        FrameInputs inputs{ m_camera.viewMatrix(), m_projMatrix, m_light.position(), m_simulation.drawVersion(), m_smoothDepth };
+        bool viewChanged{ resized || inputs.view != m_renderedInputs.view || inputs.proj != m_renderedInputs.proj };
+        bool fluidChanged{ viewChanged || inputs.particles != m_renderedInputs.particles || inputs.smoothDepth != m_renderedInputs.smoothDepth };
+        bool frameChanged{ fluidChanged || inputs.light != m_renderedInputs.light || m_redraw };
+
+        // only frames rendering the fluid are timed, as they decide the resolution
+        if (fluidChanged)
+        {
+            m_gpuTimer.begin();
+            if (render_params::frustumCulling)
+            {
+                m_simulation.cull(m_projMatrix * inputs.view, render_params::cullMargin);
+            }
+            renderDepth();
+            renderThickness();
+        }
+        m_simulation.endFrame();
+        if (fluidChanged)
+        {
+            if (m_smoothDepth)
+            {
+                smoothDepth();
+            }
+            renderNormal();
+        }
+        if (viewChanged)
+        {
+            renderBackground();
+        }
+        if (fluidChanged && !m_smoothDepth)
+        {
+            smoothNormal();
+        }
+        if (frameChanged)
+        {
+            renderFinal();
+        }
+        if (fluidChanged)
+        {
+            m_gpuTimer.end();
+        }
+        updateResolution();
+        m_renderedInputs = inputs;
+        m_redraw = false;
+        if (m_player)
+        {
+            updatePlayback();
+        }
 
+        if (!frameChanged)
+        {
+            // the window still shows the last frame; idle time does not count against the frame rate
+            double idleStart{ glfwGetTime() };
+            glfwWaitEventsTimeout(render_params::idleWait);
+            m_timeLastFrame += glfwGetTime() - idleStart;
+            continue;
+        }
         glfwSwapBuffers(m_context);
         glfwPollEvents();
 
@@ -388,7 +852,8 @@ void Renderer::run()
         {
             double timeThisFrame{ glfwGetTime() };
             m_fps = render_params::fpsFrames / (timeThisFrame - m_timeLastFrame);
-            std::cout << "FPS: " << m_fps << "\n";
+            std::cout << "FPS: " << m_fps << ", GPU time: " << m_gpuTime * 1000.0 << " ms, resolution: "
+                << m_depthTexture.width() << "x" << m_depthTexture.height() << "\n";
             m_timeLastFrame = timeThisFrame;
             m_frames = 0;
         }
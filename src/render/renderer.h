@@ -3,17 +3,28 @@
 #include "orbit_camera.h"
 #include "orbit_light.h"
 #include "fullscreen_quad.h"
+#include "simulation_thread.h"
 #include <simulation/fluid_system.h>
 #include <glutils/shader_program.h>
 #include <glutils/fbo.h>
 #include <glutils/texture.h>
 #include <glutils/cubemap.h>
+#include <glutils/pass_descriptor.h>
+#include <glutils/gpu_timer.h>
+#include <glutils/gpu_memory.h>
+#include <cache/particle_cache_writer.h>
+#include <cache/cache_player.h>
+#include <mesh/mesh_writer.h>
+#include <mesh/distance_field.h>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
 
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <vector>
 
 /// @brief Renderer for this project
 class Renderer
@@ -53,8 +64,8 @@ private:
     /// @brief Only one light
     OrbitLight m_light{};
 
-    /// @brief The fluid render
-    FluidSystem m_fluid{};
+    /// @brief The fluid system, simulated on its own thread
+    SimulationThread m_simulation;
 
     /// @brief Fullscreen quad for rendering texture
     FullscreenQuad m_screenQuad{};
@@ -62,19 +73,26 @@ private:
     /// @brief The skybox
     Cubemap m_skybox{};
 
-    /// @brief Texture that holds depth
+    /// @brief Texture that holds depth; this and the other screen space textures are
+    ///        scaled from the window size by the resolution scale
     Texture m_depthTexture{};
 
+    /// @brief Texture that holds smoothed depth
+    Texture m_smoothDepthTexture{};
+
+    /// @brief Texture that holds depth smoothed along rows
+    Texture m_smoothDepthTextureRows{};
+
     /// @brief Texture that holds normal map
     Texture m_normalTexture{};
 
     /// @brief Texture that holds intermediate result of smooth normal
     Texture m_smoothNormalTexture{};
 
-    /// @brief Texture that holds thickness
+    /// @brief Texture that holds thickness; smaller than the other screen space textures
     Texture m_thicknessTexture{};
 
-    /// @brief Texture that shows background; should be the same size as window
+    /// @brief Texture that shows background; the same size as window
     Texture m_backgroundTexture{};
 
     /// @brief FBO for rendering depth to texture
@@ -104,9 +122,88 @@ private:
     /// @brief Shader for smoothing normal (gaussian smooth)
     ShaderProgram m_smoothShader{};
 
+    /// @brief Shader for smoothing depth (bilateral smooth)
+    ShaderProgram m_bilateralShader{};
+
     /// @brief Shader for rendering background
     ShaderProgram m_backgroundShader{};
 
+    /// @brief Bindings of the depth pass
+    PassDescriptor m_depthPass{};
+
+    /// @brief Bindings of the thickness pass
+    PassDescriptor m_thicknessPass{};
+
+    /// @brief Bindings of the normal pass
+    PassDescriptor m_normalPass{};
+
+    /// @brief Bindings of the background pass
+    PassDescriptor m_backgroundPass{};
+
+    /// @brief Bindings of the final pass
+    PassDescriptor m_finalPass{};
+
+    /// @brief Bindings of the blur passes smoothing normals along rows and columns
+    PassDescriptor m_smoothNormalRowsPass{};
+    PassDescriptor m_smoothNormalColumnsPass{};
+
+    /// @brief Bindings of the blur passes smoothing depth along rows and columns
+    PassDescriptor m_smoothDepthRowsPass{};
+    PassDescriptor m_smoothDepthColumnsPass{};
+
+    /// @brief Timer of the GPU time of rendering a frame
+    GpuTimer m_gpuTimer{};
+
+    /// @brief The latest GPU time of rendering a frame in seconds
+    double m_gpuTime{};
+
+    /// @brief The size of screen space textures relative to the window
+    float m_resolutionScale{};
+
+    /// @brief Measurements to wait for before the resolution scale changes again
+    int m_resolutionCooldown{};
+
+    /// @brief Writer of the particle cache; only exists while recording
+    std::unique_ptr<ParticleCacheWriter> m_cacheWriter{};
+
+    /// @brief Writer of surface meshes; only exists while meshing
+    std::unique_ptr<MeshWriter> m_meshWriter{};
+
+    /// @brief Player of the particle cache; only exists during playback, which replaces simulation
+    std::unique_ptr<CachePlayer> m_player{};
+
+    /// @brief Whether playback is paused
+    bool m_playbackPaused{};
+
+    /// @brief The frame of the cache uploaded to the fluid system; -1 if none
+    int m_playbackFrame{ -1 };
+
+    /// @brief Positions of the played frame
+    std::vector<glm::vec4> m_playbackPositions{};
+
+    /// @brief Whether depth is smoothed before normals are computed, rather than the normals
+    bool m_smoothDepth{};
+
+    /// @brief Whether the demo inflow and outflow are on
+    bool m_flowing{};
+
+    /// @brief What a frame is rendered from; passes whose inputs did not change since the
+    ///        last frame keep their textures
+    struct FrameInputs
+    {
+        glm::mat4 view{};
+        glm::mat4 proj{};
+        glm::vec3 light{};
+        std::uint64_t particles{}; // the draw version of the simulation thread
+        bool smoothDepth{};
+    };
+
+    /// @brief The inputs of the last frame rendered
+    FrameInputs m_renderedInputs{};
+
+    /// @brief Whether the window must be drawn again though nothing changed, e.g. when uncovered
+    bool m_redraw{ true };
+
     /// @brief Initialize the window
     static GLFWwindow* setupContext(int width, int height, const char* title);
 
@@ -116,9 +213,15 @@ private:
     /// @brief Callback for mouse event
     static void mouseCallback(GLFWwindow* window, double xpos, double ypos);
 
+    /// @brief Callback when the window must be drawn again
+    static void refreshCallback(GLFWwindow* window);
+
     /// @brief Render final image
     void renderFinal();
 
+    /// @brief Set the point size of a particle shader for drawing into a texture
+    void setPointSize(ShaderProgram& shader, const Texture& target);
+
     /// @brief Render depth to texture
     void renderDepth();
 
@@ -128,12 +231,52 @@ private:
     /// @brief Render thickness to texture
     void renderThickness();
 
+    /// @brief Blur a texture along rows or columns with a blur compute shader
+    /// @param pass the bindings of the shader, the source texture and the target image
+    /// @param direction (1, 0) along rows, (0, 1) along columns
+    void blur(ShaderProgram& shader, const PassDescriptor& pass, const Texture& target, const glm::ivec2& direction);
+
     /// @brief Smooth normal
     void smoothNormal();
 
+    /// @brief Smooth depth, keeping edges between fluid at different depths
+    void smoothDepth();
+
     /// @brief Render the background behind fluid
     void renderBackground();
 
+    /// @brief Resize the screen space textures to the window size and the resolution scale
+    /// @return whether any texture was created again
+    bool resizeTextures();
+
+    /// @brief Attach the screen space textures to the framebuffers, after they are created again
+    void attachTargets();
+
+    /// @brief Record the bindings of every pass; again when the depth the normals are
+    ///        computed from changes
+    void recordPasses();
+
+    /// @brief Adjust the resolution scale to the GPU time of rendering
+    void updateResolution();
+
+    /// @brief Give snapshots of the simulation to the cache writer and the mesh writer that exist
+    void updateSnapshotCallback();
+
+    /// @brief Start or stop recording the simulation to the cache file
+    void toggleRecording();
+
+    /// @brief Start or stop writing a surface mesh of every frame
+    void toggleMeshing();
+
+    /// @brief Start or stop the demo inflow and outflow
+    void toggleFlow();
+
+    /// @brief Start or stop playing back the cache file
+    void togglePlayback();
+
+    /// @brief Advance playback and upload the current frame to the fluid system
+    void updatePlayback();
+
 public:
     /// @brief Create a renderer
     Renderer();
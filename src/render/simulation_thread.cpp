@@ -0,0 +1,416 @@
+#include "simulation_thread.h"
+
+#include <simulation/work_group_tuner.h>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+
+/// @brief Parameters of the simulation thread
+namespace thread_params
+{
+    constexpr int maxLagFrames{ 1 }; // a simulation further behind its schedule starts a new one
+    constexpr float maxJump{ 0.1f }; // in m; particles moving farther between frames are not interpolated
+    constexpr int cullGroupSize{ 1024 }; // the same as in the cull shaders
+    const char* workGroupCache{ "work_groups.txt" }; // tuned work group sizes of the simulation kernels
+}
+
+/// @brief What the GPU memory of frames and culling is accounted to
+namespace memory_tag
+{
+    constexpr GpuMemory::Tag framePositions{ "frames", "positions" };
+    constexpr GpuMemory::Tag frameDensities{ "frames", "densities" };
+    constexpr GpuMemory::Tag drawCommands{ "frames", "draw commands" };
+    constexpr GpuMemory::Tag culling{ "renderer", "culling" };
+}
+
+namespace shader_path
+{
+    const char* cullCells{ "shaders/cull_cells.comp" };
+    const char* cullParticles{ "shaders/cull_particles.comp" };
+}
+
+SimulationThread::SimulationThread(GLFWwindow* window, const FluidSystem::Options& options)
+    : m_options{ options }
+    , m_cullCellsShader{ shader_path::cullCells }
+    , m_cullParticlesShader{ shader_path::cullParticles }
+{
+    GLuint command[]{ 0, 1, 0, 0, 0 };
+    m_cullCommand = SSBO(GL_DYNAMIC_COPY, sizeof(command), command, memory_tag::culling);
+
+    // the latest and the previous frame; their buffers change every frame
+    m_VAO.setFormat(0, 4, GL_FLOAT);
+    m_VAO.setFormat(1, 1, GL_FLOAT);
+    m_VAO.setFormat(2, 4, GL_FLOAT);
+    m_VAO.setFormat(3, 1, GL_FLOAT);
+
+    // windows can only be created on the main thread
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    m_context = glfwCreateWindow(1, 1, "simulation", nullptr, window);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+    if (!m_context)
+    {
+        std::cerr << "Failed to create a context for simulation!\n";
+        return;
+    }
+
+    m_thread = std::thread{ &SimulationThread::run, this };
+}
+
+SimulationThread::~SimulationThread()
+{
+    stop();
+}
+
+void SimulationThread::stop()
+{
+    if (!m_thread.joinable())
+    {
+        return;
+    }
+
+    {
+        std::lock_guard lock{ m_mutex };
+        m_stop = true;
+    }
+    m_changed.notify_all();
+    m_thread.join();
+
+    glfwDestroyWindow(m_context);
+    m_context = nullptr;
+    m_latest = -1;
+    m_previous = -1;
+}
+
+void SimulationThread::run()
+{
+    glfwMakeContextCurrent(m_context);
+    {
+        FluidSystem fluid{ m_options };
+        // frames are handed over in ID order, so the same index is the same particle in both
+        fluid.setParticleIds(true);
+        // the kernels are tuned to this GPU on the first run only
+        WorkGroupTuner{ thread_params::workGroupCache }.apply(fluid);
+        publish(fluid, Clock::now(), false);
+
+        Clock::duration frameDuration{ std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<float>{ FluidSystem::frameTime() }) };
+        Clock::time_point next{ Clock::now() + frameDuration };
+        bool continuous{ true };
+        while (true)
+        {
+            std::vector<std::pair<Command, bool>> commands{};
+            bool paused{};
+            {
+                std::unique_lock lock{ m_mutex };
+                auto ready{ [this]() { return m_stop || !m_commands.empty(); } };
+                if (m_paused)
+                {
+                    m_changed.wait(lock, ready);
+                }
+                else
+                {
+                    m_changed.wait_until(lock, next, ready);
+                }
+                if (m_stop)
+                {
+                    break;
+                }
+                commands.swap(m_commands);
+                paused = m_paused;
+            }
+
+            for (auto& [command, discontinuous] : commands)
+            {
+                command(fluid);
+                continuous = continuous && !discontinuous;
+            }
+            if (!commands.empty())
+            {
+                {
+                    std::lock_guard lock{ m_mutex };
+                    m_executed += commands.size();
+                }
+                m_changed.notify_all();
+            }
+
+            if (paused)
+            {
+                // e.g. played back frames, which are shown as they come
+                if (!commands.empty())
+                {
+                    publish(fluid, Clock::now(), false);
+                }
+                continuous = true;
+                continue;
+            }
+            if (Clock::now() < next)
+            {
+                continue; // woken up by commands
+            }
+
+            // frames are timed when they are ready, which keeps interpolation smooth when
+            // they take longer than the schedule allows
+            fluid.update();
+            publish(fluid, Clock::now(), continuous);
+            continuous = true;
+            next += frameDuration;
+            // a simulation slower than real time starts a new schedule instead of catching up
+            if (Clock::now() - next > thread_params::maxLagFrames * frameDuration)
+            {
+                next = Clock::now();
+            }
+        }
+    }
+
+    // the frames are deleted with the context that wrote them still current
+    for (Slot& slot : m_slots)
+    {
+        glDeleteSync(slot.written);
+        glDeleteSync(slot.read);
+        slot = Slot{};
+    }
+    glfwMakeContextCurrent(nullptr);
+}
+
+void SimulationThread::publish(FluidSystem& fluid, Clock::time_point time, bool continuous)
+{
+    int index{ -1 };
+    GLsync read{};
+    {
+        std::lock_guard lock{ m_mutex };
+        // the renderer draws at most two slots, so one of the others is always free
+        for (int i{ 0 }; i < numSlots && index < 0; ++i)
+        {
+            if (i != m_latest && i != m_previous && !m_slots[i].rendering)
+            {
+                index = i;
+            }
+        }
+        if (index < 0)
+        {
+            index = m_previous;
+            m_previous = -1; // not to be chosen while it is being written
+        }
+        std::swap(read, m_slots[index].read);
+    }
+
+    Slot& slot{ m_slots[index] };
+    if (read)
+    {
+        // the renderer's draws of the slot must be done before it is overwritten
+        glWaitSync(read, 0, GL_TIMEOUT_IGNORED);
+        glDeleteSync(read);
+    }
+    if (slot.capacity != fluid.capacity())
+    {
+        slot.capacity = fluid.capacity();
+        slot.positions = SSBO(GL_DYNAMIC_COPY, slot.capacity * sizeof(glm::vec4), nullptr, memory_tag::framePositions);
+        slot.densities = SSBO(GL_DYNAMIC_COPY, slot.capacity * sizeof(float), nullptr, memory_tag::frameDensities);
+        GLuint command[]{ 0, 1, 0, 0 };
+        slot.drawCommand = SSBO(GL_DYNAMIC_COPY, sizeof(command), command, memory_tag::drawCommands);
+    }
+    fluid.exportFrame(slot.positions, slot.densities, slot.drawCommand);
+    glDeleteSync(slot.written);
+    GLsync written{ glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0) };
+    glFlush(); // the fence must reach the GPU before the renderer's context waits on it
+
+    std::lock_guard lock{ m_mutex };
+    slot.written = written;
+    slot.time = time;
+    slot.continuous = continuous;
+    slot.generation = ++m_generation;
+    slot.boundary = fluid.boundary();
+    slot.grid = fluid.grid();
+    m_previous = m_latest;
+    m_latest = index;
+}
+
+void SimulationThread::post(Command command, bool discontinuous)
+{
+    {
+        std::lock_guard lock{ m_mutex };
+        m_commands.emplace_back(std::move(command), discontinuous);
+        ++m_posted;
+    }
+    m_changed.notify_all();
+}
+
+void SimulationThread::flush()
+{
+    std::unique_lock lock{ m_mutex };
+    std::uint64_t posted{ m_posted };
+    m_changed.wait(lock, [&]() { return m_stop || !m_thread.joinable() || m_executed >= posted; });
+}
+
+void SimulationThread::setPaused(bool paused)
+{
+    {
+        std::lock_guard lock{ m_mutex };
+        m_paused = paused;
+    }
+    m_changed.notify_all();
+}
+
+void SimulationThread::beginFrame()
+{
+    GLsync latestWritten{};
+    GLsync previousWritten{};
+    {
+        std::lock_guard lock{ m_mutex };
+        m_drawLatest = m_latest;
+        m_drawPrevious = -1;
+        m_alpha = 1.0f;
+        if (m_latest < 0)
+        {
+            return;
+        }
+
+        Slot& latest{ m_slots[m_latest] };
+        latest.rendering = true;
+        latestWritten = latest.written;
+        if (m_previous >= 0 && latest.continuous && m_slots[m_previous].capacity == latest.capacity)
+        {
+            Slot& previous{ m_slots[m_previous] };
+            previous.rendering = true;
+            previousWritten = previous.written;
+            m_drawPrevious = m_previous;
+
+            // drawn one frame late, so the latest frame is reached when the next one is expected
+            std::chrono::duration<float> sinceLatest{ Clock::now() - latest.time };
+            std::chrono::duration<float> interval{ latest.time - previous.time };
+            m_alpha = interval.count() > 0.0f ? std::clamp(sinceLatest / interval, 0.0f, 1.0f) : 1.0f;
+        }
+
+        std::uint64_t previousGeneration{ m_drawPrevious >= 0 ? m_slots[m_drawPrevious].generation : 0 };
+        if (latest.generation != m_drawnLatest || previousGeneration != m_drawnPrevious || m_alpha != m_drawnAlpha)
+        {
+            m_drawnLatest = latest.generation;
+            m_drawnPrevious = previousGeneration;
+            m_drawnAlpha = m_alpha;
+            ++m_drawVersion;
+        }
+    }
+
+    glWaitSync(latestWritten, 0, GL_TIMEOUT_IGNORED);
+    if (previousWritten)
+    {
+        glWaitSync(previousWritten, 0, GL_TIMEOUT_IGNORED);
+    }
+}
+
+void SimulationThread::cull(const glm::mat4& viewProj, float margin)
+{
+    m_culled = false;
+    if (m_drawLatest < 0)
+    {
+        return;
+    }
+
+    const Slot& latest{ m_slots[m_drawLatest] };
+    const Slot& previous{ m_slots[m_drawPrevious >= 0 ? m_drawPrevious : m_drawLatest] };
+    if (m_visibleCellsCapacity < latest.grid.numCells)
+    {
+        m_visibleCellsCapacity = latest.grid.numCells;
+        m_visibleCells = SSBO(GL_DYNAMIC_COPY, m_visibleCellsCapacity * sizeof(GLuint), nullptr, memory_tag::culling);
+    }
+    if (m_visibleIndicesCapacity < latest.capacity)
+    {
+        m_visibleIndicesCapacity = latest.capacity;
+        m_visibleIndices = SSBO(GL_DYNAMIC_COPY, m_visibleIndicesCapacity * sizeof(GLuint), nullptr, memory_tag::culling);
+    }
+
+    // planes of the frustum from the rows of the matrix, normalized so the margin is a distance
+    glm::mat4 rows{ glm::transpose(viewProj) };
+    for (int i{ 0 }; i < 6; ++i)
+    {
+        glm::vec4 plane{ rows[3] + (i % 2 == 0 ? 1.0f : -1.0f) * rows[i / 2] };
+        std::string name{ "u_planes[" + std::to_string(i) + "]" };
+        m_cullCellsShader.setUniform(name.c_str(), plane / glm::length(glm::vec3{ plane }));
+    }
+    m_cullCellsShader.setUniform("u_margin", margin);
+    for (ShaderProgram* shader : { &m_cullCellsShader, &m_cullParticlesShader })
+    {
+        shader->setUniform("u_boundary.low", latest.boundary.low);
+        shader->setUniform("u_boundary.high", latest.boundary.high);
+        shader->setUniform("u_gridResolution", latest.grid.resolution);
+    }
+
+    m_visibleCells.bind(0);
+    m_cullCellsShader.activate();
+    glDispatchCompute((latest.grid.numCells + thread_params::cullGroupSize - 1) / thread_params::cullGroupSize, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    GLuint command[]{ 0, 1, 0, 0, 0 };
+    glNamedBufferSubData(m_cullCommand, 0, sizeof(command), command);
+    latest.positions.bind(0);
+    previous.positions.bind(1);
+    m_visibleCells.bind(2);
+    latest.drawCommand.bind(3);
+    m_cullCommand.bind(4);
+    m_visibleIndices.bind(5);
+    m_cullParticlesShader.activate();
+    glDispatchCompute((latest.capacity + thread_params::cullGroupSize - 1) / thread_params::cullGroupSize, 1, 1);
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_ELEMENT_ARRAY_BARRIER_BIT);
+    m_culled = true;
+}
+
+void SimulationThread::draw(ShaderProgram& program) const
+{
+    if (m_drawLatest < 0)
+    {
+        return;
+    }
+
+    const Slot& latest{ m_slots[m_drawLatest] };
+    const Slot& previous{ m_slots[m_drawPrevious >= 0 ? m_drawPrevious : m_drawLatest] };
+    m_VAO.setBuffer(0, latest.positions, sizeof(glm::vec4));
+    m_VAO.setBuffer(1, latest.densities, sizeof(float));
+    m_VAO.setBuffer(2, previous.positions, sizeof(glm::vec4));
+    m_VAO.setBuffer(3, previous.densities, sizeof(float));
+    m_VAO.activate();
+    program.setUniform("u_alpha", m_alpha);
+    program.setUniform("u_maxJump", thread_params::maxJump);
+    program.activate();
+    if (m_culled)
+    {
+        // the indices are IDs, so the attributes of the same particle are fetched
+        m_VAO.setElements(m_visibleIndices);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_cullCommand);
+        glDrawElementsIndirect(GL_POINTS, GL_UNSIGNED_INT, nullptr);
+        return;
+    }
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, latest.drawCommand);
+    glDrawArraysIndirect(GL_POINTS, nullptr);
+}
+
+void SimulationThread::endFrame()
+{
+    if (m_drawLatest < 0)
+    {
+        return;
+    }
+
+    // one fence per slot, as each is deleted by whoever overwrites its slot
+    GLsync latestRead{ glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0) };
+    GLsync previousRead{ m_drawPrevious >= 0 ? glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0) : nullptr };
+    glFlush();
+
+    std::lock_guard lock{ m_mutex };
+    for (auto [index, read] : { std::pair{ m_drawLatest, latestRead }, std::pair{ m_drawPrevious, previousRead } })
+    {
+        if (index < 0)
+        {
+            continue;
+        }
+        Slot& slot{ m_slots[index] };
+        glDeleteSync(slot.read);
+        slot.read = read;
+        slot.rendering = false;
+    }
+    m_culled = false;
+    m_drawLatest = -1;
+    m_drawPrevious = -1;
+}
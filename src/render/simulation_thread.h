@@ -0,0 +1,210 @@
+#pragma once
+
+#include <simulation/fluid_system.h>
+#include <glutils/shader_program.h>
+#include <glutils/ssbo.h>
+#include <glutils/vao.h>
+#include <misc/bounding_box.h>
+#include <misc/grid.h>
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/// @brief Runs a fluid system at a fixed rate on its own thread, with a hidden window whose
+///        context is shared with the renderer's. Every frame is exported in particle ID
+///        order into a free slot and handed over with a fence, and the renderer draws the
+///        particles interpolated between the two latest frames, so the display keeps its
+///        own rate however long a simulation frame takes
+class SimulationThread
+{
+public:
+    /// @brief A change to the fluid system, run on the simulation thread between frames
+    using Command = std::function<void(FluidSystem&)>;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    /// @brief A frame handed over to the renderer
+    struct Slot
+    {
+        /// @brief Positions in ID order; w = 0 for unused IDs
+        SSBO positions{};
+
+        /// @brief Densities in ID order
+        SSBO densities{};
+
+        /// @brief DrawArraysIndirectCommand over the IDs in use
+        SSBO drawCommand{};
+
+        /// @brief The number of particles the buffers hold
+        int capacity{};
+
+        /// @brief The boundary and the grid of the fluid system at the frame
+        BoundingBox boundary{};
+        Grid grid{};
+
+        /// @brief Placed by the simulation after writing the frame
+        GLsync written{};
+
+        /// @brief Placed by the renderer after its last draw of the frame
+        GLsync read{};
+
+        /// @brief When the frame was ready
+        Clock::time_point time{};
+
+        /// @brief The number of frames handed over up to this one
+        std::uint64_t generation{};
+
+        /// @brief Whether particles only moved by simulation since the previous frame
+        bool continuous{};
+
+        /// @brief Whether the renderer is drawing the frame
+        bool rendering{};
+    };
+
+    /// @brief The number of slots; the renderer holds two while one is the latest and one written
+    static constexpr int numSlots{ 4 };
+
+    /// @brief The hidden window whose context the simulation runs in
+    GLFWwindow* m_context{};
+
+    /// @brief The options of the fluid system
+    FluidSystem::Options m_options{};
+
+    /// @brief The frames handed over
+    std::array<Slot, numSlots> m_slots{};
+
+    /// @brief The latest frame and the one before; -1 if none
+    int m_latest{ -1 };
+    int m_previous{ -1 };
+
+    /// @brief The frames the renderer draws in this display frame and the weight of the latest
+    int m_drawLatest{ -1 };
+    int m_drawPrevious{ -1 };
+    float m_alpha{};
+
+    /// @brief The number of frames handed over
+    std::uint64_t m_generation{};
+
+    /// @brief The generations of the chosen frames and the weight the last time they changed
+    std::uint64_t m_drawnLatest{};
+    std::uint64_t m_drawnPrevious{};
+    float m_drawnAlpha{ -1.0f };
+
+    /// @brief Changes whenever the chosen frames or their weight change
+    std::uint64_t m_drawVersion{};
+
+    /// @brief The VAO for drawing frames; belongs to the renderer's context
+    VAO m_VAO{};
+
+    /// @brief Shaders for culling cells of the grid and then particles against the view
+    ShaderProgram m_cullCellsShader{};
+    ShaderProgram m_cullParticlesShader{};
+
+    /// @brief Whether each cell of the grid is in view, and the number of cells it holds
+    SSBO m_visibleCells{};
+    int m_visibleCellsCapacity{};
+
+    /// @brief IDs of the particles in view, and the number of IDs it holds
+    SSBO m_visibleIndices{};
+    int m_visibleIndicesCapacity{};
+
+    /// @brief DrawElementsIndirectCommand over the particles in view
+    SSBO m_cullCommand{};
+
+    /// @brief Whether the chosen frames are culled, so only particles in view are drawn
+    bool m_culled{};
+
+    /// @brief Commands waiting to run, with whether they move particles other than by simulation
+    std::vector<std::pair<Command, bool>> m_commands{};
+
+    /// @brief The number of commands posted and run, for waiting on them
+    std::uint64_t m_posted{};
+    std::uint64_t m_executed{};
+
+    /// @brief Whether simulation stops while commands still run, e.g. during playback
+    bool m_paused{};
+
+    /// @brief Set when the thread is being stopped
+    bool m_stop{};
+
+    /// @brief Guards the slots, the commands and the flags
+    std::mutex m_mutex{};
+
+    /// @brief Signaled when commands are posted or run, or the flags change
+    std::condition_variable m_changed{};
+
+    /// @brief The simulation thread
+    std::thread m_thread{};
+
+    /// @brief Simulation thread loop
+    void run();
+
+    /// @brief Export the current frame of the fluid system into a free slot and hand it over
+    /// @param fluid the fluid system
+    /// @param time when the frame is ready
+    /// @param continuous whether particles only moved by simulation since the last frame
+    void publish(FluidSystem& fluid, Clock::time_point time, bool continuous);
+
+public:
+    /// @brief Create the fluid system on a new thread
+    /// @param window the window whose context is shared
+    /// @param options the options of the fluid system
+    SimulationThread(GLFWwindow* window, const FluidSystem::Options& options);
+
+    /// @brief Stop the thread
+    ~SimulationThread();
+
+    /// @brief No copying
+    SimulationThread(const SimulationThread& other) = delete;
+
+    /// @brief No copying
+    SimulationThread& operator=(const SimulationThread& other) = delete;
+
+    /// @brief Run a command on the fluid system before the next frame
+    /// @param command the command
+    /// @param discontinuous whether the command moves particles, e.g. a reset, so the next
+    ///        frame is not interpolated from the last one
+    void post(Command command, bool discontinuous = false);
+
+    /// @brief Wait until every command posted so far has run
+    void flush();
+
+    /// @brief Stop or resume simulating; commands still run and are handed over while paused
+    void setPaused(bool paused);
+
+    /// @brief Stop the thread and destroy the fluid system; must happen before GLFW terminates
+    void stop();
+
+    /// @brief Choose the frames of this display frame and the interpolation weight at the
+    ///        current time; call once before drawing
+    void beginFrame();
+
+    /// @brief Changes whenever draw() would draw particles elsewhere than the last time;
+    ///        stays the same while simulation is paused and interpolation has finished
+    inline std::uint64_t drawVersion() const { return m_drawVersion; }
+
+    /// @brief Find the particles of the chosen frames in view, so draws skip the others;
+    ///        cells of the grid are tested against the view, then particles take the result
+    ///        of their cell. Call after beginFrame and before drawing
+    /// @param viewProj the view projection matrix
+    /// @param margin in world space; particles in cells this close to the view are drawn
+    void cull(const glm::mat4& viewProj, float margin);
+
+    /// @brief Draw the particles interpolated between the chosen frames
+    void draw(ShaderProgram& program) const;
+
+    /// @brief Give the chosen frames back to the simulation; call once after the last draw
+    void endFrame();
+};
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+
+/// @brief On-disk layout of simulation checkpoints. A checkpoint is a header, a table
+///        of sections and the sections themselves, each holding the content of one
+///        state-bearing buffer. Sections are aligned so they can be uploaded straight
+///        from a memory mapping. All values are little endian.
+namespace checkpoint
+{
+    constexpr std::uint32_t magic{ 0x4b464250 }; // "PBFK"
+    constexpr std::uint32_t version{ 1 };
+    constexpr std::uint64_t sectionAlignment{ 256 };
+
+    /// @brief What a section holds
+    enum class Section : std::uint32_t
+    {
+        positions = 0,
+        velocities = 1,
+        ids = 2, // only if particle IDs are tracked
+    };
+
+    /// @brief The header at the start of the file
+    struct Header
+    {
+        std::uint32_t magic;
+        std::uint32_t version;
+        std::uint32_t numParticles;
+        std::uint32_t numSections;
+        std::uint64_t frame;
+
+        /// @brief The state of the system
+        std::uint32_t shape;
+        std::uint32_t seed;
+        float mass;
+        float boundaryLow[3];
+        float boundaryHigh[3];
+        float volumeLow[3];
+        float volumeHigh[3];
+
+        /// @brief The parameters the state was simulated with; only checked on loading
+        float deltaTime;
+        float restDensity;
+        std::int32_t stepsPerFrame;
+        std::int32_t solverIterations;
+        std::uint32_t reserved;
+    };
+
+    /// @brief An entry of the section table following the header
+    struct SectionEntry
+    {
+        std::uint32_t section;
+        std::uint32_t reserved;
+        std::uint64_t offset;
+        std::uint64_t size;
+    };
+
+    /// @brief Round an offset up to the section alignment
+    constexpr std::uint64_t align(std::uint64_t offset)
+    {
+        return (offset + sectionAlignment - 1) / sectionAlignment * sectionAlignment;
+    }
+
+    static_assert(sizeof(Header) == 104);
+    static_assert(sizeof(SectionEntry) == 24);
+}
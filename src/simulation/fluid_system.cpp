@@ -1,22 +1,54 @@
 #include "fluid_system.h"
+#include "checkpoint_format.h"
 
 #include <misc/helper.h>
+#include <misc/mapped_file.h>
 
-#include <glm/gtc/random.hpp>
+#include <glm/gtc/constants.hpp>
+#include <glm/gtc/packing.hpp>
 
+#include <algorithm>
 #include <iostream>
 #include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <numeric>
+#include <string>
 
 /// @brief The parameters for simulation
 namespace simulation_params
 {
-    constexpr int stepsPerFrame{ 2 };
-    constexpr int solverIterations{ 3 };
+    constexpr float frameTime{ 1.0f / 60 };
+    constexpr int stepsPerFrame{ 2 }; // until the first speed is read back, or always without adaptive steps
+    constexpr int solverIterations{ 3 }; // the most per substep, unless set in the options
+
+    constexpr bool earlyTermination{ true };
+    constexpr float densityTolerance{ 0.005f }; // mean positive density error the solver stops below
+    constexpr int minSolverIterations{ 1 };
+
+    // accelerated solver
+    constexpr float relaxation{ 0.5f }; // fraction of the correction applied per iteration
+    constexpr float chebyshevRho{ 0.7f }; // estimated spectral radius of the iteration
+    constexpr float warmStartFactor{ 0.4f }; // fraction of the last substep's lambdas applied first
+
+    // sleeping regions
+    // the solver leaves settled fluid jittering and compressed by a few percent, so the
+    // thresholds are above that
+    constexpr float sleepSpeed{ 0.1f }; // kernel radii per frame; cells with faster particles stay awake
+    constexpr float sleepDensityError{ 0.2f }; // cells with particles compressed more stay awake
+    constexpr int sleepSubsteps{ 30 }; // quiet substeps before a cell can sleep
+
+    constexpr bool adaptiveSteps{ true };
+    constexpr int maxStepsPerFrame{ 4 }; // the budget; steps are longer than the CFL condition allows beyond it
+    constexpr float courantNumber{ 0.4f }; // fraction of the kernel radius a particle may move in a step
 
     constexpr float waterDensity{ 997.0f }; // kg/m^3
     const glm::vec3 gravity{ 0.0f, -9.80665f, 0.0f }; // m/s^2
-    constexpr float deltaTime{ 1.0f / (60 * stepsPerFrame) };
+    constexpr float deltaTime{ frameTime / stepsPerFrame };
     constexpr float collisionDamping{ 0.1f };
+    constexpr float colliderMargin{ 0.5f }; // kernel radii particles keep from colliders
 
     constexpr int numParticles{ 100'000 };
     constexpr int expectedParticlesPerCell{ 15 };
@@ -25,12 +57,17 @@ namespace simulation_params
     const glm::vec3 boundaryHigh{ 1.0f, 2.0f, 1.0f };
     const glm::vec3 volumeLow{ -0.8f, 0.8f , -0.8f };
     const glm::vec3 volumeHigh{ 0.5f, 1.8f, 0.5f };
+    constexpr FluidSystem::InitialShape initialShape{ FluidSystem::InitialShape::box };
+    constexpr float twoBlocksWidth{ 0.35f }; // fraction of volume width taken by each block
+    constexpr float latticeJitter{ 0.2f }; // fraction of lattice spacing
 
-    constexpr int workGroupSize{ 1024 };
+    constexpr int workGroupSize{ 1024 }; // the largest group size kernels are compiled at
+    constexpr int maxTimedDispatches{ 1024 }; // dispatches of a kernel measured at once
 }
 
 namespace shader_path
 {
+    const char* initParticles{ "shaders/init_particles.comp" };
     const char* gravity{ "shaders/gravity.comp" };
     const char* particlesCells{ "shaders/particles_cells.comp" };
     const char* prefixSumLocal{ "shaders/prefix_sum_cells_local.comp" };
@@ -39,6 +76,32 @@ namespace shader_path
     const char* computeLambda{ "shaders/compute_lambda.comp" };
     const char* computePosition{ "shaders/compute_position.comp" };
     const char* velocityCorrect{ "shaders/correct_velocity.comp" };
+    const char* exportParticles{ "shaders/export_particles.comp" };
+    const char* emitParticles{ "shaders/emit_particles.comp" };
+    const char* updateDispatch{ "shaders/update_dispatch.comp" };
+    const char* maxSpeed{ "shaders/max_speed.comp" };
+    const char* solverControl{ "shaders/solver_control.comp" };
+    const char* copyPositions{ "shaders/copy_positions.comp" };
+    const char* compactAwake{ "shaders/compact_awake.comp" };
+    const char* updateSleep{ "shaders/update_sleep.comp" };
+}
+
+/// @brief What the GPU memory of the system is accounted to
+namespace memory_tag
+{
+    constexpr GpuMemory::Tag positions{ "simulation", "positions" };
+    constexpr GpuMemory::Tag solverPositions{ "simulation", "solver positions" };
+    constexpr GpuMemory::Tag velocities{ "simulation", "velocities" };
+    constexpr GpuMemory::Tag densities{ "simulation", "densities" };
+    constexpr GpuMemory::Tag lambdas{ "simulation", "lambdas" };
+    constexpr GpuMemory::Tag sorting{ "simulation", "sorting" };
+    constexpr GpuMemory::Tag ids{ "simulation", "particle IDs" };
+    constexpr GpuMemory::Tag grid{ "simulation", "grid" };
+    constexpr GpuMemory::Tag sleeping{ "simulation", "sleeping" };
+    constexpr GpuMemory::Tag state{ "simulation", "state" };
+    constexpr GpuMemory::Tag scenes{ "simulation", "scenes" };
+    constexpr GpuMemory::Tag colliders{ "simulation", "colliders" };
+    constexpr GpuMemory::Tag snapshots{ "simulation", "snapshots" };
 }
 
 Grid FluidSystem::createGrid(BoundingBox box, BoundingBox volume, int numParticles, int expectedParticlesPerCell)
@@ -50,67 +113,737 @@ Grid FluidSystem::createGrid(BoundingBox box, BoundingBox volume, int numParticl
     Grid grid{};
     glm::vec3 diagonal{ box.high - box.low };
     grid.resolution = glm::ceil(diagonal / expectedCellSize);
-    grid.numCells = helper::roundUp(grid.resolution.x * grid.resolution.y * grid.resolution.z,
+    // one more cell after the grid holds particles removed by sinks, so sorting moves them to the end
+    grid.numCells = helper::roundUp(grid.resolution.x * grid.resolution.y * grid.resolution.z + 1,
                                     2 * simulation_params::workGroupSize); // for convenience of compute shader group size
     grid.cellSize = diagonal.x / grid.resolution.x;
 
     return grid;
 }
 
-std::vector<glm::vec4> FluidSystem::uniformRandomPositions(BoundingBox volume, int numParticles)
+GLuint FluidSystem::deadCell(const Grid& grid)
+{
+    return grid.resolution.x * grid.resolution.y * grid.resolution.z;
+}
+
+float FluidSystem::shapeVolume(BoundingBox volume, InitialShape shape)
+{
+    glm::vec3 extent{ volume.high - volume.low };
+    switch (shape)
+    {
+    case InitialShape::sphere:
+    {
+        float radius{ 0.5f * glm::min(extent.x, glm::min(extent.y, extent.z)) };
+        return 4.0f / 3.0f * glm::pi<float>() * radius * radius * radius;
+    }
+    case InitialShape::cylinder:
+    {
+        float radius{ 0.5f * glm::min(extent.x, extent.z) };
+        return glm::pi<float>() * radius * radius * extent.y;
+    }
+    case InitialShape::twoBlocks:
+        return 2.0f * simulation_params::twoBlocksWidth * volume.volume();
+    default:
+        return volume.volume();
+    }
+}
+
+std::vector<std::string> FluidSystem::shaderDefines(const Options& options)
+{
+    std::vector<std::string> defines{};
+    if (options.compactStorage)
+    {
+        defines.push_back("COMPACT_STORAGE");
+    }
+    if (options.sleeping)
+    {
+        defines.push_back("SLEEPING");
+    }
+    if (options.numScenes > 1)
+    {
+        defines.push_back("ENSEMBLE");
+    }
+    if (!options.densities && !options.sleeping)
+    {
+        defines.push_back("NO_DENSITIES");
+    }
+    return defines;
+}
+
+std::size_t FluidSystem::positionStride() const
+{
+    return m_options.compactStorage ? sizeof(glm::uvec2) : sizeof(glm::vec4);
+}
+
+std::size_t FluidSystem::velocityStride() const
+{
+    return m_options.compactStorage ? sizeof(glm::uvec2) : sizeof(glm::vec4);
+}
+
+std::size_t FluidSystem::lambdaBytes() const
+{
+    // half-float lambdas are packed in pairs
+    return m_options.compactStorage ? m_capacity * sizeof(GLuint) / 2 : m_capacity * sizeof(float);
+}
+
+void FluidSystem::setStorageUniforms()
+{
+    if (!m_options.compactStorage)
+    {
+        return;
+    }
+
+    for (ShaderProgram* shader : { &m_initShader, &m_gravityShader, &m_particlesCellsShader, &m_reindexShader,
+        &m_computeLambdaShader, &m_computePositionShader, &m_velocityCorrectShader, &m_exportShader, &m_emitShader,
+        &m_compactAwakeShader })
+    {
+        setStorageUniforms(*shader);
+    }
+    std::cout << "Fixed-point position step: " << storageStep() << '\n';
+}
+
+float FluidSystem::storageStep() const
+{
+    constexpr float maxFixedPoint{ (1 << 21) - 1 };
+    glm::vec3 extent{ m_storageBox.high - m_storageBox.low };
+    return glm::max(extent.x, glm::max(extent.y, extent.z)) / maxFixedPoint;
+}
+
+void FluidSystem::setStorageUniforms(ShaderProgram& shader) const
+{
+    shader.setUniform("u_storageLow", m_storageBox.low);
+    shader.setUniform("u_storageStep", storageStep());
+}
+
+void FluidSystem::recordPasses()
+{
+    m_VAO.setFormat(0, 3, GL_FLOAT);
+    m_VAO.setFormat(1, 1, GL_FLOAT);
+    if (!keepsDensities())
+    {
+        glDisableVertexArrayAttrib(m_VAO, 1); // drawn with the rest density
+    }
+
+    // per-particle passes dispatch the command of the particle state, and solver passes
+    // that of the solver state
+    m_initPass = PassDescriptor{ m_initShader }
+        .storage(0, m_startPosition)
+        .storage(1, m_velocities);
+    m_emitPass = PassDescriptor{ m_emitShader }
+        .storage(0, m_startPosition)
+        .storage(1, m_velocities)
+        .storage(2, m_ids)
+        .storage(3, m_freeIds)
+        .storage(4, m_lambdaSums)
+        .storage(8, m_state);
+    m_gravityPass = PassDescriptor{ m_gravityShader }
+        .storage(0, m_startPosition)
+        .storage(1, m_velocities)
+        .storage(2, m_intermediatePositions)
+        .storage(8, m_state)
+        .storage(14, m_awakeParticles)
+        .storage(15, m_cellSleep)
+        .storage(16, m_sceneBuffer)
+        .buffer(GL_DISPATCH_INDIRECT_BUFFER, m_state);
+    m_particlesCellsPass = PassDescriptor{ m_particlesCellsShader }
+        .storage(0, m_intermediatePositions)
+        .storage(1, m_numParticlesCells)
+        .storage(2, m_cellIndices)
+        .storage(3, m_prefixSumParticlesCells) // still those of the last substep
+        .storage(8, m_state)
+        .buffer(GL_DISPATCH_INDIRECT_BUFFER, m_state);
+    m_prefixSumLocalPass = PassDescriptor{ m_prefixSumLocalShader }
+        .storage(0, m_numParticlesCells)
+        .storage(1, m_prefixSumParticlesCells);
+    m_prefixSumGlobalPass = PassDescriptor{ m_prefixSumGlobalShader }
+        .storage(0, m_prefixSumParticlesCells);
+    m_reindexPass = PassDescriptor{ m_reindexShader }
+        .storage(0, m_prefixSumParticlesCells)
+        .storage(1, m_numParticlesCells)
+        .storage(2, m_intermediatePositions)
+        .storage(3, m_nextPositions)
+        .storage(4, m_startPosition)
+        .storage(5, m_savedPositions) // save for velocity correction
+        .storage(6, m_ids)
+        .storage(7, m_nextIds)
+        .storage(8, m_state)
+        .storage(9, m_freeIds)
+        .storage(10, m_cellIndices)
+        .storage(12, m_lambdaSums)
+        .storage(13, m_nextLambdaSums)
+        .buffer(GL_DISPATCH_INDIRECT_BUFFER, m_state);
+    m_computeLambdaPass = PassDescriptor{ m_computeLambdaShader }
+        .storage(0, m_intermediatePositions)
+        .storage(1, m_lambdas)
+        .storage(2, m_densities)
+        .storage(3, m_prefixSumParticlesCells)
+        .storage(4, m_lambdaSums)
+        .storage(8, m_state)
+        .storage(11, m_solverState)
+        .storage(14, m_awakeParticles)
+        .storage(15, m_cellSleep)
+        .buffer(GL_DISPATCH_INDIRECT_BUFFER, m_solverState);
+    m_computePositionPass = PassDescriptor{ m_computePositionShader }
+        .storage(0, m_intermediatePositions)
+        .storage(1, m_lambdas)
+        .storage(2, m_prefixSumParticlesCells)
+        .storage(3, m_nextPositions)
+        .storage(4, m_lambdaSums)
+        .storage(8, m_state)
+        .storage(14, m_awakeParticles)
+        .storage(15, m_cellSleep)
+        .storage(16, m_sceneBuffer)
+        .buffer(GL_DISPATCH_INDIRECT_BUFFER, m_solverState);
+    // the colliders are sampled from the first texture units
+    for (int i{ 0 }; i < maxColliders; ++i)
+    {
+        m_gravityPass.texture(i, m_colliderFields[i]);
+        m_computePositionPass.texture(i, m_colliderFields[i]);
+    }
+    m_copyPositionsPass = PassDescriptor{ m_copyPositionsShader }
+        .storage(0, m_intermediatePositions)
+        .storage(1, m_nextPositions)
+        .storage(8, m_state)
+        .storage(14, m_awakeParticles)
+        .storage(15, m_cellSleep)
+        .buffer(GL_DISPATCH_INDIRECT_BUFFER, m_solverState);
+    m_velocityCorrectPass = PassDescriptor{ m_velocityCorrectShader }
+        .storage(0, m_savedPositions)
+        .storage(1, m_nextPositions)
+        .storage(2, m_velocities)
+        .storage(3, m_startPosition) // only written with compact storage
+        .storage(4, m_densities) // only read when sleeping
+        .storage(8, m_state)
+        .storage(14, m_awakeParticles)
+        .storage(15, m_cellSleep)
+        .buffer(GL_DISPATCH_INDIRECT_BUFFER, m_state);
+    m_compactAwakePass = PassDescriptor{ m_compactAwakeShader }
+        .storage(0, m_nextPositions) // sorted by the reindex pass
+        .storage(1, m_intermediatePositions)
+        .storage(2, m_densities)
+        .storage(3, m_savedPositions)
+        .storage(8, m_state)
+        .storage(14, m_awakeParticles)
+        .storage(15, m_cellSleep)
+        .buffer(GL_DISPATCH_INDIRECT_BUFFER, m_state);
+    m_updateSleepPass = PassDescriptor{ m_updateSleepShader }
+        .storage(14, m_awakeParticles)
+        .storage(15, m_cellSleep);
+    m_maxSpeedPass = PassDescriptor{ m_maxSpeedShader }
+        .storage(0, m_velocities)
+        .storage(1, m_maxSpeedBuffer)
+        .storage(8, m_state)
+        .buffer(GL_DISPATCH_INDIRECT_BUFFER, m_state);
+    m_solverControlPass = PassDescriptor{ m_solverControlShader }
+        .storage(3, m_prefixSumParticlesCells)
+        .storage(8, m_state)
+        .storage(11, m_solverState)
+        .storage(14, m_awakeParticles);
+    m_updateDispatchPass = PassDescriptor{ m_updateDispatchShader }
+        .storage(8, m_state);
+    m_exportParticlesPass = PassDescriptor{ m_exportShader }
+        .storage(0, m_ids)
+        .storage(1, m_startPosition)
+        .storage(2, m_velocities)
+        .storage(3, m_exportPositions)
+        .storage(4, m_exportVelocities)
+        .storage(8, m_state)
+        .buffer(GL_DISPATCH_INDIRECT_BUFFER, m_state);
+    // the buffers of the frame belong to the caller
+    m_exportFramePass = PassDescriptor{ m_exportShader }
+        .storage(0, m_ids)
+        .storage(1, m_startPosition)
+        .storage(5, m_densities)
+        .storage(8, m_state)
+        .buffer(GL_DISPATCH_INDIRECT_BUFFER, m_state);
+}
+
+std::vector<glm::vec4> FluidSystem::downloadVelocities(int first, int numParticles) const
+{
+    std::vector<glm::vec4> velocities(numParticles);
+    if (!m_options.compactStorage)
+    {
+        glGetNamedBufferSubData(m_velocities, first * sizeof(glm::vec4), numParticles * sizeof(glm::vec4), velocities.data());
+        return velocities;
+    }
+
+    std::vector<glm::uvec2> packed(numParticles);
+    glGetNamedBufferSubData(m_velocities, first * sizeof(glm::uvec2), numParticles * sizeof(glm::uvec2), packed.data());
+    for (int i{ 0 }; i < numParticles; ++i)
+    {
+        velocities[i] = glm::vec4(glm::unpackHalf2x16(packed[i].x), glm::unpackHalf2x16(packed[i].y).x, 0.0f);
+    }
+    return velocities;
+}
+
+void FluidSystem::uploadVelocities(const void* velocities, int first, int numParticles)
 {
-    std::vector<glm::vec4> positions{};
+    if (!m_options.compactStorage)
+    {
+        glNamedBufferSubData(m_velocities, first * sizeof(glm::vec4), numParticles * sizeof(glm::vec4), velocities);
+        return;
+    }
+
+    std::vector<glm::vec4> unpacked(numParticles);
+    std::memcpy(unpacked.data(), velocities, numParticles * sizeof(glm::vec4));
+    std::vector<glm::uvec2> packed(numParticles);
     for (int i{ 0 }; i < numParticles; ++i)
     {
-        positions.push_back(glm::vec4(glm::linearRand(volume.low, volume.high), 1.0f));
+        packed[i] = glm::uvec2(
+            glm::packHalf2x16(glm::vec2(unpacked[i])),
+            glm::packHalf2x16(glm::vec2(unpacked[i].z, 0.0f)));
+    }
+    glNamedBufferSubData(m_velocities, first * sizeof(glm::uvec2), numParticles * sizeof(glm::uvec2), packed.data());
+}
+
+glm::uvec2 FluidSystem::ownedLayers() const
+{
+    GLuint layers{ m_grid.resolution.z };
+    return { layers * m_options.rank / m_options.numRanks, layers * (m_options.rank + 1) / m_options.numRanks };
+}
+
+GLuint FluidSystem::layerStart(GLuint layer) const
+{
+    // the prefix sums are inclusive, so a layer starts where the cell before it ends
+    GLuint cell{ layer * m_grid.resolution.x * m_grid.resolution.y };
+    GLuint start{ 0 };
+    if (cell > 0)
+    {
+        glGetNamedBufferSubData(m_prefixSumParticlesCells, (cell - 1) * sizeof(GLuint), sizeof(GLuint), &start);
+    }
+    return start;
+}
+
+std::array<GLuint, FluidSystem::numExchangeLayers> FluidSystem::exchangeLayers() const
+{
+    glm::uvec2 owned{ ownedLayers() };
+    return { owned.x, owned.x + 1, owned.y - 1, owned.y, m_grid.resolution.z };
+}
+
+void FluidSystem::captureLayerStarts()
+{
+    // the prefix sums are inclusive, so a layer starts where the cell before it ends; the
+    // first layer starts at 0, and what is copied for it is ignored
+    std::array<GLuint, numExchangeLayers> layers{ exchangeLayers() };
+    GLuint layerCells{ m_grid.resolution.x * m_grid.resolution.y };
+    auto copy{ [&](int i)
+        {
+            GLuint cell{ std::max(layers[i] * layerCells, 1u) - 1 };
+            return ReadbackRing::Copy{ m_prefixSumParticlesCells, static_cast<GLintptr>(cell * sizeof(GLuint)),
+                static_cast<GLintptr>(i * sizeof(GLuint)), sizeof(GLuint) };
+        } };
+    m_layerCaptured = m_layerReadback.capture({ copy(0), copy(1), copy(2), copy(3), copy(4) }, ++m_layerCaptures);
+}
+
+std::vector<BoundingBox> FluidSystem::shapeBlocks(BoundingBox volume, InitialShape shape)
+{
+    if (shape != InitialShape::twoBlocks)
+    {
+        return { volume };
+    }
+
+    float width{ simulation_params::twoBlocksWidth * (volume.high.x - volume.low.x) };
+    BoundingBox left{ volume };
+    left.high.x = volume.low.x + width;
+    BoundingBox right{ volume };
+    right.low.x = volume.high.x - width;
+    return { left, right };
+}
+
+glm::uvec3 FluidSystem::latticeDimensions(BoundingBox block, int numParticles)
+{
+    glm::vec3 extent{ block.high - block.low };
+    float spacing{ std::cbrt(block.volume() / numParticles) };
+    glm::uvec3 dims{ glm::max(glm::ceil(extent / spacing), glm::vec3(1.0f)) };
+    // the spacing is shrunk until the lattice can hold all the particles
+    while (static_cast<long long>(dims.x) * dims.y * dims.z < numParticles)
+    {
+        spacing *= 0.99f;
+        dims = glm::uvec3{ glm::max(glm::ceil(extent / spacing), glm::vec3(1.0f)) };
+    }
+    return dims;
+}
+
+void FluidSystem::writeState(GLuint numParticles, GLuint idLimit, GLuint numFreeIds)
+{
+    ParticleState state{ numParticles, 1, 0, 0, numParticles, 0, numFreeIds, idLimit, {} };
+    for (int i{ 0 }; i < numGroupSizes; ++i)
+    {
+        GLuint groupSize{ static_cast<GLuint>(groupSizeAt(i)) };
+        state.groups[i] = DispatchCommand{ (numParticles + groupSize - 1) / groupSize, 1, 1, 0 };
+    }
+    glNamedBufferSubData(m_state, 0, sizeof(state), &state);
+}
+
+FluidSystem::ParticleState FluidSystem::readState() const
+{
+    ParticleState state{};
+    glGetNamedBufferSubData(m_state, 0, sizeof(state), &state);
+    return state;
+}
+
+const char* FluidSystem::kernelPath(Kernel kernel)
+{
+    switch (kernel)
+    {
+    case Kernel::gravity:
+        return shader_path::gravity;
+    case Kernel::particlesCells:
+        return shader_path::particlesCells;
+    case Kernel::reindex:
+        return shader_path::reindex;
+    case Kernel::computeLambda:
+        return shader_path::computeLambda;
+    case Kernel::computePosition:
+        return shader_path::computePosition;
+    case Kernel::copyPositions:
+        return shader_path::copyPositions;
+    case Kernel::velocityCorrect:
+        return shader_path::velocityCorrect;
+    case Kernel::compactAwake:
+        return shader_path::compactAwake;
+    case Kernel::maxSpeed:
+        return shader_path::maxSpeed;
+    default:
+        return shader_path::exportParticles;
+    }
+}
+
+ShaderProgram& FluidSystem::kernelShader(Kernel kernel)
+{
+    switch (kernel)
+    {
+    case Kernel::gravity:
+        return m_gravityShader;
+    case Kernel::particlesCells:
+        return m_particlesCellsShader;
+    case Kernel::reindex:
+        return m_reindexShader;
+    case Kernel::computeLambda:
+        return m_computeLambdaShader;
+    case Kernel::computePosition:
+        return m_computePositionShader;
+    case Kernel::copyPositions:
+        return m_copyPositionsShader;
+    case Kernel::velocityCorrect:
+        return m_velocityCorrectShader;
+    case Kernel::compactAwake:
+        return m_compactAwakeShader;
+    case Kernel::maxSpeed:
+        return m_maxSpeedShader;
+    default:
+        return m_exportShader;
+    }
+}
+
+bool FluidSystem::beginDispatch(Kernel kernel)
+{
+    return m_timing && kernel == m_timedKernel && m_kernelTimer.begin();
+}
+
+void FluidSystem::endDispatch(bool measured)
+{
+    if (measured)
+    {
+        m_kernelTimer.end();
+        ++m_timedDispatches;
+    }
+}
+
+void FluidSystem::dispatchParticles(Kernel kernel)
+{
+    bool measured{ beginDispatch(kernel) };
+    glDispatchComputeIndirect(offsetof(ParticleState, groups) + m_groupSizeIndices[static_cast<int>(kernel)] * sizeof(DispatchCommand));
+    endDispatch(measured);
+}
+
+void FluidSystem::dispatchSolver(Kernel kernel, GLintptr commands)
+{
+    bool measured{ beginDispatch(kernel) };
+    glDispatchComputeIndirect(commands + m_groupSizeIndices[static_cast<int>(kernel)] * sizeof(DispatchCommand));
+    endDispatch(measured);
+}
+
+void FluidSystem::controlSolver(SolverControl mode)
+{
+    m_solverControlShader.setUniform("u_mode", static_cast<int>(mode));
+    m_solverControlShader.setUniform("u_gridResolution", m_grid.resolution);
+    m_solverControlShader.setUniform("u_ownedLayers", ownedLayers());
+    m_solverControlShader.setUniform("u_tolerance", simulation_params::earlyTermination ? simulation_params::densityTolerance : 0.0f);
+    m_solverControlShader.setUniform("u_minIterations", static_cast<GLuint>(simulation_params::minSolverIterations));
+    m_solverControlShader.setUniform("u_maxIterations", static_cast<GLuint>(m_options.maxSolverIterations));
+    m_solverControlShader.setUniform("u_sleeping", static_cast<int>(m_options.sleeping));
+    m_solverControlShader.setUniform("u_workGroupSize", static_cast<GLuint>(simulation_params::workGroupSize));
+
+    m_solverControlPass.bind();
+    glDispatchCompute(1, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+}
+
+void FluidSystem::updateDispatch(GLuint emitted)
+{
+    m_updateDispatchShader.setUniform("u_emitted", emitted);
+    m_updateDispatchShader.setUniform("u_capacity", static_cast<GLuint>(m_capacity));
+    m_updateDispatchShader.setUniform("u_workGroupSize", static_cast<GLuint>(simulation_params::workGroupSize));
+    m_updateDispatchShader.setUniform("u_trackIds", static_cast<int>(m_trackIds));
+
+    m_updateDispatchPass.bind();
+    glDispatchCompute(1, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+}
+
+void FluidSystem::initializeParticles()
+{
+    // the scenes of an ensemble start with the same shape
+    int numParticles{ sceneParticles() };
+    std::vector<BoundingBox> blocks{ shapeBlocks(m_volume, m_shape) };
+    int split{ numParticles / static_cast<int>(blocks.size()) };
+    m_initShader.setUniform("u_split", static_cast<GLuint>(blocks.size() == 1 ? numParticles : split));
+    for (int i{ 0 }; i < static_cast<int>(blocks.size()); ++i)
+    {
+        int particles{ i == 0 ? split : numParticles - split };
+        std::string lattice{ "u_lattices[" + std::to_string(i) + "]" };
+        m_initShader.setUniform((lattice + ".low").c_str(), blocks[i].low);
+        m_initShader.setUniform((lattice + ".high").c_str(), blocks[i].high);
+        m_initShader.setUniform((lattice + ".dims").c_str(), latticeDimensions(blocks[i], particles));
+    }
+
+    m_initShader.setUniform("u_volume.low", m_volume.low);
+    m_initShader.setUniform("u_volume.high", m_volume.high);
+    m_initShader.setUniform("u_shape", static_cast<GLuint>(m_shape));
+    m_initShader.setUniform("u_seed", m_seed);
+    m_initShader.setUniform("u_jitter", simulation_params::latticeJitter);
+    m_initShader.setUniform("u_numParticles", static_cast<GLuint>(m_numParticles));
+    m_initShader.setUniform("u_sceneParticles", static_cast<GLuint>(numParticles));
+
+    m_initPass.bind();
+    glDispatchCompute(m_numParticles / simulation_params::workGroupSize, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+
+    m_mass = shapeVolume(m_volume, m_shape) * simulation_params::waterDensity / numParticles;
+    resetLambdaSums();
+    wakeCells();
+    m_slabSorted = false;
+
+    if (m_trackIds)
+    {
+        initializeIds(m_numParticles);
+    }
+    else
+    {
+        writeState(m_numParticles, m_numParticles, 0);
+    }
+}
+
+void FluidSystem::initializeIds(int numParticles, const GLuint* ids)
+{
+    std::vector<GLuint> values(numParticles);
+    GLuint idLimit{ static_cast<GLuint>(numParticles) };
+    std::vector<GLuint> freeIds{};
+    if (ids)
+    {
+        values.assign(ids, ids + numParticles);
+        idLimit = numParticles == 0 ? 0 : *std::max_element(values.begin(), values.end()) + 1;
+        if (idLimit > static_cast<GLuint>(m_capacity))
+        {
+            std::cerr << "Particle IDs exceed the capacity; giving particles new IDs\n";
+            ids = nullptr;
+            idLimit = static_cast<GLuint>(numParticles);
+        }
+    }
+    if (ids)
+    {
+        // the IDs in between belong to removed particles
+        std::vector<bool> used(idLimit);
+        for (GLuint id : values)
+        {
+            used[id] = true;
+        }
+        for (GLuint id{ idLimit }; id-- > 0;)
+        {
+            if (!used[id])
+            {
+                freeIds.push_back(id);
+            }
+        }
+        glNamedBufferSubData(m_freeIds, 0, freeIds.size() * sizeof(GLuint), freeIds.data());
+    }
+    else
+    {
+        std::iota(values.begin(), values.end(), 0);
+    }
+    glNamedBufferSubData(m_ids, 0, numParticles * sizeof(GLuint), values.data());
+    writeState(numParticles, idLimit, static_cast<GLuint>(freeIds.size()));
+}
+
+GLuint FluidSystem::emitParticles()
+{
+    GLuint emitted{ 0 };
+    for (Emitter& emitter : m_emitters)
+    {
+        emitter.accumulated += emitter.rate * m_deltaTime;
+        GLuint count{ std::min(static_cast<GLuint>(emitter.accumulated), static_cast<GLuint>(m_capacity)) };
+        emitter.accumulated -= static_cast<float>(static_cast<GLuint>(emitter.accumulated));
+        if (count == 0)
+        {
+            continue;
+        }
+
+        m_emitShader.setUniform("u_region.low", emitter.region.low);
+        m_emitShader.setUniform("u_region.high", emitter.region.high);
+        m_emitShader.setUniform("u_velocity", emitter.velocity);
+        m_emitShader.setUniform("u_first", emitted);
+        m_emitShader.setUniform("u_count", count);
+        m_emitShader.setUniform("u_capacity", static_cast<GLuint>(m_capacity));
+        m_emitShader.setUniform("u_trackIds", static_cast<int>(m_trackIds));
+        m_emitShader.setUniform("u_carryLambdas", static_cast<int>(m_options.acceleratedSolver));
+        m_emitShader.setUniform("u_seed", m_emitSeed++);
+
+        m_emitPass.bind();
+        glDispatchCompute((count + simulation_params::workGroupSize - 1) / simulation_params::workGroupSize, 1, 1);
+        emitted += count;
+    }
+    if (emitted > 0)
+    {
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    }
+    return emitted;
+}
+
+GLuint FluidSystem::exchangeHalo()
+{
+    // the starts were captured after the sort of the last substep, and the solver passes
+    // issued after it are not waited for; older captures are stale, and without the latest
+    // the starts are read back one by one
+    std::array<GLuint, numExchangeLayers> layers{ exchangeLayers() };
+    std::array<GLuint, numExchangeLayers> starts{};
+    bool captured{ false };
+    m_layerReadback.finish([&](const void* data, std::uint64_t tag)
+        {
+            if (m_layerCaptured && tag == m_layerCaptures)
+            {
+                std::memcpy(starts.data(), data, sizeof(starts));
+                captured = true;
+            }
+        });
+    for (int i{ 0 }; i < numExchangeLayers; ++i)
+    {
+        starts[i] = layers[i] == 0 ? 0 : (captured ? starts[i] : layerStart(layers[i]));
     }
-    return positions;
+    GLuint numParticles{ starts[4] };
+
+    // the outermost layers of the slab are the neighbors' ghost layers, and the particles
+    // leaving the slab are in them too, so sending them also migrates those
+    auto download{ [this](GLuint begin, GLuint end)
+        {
+            HaloParticles particles{};
+            particles.positions.resize(end - begin);
+            glGetNamedBufferSubData(m_startPosition, begin * sizeof(glm::vec4), (end - begin) * sizeof(glm::vec4), particles.positions.data());
+            particles.velocities = downloadVelocities(static_cast<int>(begin), static_cast<int>(end - begin));
+            return particles;
+        } };
+    HaloParticles low{};
+    HaloParticles high{};
+    if (m_options.rank > 0)
+    {
+        low = download(starts[0], starts[1]);
+    }
+    if (m_options.rank < m_options.numRanks - 1)
+    {
+        high = download(starts[2], starts[3]);
+    }
+    m_haloExchange.send(low, high);
+
+    // the halo is final only at the end of the last substep, so the downloads above wait for
+    // it; the particles here are moved while the neighbors' are on their way
+    applyGravity();
+    glFlush();
+
+    m_haloExchange.receive(low, high);
+    std::vector<glm::vec4> positions{ std::move(low.positions) };
+    std::vector<glm::vec4> velocities{ std::move(low.velocities) };
+    positions.insert(positions.end(), high.positions.begin(), high.positions.end());
+    velocities.insert(velocities.end(), high.velocities.begin(), high.velocities.end());
+    GLuint received{ std::min(static_cast<GLuint>(positions.size()), static_cast<GLuint>(m_capacity) - numParticles) };
+    if (received < positions.size())
+    {
+        std::cerr << "Particles received from neighboring slabs exceed the capacity; " << positions.size() - received << " dropped\n";
+    }
+    if (received == 0)
+    {
+        return numParticles;
+    }
+
+    glNamedBufferSubData(m_startPosition, numParticles * sizeof(glm::vec4), received * sizeof(glm::vec4), positions.data());
+    uploadVelocities(velocities.data(), static_cast<int>(numParticles), static_cast<int>(received));
+    if (m_options.acceleratedSolver)
+    {
+        glClearNamedBufferSubData(m_lambdaSums, GL_R32F, numParticles * sizeof(float), received * sizeof(float),
+            GL_RED, GL_FLOAT, nullptr);
+    }
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    updateDispatch(received);
+    applyGravity(numParticles, received);
+    return numParticles + received;
 }
 
-void FluidSystem::applyGravity()
+void FluidSystem::applyGravity(GLuint first, GLuint count)
 {
-    m_startPosition.bind(0);
-    m_velocities.bind(1);
-    m_intermediatePositions.bind(2);
-    
     m_gravityShader.setUniform("u_gravity", simulation_params::gravity);
-    m_gravityShader.setUniform("u_deltaTime", simulation_params::deltaTime);
+    m_gravityShader.setUniform("u_deltaTime", m_deltaTime);
     m_gravityShader.setUniform("u_boundary.low", m_boundary.low);
     m_gravityShader.setUniform("u_boundary.high", m_boundary.high);
     m_gravityShader.setUniform("u_damping", simulation_params::collisionDamping);
+    m_gravityShader.setUniform("u_first", count == 0 ? 0 : first);
+    m_gravityShader.setUniform("u_gridResolution", m_grid.resolution);
+    setColliderUniforms(m_gravityShader);
 
-    m_gravityShader.activate();
-    glDispatchCompute(m_numParticles / simulation_params::workGroupSize, 1, 1);
+    m_gravityPass.bind();
+    if (count == 0)
+    {
+        dispatchParticles(Kernel::gravity);
+    }
+    else
+    {
+        GLuint groupSize{ static_cast<GLuint>(this->groupSize(Kernel::gravity)) };
+        bool measured{ beginDispatch(Kernel::gravity) };
+        glDispatchCompute((count + groupSize - 1) / groupSize, 1, 1);
+        endDispatch(measured);
+    }
     glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
 }
 
 void FluidSystem::countParticlesCells()
 {
-    m_intermediatePositions.bind(0);
-    m_numParticlesCells.bind(1);
-
     m_particlesCellsShader.setUniform("u_boundary.low", m_boundary.low);
     m_particlesCellsShader.setUniform("u_boundary.high", m_boundary.high);
     m_particlesCellsShader.setUniform("u_gridResolution", m_grid.resolution);
+    m_particlesCellsShader.setUniform("u_deadCell", deadCell(m_grid));
+    m_particlesCellsShader.setUniform("u_ownedLayers", ownedLayers());
+    m_particlesCellsShader.setUniform("u_removeGhosts", static_cast<int>(splitGrid() && m_slabSorted));
+    m_particlesCellsShader.setUniform("u_removeFar", static_cast<int>(splitGrid() && !m_slabSorted));
+    m_particlesCellsShader.setUniform("u_numSinks", static_cast<int>(m_sinks.size()));
+    for (int i{ 0 }; i < static_cast<int>(m_sinks.size()); ++i)
+    {
+        std::string sink{ "u_sinks[" + std::to_string(i) + "]" };
+        m_particlesCellsShader.setUniform((sink + ".low").c_str(), m_sinks[i].low);
+        m_particlesCellsShader.setUniform((sink + ".high").c_str(), m_sinks[i].high);
+    }
 
-    m_particlesCellsShader.activate();
-    glDispatchCompute(m_numParticles / simulation_params::workGroupSize, 1, 1);
+    m_particlesCellsPass.bind();
+    dispatchParticles(Kernel::particlesCells);
     glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
 }
 
 void FluidSystem::prefixSumCells()
 {
-    m_numParticlesCells.bind(0);
-    m_prefixSumParticlesCells.bind(1);
-
-    m_prefixSumLocalShader.activate();
+    m_prefixSumLocalPass.bind();
     glDispatchCompute(m_grid.numCells / (2 * simulation_params::workGroupSize), 1, 1);
     glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
 
     GLuint localSteps{ static_cast<GLuint>(glm::ceil(glm::log2(static_cast<float>(simulation_params::workGroupSize))) + 1) };
     GLuint globalSteps{ static_cast<GLuint>(glm::ceil(glm::log2(static_cast<float>(m_grid.numCells))) + 1) };
-    m_prefixSumParticlesCells.bind(0);
-    m_prefixSumGlobalShader.activate();
+    m_prefixSumGlobalPass.bind();
     for (GLuint step{ localSteps }; step < globalSteps; ++step)
     {
         m_prefixSumGlobalShader.setUniform("u_step", step);
@@ -121,165 +854,1119 @@ void FluidSystem::prefixSumCells()
 
 void FluidSystem::reindexParticles()
 {
-    m_prefixSumParticlesCells.bind(0);
-    m_numParticlesCells.bind(1);
-    m_intermediatePositions.bind(2);
-    m_nextPositions.bind(3);
-    m_startPosition.bind(4);
-    m_savedPositions.bind(5); // save for velocity correction
-
-    m_reindexShader.setUniform("u_boundary.low", m_boundary.low);
-    m_reindexShader.setUniform("u_boundary.high", m_boundary.high);
-    m_reindexShader.setUniform("u_gridResolution", m_grid.resolution);
+    m_reindexShader.setUniform("u_trackIds", static_cast<int>(m_trackIds));
+    m_reindexShader.setUniform("u_carryLambdas", static_cast<int>(m_options.acceleratedSolver));
+    m_reindexShader.setUniform("u_deadCell", deadCell(m_grid));
 
-    m_reindexShader.activate();
-    glDispatchCompute(m_numParticles / simulation_params::workGroupSize, 1, 1);
+    m_reindexPass.bind();
+    dispatchParticles(Kernel::reindex);
     glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    if (m_trackIds)
+    {
+        SSBO::swap(m_ids, m_nextIds);
+    }
+    if (m_options.acceleratedSolver)
+    {
+        SSBO::swap(m_lambdaSums, m_nextLambdaSums);
+    }
+    if (!m_sinks.empty() || splitGrid())
+    {
+        updateDispatch(0); // removed particles are now after the live ones
+    }
+    m_slabSorted = true;
 }
 
-void FluidSystem::positionSolver()
+void FluidSystem::positionSolver(bool warmStart, float omega)
 {
-    m_intermediatePositions.bind(0);
-    m_lambdas.bind(1);
-    m_densities.bind(2);
-    m_prefixSumParticlesCells.bind(3);
-
     m_computeLambdaShader.setUniform("u_boundary.low", m_boundary.low);
     m_computeLambdaShader.setUniform("u_boundary.high", m_boundary.high);
     m_computeLambdaShader.setUniform("u_gridResolution", m_grid.resolution);
+    m_computeLambdaShader.setUniform("u_ownedLayers", ownedLayers());
     m_computeLambdaShader.setUniform("u_mass", m_mass);
     m_computeLambdaShader.setUniform("u_restDensity", simulation_params::waterDensity);
     m_computeLambdaShader.setUniform("u_radius", m_grid.cellSize);
+    m_computeLambdaShader.setUniform("u_warmStart", static_cast<int>(warmStart));
+    m_computeLambdaShader.setUniform("u_warmStartFactor", simulation_params::warmStartFactor);
 
-    m_computeLambdaShader.activate();
-    glDispatchCompute(m_numParticles / simulation_params::workGroupSize, 1, 1);
+    m_computeLambdaPass.bind();
+    dispatchSolver(Kernel::computeLambda, offsetof(SolverState, groups));
     glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
 
-    m_intermediatePositions.bind(0);
-    m_lambdas.bind(1);
-    m_prefixSumParticlesCells.bind(2);
-    m_nextPositions.bind(3);
+    controlSolver(SolverControl::check);
 
     m_computePositionShader.setUniform("u_boundary.low", m_boundary.low);
     m_computePositionShader.setUniform("u_boundary.high", m_boundary.high);
     m_computePositionShader.setUniform("u_gridResolution", m_grid.resolution);
+    m_computePositionShader.setUniform("u_ownedLayers", ownedLayers());
     m_computePositionShader.setUniform("u_mass", m_mass);
     m_computePositionShader.setUniform("u_restDensity", simulation_params::waterDensity);
     m_computePositionShader.setUniform("u_radius", m_grid.cellSize);
     m_computePositionShader.setUniform("u_damping", simulation_params::collisionDamping);
-    m_computePositionShader.setUniform("u_iterations", simulation_params::solverIterations);
+    m_computePositionShader.setUniform("u_relaxation", m_options.acceleratedSolver
+        ? simulation_params::relaxation : 1.0f / m_options.maxSolverIterations);
+    m_computePositionShader.setUniform("u_omega", omega);
+    m_computePositionShader.setUniform("u_accumulateLambdas", static_cast<int>(m_options.acceleratedSolver));
+    setColliderUniforms(m_computePositionShader);
 
-    m_computePositionShader.activate();
-    glDispatchCompute(m_numParticles / simulation_params::workGroupSize, 1, 1);
+    m_computePositionPass.bind();
+    dispatchSolver(Kernel::computePosition, offsetof(SolverState, groups));
     glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
 }
 
 void FluidSystem::updatePosition()
 {
-    for (int i{ 0 }; i < simulation_params::solverIterations; i++)
+    // iterations stop on GPU once the density error is below the tolerance; the passes of
+    // the remaining ones are dispatched with zero groups
+    controlSolver(SolverControl::begin);
+    float omega{ 1.0f };
+    for (int i{ 0 }; i < m_options.maxSolverIterations; i++)
     {
         SSBO::swap(m_intermediatePositions, m_nextPositions);
-        positionSolver();
+        if (m_options.acceleratedSolver)
+        {
+            // Chebyshev semi-iterative weights; the first iteration is not extrapolated
+            // reference: A Chebyshev Semi-Iterative Approach for Accelerating Projective and Position-based Dynamics, Wang, 2015
+            constexpr float rhoSquared{ simulation_params::chebyshevRho * simulation_params::chebyshevRho };
+            omega = i == 0 ? 1.0f : i == 1 ? 2.0f / (2.0f - rhoSquared) : 4.0f / (4.0f - rhoSquared * omega);
+        }
+        positionSolver(m_options.acceleratedSolver && i == 0, omega);
     }
+    controlSolver(SolverControl::finish);
+
+    m_copyPositionsShader.setUniform("u_boundary.low", m_boundary.low);
+    m_copyPositionsShader.setUniform("u_boundary.high", m_boundary.high);
+    m_copyPositionsShader.setUniform("u_gridResolution", m_grid.resolution);
+    m_copyPositionsPass.bind();
+    dispatchSolver(Kernel::copyPositions, offsetof(SolverState, copyGroups));
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
 }
 
 void FluidSystem::velecityCorrection()
 {
-    m_savedPositions.bind(0);
-    m_nextPositions.bind(1);
-    m_velocities.bind(2);
-
-    m_velocityCorrectShader.setUniform("u_deltaTime", simulation_params::deltaTime);
+    m_velocityCorrectShader.setUniform("u_deltaTime", m_deltaTime);
+    m_velocityCorrectShader.setUniform("u_boundary.low", m_boundary.low);
+    m_velocityCorrectShader.setUniform("u_boundary.high", m_boundary.high);
+    m_velocityCorrectShader.setUniform("u_gridResolution", m_grid.resolution);
+    m_velocityCorrectShader.setUniform("u_restDensity", simulation_params::waterDensity);
+    m_velocityCorrectShader.setUniform("u_sleepSpeed", simulation_params::sleepSpeed * m_grid.cellSize / simulation_params::frameTime);
+    m_velocityCorrectShader.setUniform("u_sleepDensityError", simulation_params::sleepDensityError);
 
-    m_velocityCorrectShader.activate();
-    glDispatchCompute(m_numParticles / simulation_params::workGroupSize, 1, 1);
+    m_velocityCorrectPass.bind();
+    dispatchParticles(Kernel::velocityCorrect);
     glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
 }
 
-FluidSystem::FluidSystem()
-    : m_boundary{ simulation_params::boundaryLow, simulation_params::boundaryHigh }
-    , m_volume{ simulation_params::volumeLow, simulation_params::volumeHigh }
-    , m_numParticles{ helper::roundUp(simulation_params::numParticles, simulation_params::workGroupSize) }
-    , m_mass{ m_volume.volume() * simulation_params::waterDensity / m_numParticles }
-    , m_grid{ createGrid(m_boundary, m_volume, m_numParticles, simulation_params::expectedParticlesPerCell) }
-    , m_startPosition{ GL_STATIC_DRAW, m_numParticles * sizeof(glm::vec4), uniformRandomPositions(m_volume, m_numParticles).data() }
-    , m_savedPositions{ GL_STATIC_COPY, m_numParticles * sizeof(glm::vec4) }
-    , m_intermediatePositions{ GL_STATIC_COPY, m_numParticles * sizeof(glm::vec4) }
-    , m_nextPositions{ GL_STATIC_COPY, m_numParticles * sizeof(glm::vec4) }
-    , m_velocities{ GL_STATIC_COPY, m_numParticles * sizeof(glm::vec4), std::vector<glm::vec4>(m_numParticles).data() }
-    , m_numParticlesCells{ GL_STATIC_COPY, m_grid.numCells * sizeof(GLuint), std::vector<GLuint>(m_grid.numCells).data()}
-    , m_prefixSumParticlesCells{ GL_STATIC_COPY, m_grid.numCells * sizeof(GLuint) }
-    , m_densities{ GL_STATIC_DRAW, m_numParticles * sizeof(float) }
-    , m_lambdas{ GL_STATIC_COPY, m_numParticles * sizeof(float) }
-    , m_VAO{}
-    , m_gravityShader{ shader_path::gravity }
-    , m_particlesCellsShader{ shader_path::particlesCells }
-    , m_prefixSumLocalShader{ shader_path::prefixSumLocal }
-    , m_prefixSumGlobalShader{ shader_path::prefixSumGlobal }
-    , m_reindexShader{ shader_path::reindex }
-    , m_computeLambdaShader{ shader_path::computeLambda }
-    , m_computePositionShader{ shader_path::computePosition }
-    , m_velocityCorrectShader{ shader_path::velocityCorrect }
+void FluidSystem::compactAwakeParticles()
 {
-    std::cout << "Grid resolution: " << m_grid.resolution.x << ' ' << m_grid.resolution.y << ' ' << m_grid.resolution.z << '\n';
-    std::cout << "Cell size: " << m_grid.cellSize << '\n';
-    std::cout << "Number of particles: " << m_numParticles << '\n';
-    std::cout << "Particle mass: " << m_mass << '\n';
-    std::cout << '\n';
+    glClearNamedBufferSubData(m_awakeParticles, GL_R32UI, 0, sizeof(GLuint), GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+    m_compactAwakeShader.setUniform("u_boundary.low", m_boundary.low);
+    m_compactAwakeShader.setUniform("u_boundary.high", m_boundary.high);
+    m_compactAwakeShader.setUniform("u_gridResolution", m_grid.resolution);
+    m_compactAwakeShader.setUniform("u_restDensity", simulation_params::waterDensity);
+
+    m_compactAwakePass.bind();
+    dispatchParticles(Kernel::compactAwake);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
 }
 
-void FluidSystem::draw(const ShaderProgram& program) const
+void FluidSystem::updateSleep()
 {
-    m_VAO.setAttrib(m_startPosition, 0, 3, GL_FLOAT, sizeof(glm::vec4), 0);
-    m_VAO.setAttrib(m_densities, 1, 1, GL_FLOAT, sizeof(float), 0);
-    program.activate();
-    glDrawArrays(GL_POINTS, 0, m_numParticles);
+    m_updateSleepShader.setUniform("u_gridResolution", m_grid.resolution);
+    m_updateSleepShader.setUniform("u_window", static_cast<GLuint>(simulation_params::sleepSubsteps));
+
+    // each mode reads what the one before wrote in the neighboring cells
+    m_updateSleepPass.bind();
+    for (SleepUpdate mode : { SleepUpdate::quiet, SleepUpdate::asleep, SleepUpdate::state })
+    {
+        m_updateSleepShader.setUniform("u_mode", static_cast<int>(mode));
+        glDispatchCompute(m_grid.numCells / simulation_params::workGroupSize, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    }
 }
 
-void FluidSystem::update()
+void FluidSystem::wakeCells()
 {
-    for (int i{ 0 }; i < simulation_params::stepsPerFrame; ++i)
+    if (!m_options.sleeping)
     {
-        applyGravity();
-        countParticlesCells();
-        prefixSumCells();
-        reindexParticles();
-        updatePosition();
-        velecityCorrection();
-        SSBO::swap(m_startPosition, m_nextPositions);
+        return;
     }
+
+    // every particle counts as new until the next sort, which keeps their cells awake
+    glClearNamedBufferData(m_cellSleep, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+    glClearNamedBufferSubData(m_awakeParticles, GL_R32UI, sizeof(GLuint), sizeof(GLuint), GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
 }
 
-void FluidSystem::reset()
+void FluidSystem::reduceMaxSpeed()
 {
-    m_startPosition = SSBO{
-        GL_STATIC_DRAW,
-        static_cast<GLsizeiptr>(m_numParticles * sizeof(glm::vec4)),
-        uniformRandomPositions(m_volume, m_numParticles).data()
-    };
+    m_maxSpeedPass.bind();
+    dispatchParticles(Kernel::maxSpeed);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
 }
 
-void FluidSystem::moveBoundaryX(float amount)
+void FluidSystem::pollStatistics()
 {
-    m_boundary.low.x += amount;
-    if (m_boundary.low.x > simulation_params::boundaryLow.x) m_boundary.low.x = simulation_params::boundaryLow.x;
-    if (m_boundary.low.x < 3 * simulation_params::boundaryLow.x) m_boundary.low.x = 3 * simulation_params::boundaryLow.x;
-
-    resetGrid();
+    m_statsReadback.poll([this](const void* data, std::uint64_t)
+        {
+            const std::byte* bytes{ static_cast<const std::byte*>(data) };
+            GLuint iterations{};
+            std::memcpy(&m_maxSpeed, bytes, sizeof(m_maxSpeed));
+            std::memcpy(&iterations, bytes + sizeof(GLuint), sizeof(iterations));
+            std::memcpy(&m_densityError, bytes + 2 * sizeof(GLuint), sizeof(m_densityError));
+            GLuint awake{};
+            std::memcpy(&awake, bytes + 3 * sizeof(GLuint), sizeof(awake));
+            m_solverIterations = static_cast<int>(iterations);
+            m_awakeCount = static_cast<int>(awake);
+        });
 }
 
-void FluidSystem::moveBoundaryZ(float amount)
+void FluidSystem::scheduleSubsteps()
 {
-    m_boundary.low.z += amount;
-    if (m_boundary.low.z > simulation_params::boundaryLow.z) m_boundary.low.z = simulation_params::boundaryLow.z;
-    if (m_boundary.low.z < 3 * simulation_params::boundaryLow.z) m_boundary.low.z = 3 * simulation_params::boundaryLow.z;
-
+    if (!simulation_params::adaptiveSteps)
+    {
+        return;
+    }
+
+    // slabs must take the same substeps, as they exchange particles every substep
+    float maxSpeed{ m_haloExchange.maxOverSlabs ? m_haloExchange.maxOverSlabs(m_maxSpeed) : m_maxSpeed };
+    // gravity may speed particles up within the frame
+    float speed{ maxSpeed + glm::length(simulation_params::gravity) * simulation_params::frameTime };
+    float stableStep{ simulation_params::courantNumber * m_grid.cellSize / speed };
+    m_substeps = glm::clamp(static_cast<int>(std::ceil(simulation_params::frameTime / stableStep)), 1, simulation_params::maxStepsPerFrame);
+    m_deltaTime = simulation_params::frameTime / m_substeps;
+}
+
+FluidSystem::FluidSystem()
+    : FluidSystem{ Options{} }
+{
+}
+
+FluidSystem::FluidSystem(const Options& options)
+    : m_options{ options }
+    , m_boundary{ simulation_params::boundaryLow, simulation_params::boundaryHigh }
+    , m_volume{ simulation_params::volumeLow, simulation_params::volumeHigh }
+    , m_numParticles{ helper::roundUp(options.numParticles > 0 ? options.numParticles : simulation_params::numParticles, simulation_params::workGroupSize)
+        * std::max(options.numScenes, 1) }
+    , m_capacity{ helper::roundUp(std::max(options.capacity, m_numParticles), simulation_params::workGroupSize) }
+    , m_mass{ shapeVolume(m_volume, simulation_params::initialShape) * simulation_params::waterDensity / m_numParticles }
+    , m_shape{ simulation_params::initialShape }
+    , m_seed{ 0 }
+    , m_grid{ createGrid(m_boundary, m_volume, m_numParticles, simulation_params::expectedParticlesPerCell) }
+    , m_storageBox{ simulation_params::boundaryLow * glm::vec3{ 3.0f, 1.0f, 3.0f }, simulation_params::boundaryHigh }
+    , m_startPosition{ GL_STATIC_DRAW, static_cast<GLsizeiptr>(m_capacity * sizeof(glm::vec4)), nullptr, memory_tag::positions }
+    , m_savedPositions{ GL_STATIC_COPY, static_cast<GLsizeiptr>(m_capacity * positionStride()), nullptr, memory_tag::solverPositions }
+    , m_intermediatePositions{ GL_STATIC_COPY, static_cast<GLsizeiptr>(m_capacity * positionStride()), nullptr, memory_tag::solverPositions }
+    , m_nextPositions{ GL_STATIC_COPY, static_cast<GLsizeiptr>(m_capacity * positionStride()), nullptr, memory_tag::solverPositions }
+    , m_velocities{ GL_STATIC_COPY, static_cast<GLsizeiptr>(m_capacity * velocityStride()), nullptr, memory_tag::velocities }
+    , m_state{ GL_DYNAMIC_COPY, sizeof(ParticleState), nullptr, memory_tag::state }
+    , m_cellIndices{ GL_STATIC_COPY, static_cast<GLsizeiptr>(m_capacity * sizeof(GLuint)), nullptr, memory_tag::sorting }
+    , m_numParticlesCells{ GL_STATIC_COPY, static_cast<GLsizeiptr>(m_grid.numCells * sizeof(GLuint)), std::vector<GLuint>(m_grid.numCells).data(), memory_tag::grid }
+    , m_prefixSumParticlesCells{ GL_STATIC_COPY, static_cast<GLsizeiptr>(m_grid.numCells * sizeof(GLuint)), nullptr, memory_tag::grid }
+    , m_densities{ keepsDensities() ? SSBO{ GL_STATIC_DRAW, static_cast<GLsizeiptr>(m_capacity * sizeof(float)), nullptr, memory_tag::densities } : SSBO{} }
+    , m_lambdas{ GL_STATIC_COPY, static_cast<GLsizeiptr>(lambdaBytes()), nullptr, memory_tag::lambdas }
+    , m_VAO{}
+    , m_substeps{ simulation_params::stepsPerFrame }
+    , m_deltaTime{ simulation_params::deltaTime }
+    , m_maxSpeedBuffer{ GL_DYNAMIC_COPY, sizeof(GLuint), nullptr, memory_tag::state }
+    , m_solverState{ GL_DYNAMIC_COPY, sizeof(SolverState), std::vector<std::byte>(sizeof(SolverState)).data(), memory_tag::state }
+    , m_awakeParticles{ GL_DYNAMIC_COPY, static_cast<GLsizeiptr>((2 + (options.sleeping ? m_capacity : 0)) * sizeof(GLuint)),
+        std::vector<GLuint>(2 + (options.sleeping ? m_capacity : 0)).data(), memory_tag::sleeping }
+    , m_statsReadback{ 4 * sizeof(GLuint), 3, memory_tag::state }
+    , m_layerReadback{ options.numRanks > 1 ? ReadbackRing{ numExchangeLayers * sizeof(GLuint), 2, memory_tag::state } : ReadbackRing{} }
+    , m_initShader{ shader_path::initParticles, shaderDefines(options) }
+    , m_gravityShader{ shader_path::gravity, shaderDefines(options) }
+    , m_particlesCellsShader{ shader_path::particlesCells, shaderDefines(options) }
+    , m_prefixSumLocalShader{ shader_path::prefixSumLocal }
+    , m_prefixSumGlobalShader{ shader_path::prefixSumGlobal }
+    , m_reindexShader{ shader_path::reindex, shaderDefines(options) }
+    , m_computeLambdaShader{ shader_path::computeLambda, shaderDefines(options) }
+    , m_computePositionShader{ shader_path::computePosition, shaderDefines(options) }
+    , m_velocityCorrectShader{ shader_path::velocityCorrect, shaderDefines(options) }
+    , m_exportShader{ shader_path::exportParticles, shaderDefines(options) }
+    , m_emitShader{ shader_path::emitParticles, shaderDefines(options) }
+    , m_updateDispatchShader{ shader_path::updateDispatch, std::vector<std::string>{} }
+    , m_maxSpeedShader{ shader_path::maxSpeed, shaderDefines(options) }
+    , m_solverControlShader{ shader_path::solverControl, std::vector<std::string>{} }
+    , m_copyPositionsShader{ shader_path::copyPositions, shaderDefines(options) }
+    , m_compactAwakeShader{ shader_path::compactAwake, shaderDefines(options) }
+    , m_updateSleepShader{ shader_path::updateSleep, std::vector<std::string>{} }
+{
+    if (m_options.numScenes < 1)
+    {
+        m_options.numScenes = 1;
+    }
+    if (ensemble())
+    {
+        layoutScenes();
+    }
+
+    std::cout << "Grid resolution: " << m_grid.resolution.x << ' ' << m_grid.resolution.y << ' ' << m_grid.resolution.z << '\n';
+    std::cout << "Cell size: " << m_grid.cellSize << '\n';
+    std::cout << "Number of particles: " << m_numParticles << '\n';
+    if (ensemble())
+    {
+        std::cout << "Number of scenes: " << m_options.numScenes << '\n';
+    }
+    std::cout << "Particle capacity: " << m_capacity << '\n';
+    std::cout << "Particle mass: " << m_mass << '\n';
+    std::cout << "Particle memory: " << particleMemory() / (1 << 20) << " MiB\n";
+    std::cout << '\n';
+
+    if (m_options.maxSolverIterations <= 0)
+    {
+        m_options.maxSolverIterations = simulation_params::solverIterations;
+    }
+    if (m_options.acceleratedSolver)
+    {
+        m_lambdaSums = SSBO(GL_STATIC_COPY, m_capacity * sizeof(float), nullptr, memory_tag::lambdas);
+        m_nextLambdaSums = SSBO(GL_STATIC_COPY, m_capacity * sizeof(float), nullptr, memory_tag::lambdas);
+    }
+    if (m_options.sleeping)
+    {
+        m_cellSleep = SSBO(GL_STATIC_COPY, m_grid.numCells * sizeof(CellSleep), nullptr, memory_tag::sleeping);
+    }
+
+    recordPasses();
+    setStorageUniforms();
+    initializeParticles();
+}
+
+void FluidSystem::draw(const ShaderProgram& program) const
+{
+    // the buffers are reallocated with the capacity, while the formats stay
+    m_VAO.setBuffer(0, m_startPosition, sizeof(glm::vec4));
+    if (keepsDensities())
+    {
+        m_VAO.setBuffer(1, m_densities, sizeof(float));
+    }
+    else
+    {
+        glVertexAttrib1f(1, simulation_params::waterDensity);
+    }
+    m_VAO.activate();
+    program.activate();
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_state);
+    glDrawArraysIndirect(GL_POINTS, nullptr);
+}
+
+void FluidSystem::update()
+{
+    deliverSnapshots();
+
+    pollStatistics();
+    scheduleSubsteps();
+    glClearNamedBufferData(m_maxSpeedBuffer, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+    glClearNamedBufferSubData(m_solverState, GL_R32UI, offsetof(SolverState, frameIterations), sizeof(GLuint),
+        GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+    for (int i{ 0 }; i < m_substeps; ++i)
+    {
+        // on the first substep after particles are replaced, every slab starts from all of them
+        bool exchange{ splitGrid() && m_slabSorted && m_haloExchange.send };
+        GLuint numParticles{ exchange ? exchangeHalo() : 0 };
+        GLuint emitted{ emitParticles() };
+        if (emitted > 0)
+        {
+            updateDispatch(emitted);
+        }
+        if (!exchange)
+        {
+            applyGravity();
+        }
+        else if (emitted > 0)
+        {
+            applyGravity(numParticles, emitted);
+        }
+        countParticlesCells();
+        prefixSumCells();
+        if (splitGrid() && m_haloExchange.send)
+        {
+            captureLayerStarts();
+        }
+        reindexParticles();
+        if (m_options.sleeping)
+        {
+            compactAwakeParticles();
+        }
+        updatePosition();
+        velecityCorrection();
+        if (m_options.sleeping)
+        {
+            updateSleep();
+        }
+        reduceMaxSpeed();
+        if (!m_options.compactStorage)
+        {
+            SSBO::swap(m_startPosition, m_nextPositions);
+        }
+    }
+    ++m_frame;
+
+    // frameIterations and error are adjacent in the solver state
+    m_statsReadback.capture({
+        { m_maxSpeedBuffer, 0, 0, sizeof(GLuint) },
+        { m_solverState, offsetof(SolverState, frameIterations), sizeof(GLuint), 2 * sizeof(GLuint) },
+        { m_awakeParticles, 0, 3 * sizeof(GLuint), sizeof(GLuint) } },
+        m_frame);
+    captureSnapshot();
+}
+
+void FluidSystem::reset()
+{
+    ++m_seed;
+    initializeParticles();
+}
+
+void FluidSystem::reset(InitialShape shape)
+{
+    m_shape = shape;
+    reset();
+}
+
+void FluidSystem::moveBoundaryX(float amount)
+{
+    if (ensemble())
+    {
+        std::cerr << "Cannot move the boundary of an ensemble; set the boundaries of its scenes instead\n";
+        return;
+    }
+
+    m_boundary.low.x += amount;
+    if (m_boundary.low.x > simulation_params::boundaryLow.x) m_boundary.low.x = simulation_params::boundaryLow.x;
+    if (m_boundary.low.x < 3 * simulation_params::boundaryLow.x) m_boundary.low.x = 3 * simulation_params::boundaryLow.x;
+
+    resetGrid();
+}
+
+void FluidSystem::moveBoundaryZ(float amount)
+{
+    if (splitGrid())
+    {
+        std::cerr << "Cannot move the boundary in z with the grid split into slabs\n";
+        return;
+    }
+    if (ensemble())
+    {
+        std::cerr << "Cannot move the boundary of an ensemble; set the boundaries of its scenes instead\n";
+        return;
+    }
+
+    m_boundary.low.z += amount;
+    if (m_boundary.low.z > simulation_params::boundaryLow.z) m_boundary.low.z = simulation_params::boundaryLow.z;
+    if (m_boundary.low.z < 3 * simulation_params::boundaryLow.z) m_boundary.low.z = 3 * simulation_params::boundaryLow.z;
+
     resetGrid();
 }
 
+bool FluidSystem::setScene(int index, const Scene& scene)
+{
+    if (index < 0 || index >= static_cast<int>(m_scenes.size()))
+    {
+        std::cerr << "There is no scene " << index << " in the ensemble\n";
+        return false;
+    }
+
+    // the gap between slots only keeps scenes apart while they stay inside the default boundary
+    Scene clipped{ scene };
+    clipped.boundary.low = glm::max(scene.boundary.low, simulation_params::boundaryLow);
+    clipped.boundary.high = glm::min(scene.boundary.high, simulation_params::boundaryHigh);
+    if (glm::any(glm::greaterThanEqual(clipped.boundary.low, clipped.boundary.high)))
+    {
+        std::cerr << "The boundary of scene " << index << " is empty inside the default boundary\n";
+        return false;
+    }
+
+    m_scenes[index] = clipped;
+    uploadScene(index);
+    return true;
+}
+
+glm::vec3 FluidSystem::sceneOrigin(int index) const
+{
+    return glm::vec3{ m_slotSize.x * (index % m_sceneColumns), 0.0f, m_slotSize.y * (index / m_sceneColumns) };
+}
+
+int FluidSystem::sceneAt(const glm::vec3& position) const
+{
+    if (!ensemble())
+    {
+        return 0;
+    }
+
+    // the same as sceneOf in scene.glsl
+    glm::ivec2 slot{ glm::max(glm::vec2{ position.x - m_boundary.low.x, position.z - m_boundary.low.z } / m_slotSize, 0.0f) };
+    int scene{ std::min(slot.x, m_sceneColumns - 1) + m_sceneColumns * slot.y };
+    return std::min(scene, m_options.numScenes - 1);
+}
+
+void FluidSystem::resetLambdaSums()
+{
+    if (m_options.acceleratedSolver)
+    {
+        glClearNamedBufferData(m_lambdaSums, GL_R32F, GL_RED, GL_FLOAT, nullptr);
+    }
+}
+
 void FluidSystem::resetGrid()
 {
-    m_grid = createGrid(m_boundary, m_volume, m_numParticles, simulation_params::expectedParticlesPerCell);
-    m_numParticlesCells = SSBO(GL_STATIC_COPY, m_grid.numCells * sizeof(GLuint), std::vector<GLuint>(m_grid.numCells).data());
-    m_prefixSumParticlesCells = SSBO(GL_STATIC_COPY, m_grid.numCells * sizeof(GLuint));
+    m_slabSorted = false;
+    m_grid = createGrid(m_boundary, m_volume, sceneParticles(), simulation_params::expectedParticlesPerCell);
+    m_numParticlesCells = SSBO(GL_STATIC_COPY, m_grid.numCells * sizeof(GLuint), std::vector<GLuint>(m_grid.numCells).data(), memory_tag::grid);
+    m_prefixSumParticlesCells = SSBO(GL_STATIC_COPY, m_grid.numCells * sizeof(GLuint), nullptr, memory_tag::grid);
+    if (m_options.sleeping)
+    {
+        // the moving wall may push any of the fluid
+        m_cellSleep = SSBO(GL_STATIC_COPY, m_grid.numCells * sizeof(CellSleep), nullptr, memory_tag::sleeping);
+        wakeCells();
+    }
+}
+
+void FluidSystem::layoutScenes()
+{
+    // the slots are about as many in x as in z, which keeps the grid and the fixed-point
+    // range of compact storage compact
+    BoundingBox box{ simulation_params::boundaryLow, simulation_params::boundaryHigh };
+    m_sceneColumns = static_cast<int>(std::ceil(std::sqrt(static_cast<float>(m_options.numScenes))));
+    int rows{ (m_options.numScenes + m_sceneColumns - 1) / m_sceneColumns };
+
+    // two cells of the grid of a single scene are wider than a cell of the ensemble's,
+    // which is the kernel radius, so fluid of neighboring slots never interacts
+    Grid sceneGrid{ createGrid(box, m_volume, sceneParticles(), simulation_params::expectedParticlesPerCell) };
+    float gap{ 2.0f * sceneGrid.cellSize };
+    glm::vec3 extent{ box.high - box.low };
+    m_slotSize = glm::vec2{ extent.x + gap, extent.z + gap };
+    m_boundary = BoundingBox{ box.low, box.high + glm::vec3{ (m_sceneColumns - 1) * m_slotSize.x, 0.0f, (rows - 1) * m_slotSize.y } };
+    // the boundaries of scenes only move inside their slots
+    m_storageBox = m_boundary;
+    m_mass = shapeVolume(m_volume, m_shape) * simulation_params::waterDensity / sceneParticles();
+    resetGrid();
+
+    m_scenes.assign(m_options.numScenes, Scene{ box, simulation_params::gravity, simulation_params::collisionDamping });
+    m_sceneBuffer = SSBO(GL_DYNAMIC_DRAW, m_options.numScenes * sizeof(SceneData), nullptr, memory_tag::scenes);
+    for (int i{ 0 }; i < m_options.numScenes; ++i)
+    {
+        uploadScene(i);
+    }
+    for (ShaderProgram* shader : { &m_initShader, &m_gravityShader, &m_computePositionShader })
+    {
+        setSlotUniforms(*shader);
+    }
+}
+
+void FluidSystem::setSlotUniforms(ShaderProgram& shader) const
+{
+    shader.setUniform("u_slotSize", m_slotSize);
+    shader.setUniform("u_sceneColumns", static_cast<GLuint>(m_sceneColumns));
+}
+
+void FluidSystem::uploadScene(int index)
+{
+    const Scene& scene{ m_scenes[index] };
+    glm::vec3 origin{ sceneOrigin(index) };
+    SceneData data{ glm::vec4{ origin + scene.boundary.low, 0.0f }, glm::vec4{ origin + scene.boundary.high, 0.0f },
+        glm::vec4{ scene.gravity, scene.damping } };
+    glNamedBufferSubData(m_sceneBuffer, index * sizeof(SceneData), sizeof(SceneData), &data);
+}
+
+void FluidSystem::resizeParticles(int capacity)
+{
+    // callers write the particles and the state afterwards
+    m_capacity = helper::roundUp(capacity, simulation_params::workGroupSize);
+    m_startPosition = SSBO(GL_STATIC_DRAW, m_capacity * sizeof(glm::vec4), nullptr, memory_tag::positions);
+    m_savedPositions = SSBO(GL_STATIC_COPY, m_capacity * positionStride(), nullptr, memory_tag::solverPositions);
+    m_intermediatePositions = SSBO(GL_STATIC_COPY, m_capacity * positionStride(), nullptr, memory_tag::solverPositions);
+    m_nextPositions = SSBO(GL_STATIC_COPY, m_capacity * positionStride(), nullptr, memory_tag::solverPositions);
+    m_velocities = SSBO(GL_STATIC_COPY, m_capacity * velocityStride(), nullptr, memory_tag::velocities);
+    m_cellIndices = SSBO(GL_STATIC_COPY, m_capacity * sizeof(GLuint), nullptr, memory_tag::sorting);
+    if (keepsDensities())
+    {
+        m_densities = SSBO(GL_STATIC_DRAW, m_capacity * sizeof(float), nullptr, memory_tag::densities);
+    }
+    m_lambdas = SSBO(GL_STATIC_COPY, lambdaBytes(), nullptr, memory_tag::lambdas);
+    if (m_options.acceleratedSolver)
+    {
+        m_lambdaSums = SSBO(GL_STATIC_COPY, m_capacity * sizeof(float), nullptr, memory_tag::lambdas);
+        m_nextLambdaSums = SSBO(GL_STATIC_COPY, m_capacity * sizeof(float), nullptr, memory_tag::lambdas);
+    }
+    if (m_options.sleeping)
+    {
+        m_awakeParticles = SSBO(GL_DYNAMIC_COPY, (2 + m_capacity) * sizeof(GLuint), std::vector<GLuint>(2 + m_capacity).data(), memory_tag::sleeping);
+    }
+    if (m_trackIds)
+    {
+        m_ids = SSBO(GL_STATIC_COPY, m_capacity * sizeof(GLuint), nullptr, memory_tag::ids);
+        m_nextIds = SSBO(GL_STATIC_COPY, m_capacity * sizeof(GLuint), nullptr, memory_tag::ids);
+        m_freeIds = SSBO(GL_STATIC_COPY, m_capacity * sizeof(GLuint), nullptr, memory_tag::ids);
+    }
+
+    // the readback ring is sized for the old number of particles
+    if (m_snapshotCallback)
+    {
+        setSnapshotCallback(std::move(m_snapshotCallback));
+    }
+}
+
+void FluidSystem::exportParticles()
+{
+    if (m_trackIds)
+    {
+        // IDs of removed particles keep w = 0
+        glClearNamedBufferData(m_exportPositions, GL_RGBA32F, GL_RGBA, GL_FLOAT, nullptr);
+    }
+    m_exportShader.setUniform("u_trackIds", static_cast<int>(m_trackIds));
+    m_exportShader.setUniform("u_exportVelocities", 1);
+    m_exportShader.setUniform("u_exportDensities", 0);
+    m_exportParticlesPass.bind();
+    dispatchParticles(Kernel::exportParticles);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+void FluidSystem::exportFrame(GLuint positions, GLuint densities, GLuint drawCommand)
+{
+    if (!m_trackIds)
+    {
+        std::cerr << "Exporting a frame needs particle IDs\n";
+        return;
+    }
+
+    // IDs of removed particles keep w = 0
+    glClearNamedBufferData(positions, GL_RGBA32F, GL_RGBA, GL_FLOAT, nullptr);
+    m_exportShader.setUniform("u_trackIds", 1);
+    m_exportShader.setUniform("u_exportVelocities", 0);
+    m_exportShader.setUniform("u_exportDensities", static_cast<int>(keepsDensities()));
+    if (!keepsDensities())
+    {
+        glClearNamedBufferData(densities, GL_R32F, GL_RED, GL_FLOAT, &simulation_params::waterDensity);
+    }
+    m_exportFramePass.bind();
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, positions);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, densities);
+    dispatchParticles(Kernel::exportParticles);
+    glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+    // every ID below the limit is drawn, and unused ones are culled by w = 0
+    glCopyNamedBufferSubData(m_state, drawCommand, offsetof(ParticleState, idLimit), 0, sizeof(GLuint));
+}
+
+void FluidSystem::captureSnapshot()
+{
+    if (!m_snapshotCallback)
+    {
+        return;
+    }
+
+    if (exportsSnapshots())
+    {
+        exportParticles();
+    }
+    GLuint positions{ exportsSnapshots() ? m_exportPositions : m_startPosition };
+    GLuint velocities{ exportsSnapshots() ? m_exportVelocities : m_velocities };
+    // the number of particles is only known on GPU, so the whole buffers are copied along with the state
+    GLsizeiptr bytes{ static_cast<GLsizeiptr>(m_capacity * sizeof(glm::vec4)) };
+    bool captured{ m_readback.capture({
+        { positions, 0, 0, bytes },
+        { velocities, 0, bytes, bytes },
+        { m_state, 0, 2 * bytes, sizeof(ParticleState) } },
+        m_frame) };
+    if (captured)
+    {
+        m_pendingSnapshots.push_back(ParticleSnapshot{ m_frame, 0, m_boundary, m_grid, m_trackIds, nullptr, nullptr });
+    }
+}
+
+void FluidSystem::deliverSnapshots()
+{
+    if (!m_snapshotCallback)
+    {
+        return;
+    }
+
+    m_readback.poll([this](const void* data, std::uint64_t)
+        {
+            ParticleSnapshot snapshot{ m_pendingSnapshots.front() };
+            m_pendingSnapshots.pop_front();
+            ParticleState state{};
+            std::memcpy(&state, static_cast<const std::byte*>(data) + 2 * m_capacity * sizeof(glm::vec4), sizeof(state));
+            // IDs freed by sinks are below the limit too, and export left them at w = 0
+            snapshot.numParticles = static_cast<int>(snapshot.idOrdered ? state.idLimit : state.numParticles);
+            snapshot.positions = static_cast<const glm::vec4*>(data);
+            snapshot.velocities = snapshot.positions + m_capacity;
+            m_snapshotCallback(snapshot);
+        });
+}
+
+void FluidSystem::setParticleIds(bool enable)
+{
+    if (enable && splitGrid())
+    {
+        std::cerr << "Particle IDs are not kept across slabs; not tracking them\n";
+        return;
+    }
+
+    m_trackIds = enable;
+    if (m_trackIds)
+    {
+        m_ids = SSBO(GL_STATIC_COPY, m_capacity * sizeof(GLuint), nullptr, memory_tag::ids);
+        m_nextIds = SSBO(GL_STATIC_COPY, m_capacity * sizeof(GLuint), nullptr, memory_tag::ids);
+        m_freeIds = SSBO(GL_STATIC_COPY, m_capacity * sizeof(GLuint), nullptr, memory_tag::ids);
+        initializeIds(liveParticles());
+    }
+    else
+    {
+        m_ids = SSBO{};
+        m_nextIds = SSBO{};
+        m_freeIds = SSBO{};
+    }
+}
+
+void FluidSystem::setSnapshotCallback(std::function<void(const ParticleSnapshot&)> callback)
+{
+    m_snapshotCallback = std::move(callback);
+    m_pendingSnapshots.clear();
+    if (m_snapshotCallback)
+    {
+        m_readback = ReadbackRing{ static_cast<GLsizeiptr>(2 * m_capacity * sizeof(glm::vec4) + sizeof(ParticleState)), 3, memory_tag::snapshots };
+        m_exportPositions = SSBO(GL_STREAM_COPY, m_capacity * sizeof(glm::vec4), nullptr, memory_tag::snapshots);
+        m_exportVelocities = SSBO(GL_STREAM_COPY, m_capacity * sizeof(glm::vec4), nullptr, memory_tag::snapshots);
+    }
+    else
+    {
+        m_readback = ReadbackRing{};
+        m_exportPositions = SSBO{};
+        m_exportVelocities = SSBO{};
+    }
+}
+
+void FluidSystem::addEmitter(const Emitter& emitter)
+{
+    m_emitters.push_back(emitter);
+}
+
+void FluidSystem::clearEmitters()
+{
+    m_emitters.clear();
+}
+
+bool FluidSystem::addSink(const BoundingBox& region)
+{
+    if (static_cast<int>(m_sinks.size()) >= maxSinks)
+    {
+        std::cerr << "Cannot add more than " << maxSinks << " sinks\n";
+        return false;
+    }
+    m_sinks.push_back(region);
+    return true;
+}
+
+void FluidSystem::clearSinks()
+{
+    m_sinks.clear();
+}
+
+bool FluidSystem::addCollider(const DistanceField& field)
+{
+    if (static_cast<int>(m_colliders.size()) >= maxColliders)
+    {
+        std::cerr << "Cannot add more than " << maxColliders << " colliders\n";
+        return false;
+    }
+    if (field.empty())
+    {
+        std::cerr << "Cannot add a collider without a distance field\n";
+        return false;
+    }
+    if (field.bandWidth() <= simulation_params::colliderMargin * m_grid.cellSize)
+    {
+        std::cerr << "The band of the distance field is narrower than the margin kept from colliders\n";
+    }
+
+    // the texture is recorded in the passes, so it is replaced in place
+    m_colliderFields[m_colliders.size()] = Texture3D{ field.resolution(), field.distances().data(), GL_R32F, memory_tag::colliders };
+    m_colliders.push_back(field.box());
+    return true;
+}
+
+void FluidSystem::clearColliders()
+{
+    m_colliders.clear();
+    m_colliderFields = {};
+}
+
+void FluidSystem::setColliderUniforms(ShaderProgram& shader) const
+{
+    shader.setUniform("u_numColliders", static_cast<int>(m_colliders.size()));
+    shader.setUniform("u_colliderMargin", simulation_params::colliderMargin * m_grid.cellSize);
+    for (int i{ 0 }; i < static_cast<int>(m_colliders.size()); ++i)
+    {
+        std::string index{ "[" + std::to_string(i) + "]" };
+        shader.setUniform(("u_colliders" + index).c_str(), i);
+        shader.setUniform(("u_colliderLow" + index).c_str(), m_colliders[i].low);
+        shader.setUniform(("u_colliderHigh" + index).c_str(), m_colliders[i].high);
+    }
+}
+
+void FluidSystem::setHaloExchange(HaloExchange exchange)
+{
+    m_haloExchange = std::move(exchange);
+}
+
+bool FluidSystem::uploadPositions(const glm::vec4* positions, int numParticles)
+{
+    std::vector<glm::vec4> live{};
+    live.reserve(numParticles);
+    std::copy_if(positions, positions + numParticles, std::back_inserter(live), [](const glm::vec4& p) { return p.w != 0.0f; });
+    if (live.empty())
+    {
+        std::cerr << "Cannot upload a frame without particles\n";
+        return false;
+    }
+    int count{ static_cast<int>(live.size()) };
+    if (count > m_capacity)
+    {
+        resizeParticles(count);
+    }
+
+    glNamedBufferSubData(m_startPosition, 0, count * sizeof(glm::vec4), live.data());
+    glClearNamedBufferData(m_velocities, GL_RGBA32F, GL_RGBA, GL_FLOAT, nullptr);
+    if (keepsDensities())
+    {
+        glClearNamedBufferData(m_densities, GL_R32F, GL_RED, GL_FLOAT, &simulation_params::waterDensity);
+    }
+    resetLambdaSums();
+    wakeCells();
+    m_slabSorted = false;
+    if (m_trackIds)
+    {
+        initializeIds(count);
+    }
+    else
+    {
+        writeState(count, count, 0);
+    }
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+    return true;
+}
+
+bool FluidSystem::save(const std::string& path) const
+{
+    std::ofstream file{ path, std::ios::binary | std::ios::trunc };
+    if (!file)
+    {
+        std::cerr << "Failed to create checkpoint file " << path << '\n';
+        return false;
+    }
+
+    int numParticles{ liveParticles() };
+    checkpoint::Header header{};
+    header.magic = checkpoint::magic;
+    header.version = checkpoint::version;
+    header.numParticles = static_cast<std::uint32_t>(numParticles);
+    header.numSections = m_trackIds ? 3 : 2;
+    header.frame = m_frame;
+    header.shape = static_cast<std::uint32_t>(m_shape);
+    header.seed = m_seed;
+    header.mass = m_mass;
+    for (int c{ 0 }; c < 3; ++c)
+    {
+        header.boundaryLow[c] = m_boundary.low[c];
+        header.boundaryHigh[c] = m_boundary.high[c];
+        header.volumeLow[c] = m_volume.low[c];
+        header.volumeHigh[c] = m_volume.high[c];
+    }
+    header.deltaTime = simulation_params::deltaTime;
+    header.restDensity = simulation_params::waterDensity;
+    header.stepsPerFrame = simulation_params::stepsPerFrame;
+    header.solverIterations = m_options.maxSolverIterations;
+
+    // the buffers hold particles in the same (sorted) order, so they are saved as they are
+    const GLuint buffers[]{ m_startPosition, m_velocities, m_ids };
+    const checkpoint::Section sections[]{ checkpoint::Section::positions, checkpoint::Section::velocities, checkpoint::Section::ids };
+    const std::uint64_t sizes[]{ numParticles * sizeof(glm::vec4), numParticles * sizeof(glm::vec4), numParticles * sizeof(GLuint) };
+    std::uint64_t offset{ checkpoint::align(sizeof(header) + header.numSections * sizeof(checkpoint::SectionEntry)) };
+
+    std::vector<checkpoint::SectionEntry> table{};
+    for (std::uint32_t i{ 0 }; i < header.numSections; ++i)
+    {
+        table.push_back(checkpoint::SectionEntry{ static_cast<std::uint32_t>(sections[i]), 0, offset, sizes[i] });
+        offset += checkpoint::align(sizes[i]);
+    }
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(table.data()), table.size() * sizeof(checkpoint::SectionEntry));
+
+    std::vector<char> data{};
+    for (std::size_t i{ 0 }; i < table.size(); ++i)
+    {
+        std::vector<char> padding(table[i].offset - static_cast<std::uint64_t>(file.tellp()));
+        file.write(padding.data(), padding.size());
+        data.resize(table[i].size);
+        if (sections[i] == checkpoint::Section::velocities)
+        {
+            std::vector<glm::vec4> velocities{ downloadVelocities(0, numParticles) }; // unpacked with compact storage
+            std::memcpy(data.data(), velocities.data(), data.size());
+        }
+        else
+        {
+            glGetNamedBufferSubData(buffers[i], 0, static_cast<GLsizeiptr>(data.size()), data.data());
+        }
+        file.write(data.data(), data.size());
+    }
+
+    if (!file)
+    {
+        std::cerr << "Failed to write checkpoint file " << path << '\n';
+        return false;
+    }
+    return true;
+}
+
+bool FluidSystem::load(const std::string& path)
+{
+    MappedFile file{ path.c_str() };
+    if (!file.available())
+    {
+        std::cerr << "Failed to open checkpoint file " << path << '\n';
+        return false;
+    }
+
+    checkpoint::Header header{};
+    if (file.size() < sizeof(header))
+    {
+        std::cerr << "Checkpoint file " << path << " is truncated\n";
+        return false;
+    }
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (header.magic != checkpoint::magic || header.version != checkpoint::version)
+    {
+        std::cerr << "File " << path << " is not a checkpoint of version " << checkpoint::version << '\n';
+        return false;
+    }
+    if (header.numParticles == 0 || header.shape >= static_cast<std::uint32_t>(InitialShape::count))
+    {
+        std::cerr << "Checkpoint file " << path << " has an invalid header\n";
+        return false;
+    }
+
+    std::uint64_t sectionSize{ header.numParticles * sizeof(glm::vec4) };
+    std::uint64_t tableEnd{ sizeof(header) + static_cast<std::uint64_t>(header.numSections) * sizeof(checkpoint::SectionEntry) };
+    if (file.size() < tableEnd)
+    {
+        std::cerr << "Checkpoint file " << path << " is truncated\n";
+        return false;
+    }
+    std::uint64_t idsSize{ header.numParticles * sizeof(GLuint) };
+    const std::byte* positions{};
+    const std::byte* velocities{};
+    const std::byte* ids{};
+    for (std::uint32_t i{ 0 }; i < header.numSections; ++i)
+    {
+        checkpoint::SectionEntry entry{};
+        std::memcpy(&entry, file.data() + sizeof(header) + i * sizeof(entry), sizeof(entry));
+        if (entry.offset > file.size() || file.size() - entry.offset < entry.size)
+        {
+            continue; // damaged; required sections are checked below
+        }
+        const std::byte* data{ file.data() + entry.offset };
+        if (entry.section == static_cast<std::uint32_t>(checkpoint::Section::positions) && entry.size == sectionSize) positions = data;
+        if (entry.section == static_cast<std::uint32_t>(checkpoint::Section::velocities) && entry.size == sectionSize) velocities = data;
+        if (entry.section == static_cast<std::uint32_t>(checkpoint::Section::ids) && entry.size == idsSize) ids = data;
+    }
+    if (!positions || !velocities)
+    {
+        std::cerr << "Checkpoint file " << path << " misses particle data\n";
+        return false;
+    }
+
+    if (header.deltaTime != simulation_params::deltaTime || header.restDensity != simulation_params::waterDensity
+        || header.stepsPerFrame != simulation_params::stepsPerFrame || header.solverIterations != m_options.maxSolverIterations)
+    {
+        std::cerr << "Checkpoint file " << path << " was saved with different parameters; continuing with the current ones\n";
+    }
+
+    glm::vec3 boundaryLow{ header.boundaryLow[0], header.boundaryLow[1], header.boundaryLow[2] };
+    glm::vec3 boundaryHigh{ header.boundaryHigh[0], header.boundaryHigh[1], header.boundaryHigh[2] };
+    if (ensemble() && (boundaryLow != m_boundary.low || boundaryHigh != m_boundary.high))
+    {
+        // the slots of the scenes are fixed by the options
+        std::cerr << "Checkpoint file " << path << " was not saved from an ensemble of the same layout\n";
+        return false;
+    }
+
+    int numParticles{ static_cast<int>(header.numParticles) };
+    if (numParticles > m_capacity)
+    {
+        resizeParticles(numParticles);
+    }
+    m_frame = header.frame;
+    m_shape = static_cast<InitialShape>(header.shape);
+    m_seed = header.seed;
+    m_mass = header.mass;
+    m_boundary = BoundingBox{ boundaryLow, boundaryHigh };
+    m_volume = BoundingBox{
+        glm::vec3{ header.volumeLow[0], header.volumeLow[1], header.volumeLow[2] },
+        glm::vec3{ header.volumeHigh[0], header.volumeHigh[1], header.volumeHigh[2] } };
+    resetGrid();
+
+    file.prefetch(static_cast<std::size_t>(positions - file.data()), sectionSize);
+    file.prefetch(static_cast<std::size_t>(velocities - file.data()), sectionSize);
+    glNamedBufferSubData(m_startPosition, 0, static_cast<GLsizeiptr>(sectionSize), positions);
+    uploadVelocities(velocities, 0, numParticles);
+    resetLambdaSums();
+    if (m_trackIds)
+    {
+        // sections are aligned, so the IDs can be read in place; null if saved without IDs
+        initializeIds(numParticles, reinterpret_cast<const GLuint*>(ids));
+    }
+    else
+    {
+        writeState(numParticles, numParticles, 0);
+    }
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+
+    std::cout << "Loaded checkpoint " << path << " at frame " << m_frame << '\n';
+    return true;
+}
+
+float FluidSystem::restDensity()
+{
+    return simulation_params::waterDensity;
+}
+
+float FluidSystem::frameTime()
+{
+    return simulation_params::frameTime;
+}
+
+int FluidSystem::liveParticles() const
+{
+    return static_cast<int>(readState().numParticles);
+}
+
+int FluidSystem::ownedParticles() const
+{
+    if (!m_slabSorted)
+    {
+        return liveParticles();
+    }
+    glm::uvec2 owned{ ownedLayers() };
+    return static_cast<int>(layerStart(owned.y) - layerStart(owned.x));
+}
+
+std::vector<float> FluidSystem::densities() const
+{
+    if (!keepsDensities())
+    {
+        std::cerr << "The densities are not kept\n";
+        return {};
+    }
+    std::vector<float> densities(liveParticles());
+    glGetNamedBufferSubData(m_densities, 0, densities.size() * sizeof(float), densities.data());
+    return densities;
+}
+
+std::size_t FluidSystem::particleMemory() const
+{
+    std::size_t bytes{ m_capacity * (sizeof(glm::vec4) + 3 * positionStride() + velocityStride() + sizeof(GLuint)) + lambdaBytes() };
+    if (keepsDensities())
+    {
+        bytes += m_capacity * sizeof(float);
+    }
+    if (m_options.acceleratedSolver)
+    {
+        bytes += 2 * m_capacity * sizeof(float);
+    }
+    if (m_options.sleeping)
+    {
+        bytes += m_capacity * sizeof(GLuint);
+    }
+    if (m_trackIds)
+    {
+        bytes += 3 * m_capacity * sizeof(GLuint);
+    }
+    return bytes;
+}
+
+int FluidSystem::groupSizeAt(int index)
+{
+    return simulation_params::workGroupSize >> index;
+}
+
+std::string FluidSystem::kernelName(Kernel kernel)
+{
+    // the file name without directory and extension
+    std::string path{ kernelPath(kernel) };
+    std::size_t begin{ path.find_last_of('/') + 1 };
+    return path.substr(begin, path.find_last_of('.') - begin);
+}
+
+std::string FluidSystem::kernelVariant(Kernel kernel) const
+{
+    std::string variant{ kernelName(kernel) };
+    for (const std::string& define : shaderDefines(m_options))
+    {
+        variant += '+' + define;
+    }
+    return variant;
+}
+
+int FluidSystem::groupSize(Kernel kernel) const
+{
+    return groupSizeAt(m_groupSizeIndices[static_cast<int>(kernel)]);
+}
+
+bool FluidSystem::setGroupSize(Kernel kernel, int size)
+{
+    int index{ 0 };
+    while (index < numGroupSizes && groupSizeAt(index) != size)
+    {
+        ++index;
+    }
+    if (index == numGroupSizes)
+    {
+        std::cerr << "Kernels cannot be compiled at a work group size of " << size << '\n';
+        return false;
+    }
+    if (index == m_groupSizeIndices[static_cast<int>(kernel)])
+    {
+        return true;
+    }
+
+    std::vector<std::string> defines{ shaderDefines(m_options) };
+    defines.push_back("GROUP_SIZE " + std::to_string(size));
+    ShaderProgram shader{ kernelPath(kernel), defines };
+    if (!shader.available())
+    {
+        return false;
+    }
+
+    // the passes refer to the program object, which keeps its place; uniforms set once are
+    // set again, and the others are set before every dispatch
+    ShaderProgram& program{ kernelShader(kernel) };
+    program = std::move(shader);
+    if (m_options.compactStorage)
+    {
+        setStorageUniforms(program);
+    }
+    if (ensemble())
+    {
+        setSlotUniforms(program);
+    }
+    m_groupSizeIndices[static_cast<int>(kernel)] = index;
+    return true;
+}
+
+void FluidSystem::timeKernel(Kernel kernel)
+{
+    if (!m_kernelTimer.available())
+    {
+        m_kernelTimer = GpuTimer{ simulation_params::maxTimedDispatches };
+    }
+    m_kernelTimer.finish(); // drops measurements of an earlier timing not read
+    m_timedKernel = kernel;
+    m_timing = true;
+    m_timedDispatches = 0;
+}
+
+FluidSystem::KernelTime FluidSystem::kernelTime()
+{
+    m_timing = false;
+    return KernelTime{ m_kernelTimer.finish(), m_timedDispatches };
 }
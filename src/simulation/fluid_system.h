@@ -1,35 +1,293 @@
 #pragma once
 
+#include "particle_snapshot.h"
 #include <misc/bounding_box.h>
 #include <misc/grid.h>
 #include <glutils/ssbo.h>
 #include <glutils/vao.h>
 #include <glutils/shader_program.h>
+#include <glutils/pass_descriptor.h>
+#include <glutils/readback_ring.h>
+#include <glutils/gpu_timer.h>
+#include <glutils/texture3d.h>
+#include <glutils/gpu_memory.h>
+#include <mesh/distance_field.h>
 
 #include <glm/glm.hpp>
 #include <glad/glad.h>
 
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <cstddef>
+#include <functional>
+#include <string>
 #include <vector>
 
 /// @brief A fluid system that's based on position based fluids
 class FluidSystem
 {
+public:
+    /// @brief The initial shape of the fluid inside its volume
+    enum class InitialShape
+    {
+        box,        // fills the whole volume
+        sphere,     // the largest sphere inside the volume
+        cylinder,   // the largest vertical cylinder inside the volume
+        twoBlocks,  // two blocks at the opposite sides of the volume
+        count
+    };
+
+    /// @brief Options fixed when the system is created
+    struct Options
+    {
+        /// @brief Store positions of the solver as 21-bit fixed point and velocities and
+        ///        lambdas as half floats, which nearly halves the memory per particle and
+        ///        the bandwidth of the neighbor loops
+        bool compactStorage{ false };
+
+        /// @brief The number of particles the buffers hold, which emitters can fill up
+        ///        to; 0 for the number of particles created on reset
+        int capacity{ 0 };
+
+        /// @brief Warm start every substep with the lambdas of the last one and over-relax
+        ///        the iterations with Chebyshev acceleration, instead of dividing each
+        ///        correction by the number of iterations
+        bool acceleratedSolver{ false };
+
+        /// @brief The most solver iterations per substep; 0 for the default
+        int maxSolverIterations{ 0 };
+
+        /// @brief The number of particles created on reset; 0 for the default
+        int numParticles{ 0 };
+
+        /// @brief The slab this system simulates when the grid is split along z into
+        ///        numRanks slabs of whole cell layers, e.g. one per process; particles near
+        ///        the faces are exchanged with the neighbors through the halo exchange
+        int rank{ 0 };
+        int numRanks{ 1 };
+
+        /// @brief Let cells where the fluid has been at rest for a while fall asleep and
+        ///        run the solver only on the particles of awake cells, so a settled scene
+        ///        costs about as much as its moving fluid
+        bool sleeping{ false };
+
+        /// @brief The number of independent scenes simulated together, e.g. for a parameter
+        ///        study of scenes too small to fill the GPU. The scenes share the buffers and
+        ///        grid, and every pass runs on all of them in one dispatch; each starts with
+        ///        numParticles particles in a box of its own. Substeps and solver iterations
+        ///        are those the fastest and least converged scene needs
+        int numScenes{ 1 };
+
+        /// @brief Keep the density of every particle, which densities() reads and drawn
+        ///        particles are sized by; without it, a float per particle is saved and
+        ///        particles are drawn at the rest density. Sleeping keeps them regardless
+        bool densities{ true };
+    };
+
+    /// @brief The parameters of a scene of an ensemble
+    struct Scene
+    {
+        /// @brief The walls the fluid is kept in, in the coordinates of the scene; within the
+        ///        default boundary of a system
+        BoundingBox boundary{};
+
+        /// @brief The acceleration by gravity in m/s^2
+        glm::vec3 gravity{};
+
+        /// @brief The fraction of the speed into a wall kept after bouncing off it
+        float damping{};
+    };
+
+    /// @brief Particles sent to or received from the system of a neighboring slab
+    struct HaloParticles
+    {
+        std::vector<glm::vec4> positions{};
+        std::vector<glm::vec4> velocities{};
+    };
+
+    /// @brief How a system with the grid split talks to the systems of the other slabs,
+    ///        e.g. through shared memory or MPI. Every substep, each system sends the
+    ///        particles of its outermost layers to the neighbors below and above in z and
+    ///        receives theirs as ghosts
+    struct HaloExchange
+    {
+        /// @brief Send particles to the neighbors below and above; a missing neighbor gets nothing
+        std::function<void(const HaloParticles& low, const HaloParticles& high)> send{};
+
+        /// @brief Receive the particles the neighbors sent this substep; blocks until they arrive
+        std::function<void(HaloParticles& low, HaloParticles& high)> receive{};
+
+        /// @brief The largest of a value over all slabs; blocks until every slab gave its value
+        std::function<float(float)> maxOverSlabs{};
+    };
+
+    /// @brief A box that emits particles at a constant rate
+    struct Emitter
+    {
+        /// @brief The box new particles are placed in at random
+        BoundingBox region{};
+
+        /// @brief The initial velocity of new particles in m/s
+        glm::vec3 velocity{};
+
+        /// @brief Particles emitted per second
+        float rate{};
+
+        /// @brief Particles owed from earlier substeps, as rates rarely divide into whole particles
+        float accumulated{};
+    };
+
+    /// @brief The most sinks there can be; limited by uniform arrays in the shaders
+    static constexpr int maxSinks{ 4 };
+
+    /// @brief The most colliders there can be; limited by the texture units of the shaders
+    static constexpr int maxColliders{ 4 };
+
+    /// @brief The per-particle compute kernels, whose work group size can be chosen
+    enum class Kernel
+    {
+        gravity,
+        particlesCells,
+        reindex,
+        computeLambda,
+        computePosition,
+        copyPositions,
+        velocityCorrect,
+        compactAwake,
+        maxSpeed,
+        exportParticles,
+    };
+
+    /// @brief The number of kernels
+    static constexpr int numKernels{ 10 };
+
+    /// @brief The number of work group sizes kernels can be compiled at, the largest first
+    ///        and each half the one before; must match particle_state.glsl
+    static constexpr int numGroupSizes{ 5 };
+
+    /// @brief The GPU time of the dispatches of a kernel
+    struct KernelTime
+    {
+        double seconds{};
+
+        /// @brief The dispatches measured; 0 if the kernel did not run
+        int dispatches{};
+    };
+
 private:
+    /// @brief DispatchIndirectCommand of a pass over particles; must match particle_state.glsl
+    struct DispatchCommand
+    {
+        GLuint numGroupsX;
+        GLuint numGroupsY;
+        GLuint numGroupsZ;
+        GLuint reserved;
+    };
+    static_assert(sizeof(DispatchCommand) == 16);
+
+    /// @brief The state of the particle system kept on GPU; must match particle_state.glsl
+    struct ParticleState
+    {
+        /// @brief DrawArraysIndirectCommand for drawing live particles
+        GLuint drawCount;
+        GLuint drawInstanceCount;
+        GLuint drawFirst;
+        GLuint drawBaseInstance;
+
+        GLuint numParticles;
+        GLuint numRemoved;
+        GLuint numFreeIds;
+        GLuint idLimit;
+
+        /// @brief Commands for per-particle passes, one per work group size
+        DispatchCommand groups[numGroupSizes];
+    };
+    static_assert(sizeof(ParticleState) == 112);
+
+    /// @brief The state of the position solver kept on GPU; must match solver_state.glsl
+    struct SolverState
+    {
+        GLuint errorSum;
+        GLuint errorSumHigh;
+        GLuint iterations;
+        GLuint frameIterations;
+        float error;
+
+        /// @brief Commands for the lambda and position passes, one per work group size
+        DispatchCommand groups[numGroupSizes];
+
+        /// @brief Commands for moving the solution into the output buffer
+        DispatchCommand copyGroups[numGroupSizes];
+    };
+    static_assert(sizeof(SolverState) == 180);
+
+    /// @brief The sleep state of a grid cell; must match sleeping.glsl
+    struct CellSleep
+    {
+        GLuint moving;
+        GLuint quiet;
+        GLuint asleep;
+        GLuint state;
+    };
+    static_assert(sizeof(CellSleep) == 16);
+
+    /// @brief A scene of an ensemble in the coordinates of the grid; must match scene.glsl
+    struct SceneData
+    {
+        glm::vec4 low{};
+        glm::vec4 high{};
+        glm::vec4 gravity{}; // w is the damping
+    };
+    static_assert(sizeof(SceneData) == 48);
+
+    /// @brief What the sleep update shader does
+    enum class SleepUpdate
+    {
+        quiet = 0,  // count the quiet substeps of each cell
+        asleep = 1, // put cells to sleep whose neighbors are all quiet
+        state = 2,  // find the border cells
+    };
+
+    /// @brief What the solver control shader does
+    enum class SolverControl
+    {
+        begin = 0,  // before the first iteration of a substep
+        check = 1,  // after each lambda pass
+        finish = 2, // after the last iteration
+    };
+
+    /// @brief The options
+    Options m_options{};
+
     /// @brief The boundary of this system
     BoundingBox m_boundary{};
 
     /// @brief The volume of fluid in m^3; ideally it will not be changed
     BoundingBox m_volume{};
 
-    /// @brief Total number of particles
+    /// @brief The number of particles created on reset; the live count is only known on GPU
     int m_numParticles{};
 
+    /// @brief The number of particles the buffers hold
+    int m_capacity{};
+
     /// @brief The mass of each particle in kg
     float m_mass{};
 
+    /// @brief The shape of fluid used when particles are initialized
+    InitialShape m_shape{};
+
+    /// @brief Seed of the random number generator for initialization; changed every reset
+    GLuint m_seed{};
+
     /// @brief The grid used for finding neighbors
     Grid m_grid{};
 
+    /// @brief The box covered by fixed-point positions in compact storage; every
+    ///        position the boundary can move to
+    BoundingBox m_storageBox{};
+
     /// @brief The SSBO for particles' starting position in one frame; initialized, used for drawing
     SSBO m_startPosition{};
 
@@ -45,21 +303,162 @@ private:
     /// @brief The SSBO for storing the velocities of particles; initialized
     SSBO m_velocities{};
 
+    /// @brief The SSBO for the state of the particle system, also used as indirect draw and
+    ///        dispatch buffer
+    SSBO m_state{};
+
+    /// @brief The SSBO for the cell of each particle, or the dead cell if it entered a sink
+    SSBO m_cellIndices{};
+
     /// @brief The SSBO for storing the number of particles in the cells
     SSBO m_numParticlesCells{};
 
     /// @brief The SSBO for storing the prefix sum of particles in the cells
     SSBO m_prefixSumParticlesCells{};
 
-    /// @brief The SSBO for storing the densities of particles, only for debugging
+    /// @brief The SSBO for storing the densities of particles, for drawing, sleeping and
+    ///        measuring the error; none unless they are kept
     SSBO m_densities{};
 
     /// @brief The SSBO for storing lambdas (step size in the Newton's method) of particles
     SSBO m_lambdas{};
 
+    /// @brief The SSBO for the sum of lambdas applied in a substep, for warm starting the next
+    ///        one; only allocated with the accelerated solver
+    SSBO m_lambdaSums{};
+
+    /// @brief The SSBO the lambda sums are reindexed into
+    SSBO m_nextLambdaSums{};
+
+    /// @brief Whether the IDs of particles are carried through reindexing
+    bool m_trackIds{};
+
+    /// @brief The SSBO for the ID of each particle in cell order; only allocated when tracking IDs
+    SSBO m_ids{};
+
+    /// @brief The SSBO the IDs are reindexed into
+    SSBO m_nextIds{};
+
+    /// @brief The SSBO for the IDs of removed particles, given to emitted ones first
+    SSBO m_freeIds{};
+
+    /// @brief The emitters
+    std::vector<Emitter> m_emitters{};
+
+    /// @brief The boxes that remove particles entering them
+    std::vector<BoundingBox> m_sinks{};
+
+    /// @brief The boxes covered by the distance fields of the colliders
+    std::vector<BoundingBox> m_colliders{};
+
+    /// @brief The distance fields of the colliders; the first as many as there are colliders are used
+    std::array<Texture3D, maxColliders> m_colliderFields{};
+
+    /// @brief Seed of the random number generator for emitting; changed every emit pass
+    GLuint m_emitSeed{};
+
+    /// @brief The exchange with the systems of the other slabs; empty unless the grid is split
+    HaloExchange m_haloExchange{};
+
+    /// @brief Whether the particles are still sorted by the prefix sums of the last substep,
+    ///        by which the ghosts are found; false after particles are replaced or the grid changes
+    bool m_slabSorted{};
+
+    /// @brief The SSBO for unpacked positions in ID order, for reading back; only allocated
+    ///        when needed for snapshots
+    SSBO m_exportPositions{};
+
+    /// @brief The SSBO for unpacked velocities in ID order, for reading back
+    SSBO m_exportVelocities{};
+
     /// @brief The VAO for rendering particles
     VAO m_VAO{};
 
+    /// @brief The number of frames simulated since creation
+    std::uint64_t m_frame{};
+
+    /// @brief The number of substeps of the current frame
+    int m_substeps{};
+
+    /// @brief The time step of the substeps in s
+    float m_deltaTime{};
+
+    /// @brief The largest particle speed in m/s of the latest frame read back
+    float m_maxSpeed{};
+
+    /// @brief The SSBO the largest speed of a frame is reduced into
+    SSBO m_maxSpeedBuffer{};
+
+    /// @brief The SSBO for the state of the position solver, also used as indirect dispatch buffer
+    SSBO m_solverState{};
+
+    /// @brief Position passes run in the latest frame read back, summed over substeps
+    int m_solverIterations{};
+
+    /// @brief Mean positive density error of the last lambda pass of the latest frame read back
+    float m_densityError{};
+
+    /// @brief The SSBO for the number of awake particles, the number of particles at the last
+    ///        sort and the list of awake particles; the list is only allocated when sleeping
+    SSBO m_awakeParticles{};
+
+    /// @brief The SSBO for the sleep state of every cell; only allocated when sleeping
+    SSBO m_cellSleep{};
+
+    /// @brief The scenes of an ensemble; empty for a single scene
+    std::vector<Scene> m_scenes{};
+
+    /// @brief The SSBO for the scenes in the coordinates of the grid; only allocated for an ensemble
+    SSBO m_sceneBuffer{};
+
+    /// @brief The extent in x and z of the slot of each scene, its boundary and a gap
+    glm::vec2 m_slotSize{};
+
+    /// @brief The number of slots along x
+    int m_sceneColumns{ 1 };
+
+    /// @brief Particles the solver ran on in the last substep of the latest frame read back
+    int m_awakeCount{};
+
+    /// @brief Ring of buffers for reading the largest speed and solver statistics back without stalling
+    ReadbackRing m_statsReadback{};
+
+    /// @brief Ring of buffers for reading back where the layers of the halo exchange start,
+    ///        captured right after the prefix sums; only with a split grid
+    ReadbackRing m_layerReadback{};
+
+    /// @brief The number of layer captures, which tags them, and whether the last one was
+    ///        taken rather than dropped
+    std::uint64_t m_layerCaptures{};
+    bool m_layerCaptured{};
+
+    /// @brief Ring of buffers for reading back positions and velocities; created with the callback
+    ReadbackRing m_readback{};
+
+    /// @brief Boundary and grid of captures in flight, in capture order
+    std::deque<ParticleSnapshot> m_pendingSnapshots{};
+
+    /// @brief Consumer of the particle snapshots
+    std::function<void(const ParticleSnapshot&)> m_snapshotCallback{};
+
+    /// @brief The work group size of each kernel, as the index among those it can be compiled at
+    std::array<int, numKernels> m_groupSizeIndices{};
+
+    /// @brief Measures the dispatches of the kernel being timed; created on the first timing
+    GpuTimer m_kernelTimer{};
+
+    /// @brief The kernel being timed
+    Kernel m_timedKernel{};
+
+    /// @brief Whether a kernel is being timed
+    bool m_timing{};
+
+    /// @brief Dispatches of the timed kernel measured so far
+    int m_timedDispatches{};
+
+    /// @brief Shader for initializing positions and velocities of particles
+    ShaderProgram m_initShader{};
+
     /// @brief Shader for computing gravity
     ShaderProgram m_gravityShader{};
 
@@ -84,6 +483,84 @@ private:
     /// @brief Shader for velocity correction
     ShaderProgram m_velocityCorrectShader{};
 
+    /// @brief Shader for scattering particles into ID order
+    ShaderProgram m_exportShader{};
+
+    /// @brief Shader for appending emitted particles
+    ShaderProgram m_emitShader{};
+
+    /// @brief Shader for updating the particle count and the indirect commands
+    ShaderProgram m_updateDispatchShader{};
+
+    /// @brief Shader for reducing the speed of particles to the largest one
+    ShaderProgram m_maxSpeedShader{};
+
+    /// @brief Shader for stopping solver iterations once the density error is small enough
+    ShaderProgram m_solverControlShader{};
+
+    /// @brief Shader for copying solver positions between buffers
+    ShaderProgram m_copyPositionsShader{};
+
+    /// @brief Shader for listing the particles of awake cells
+    ShaderProgram m_compactAwakeShader{};
+
+    /// @brief Shader for updating the sleep state of cells
+    ShaderProgram m_updateSleepShader{};
+
+    /// @brief Bindings of the pass for initializing particles
+    PassDescriptor m_initPass{};
+
+    /// @brief Bindings of the pass for emitting particles
+    PassDescriptor m_emitPass{};
+
+    /// @brief Bindings of the pass for applying gravity
+    PassDescriptor m_gravityPass{};
+
+    /// @brief Bindings of the pass for counting the particles in cells
+    PassDescriptor m_particlesCellsPass{};
+
+    /// @brief Bindings of the pass for the local prefix sums
+    PassDescriptor m_prefixSumLocalPass{};
+
+    /// @brief Bindings of the pass for the global prefix sums
+    PassDescriptor m_prefixSumGlobalPass{};
+
+    /// @brief Bindings of the pass for reindexing particles
+    PassDescriptor m_reindexPass{};
+
+    /// @brief Bindings of the pass for computing lambdas
+    PassDescriptor m_computeLambdaPass{};
+
+    /// @brief Bindings of the pass for computing positions
+    PassDescriptor m_computePositionPass{};
+
+    /// @brief Bindings of the pass for copying solver positions
+    PassDescriptor m_copyPositionsPass{};
+
+    /// @brief Bindings of the pass for velocity correction
+    PassDescriptor m_velocityCorrectPass{};
+
+    /// @brief Bindings of the pass for listing awake particles
+    PassDescriptor m_compactAwakePass{};
+
+    /// @brief Bindings of the pass for updating the sleep state
+    PassDescriptor m_updateSleepPass{};
+
+    /// @brief Bindings of the pass for reducing the largest speed
+    PassDescriptor m_maxSpeedPass{};
+
+    /// @brief Bindings of the pass for controlling the solver
+    PassDescriptor m_solverControlPass{};
+
+    /// @brief Bindings of the pass for updating the dispatch commands
+    PassDescriptor m_updateDispatchPass{};
+
+    /// @brief Bindings of the pass for exporting particles for snapshots
+    PassDescriptor m_exportParticlesPass{};
+
+    /// @brief Bindings of the pass for exporting frames for drawing
+    PassDescriptor m_exportFramePass{};
+
     /// @brief Create a grid based on the parameters
     /// @param box the box to be divided into a grid of cells
     /// @param volume the volume of fluid
@@ -92,14 +569,144 @@ private:
     /// @return the grid
     static Grid createGrid(BoundingBox box, BoundingBox volume, int numParticles, int expectedParticlesPerCell);
 
-    /// @brief Get positions distributed uniformly in the given volume
-    /// @param volume the volume
+    /// @brief Get the cell after the grid that particles removed by sinks are sorted into
+    static GLuint deadCell(const Grid& grid);
+
+    /// @brief Get the volume actually occupied by fluid of the given shape
+    /// @param volume the volume of fluid
+    /// @param shape the shape of fluid inside the volume
+    /// @return the fluid volume in m^3
+    static float shapeVolume(BoundingBox volume, InitialShape shape);
+
+    /// @brief Get the blocks filled by a lattice for the given shape
+    /// @param volume the volume of fluid
+    /// @param shape the shape of fluid inside the volume; only box and twoBlocks use lattices
+    /// @return one block for box and two blocks for twoBlocks
+    static std::vector<BoundingBox> shapeBlocks(BoundingBox volume, InitialShape shape);
+
+    /// @brief Get the smallest lattice dimension that fills the block with the particles
+    /// @param block the block
     /// @param numParticles the number of particles
-    /// @return the positions
-    static std::vector<glm::vec4> uniformRandomPositions(BoundingBox volume, int numParticles);
+    /// @return the number of lattice points along each axis
+    static glm::uvec3 latticeDimensions(BoundingBox block, int numParticles);
+
+    /// @brief Get the macros defined in the compute shaders for the options
+    static std::vector<std::string> shaderDefines(const Options& options);
+
+    /// @brief Record the bindings of every pass; they refer to the buffers, so this is
+    ///        only needed once
+    void recordPasses();
+
+    /// @brief Bytes per particle of the solver's position buffers
+    std::size_t positionStride() const;
+
+    /// @brief Bytes per particle of the velocity buffer
+    std::size_t velocityStride() const;
+
+    /// @brief Bytes of the lambda buffer
+    std::size_t lambdaBytes() const;
+
+    /// @brief Set the origin and unit of fixed-point positions in all shaders
+    void setStorageUniforms();
+
+    /// @brief Whether snapshots are read back through the export pass
+    inline bool exportsSnapshots() const { return m_trackIds || m_options.compactStorage; }
+
+    /// @brief Read velocities of a range of particles back as floats
+    std::vector<glm::vec4> downloadVelocities(int first, int numParticles) const;
+
+    /// @brief Write velocities of a range of particles given as floats
+    void uploadVelocities(const void* velocities, int first, int numParticles);
+
+    /// @brief Whether the grid is split into slabs
+    inline bool splitGrid() const { return m_options.numRanks > 1; }
+
+    /// @brief Whether several scenes are simulated together
+    inline bool ensemble() const { return m_options.numScenes > 1; }
+
+    /// @brief Whether the densities of particles are kept
+    inline bool keepsDensities() const { return m_options.densities || m_options.sleeping; }
+
+    /// @brief The number of particles of each scene created on reset
+    inline int sceneParticles() const { return m_numParticles / m_options.numScenes; }
+
+    /// @brief Place the scenes of an ensemble in slots tiling the grid, which covers them all
+    void layoutScenes();
+
+    /// @brief Write a scene into the scene buffer in the coordinates of the grid
+    void uploadScene(int index);
+
+    /// @brief The first and the end z layer of the slab of this system
+    glm::uvec2 ownedLayers() const;
+
+    /// @brief Read back the index of the first particle in a z layer after the last sort
+    GLuint layerStart(GLuint layer) const;
+
+    /// @brief The number of layers whose starts the halo exchange needs
+    static constexpr int numExchangeLayers{ 5 };
+
+    /// @brief Return the layers whose starts the halo exchange needs: the lowest owned
+    ///        layer and the one after it, the highest owned layer and the one after it, and
+    ///        the end of the grid
+    std::array<GLuint, numExchangeLayers> exchangeLayers() const;
+
+    /// @brief Copy the starts of the exchange layers into the layer readback, so the next
+    ///        exchange reads them without waiting for the passes after the sort
+    void captureLayerStarts();
+
+    /// @brief Write the particle state from CPU, along with the indirect commands
+    void writeState(GLuint numParticles, GLuint idLimit, GLuint numFreeIds);
+
+    /// @brief Read the particle state back; stalls until the GPU is done with it
+    ParticleState readState() const;
+
+    /// @brief Return the path of the shader of a kernel
+    static const char* kernelPath(Kernel kernel);
+
+    /// @brief Return the program of a kernel
+    ShaderProgram& kernelShader(Kernel kernel);
+
+    /// @brief Start measuring a dispatch if its kernel is timed
+    /// @return whether it is measured
+    bool beginDispatch(Kernel kernel);
+
+    /// @brief Stop measuring a dispatch
+    /// @param measured what beginDispatch returned
+    void endDispatch(bool measured);
+
+    /// @brief Dispatch a per-particle pass for the live particles; its descriptor binds the
+    ///        particle state as the indirect buffer
+    void dispatchParticles(Kernel kernel);
+
+    /// @brief Dispatch a pass with commands of the solver state; its descriptor binds the
+    ///        solver state as the indirect buffer
+    /// @param commands the offset of the commands in the solver state
+    void dispatchSolver(Kernel kernel, GLintptr commands);
+
+    /// @brief Run the solver control shader
+    void controlSolver(SolverControl mode);
+
+    /// @brief Apply emitted and removed particles to the particle count
+    /// @param emitted the number of particles appended by the emit pass
+    void updateDispatch(GLuint emitted);
+
+    /// @brief Write initial positions and zero velocities of all particles on GPU
+    void initializeParticles();
+
+    /// @brief Append the particles the emitters owe for this substep
+    /// @return the number of particles appended
+    GLuint emitParticles();
+
+    /// @brief Send the particles of the outermost layers to the neighboring slabs and append
+    ///        the ones received from them; gravity is applied to the particles already here
+    ///        while waiting, and to the received ones after
+    /// @return the number of particles after the received ones
+    GLuint exchangeHalo();
 
     /// @brief Apply gravity to the positions to get predicted positions
-    void applyGravity();
+    /// @param first the first particle
+    /// @param count the number of particles; 0 for all live particles
+    void applyGravity(GLuint first = 0, GLuint count = 0);
 
     /// @brief Count the number of particles in each cell
     void countParticlesCells();
@@ -111,7 +718,9 @@ private:
     void reindexParticles();
 
     /// @brief Compute the lambdas in position based dynamics
-    void positionSolver();
+    /// @param warmStart whether to apply the lambdas of the last substep instead of new ones
+    /// @param omega the Chebyshev weight of this iteration; 1 for none
+    void positionSolver(bool warmStart, float omega);
 
     /// @brief Update position using solve iterations
     void updatePosition();
@@ -119,25 +728,262 @@ private:
     /// @brief Correct velocities
     void velecityCorrection();
 
+    /// @brief List the particles of awake cells for the solver passes
+    void compactAwakeParticles();
+
+    /// @brief Put cells to sleep or wake them by the activity of this substep
+    void updateSleep();
+
+    /// @brief Wake every cell, when particles are replaced or the grid changes
+    void wakeCells();
+
+    /// @brief Reduce the speed of particles into the largest speed of the frame
+    void reduceMaxSpeed();
+
+    /// @brief Take the statistics of the frames that have been read back
+    void pollStatistics();
+
+    /// @brief Choose the number of substeps of the frame from the CFL condition, using the
+    ///        largest speed of the latest frame that has been read back
+    void scheduleSubsteps();
+
+    /// @brief Forget the lambdas warm starting the solver, when particles are replaced
+    void resetLambdaSums();
+
     /// @brief Reset grid when the boundary is changed
     void resetGrid();
 
+    /// @brief Set the colliders in a shader including collider.glsl
+    void setColliderUniforms(ShaderProgram& shader) const;
+
+    /// @brief The step of fixed-point positions of compact storage in m
+    float storageStep() const;
+
+    /// @brief Set the fixed-point range of compact storage in a shader
+    void setStorageUniforms(ShaderProgram& shader) const;
+
+    /// @brief Set the layout of the slots of an ensemble in a shader
+    void setSlotUniforms(ShaderProgram& shader) const;
+
+    /// @brief Reallocate the per-particle buffers for a different capacity; particles are lost
+    /// @param capacity the number of particles the buffers hold
+    void resizeParticles(int capacity);
+
+    /// @brief Give particles IDs and set the particle count
+    /// @param numParticles the number of live particles
+    /// @param ids the IDs of the live particles; null to give every particle its index
+    void initializeIds(int numParticles, const GLuint* ids = nullptr);
+
+    /// @brief Write positions and velocities in ID order to the export buffers
+    void exportParticles();
+
+    /// @brief Start reading back the state of this frame if a consumer is set
+    void captureSnapshot();
+
+    /// @brief Deliver the snapshots that have arrived to the consumer
+    void deliverSnapshots();
+
 public:
     /// @brief Create a fluid system
     FluidSystem();
 
+    /// @brief Create a fluid system with the options
+    FluidSystem(const Options& options);
+
+    /// @brief No copying
+    FluidSystem(const FluidSystem& other) = delete;
+
+    /// @brief No copying
+    FluidSystem& operator=(const FluidSystem& other) = delete;
+
+    /// @brief Not movable, as the passes refer to its buffers
+    FluidSystem(FluidSystem&& other) = delete;
+
+    /// @brief Not movable, as the passes refer to its buffers
+    FluidSystem& operator=(FluidSystem&& other) = delete;
+
     /// @brief Draw the particles
     void draw(const ShaderProgram& program)const;
 
     /// @brief Update to the next frame
     void update();
 
-    /// @brief Reset the position of particles
+    /// @brief Reset the position of particles with the current shape
     void reset();
 
+    /// @brief Reset the position of particles with a new shape
+    void reset(InitialShape shape);
+
     /// @brief Move boundary in x direction
     void moveBoundaryX(float amount);
 
     /// @brief Move boundary in y direction
     void moveBoundaryZ(float amount);
+
+    /// @brief Set the parameters of a scene of an ensemble; the boundary is clipped to the
+    ///        default one, and fluid outside is pushed in by the next update
+    /// @return false if there is no such scene or the boundary is empty
+    bool setScene(int index, const Scene& scene);
+
+    /// @brief The scenes of an ensemble; empty for a single scene
+    inline const std::vector<Scene>& scenes() const { return m_scenes; }
+
+    /// @brief The offset of the coordinates of a scene from those of the system
+    glm::vec3 sceneOrigin(int index) const;
+
+    /// @brief The scene whose slot holds a position, e.g. of a snapshot; 0 for a single scene
+    int sceneAt(const glm::vec3& position) const;
+
+    /// @brief Set the consumer of particle snapshots. A snapshot is captured after every
+    ///        update and delivered one or two frames later; snapshots are dropped instead
+    ///        of stalling when the consumer falls behind
+    /// @param callback the consumer; an empty function stops capturing
+    void setSnapshotCallback(std::function<void(const ParticleSnapshot&)> callback);
+
+    /// @brief Enable or disable stable particle IDs. While enabled, an ID buffer is
+    ///        reindexed along with the positions and snapshots are delivered in ID
+    ///        order, so the same index refers to the same particle in every frame
+    /// @param enable whether to track IDs; enabling gives particles new IDs
+    void setParticleIds(bool enable);
+
+    /// @brief Whether particle IDs are tracked
+    inline bool particleIds() const { return m_trackIds; }
+
+    /// @brief Write positions and densities of the current frame in ID order into buffers
+    ///        of capacity() particles, e.g. for drawing it from another context. Needs
+    ///        particle IDs
+    /// @param positions the buffer of vec4 positions; w = 0 marks unused IDs
+    /// @param densities the buffer of float densities
+    /// @param drawCommand a DrawArraysIndirectCommand whose count is set to the number of IDs in use
+    void exportFrame(GLuint positions, GLuint densities, GLuint drawCommand);
+
+    /// @brief Add an emitter
+    void addEmitter(const Emitter& emitter);
+
+    /// @brief Remove all emitters
+    void clearEmitters();
+
+    /// @brief Add a box that removes particles entering it
+    /// @return false if there are maxSinks sinks already
+    bool addSink(const BoundingBox& region);
+
+    /// @brief Remove all sinks
+    void clearSinks();
+
+    /// @brief Add a static collider, the solid where its distance field is negative.
+    ///        Particles keep a fraction of a kernel radius from it, which must be less than
+    ///        the band of the field; fluid placed inside it is not pushed out
+    /// @return false if there are maxColliders colliders already or the field is empty
+    bool addCollider(const DistanceField& field);
+
+    /// @brief Remove all colliders
+    void clearColliders();
+
+    /// @brief Set how the system exchanges particles with the systems of the other slabs;
+    ///        needed every substep when the grid is split
+    void setHaloExchange(HaloExchange exchange);
+
+    /// @brief Replace the positions of the particles, e.g. with a frame played back from a
+    ///        cache; velocities are zeroed and densities set to the rest density. Positions
+    ///        with w = 0 mark unused IDs in ID-ordered snapshots and are skipped
+    /// @param positions the positions
+    /// @param numParticles the number of positions
+    /// @return false if there are no particles
+    bool uploadPositions(const glm::vec4* positions, int numParticles);
+
+    /// @brief Save positions, velocities, boundary and parameters to a checkpoint file
+    /// @param path the path of the checkpoint file
+    /// @return false if the file cannot be written
+    bool save(const std::string& path) const;
+
+    /// @brief Restore the state saved in a checkpoint file; the state is unchanged if
+    ///        the file is not a valid checkpoint
+    /// @param path the path of the checkpoint file
+    /// @return false if the file cannot be loaded
+    bool load(const std::string& path);
+
+    /// @brief The number of frames simulated since creation
+    inline std::uint64_t frame() const { return m_frame; }
+
+    /// @brief The number of substeps of the last frame
+    inline int substeps() const { return m_substeps; }
+
+    /// @brief The time step of the substeps of the last frame in s
+    inline float deltaTime() const { return m_deltaTime; }
+
+    /// @brief The largest particle speed in m/s; a frame or two old
+    inline float maxSpeed() const { return m_maxSpeed; }
+
+    /// @brief Solver iterations run in a frame, summed over substeps; a frame or two old
+    inline int solverIterations() const { return m_solverIterations; }
+
+    /// @brief Mean positive density error when the solver stopped; a frame or two old
+    inline float densityError() const { return m_densityError; }
+
+    /// @brief Particles the solver ran on in the last substep, including the ones of border
+    ///        cells; a frame or two old. Only counted when sleeping
+    inline int awakeParticles() const { return m_awakeCount; }
+
+    /// @brief The number of particles created on reset, in all scenes
+    inline int numParticles() const { return m_numParticles; }
+
+    /// @brief The number of live particles; reads the count back, so it stalls
+    int liveParticles() const;
+
+    /// @brief The number of particles in the slab of this system, without ghosts, at the
+    ///        last substep; all live particles before the first update. Stalls
+    int ownedParticles() const;
+
+    /// @brief The number of particles the buffers hold
+    inline int capacity() const { return m_capacity; }
+
+    /// @brief The boundary of the fluid; that of all slots of an ensemble
+    inline const BoundingBox& boundary() const { return m_boundary; }
+
+    /// @brief The grid used for finding neighbors, dividing the boundary
+    inline const Grid& grid() const { return m_grid; }
+
+    /// @brief The rest density of fluid in kg/m^3
+    static float restDensity();
+
+    /// @brief The simulated time of one frame in s
+    static float frameTime();
+
+    /// @brief Read back the densities of live particles computed in the last solver
+    ///        iteration; empty unless they are kept
+    std::vector<float> densities() const;
+
+    /// @brief Bytes of GPU memory used by per-particle buffers
+    std::size_t particleMemory() const;
+
+    /// @brief Return a work group size kernels can be compiled at
+    /// @param index from 0 for the largest to numGroupSizes - 1 for the smallest
+    static int groupSizeAt(int index);
+
+    /// @brief Return the name of a kernel, that of its shader file
+    static std::string kernelName(Kernel kernel);
+
+    /// @brief Return the name of a kernel followed by the macros the options compile it
+    ///        with, which tell apart the code the GPU runs, e.g. for caching tuned sizes
+    std::string kernelVariant(Kernel kernel) const;
+
+    /// @brief The work group size a kernel is compiled at
+    int groupSize(Kernel kernel) const;
+
+    /// @brief Compile a kernel at another work group size, e.g. one that a tuner found to
+    ///        run faster on this GPU. Results are the same at every size but for the density
+    ///        error, which is summed per work group in fixed point
+    /// @param size one of the sizes of groupSizeAt
+    /// @return false if the size is not one of those or the kernel fails to compile, in
+    ///         which case it keeps the size it had
+    bool setGroupSize(Kernel kernel, int size);
+
+    /// @brief Start measuring the GPU time of every dispatch of a kernel until kernelTime is
+    ///        called, e.g. over a few updates. No other time elapsed query may be active
+    ///        during an update meanwhile
+    void timeKernel(Kernel kernel);
+
+    /// @brief Stop measuring and return the time of the dispatches since timeKernel; waits
+    ///        for the GPU to finish them
+    KernelTime kernelTime();
 };
\ No newline at end of file
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <misc/bounding_box.h>
+#include <misc/grid.h>
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+
+/// @brief Particle state of one frame read back from GPU. Without particle IDs the
+///        particles are mostly sorted by the cells of the grid, as they were reindexed
+///        in the last substep and only moved slightly after; with IDs they are in ID
+///        order, and IDs freed by sinks stay in the arrays as dead entries until they are
+///        reused. The arrays are only valid during the callback
+struct ParticleSnapshot
+{
+    /// @brief The frame index when the snapshot was captured
+    std::uint64_t frame;
+
+    /// @brief The number of entries; with ID order, the ID limit, which includes dead IDs
+    int numParticles;
+
+    /// @brief The boundary of the system at capture time
+    BoundingBox boundary;
+
+    /// @brief The grid used at capture time
+    Grid grid;
+
+    /// @brief Whether particles are in ID order, i.e. index i is the same particle in every snapshot
+    bool idOrdered;
+
+    /// @brief Positions of particles; w is 1 for live particles and 0 for dead IDs, which
+    ///        every consumer must skip
+    const glm::vec4* positions;
+
+    /// @brief Velocities of particles; w is unused
+    const glm::vec4* velocities;
+};
@@ -0,0 +1,206 @@
+#include "shared_memory_transport.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <thread>
+
+/// @brief Parameters of the shared memory transport
+namespace transport_params
+{
+    constexpr std::uint32_t magic{ 0x4f4c4148 }; // "HALO"
+    constexpr std::size_t alignment{ 64 }; // mailboxes of different ranks do not share cache lines
+}
+
+namespace
+{
+    /// @brief Round a size up to the alignment
+    std::size_t align(std::size_t size)
+    {
+        return (size + transport_params::alignment - 1) / transport_params::alignment * transport_params::alignment;
+    }
+
+    /// @brief Wait until a condition on shared memory holds, adding the time to a sum
+    template <typename Condition>
+    void waitUntil(Condition condition, double& waitTime)
+    {
+        if (condition())
+        {
+            return;
+        }
+        auto start{ std::chrono::steady_clock::now() };
+        // ranks usually share the GPU and the cores, so waiting gives the core away
+        while (!condition())
+        {
+            std::this_thread::yield();
+        }
+        waitTime += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+std::size_t SharedMemoryTransport::mailboxStride(int maxParticles)
+{
+    return align(sizeof(Mailbox) + 2 * sizeof(glm::vec4) * static_cast<std::size_t>(maxParticles));
+}
+
+SharedMemoryTransport::Header& SharedMemoryTransport::header() const
+{
+    return *reinterpret_cast<Header*>(m_memory.data());
+}
+
+SharedMemoryTransport::Mailbox& SharedMemoryTransport::mailbox(int rank, Direction direction) const
+{
+    std::size_t offset{ align(sizeof(Header)) + (2 * rank + direction) * mailboxStride(m_maxParticles) };
+    return *reinterpret_cast<Mailbox*>(m_memory.data() + offset);
+}
+
+glm::vec4* SharedMemoryTransport::particles(Mailbox& box) const
+{
+    return reinterpret_cast<glm::vec4*>(reinterpret_cast<std::byte*>(&box) + sizeof(Mailbox));
+}
+
+SharedMemoryTransport::SharedMemoryTransport(const std::string& name, int numRanks, int maxParticles)
+    : m_numRanks{ numRanks }
+    , m_maxParticles{ maxParticles }
+{
+    if (numRanks < 1 || numRanks > maxRanks || maxParticles < 0)
+    {
+        std::cerr << "Cannot exchange particles between " << numRanks << " ranks\n";
+        return;
+    }
+
+    m_memory = SharedMemory{ name, align(sizeof(Header)) + 2 * numRanks * mailboxStride(maxParticles) };
+    if (!m_memory.available())
+    {
+        return;
+    }
+    // the ranks are started after this, so the header is visible to them
+    Header& shared{ header() };
+    shared.magic = transport_params::magic;
+    shared.numRanks = static_cast<std::uint32_t>(numRanks);
+    shared.maxParticles = static_cast<std::uint32_t>(maxParticles);
+}
+
+SharedMemoryTransport::SharedMemoryTransport(const std::string& name, int rank)
+    : m_memory{ name }
+    , m_rank{ rank }
+{
+    if (!m_memory.available())
+    {
+        return;
+    }
+
+    Header shared{};
+    if (m_memory.size() >= sizeof(Header))
+    {
+        std::memcpy(&shared, m_memory.data(), sizeof(Header));
+    }
+    // the region may be stale or foreign, so the header is checked before its counts size anything
+    bool valid{ shared.magic == transport_params::magic && shared.numRanks <= maxRanks
+        && shared.maxParticles <= static_cast<std::uint32_t>(std::numeric_limits<int>::max())
+        && rank >= 0 && rank < static_cast<int>(shared.numRanks) };
+    if (valid)
+    {
+        std::size_t size{ align(sizeof(Header)) + 2 * shared.numRanks * mailboxStride(static_cast<int>(shared.maxParticles)) };
+        valid = m_memory.size() >= size;
+    }
+    if (!valid)
+    {
+        std::cerr << "Shared memory " << name << " does not belong to a transport with rank " << rank << '\n';
+        m_memory = SharedMemory{};
+        return;
+    }
+    m_numRanks = static_cast<int>(shared.numRanks);
+    m_maxParticles = static_cast<int>(shared.maxParticles);
+}
+
+void SharedMemoryTransport::send(Direction direction, const FluidSystem::HaloParticles& particles)
+{
+    Mailbox& box{ mailbox(m_rank, direction) };
+    std::atomic_ref<std::uint64_t> taken{ box.taken };
+    waitUntil([&]() { return taken.load(std::memory_order_acquire) == m_sent[direction]; }, m_waitTime);
+
+    std::size_t count{ std::min(particles.positions.size(), static_cast<std::size_t>(m_maxParticles)) };
+    if (count < particles.positions.size())
+    {
+        std::cerr << "Halo of rank " << m_rank << " exceeds a message; " << particles.positions.size() - count << " particles dropped\n";
+    }
+    glm::vec4* data{ this->particles(box) };
+    std::copy_n(particles.positions.begin(), count, data);
+    std::copy_n(particles.velocities.begin(), count, data + m_maxParticles);
+    box.count = static_cast<std::uint32_t>(count);
+    std::atomic_ref<std::uint64_t>{ box.sent }.store(++m_sent[direction], std::memory_order_release);
+}
+
+void SharedMemoryTransport::receive(int from, Direction direction, FluidSystem::HaloParticles& particles)
+{
+    Mailbox& box{ mailbox(from, direction) };
+    std::atomic_ref<std::uint64_t> sent{ box.sent };
+    waitUntil([&]() { return sent.load(std::memory_order_acquire) > m_received[direction]; }, m_waitTime);
+
+    // the count is written by another process, so it is not trusted to fit the mailbox
+    std::size_t count{ std::min(static_cast<std::size_t>(box.count), static_cast<std::size_t>(m_maxParticles)) };
+    const glm::vec4* data{ this->particles(box) };
+    particles.positions.assign(data, data + count);
+    particles.velocities.assign(data + m_maxParticles, data + m_maxParticles + count);
+    m_particlesReceived += count;
+    std::atomic_ref<std::uint64_t>{ box.taken }.store(++m_received[direction], std::memory_order_release);
+}
+
+void SharedMemoryTransport::send(const FluidSystem::HaloParticles& low, const FluidSystem::HaloParticles& high)
+{
+    if (m_rank > 0)
+    {
+        send(Direction::low, low);
+    }
+    if (m_rank < m_numRanks - 1)
+    {
+        send(Direction::high, high);
+    }
+}
+
+void SharedMemoryTransport::receive(FluidSystem::HaloParticles& low, FluidSystem::HaloParticles& high)
+{
+    // the rank below sends up through its high mailbox, and the rank above down through its low one
+    low = FluidSystem::HaloParticles{};
+    high = FluidSystem::HaloParticles{};
+    if (m_rank > 0)
+    {
+        receive(m_rank - 1, Direction::high, low);
+    }
+    if (m_rank < m_numRanks - 1)
+    {
+        receive(m_rank + 1, Direction::low, high);
+    }
+}
+
+float SharedMemoryTransport::allReduceMax(float value)
+{
+    // a rank in reduction n + 2 has passed reduction n + 1, which every rank entered after
+    // reading the values of reduction n, so two sets of values are enough
+    Header& shared{ header() };
+    std::uint64_t reduction{ m_reductions++ };
+    float* values{ shared.values[reduction % 2] };
+    values[m_rank] = value;
+    std::atomic_ref<std::uint64_t> arrivals{ shared.arrivals };
+    arrivals.fetch_add(1, std::memory_order_acq_rel);
+    std::uint64_t expected{ (reduction + 1) * m_numRanks };
+    waitUntil([&]() { return arrivals.load(std::memory_order_acquire) >= expected; }, m_waitTime);
+    return *std::max_element(values, values + m_numRanks);
+}
+
+void SharedMemoryTransport::barrier()
+{
+    allReduceMax(0.0f);
+}
+
+FluidSystem::HaloExchange SharedMemoryTransport::haloExchange()
+{
+    return FluidSystem::HaloExchange{
+        [this](const FluidSystem::HaloParticles& low, const FluidSystem::HaloParticles& high) { send(low, high); },
+        [this](FluidSystem::HaloParticles& low, FluidSystem::HaloParticles& high) { receive(low, high); },
+        [this](float value) { return allReduceMax(value); } };
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include "fluid_system.h"
+#include <misc/shared_memory.h>
+
+#include <glm/glm.hpp>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/// @brief Exchanges halo particles between fluid systems of one grid split into slabs, one
+///        per process on the same machine, through shared memory. Messages follow MPI's
+///        point-to-point model: every rank has a mailbox per neighbor holding one message,
+///        a send waits until the last one was taken and a receive until the next one came
+class SharedMemoryTransport
+{
+public:
+    /// @brief The most ranks there can be
+    static constexpr int maxRanks{ 64 };
+
+private:
+    /// @brief The header at the start of the shared memory
+    struct Header
+    {
+        std::uint32_t magic;
+        std::uint32_t numRanks;
+        std::uint32_t maxParticles;
+        std::uint32_t reserved;
+
+        /// @brief The number of values given to reductions by all ranks
+        std::uint64_t arrivals;
+
+        /// @brief Values of the ranks in reductions, alternating between two sets so a rank
+        ///        may start the next reduction while others still read the last one
+        float values[2][maxRanks];
+    };
+
+    /// @brief A message from one rank to a neighbor, followed by the positions and the
+    ///        velocities of up to maxParticles particles
+    struct Mailbox
+    {
+        /// @brief The number of messages sent and taken; one apart while a message waits
+        std::uint64_t sent;
+        std::uint64_t taken;
+
+        /// @brief The number of particles in the message
+        std::uint32_t count;
+        std::uint32_t reserved[3];
+    };
+    static_assert(sizeof(Mailbox) % sizeof(glm::vec4) == 0);
+
+    /// @brief Mailboxes of a rank
+    enum Direction
+    {
+        low = 0,  // to the rank below
+        high = 1, // to the rank above
+    };
+
+    /// @brief The shared memory
+    SharedMemory m_memory{};
+
+    /// @brief This rank; -1 for the process that created the memory and takes no part
+    int m_rank{ -1 };
+
+    /// @brief The number of ranks
+    int m_numRanks{};
+
+    /// @brief The most particles in one message
+    int m_maxParticles{};
+
+    /// @brief The number of messages this rank sent to and received from each side
+    std::array<std::uint64_t, 2> m_sent{};
+    std::array<std::uint64_t, 2> m_received{};
+
+    /// @brief The number of reductions this rank took part in
+    std::uint64_t m_reductions{};
+
+    /// @brief Seconds spent waiting on other ranks
+    double m_waitTime{};
+
+    /// @brief Particles received from the neighbors
+    std::uint64_t m_particlesReceived{};
+
+    /// @brief Bytes of one mailbox with its particles
+    static std::size_t mailboxStride(int maxParticles);
+
+    /// @brief Get the header
+    Header& header() const;
+
+    /// @brief Get the mailbox a rank sends to one side through
+    Mailbox& mailbox(int rank, Direction direction) const;
+
+    /// @brief Get the particles following a mailbox
+    glm::vec4* particles(Mailbox& box) const;
+
+    /// @brief Send particles through a mailbox of this rank
+    void send(Direction direction, const FluidSystem::HaloParticles& particles);
+
+    /// @brief Receive the particles a neighbor sent to this rank
+    void receive(int from, Direction direction, FluidSystem::HaloParticles& particles);
+
+public:
+    /// @brief Default constructor; not connected
+    SharedMemoryTransport() = default;
+
+    /// @brief Create the shared memory for the ranks; the creating process takes no part in
+    ///        the exchange and must keep the transport until the ranks are done
+    /// @param name the name of the shared memory
+    /// @param numRanks the number of ranks, at most maxRanks
+    /// @param maxParticles the most particles a rank sends to one neighbor in a substep
+    SharedMemoryTransport(const std::string& name, int numRanks, int maxParticles);
+
+    /// @brief Join the ranks through shared memory created by another process
+    /// @param name the name of the shared memory
+    /// @param rank this rank, from 0 to numRanks - 1
+    SharedMemoryTransport(const std::string& name, int rank);
+
+    /// @brief Whether the shared memory is mapped
+    inline bool available() const { return m_memory.available(); }
+
+    /// @brief The number of ranks
+    inline int numRanks() const { return m_numRanks; }
+
+    /// @brief Send particles to the ranks below and above
+    void send(const FluidSystem::HaloParticles& low, const FluidSystem::HaloParticles& high);
+
+    /// @brief Receive the particles the ranks below and above sent; blocks until they arrive
+    void receive(FluidSystem::HaloParticles& low, FluidSystem::HaloParticles& high);
+
+    /// @brief The largest of a value over all ranks; blocks until every rank gave its value
+    float allReduceMax(float value);
+
+    /// @brief Wait until every rank gets here
+    void barrier();
+
+    /// @brief The halo exchange of a fluid system through this transport, which must outlive it
+    FluidSystem::HaloExchange haloExchange();
+
+    /// @brief Seconds this rank spent waiting on other ranks
+    inline double waitTime() const { return m_waitTime; }
+
+    /// @brief Particles this rank received from its neighbors
+    inline std::uint64_t particlesReceived() const { return m_particlesReceived; }
+};
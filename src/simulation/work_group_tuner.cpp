@@ -0,0 +1,198 @@
+#include "work_group_tuner.h"
+
+#include <glad/glad.h>
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sstream>
+
+namespace
+{
+    /// @brief The prefix of the line starting the sizes of a device in the cache file
+    const std::string deviceTag{ "device " };
+
+    std::string glString(GLenum name)
+    {
+        const GLubyte* string{ glGetString(name) };
+        return string ? reinterpret_cast<const char*>(string) : "unknown";
+    }
+}
+
+bool WorkGroupTuner::read()
+{
+    std::ifstream file{ m_cachePath };
+    if (!file)
+    {
+        return true;
+    }
+
+    // a line naming a device is followed by lines of a kernel variant and its size
+    std::map<std::string, int>* sizes{};
+    std::string line{};
+    int number{ 0 };
+    while (std::getline(file, line))
+    {
+        ++number;
+        if (line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+        if (line.compare(0, deviceTag.size(), deviceTag) == 0)
+        {
+            sizes = &m_sizes[line.substr(deviceTag.size())];
+            continue;
+        }
+        std::istringstream entry{ line };
+        std::string variant{};
+        int size{};
+        if (!sizes || !(entry >> variant >> size))
+        {
+            std::cerr << "Work group cache " << m_cachePath << " is invalid at line " << number << "; ignoring it\n";
+            m_sizes.clear();
+            return false;
+        }
+        (*sizes)[variant] = size;
+    }
+    return true;
+}
+
+bool WorkGroupTuner::write() const
+{
+    std::ofstream file{ m_cachePath, std::ios::trunc };
+    if (!file)
+    {
+        std::cerr << "Failed to write work group cache " << m_cachePath << '\n';
+        return false;
+    }
+
+    file << "# work group sizes of compute kernels by GPU and driver; delete to tune again\n";
+    for (const auto& [device, sizes] : m_sizes)
+    {
+        file << deviceTag << device << '\n';
+        for (const auto& [variant, size] : sizes)
+        {
+            file << variant << ' ' << size << '\n';
+        }
+    }
+    return static_cast<bool>(file);
+}
+
+bool WorkGroupTuner::tune(FluidSystem& fluid, const std::vector<FluidSystem::Kernel>& kernels)
+{
+    // every size is timed from the same settled state, and the state before tuning is restored
+    std::string startPath{ m_cachePath + ".start" };
+    std::string settledPath{ m_cachePath + ".settled" };
+    if (!fluid.save(startPath))
+    {
+        return false;
+    }
+    for (int i{ 0 }; i < m_options.settleFrames; ++i)
+    {
+        fluid.update();
+    }
+    if (!fluid.save(settledPath))
+    {
+        fluid.load(startPath);
+        std::remove(startPath.c_str());
+        return false;
+    }
+
+    std::map<std::string, int>& sizes{ m_sizes[m_device] };
+    for (FluidSystem::Kernel kernel : kernels)
+    {
+        double fastest{ std::numeric_limits<double>::max() };
+        int fastestSize{ fluid.groupSize(kernel) };
+        bool runs{ false };
+        for (int i{ 0 }; i < FluidSystem::numGroupSizes; ++i)
+        {
+            int size{ FluidSystem::groupSizeAt(i) };
+            if (!fluid.setGroupSize(kernel, size) || !fluid.load(settledPath))
+            {
+                continue;
+            }
+            // the first frame may include compiling the program for the GPU
+            fluid.update();
+            fluid.timeKernel(kernel);
+            for (int frame{ 0 }; frame < m_options.timedFrames; ++frame)
+            {
+                fluid.update();
+            }
+            FluidSystem::KernelTime time{ fluid.kernelTime() };
+            if (time.dispatches == 0)
+            {
+                break;
+            }
+            runs = true;
+            if (time.seconds < fastest)
+            {
+                fastest = time.seconds;
+                fastestSize = size;
+            }
+        }
+        // a kernel that does not run keeps its size, so it is not tuned again on every run
+        fluid.setGroupSize(kernel, fastestSize);
+        sizes[fluid.kernelVariant(kernel)] = fastestSize;
+        if (runs)
+        {
+            std::cout << "  " << fluid.kernelVariant(kernel) << ": " << fastestSize << " ("
+                << 1e3 * fastest / m_options.timedFrames << " ms per frame)\n";
+        }
+    }
+
+    fluid.load(startPath);
+    std::remove(startPath.c_str());
+    std::remove(settledPath.c_str());
+    return true;
+}
+
+WorkGroupTuner::WorkGroupTuner(const std::string& cachePath)
+    : WorkGroupTuner{ cachePath, Options{} }
+{
+}
+
+WorkGroupTuner::WorkGroupTuner(const std::string& cachePath, const Options& options)
+    : m_cachePath{ cachePath }
+    , m_options{ options }
+    , m_device{ deviceName() }
+{
+    read();
+}
+
+bool WorkGroupTuner::apply(FluidSystem& fluid)
+{
+    std::map<std::string, int>& sizes{ m_sizes[m_device] };
+    std::vector<FluidSystem::Kernel> untuned{};
+    for (int i{ 0 }; i < FluidSystem::numKernels; ++i)
+    {
+        FluidSystem::Kernel kernel{ static_cast<FluidSystem::Kernel>(i) };
+        auto it{ sizes.find(fluid.kernelVariant(kernel)) };
+        if (m_options.retune || it == sizes.end() || !fluid.setGroupSize(kernel, it->second))
+        {
+            untuned.push_back(kernel);
+        }
+    }
+    int cached{ FluidSystem::numKernels - static_cast<int>(untuned.size()) };
+    if (cached > 0)
+    {
+        std::cout << "Loaded work group sizes of " << cached << " kernels for " << m_device << '\n';
+    }
+    if (untuned.empty())
+    {
+        return true;
+    }
+
+    std::cout << "Tuning work group sizes for " << m_device << '\n';
+    if (!tune(fluid, untuned))
+    {
+        return false;
+    }
+    return write();
+}
+
+std::string WorkGroupTuner::deviceName()
+{
+    // the version string includes that of the driver
+    return glString(GL_VENDOR) + " | " + glString(GL_RENDERER) + " | " + glString(GL_VERSION);
+}
\ No newline at end of file
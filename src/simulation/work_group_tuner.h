@@ -0,0 +1,74 @@
+#pragma once
+
+#include "fluid_system.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+/// @brief Finds the work group size each kernel of a fluid system runs fastest at on the
+///        GPU of the current context, and keeps the sizes in a cache file by GPU and
+///        driver. Kernels with sizes cached for the device are compiled at them right away,
+///        so only the first run on a device pays for tuning
+class WorkGroupTuner
+{
+public:
+    /// @brief Options for tuning
+    struct Options
+    {
+        /// @brief Frames simulated before timing, so the kernels are timed on moving fluid
+        ///        rather than on the initial shape
+        int settleFrames{ 60 };
+
+        /// @brief Frames timed at each size
+        int timedFrames{ 4 };
+
+        /// @brief Tune every kernel, replacing the sizes cached for the device
+        bool retune{ false };
+    };
+
+private:
+    /// @brief The path of the cache file
+    std::string m_cachePath{};
+
+    /// @brief The options
+    Options m_options{};
+
+    /// @brief The GPU and driver of the current context
+    std::string m_device{};
+
+    /// @brief The sizes of kernel variants by device, of every device in the cache
+    std::map<std::string, std::map<std::string, int>> m_sizes{};
+
+    /// @brief Read the cache file; a missing file is an empty cache
+    /// @return false if the file cannot be parsed
+    bool read();
+
+    /// @brief Write the cache file
+    /// @return false if the file cannot be written
+    bool write() const;
+
+    /// @brief Time the kernels at every size and compile them at the fastest; the state of
+    ///        the system is saved to checkpoint files next to the cache and restored after
+    /// @param kernels the kernels to tune
+    /// @return false if the state cannot be saved, which leaves the sizes as they are
+    bool tune(FluidSystem& fluid, const std::vector<FluidSystem::Kernel>& kernels);
+
+public:
+    /// @brief Create a tuner for the current context with the default options
+    /// @param cachePath the path of the cache file, created if missing
+    WorkGroupTuner(const std::string& cachePath);
+
+    /// @brief Create a tuner for the current context
+    /// @param cachePath the path of the cache file, created if missing
+    WorkGroupTuner(const std::string& cachePath, const Options& options);
+
+    /// @brief Compile the kernels of a system at the sizes cached for the device, tuning and
+    ///        caching those missing. Kernels that do not run while tuning, e.g. that of
+    ///        exporting without a snapshot consumer, are cached at the size they have
+    /// @return false if the sizes cannot be tuned or cached
+    bool apply(FluidSystem& fluid);
+
+    /// @brief Return the GPU and driver of the current context, by which sizes are cached
+    static std::string deviceName();
+};
\ No newline at end of file